@@ -0,0 +1,85 @@
+// Times allocating batches of small objects and freeing them, with malloc,
+// with the VM's pools of blocks, and with an arena freeing each batch at
+// once, as the with blocks of programs do.
+//
+// usage: bench_heap [OBJECTS] [REPEAT]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include <bullet/vm/heap.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace bt::vm;
+
+namespace {
+// the sizes of the objects of a batch, between 8 and 256 bytes.
+auto sizes(size_t n) -> vector<size_t> {
+    auto result = vector<size_t>(n);
+    for (auto k = size_t(0); k < n; k++) result[k] = 8 + (k * 2654435761u) % 249;
+    return result;
+}
+
+// the best time of a few runs, in nanoseconds per object.
+template <typename F>
+auto measure(size_t n, int repeat, F&& f) -> double {
+    auto best = numeric_limits<double>::infinity();
+    for (auto i = 0; i < repeat; i++) {
+        const auto start = chrono::steady_clock::now();
+        f();
+        const auto stop = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double>(stop - start).count());
+    }
+    return best * 1e9 / double(n);
+}
+
+auto report(string_view name, double ns, double baseline) -> void {
+    cout << left << setw(8) << name << right << fixed << setprecision(3) << setw(8) << ns
+         << " ns/object " << setprecision(2) << setw(6) << baseline / ns << "x" << endl;
+}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    const auto n = size_t(argc > 1 ? max(1, atoi(argv[1])) : 1 << 16);
+    const auto repeat = argc > 2 ? max(1, atoi(argv[2])) : 20;
+    const auto batch = sizes(n);
+    auto objects = vector<void*>(n);
+
+    cout << n << " objects of 8 to 256 bytes a batch" << endl;
+    // each object is written, so no allocator is timed handing out memory it
+    // never touches.
+    const auto malloc_ns = measure(n, repeat, [&] {
+        for (auto k = size_t(0); k < n; k++) memset(objects[k] = malloc(batch[k]), 0, 8);
+        for (auto k = size_t(0); k < n; k++) free(objects[k]);
+    });
+    report("malloc", malloc_ns, malloc_ns);
+
+    report("blocks",
+           measure(n, repeat,
+                   [&] {
+                       for (auto k = size_t(0); k < n; k++)
+                           memset(objects[k] = allocate_block(batch[k]), 0, 8);
+                       for (auto k = size_t(0); k < n; k++) free_block(objects[k], batch[k]);
+                   }),
+           malloc_ns);
+
+    auto arena = arena_t();
+    report("arena",
+           measure(n, repeat,
+                   [&] {
+                       const auto mark = arena.mark();
+                       for (auto k = size_t(0); k < n; k++)
+                           memset(objects[k] = arena.bump(batch[k]), 0, 8);
+                       arena.release(mark);
+                   }),
+           malloc_ns);
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Times the kernels the VM runs for element-wise arithmetic and reductions
+// on arrays, and on slices of every fourth element, with each instruction set
+// the processor supports, against the one word at a time version; checks they
+// all compute the same.
+//
+// usage: bench_kernels [ELEMENTS] [REPEAT]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <bullet/vm/kernels.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace bt::vm;
+
+namespace {
+struct lane_case_t {
+    string_view name;
+    lane_t lane;
+};
+
+const auto lanes = array{
+    lane_case_t{"i32", lane_t::i32},
+    lane_case_t{"i64", lane_t::i64},
+    lane_case_t{"f32", lane_t::f32},
+    lane_case_t{"f64", lane_t::f64},
+};
+
+const auto ops = array{
+    pair{string_view("add"), kernel_op_t::add},
+    pair{string_view("mul"), kernel_op_t::mul},
+    pair{string_view("lt"), kernel_op_t::lt},
+};
+
+const auto reductions = array{
+    pair{string_view("sum"), reduction_t::sum},
+    pair{string_view("max"), reduction_t::max},
+};
+
+// elements as the VM keeps values of the lane's type.
+auto elements(lane_t lane, size_t n, int seed) -> vector<value_t> {
+    auto result = vector<value_t>(n);
+    for (auto k = size_t(0); k < n; k++) {
+        const auto x = int64_t((k * 2654435761u + seed) % 1000) - 500;
+        if (lane == lane_t::f32)
+            result[k].f = double(float(x) / 8);
+        else if (lane == lane_t::f64)
+            result[k].f = double(x) / 8;
+        else
+            result[k].i = x;
+    }
+    return result;
+}
+
+// the best time of a few runs, in nanoseconds per element.
+template <typename F>
+auto measure(size_t n, int repeat, F&& f) -> double {
+    auto best = numeric_limits<double>::infinity();
+    for (auto i = 0; i < repeat; i++) {
+        const auto start = chrono::steady_clock::now();
+        f();
+        const auto stop = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double>(stop - start).count());
+    }
+    return best * 1e9 / double(n);
+}
+
+auto report(string_view lane, string_view op, isa_t isa, double ns, double scalar, bool same)
+    -> void {
+    cout << left << setw(5) << lane << setw(7) << op << setw(8) << isa_name(isa) << right
+         << fixed << setprecision(3) << setw(8) << ns << " ns/element " << setprecision(2)
+         << setw(6) << scalar / ns << "x" << (same ? "" : " (different result)") << endl;
+}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    const auto n = size_t(argc > 1 ? max(1, atoi(argv[1])) : 1 << 16);
+    const auto repeat = argc > 2 ? max(1, atoi(argv[2])) : 20;
+    const auto widest = detect_isa();
+
+    cout << "instruction set: " << isa_name(widest) << ", " << n << " elements" << endl;
+    for (const auto& [name, lane] : lanes) {
+        const auto a = elements(lane, n, 1);
+        const auto b = elements(lane, n, 7);
+        auto out = vector<value_t>(n);
+        auto expected = vector<value_t>(n);
+
+        for (const auto& [op_name, op] : ops) {
+            elementwise(op, lane, a.data(), b.data(), expected.data(), n, isa_t::scalar);
+            auto scalar = 0.0;
+            for (auto isa = isa_t::scalar; isa <= widest; isa = isa_t(int(isa) + 1)) {
+                const auto ns = measure(n, repeat, [&] {
+                    elementwise(op, lane, a.data(), b.data(), out.data(), n, isa);
+                });
+                if (isa == isa_t::scalar) scalar = ns;
+                const auto same = equal(out.begin(), out.end(), expected.begin(),
+                                        [](value_t x, value_t y) { return x.u == y.u; });
+                report(name, op_name, isa, ns, scalar, same);
+            }
+        }
+
+        for (const auto& [r_name, r] : reductions) {
+            const auto want = reduce(r, lane, a.data(), n, isa_t::scalar);
+            auto scalar = 0.0;
+            for (auto isa = isa_t::scalar; isa <= widest; isa = isa_t(int(isa) + 1)) {
+                auto got = value_t();
+                const auto ns =
+                    measure(n, repeat, [&] { got = reduce(r, lane, a.data(), n, isa); });
+                if (isa == isa_t::scalar) scalar = ns;
+                report(name, r_name, isa, ns, scalar, got.u == want.u);
+            }
+        }
+
+        // every fourth element, gathered.
+        const auto wide = elements(lane, n * 4, 3);
+        for (const auto& [r_name, r] : reductions) {
+            const auto want = reduce(r, lane, wide.data(), 4, n, isa_t::scalar);
+            auto scalar = 0.0;
+            for (auto isa = isa_t::scalar; isa <= widest; isa = isa_t(int(isa) + 1)) {
+                auto got = value_t();
+                const auto ns =
+                    measure(n, repeat, [&] { got = reduce(r, lane, wide.data(), 4, n, isa); });
+                if (isa == isa_t::scalar) scalar = ns;
+                report(name, string(r_name) + "/4", isa, ns, scalar, got.u == want.u);
+            }
+        }
+    }
+    return 0;
+}
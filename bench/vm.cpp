@@ -0,0 +1,194 @@
+// Runs a few small kernels in the VM and reports how fast it executes them:
+// as lowered, after fusing the pairs their profile shows to be hot, and
+// compiled to native code; then, when built with LLVM, how fast the code
+// LLVM generates for them at -O2 runs.
+//
+// usage: bench_vm [REPEAT]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <bullet/analysis/compilation.hpp>
+#ifdef BT_HAVE_LLVM
+#include <bullet/backend/llvm.hpp>
+#endif
+#include <bullet/jit/jit.hpp>
+#include <bullet/lexer/lexer.hpp>
+#include <bullet/parser/parser.hpp>
+#include <bullet/vm/fuse.hpp>
+#include <bullet/vm/lower.hpp>
+#include <bullet/vm/vm.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace lexer;
+using namespace parser;
+
+namespace {
+struct kernel_t {
+    string_view name;
+    string_view source;
+    string_view expected;
+};
+
+const auto kernels = array{
+    kernel_t{
+        "fib",
+        "def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + fib(n - 2)\n"
+        "fib(27)\n",
+        "196418",
+    },
+    kernel_t{
+        "loops",
+        "def loops(n: i64): i64 = do:\n"
+        "    var s: i64 = 0\n"
+        "    var i: i64 = 0\n"
+        "    while (i < n):\n"
+        "        var j: i64 = 0\n"
+        "        while (j < 100):\n"
+        "            s = s + i * j % 7\n"
+        "            j = j + 1\n"
+        "        i = i + 1\n"
+        "    return s\n"
+        "loops(20000)\n",
+        "5099745",
+    },
+    kernel_t{
+        "array sums",
+        "def sums(n: i64): i64 = do:\n"
+        "    var s: i64 = 0\n"
+        "    var k: i64 = 0\n"
+        "    while (k < n):\n"
+        "        for (x : data(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, "
+        "20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32)):\n"
+        "            s = s + x\n"
+        "        k = k + 1\n"
+        "    return s\n"
+        "sums(50000)\n",
+        "26400000",
+    },
+};
+
+// the analysis passes, which code generation consults, trace to cout.
+struct quiet_t {
+    quiet_t() { cout.setstate(ios::badbit); }
+    ~quiet_t() { cout.clear(); }
+};
+
+auto check(string_view source) -> syntax::attr_node_t<analysis::type_t> {
+    const auto quiet = quiet_t();
+
+    auto compilation = analysis::compilation_t();
+    const syntax::tree_t ast = source | tokenize | parse;
+    const auto typed_ast = compilation.check(ast);
+
+    if (!compilation.diagnostics.empty()) {
+        auto s = stringstream();
+        s << compilation.diagnostics;
+        throw vm::error(s.str());
+    }
+    return typed_ast;
+}
+
+// the best time of a few runs, in seconds, and the result printed.
+auto measure(vm::vm_t& machine, const vm::program_t& program, int repeat) -> pair<double, string> {
+    auto best = numeric_limits<double>::infinity();
+    auto result = string();
+    for (auto i = 0; i < repeat; i++) {
+        const auto start = chrono::steady_clock::now();
+        const auto value = machine.run(program);
+        const auto stop = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double>(stop - start).count());
+
+        auto s = stringstream();
+        vm::print_value(s, value, program.result_type);
+        result = s.str();
+    }
+    return {best, result};
+}
+
+#ifdef BT_HAVE_LLVM
+auto measure(backend::llvm_module_t& module, int repeat) -> pair<double, string> {
+    // compiled on the first run.
+    module.run();
+
+    auto best = numeric_limits<double>::infinity();
+    auto result = string();
+    for (auto i = 0; i < repeat; i++) {
+        const auto start = chrono::steady_clock::now();
+        const auto value = module.run();
+        const auto stop = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double>(stop - start).count());
+
+        auto s = stringstream();
+        vm::print_value(s, value, module.result_type());
+        result = s.str();
+    }
+    return {best, result};
+}
+#endif
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    const auto repeat = argc > 1 ? max(1, atoi(argv[1])) : 5;
+
+    cout << "dispatch: " << vm::vm_t::dispatch() << endl;
+    for (const auto& kernel : kernels) {
+        try {
+            const auto typed_ast = check(kernel.source);
+            auto program = [&] {
+                const auto quiet = quiet_t();
+                return vm::lower(typed_ast);
+            }();
+            auto machine = vm::vm_t();
+
+            const auto [plain, plain_result] = measure(machine, program, repeat);
+            const auto executed = machine.executed();
+
+            auto profile = vm::profile_t();
+            machine.run(program, profile);
+            const auto fused = vm::fuse(program, profile);
+            const auto [best, fused_result] = measure(machine, program, repeat);
+            const auto compiled = jit::compile(program);
+            const auto [native, native_result] = measure(machine, program, repeat);
+
+            cout << left << setw(12) << kernel.name << right << setw(12) << executed
+                 << " instructions in " << fixed << setprecision(2) << setw(8) << plain * 1e3
+                 << " ms (" << setw(7) << executed / plain / 1e6 << " M/s), " << setw(8)
+                 << best * 1e3 << " ms with " << fused << " superinstructions (" << setw(7)
+                 << executed / best / 1e6 << " M/s), " << setw(8) << native * 1e3 << " ms with "
+                 << compiled << " native functions";
+            auto results = vector{plain_result, fused_result, native_result};
+#ifdef BT_HAVE_LLVM
+            auto module = [&] {
+                const auto quiet = quiet_t();
+                return backend::llvm_module_t(typed_ast);
+            }();
+            module.optimize(2);
+            const auto [llvm, llvm_result] = measure(module, repeat);
+            cout << ", " << setw(8) << llvm * 1e3 << " ms with LLVM -O2";
+            results.push_back(llvm_result);
+#endif
+            cout << defaultfloat;
+            for (const auto& result : results)
+                if (result != kernel.expected)
+                    cout << " (wrong result " << result << ", expected " << kernel.expected
+                         << ")";
+            cout << endl;
+        } catch (const exception& e) {
+            cout << kernel.name << ": " << e.what() << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
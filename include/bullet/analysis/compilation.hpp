@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <bullet/analysis/constant.hpp>
+#include <bullet/analysis/diagnostics.hpp>
+#include <bullet/analysis/environment.hpp>
+#include <bullet/analysis/layout.hpp>
+#include <bullet/analysis/type.hpp>
+#include <bullet/parser/ast.hpp>
+
+namespace bt { namespace analysis {
+    // Interns identifier text. Interned views stay valid for the lifetime of the
+    // interner, so they can be compared and hashed by address.
+    class interner_t {
+        mutable std::mutex mutex_;
+        std::unordered_set<std::string> strings_;
+
+    public:
+        auto intern(std::string_view s) -> std::string_view;
+        auto size() const -> std::size_t;
+    };
+
+    // The nominal types declared by one compilation. Ids are only unique within
+    // the table which handed them out.
+    class type_table_t {
+        interner_t& interner_;
+        mutable std::mutex mutex_;
+        std::vector<type_t> nominals_;
+        std::unordered_map<std::string_view, std::size_t> by_name_;
+        std::unordered_set<type_t, type_hash_t> interned_;
+
+    public:
+        explicit type_table_t(interner_t& interner) : interner_(interner) {}
+
+        auto make_nominal(std::string name, type_t type) -> type_t;
+        // The most recently declared nominal type of the given name, if any.
+        auto lookup_nominal(std::string_view name) const -> std::optional<type_t>;
+        auto size() const -> std::size_t;
+
+        // The one type interned of those structurally equal to the given one,
+        // so interned types compare and hash by address.
+        auto intern(const type_t& type) -> type_t;
+    };
+
+    // The templates of one compilation and their instances. An instance is made,
+    // and checked, the first time a template is used with its arguments; every
+    // later use with arguments of the same (interned) types and values shares
+    // it, however many uses there are.
+    class template_table_t {
+    public:
+        // A template as defined, and the scope its instances are checked in.
+        struct definition_t {
+            lexer::with_loc<lexer::identifier_t> name;
+            parser::syntax::template_t<type_t> ast;
+            environment_t scope;
+        };
+
+        // The type of an argument, or of the value of a constant argument.
+        struct argument_t {
+            type_t type;
+            std::optional<decltype(constant_t::value)> value;
+        };
+
+        struct instance_t {
+            std::string name;
+            type_t type;
+            // for functions, the definition of the instance, which goes next
+            // to that of its template.
+            parser::syntax::attr_node_t<type_t> definition;
+        };
+
+    private:
+        struct key_t {
+            int id;
+            std::vector<argument_t> arguments;
+        };
+
+        struct key_hash_t {
+            auto operator()(const key_t& key) const -> std::size_t;
+        };
+
+        struct key_equal_t {
+            auto operator()(const key_t& lhs, const key_t& rhs) const -> bool;
+        };
+
+        interner_t& interner_;
+        mutable std::mutex mutex_;
+        std::deque<definition_t> definitions_;
+        std::deque<std::vector<const instance_t*>> made_;
+        std::unordered_map<key_t, instance_t, key_hash_t, key_equal_t> instances_;
+        std::unordered_set<std::string_view> names_;
+
+    public:
+        explicit template_table_t(interner_t& interner) : interner_(interner) {}
+
+        auto define(definition_t definition) -> int;
+        // Definitions stay where they are as more are added.
+        auto definition(int id) -> definition_t&;
+        auto find(int id, const std::vector<argument_t>& arguments) const -> const instance_t*;
+        // Adds the instance of a template for arguments it has none for yet,
+        // renaming it if another instance took its name.
+        auto add(int id, std::vector<argument_t> arguments, instance_t instance) -> instance_t&;
+        // The instances of a template, in the order they were made.
+        auto instances(int id) const -> std::vector<const instance_t*>;
+        auto size() const -> std::size_t;
+    };
+
+    // Everything a single compilation owns: interned names, declared types,
+    // templates and their instances, the layouts of types, diagnostics and the
+    // prelude it checks against. Compilations share no mutable state, so any
+    // number of them may run concurrently, one per thread.
+    class compilation_t {
+    public:
+        std::string name;
+        interner_t interner;
+        type_table_t types;
+        template_table_t templates;
+        layout_table_t layouts;
+        diagnostics_t diagnostics;
+        const environment_t& prelude;
+
+        explicit compilation_t(std::string name = "<input>",
+                               std::size_t max_errors = diagnostics_t::default_max_errors);
+        compilation_t(const compilation_t&) = delete;
+        compilation_t& operator=(const compilation_t&) = delete;
+
+        // Attributes the AST with types and type checks it against the prelude,
+        // with this compilation installed as the current one.
+        auto check(const parser::syntax::tree_t& ast) -> parser::syntax::attr_node_t<type_t>;
+
+        // The compilation the analysis passes on the calling thread work for.
+        static auto current() -> compilation_t&;
+
+        // Installs a compilation (and its diagnostics) as the current one for the
+        // lifetime of the scope.
+        class scope_t {
+            compilation_t* previous_;
+            diagnostics_t::scope_t diagnostics_scope_;
+
+        public:
+            explicit scope_t(compilation_t& c);
+            ~scope_t();
+            scope_t(const scope_t&) = delete;
+            scope_t& operator=(const scope_t&) = delete;
+        };
+    };
+}}  // namespace bt::analysis
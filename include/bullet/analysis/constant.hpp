@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <variant>
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/parser/ast.hpp>
+
+namespace bt { namespace analysis {
+    // A value computed at compile time. Integers are held as the bits of their
+    // 64-bit representation, as the VM holds them: sign-extended if their type
+    // is signed, and integer literals nothing gave a type to as i64.
+    struct constant_t {
+        type_t type;
+        std::variant<bool, std::uint64_t, double> value;
+    };
+
+    // The value of a type checked constant expression: a literal, or operators
+    // applied to constant expressions, computed as the VM would compute them.
+    // Nothing for anything else, and for operations which fault or don't yield
+    // a finite number.
+    auto evaluate(const parser::syntax::attr_node_t<type_t>& node) -> std::optional<constant_t>;
+
+    // Replaces constant expressions in a type checked program, and uses of let
+    // variables with constant initializers, with the literals of their values,
+    // typed as the expressions were. Integer constants which don't fit the
+    // type they are computed in or converted to are reported as
+    // constant_overflow.
+    auto fold_constants(parser::syntax::attr_node_t<type_t>& ast) -> void;
+
+    // A constant converted to type t as the VM converts values. Integer literals
+    // which don't fit t are reported as constant_overflow at the node.
+    auto convert(const parser::syntax::attr_node_t<type_t>& at,
+                 const constant_t& c,
+                 const type_t& t) -> std::optional<constant_t>;
+
+    // The literal of a constant, typed as it and located as the tree is:
+    // negative numbers are the negation of their magnitude.
+    auto literal_of(const parser::syntax::attr_tree_t<type_t>& at, const constant_t& c)
+        -> parser::syntax::attr_node_t<type_t>;
+}}  // namespace bt::analysis
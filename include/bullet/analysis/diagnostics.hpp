@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include <boost/container/small_vector.hpp>
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/parser/location.hpp>
+
+namespace bt { namespace analysis {
+    enum class diag_code_t {
+        generic,
+        duplicate_function,
+        duplicate_parameter,
+        duplicate_type,
+        duplicate_variable,
+        illegal_literal_width,
+        illegal_literal_signedness,
+        undefined_identifier,
+        invalid_unary_operand,
+        invalid_binary_operands,
+        not_a_function,
+        argument_mismatch,
+        not_a_generic_type,
+        generic_arity,
+        condition_not_bool,
+        not_assignable,
+        return_type_mismatch,
+        let_not_immutable,
+        assign_type_mismatch,
+        indirection_mismatch,
+        invalid_iteration_target,
+        invalid_yield,
+        constant_overflow,
+        not_a_constant,
+        not_a_template,
+        template_deduction,
+        template_recursion,
+        undefined_field,
+        invalid_slice,
+        invalid_interpolation,
+        invalid_region,
+    };
+
+    auto diag_code_name(diag_code_t code) -> std::string_view;
+    auto operator<<(std::ostream& os, diag_code_t code) -> std::ostream&;
+
+    // A single argument of a diagnostic message. Values which are cheap to keep
+    // around (text known to outlive the diagnostic, numbers, types, locations)
+    // are stored as-is and only turned into text when the diagnostic is printed;
+    // anything else is formatted eagerly into a string.
+    using diag_arg_t = std::variant<std::string_view,
+                                    std::string,
+                                    long long,
+                                    unsigned long long,
+                                    char,
+                                    double,
+                                    type_t,
+                                    parser::location_t>;
+
+    auto operator<<(std::ostream& os, const diag_arg_t& arg) -> std::ostream&;
+
+    template <typename V>
+    auto make_diag_arg(const V& v) -> diag_arg_t {
+        using U = std::remove_cv_t<std::remove_reference_t<V>>;
+
+        // character arrays are string literals at every call site, so the text
+        // is assumed to have static storage duration.
+        if constexpr (std::is_array_v<U>)
+            return std::string_view(v);
+        else if constexpr (std::is_same_v<U, std::string_view> || std::is_same_v<U, std::string>)
+            return std::string(v);
+        else if constexpr (std::is_same_v<U, char>)
+            return v;
+        else if constexpr (std::is_same_v<U, bool>)
+            return std::string_view(v ? "true" : "false");
+        else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+            return static_cast<long long>(v);
+        else if constexpr (std::is_integral_v<U>)
+            return static_cast<unsigned long long>(v);
+        else if constexpr (std::is_floating_point_v<U>)
+            return static_cast<double>(v);
+        else if constexpr (std::is_same_v<U, type_t>)
+            return v;
+        else if constexpr (std::is_same_v<U, type_value>)
+            return type_t(v);
+        else if constexpr (std::is_same_v<U, parser::location_t>)
+            return v;
+        else {
+            auto s = std::stringstream();
+            s << v;
+            return s.str();
+        }
+    }
+
+    struct diagnostic_t {
+        using args_t = boost::container::small_vector<diag_arg_t, 8>;
+
+        diag_code_t code = diag_code_t::generic;
+        parser::location_t location;
+        args_t args;
+
+        auto message() const -> std::string;
+    };
+
+    auto operator<<(std::ostream& os, const diagnostic_t& d) -> std::ostream&;
+
+    // Collects the diagnostics of one compilation. Diagnostics are recorded in
+    // structured form and formatted only when printed. An engine is used by a
+    // single thread; parallel passes fork() an engine per worker and merge() the
+    // results afterwards. Forked engines share the error budget through an atomic
+    // counter, so the cap holds across workers without any locking.
+    class diagnostics_t {
+        struct budget_t {
+            std::atomic<std::size_t> admitted{0};
+            std::atomic<std::size_t> dropped{0};
+            std::size_t max_errors;
+        };
+
+        std::vector<diagnostic_t> diagnostics_;
+        std::shared_ptr<budget_t> budget_;
+
+    public:
+        static constexpr std::size_t default_max_errors = 100;
+
+        explicit diagnostics_t(std::size_t max_errors = default_max_errors);
+        diagnostics_t(diagnostics_t&&) noexcept = default;
+        diagnostics_t& operator=(diagnostics_t&&) noexcept = default;
+
+        // Reserve a slot for one more error; false once the cap has been reached.
+        auto admit() -> bool;
+        auto record(diagnostic_t&& d) -> void;
+
+        auto fork() const -> diagnostics_t;
+        auto merge(diagnostics_t&& child) -> void;
+
+        auto empty() const -> bool { return diagnostics_.empty(); }
+        auto size() const -> std::size_t { return diagnostics_.size(); }
+        auto dropped() const -> std::size_t { return budget_->dropped.load(); }
+        auto max_errors() const -> std::size_t { return budget_->max_errors; }
+        auto clear() -> void;
+
+        auto begin() const { return diagnostics_.begin(); }
+        auto end() const { return diagnostics_.end(); }
+
+        auto print(std::ostream& os) const -> void;
+
+        // The engine which raise<> reports into on the calling thread.
+        static auto current() -> diagnostics_t&;
+
+        // Installs an engine as the current one for the lifetime of the scope.
+        class scope_t {
+            diagnostics_t* previous_;
+
+        public:
+            explicit scope_t(diagnostics_t& d);
+            ~scope_t();
+            scope_t(const scope_t&) = delete;
+            scope_t& operator=(const scope_t&) = delete;
+        };
+    };
+
+    auto operator<<(std::ostream& os, const diagnostics_t& d) -> std::ostream&;
+}}  // namespace bt::analysis
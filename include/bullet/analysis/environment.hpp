@@ -0,0 +1,36 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include <bullet/analysis/symtab.hpp>
+#include <bullet/analysis/type.hpp>
+
+namespace bt { namespace analysis {
+    using st_type_t = symtab<type_t>;
+
+    enum class context_t { var, fn, type };
+
+    inline auto operator<<(std::ostream& os, context_t ctx) -> std::ostream& {
+        if (ctx == context_t::var)
+            os << "<VAR>";
+        else if (ctx == context_t::fn)
+            os << "<FN>";
+        else if (ctx == context_t::type)
+            os << "<TYPE>";
+        return os;
+    }
+
+    struct environment_t {
+        std::string name;
+        context_t context;
+        int next_type_id = 0;
+        st_type_t vars{}, fns{}, types{};
+        // the ids of templates in the template table of the compilation.
+        symtab<int> templates{};
+        // how many regions, with blocks, enclose the code being checked in
+        // its function, and the regions the variables are declared in.
+        int regions = 0;
+        symtab<int> var_regions{};
+    };
+}}  // namespace bt::analysis
@@ -1,13 +1,12 @@
 #pragma once
 
-#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string_view>
-#include <vector>
 
 #include <boost/exception/all.hpp>
 //#include <boost/stacktrace.hpp>
+#include <bullet/analysis/diagnostics.hpp>
 #include <bullet/parser/location.hpp>
 
 // typedef boost::error_info<struct tag_stacktrace, boost::stacktrace::stacktrace> traced;
@@ -16,27 +15,30 @@ namespace bt { namespace analysis {
     struct error : std::runtime_error {
         error(const std::string& s, const parser::location_t& l);
         error(std::stringstream& msg, const parser::location_t& l);
-
-        static std::vector<std::unique_ptr<std::runtime_error>> errors;
     };
 
+    // Reports a diagnostic into the current thread's diagnostics engine once the
+    // raise goes out of scope. The streamed values are kept as typed arguments
+    // and formatted only when the diagnostic is printed; once the engine's error
+    // cap has been reached, streaming into a raise is a no-op.
     template <typename T>
     struct raise {
-        std::stringstream msg;
-        parser::location_t loc;
+        diagnostic_t diag;
+        bool admitted;
 
         template <typename Node>
-        raise(const Node& node) : loc(node.get().location) {}
+        raise(const Node& node, diag_code_t code = diag_code_t::generic)
+            : diag{code, node.get().location, {}}, admitted(diagnostics_t::current().admit()) {}
+        raise(const raise&) = delete;
+        raise& operator=(const raise&) = delete;
         ~raise() {
-            // msg << "\n\n" << boost::stacktrace::stacktrace() << std::endl << std::endl;
-
-            error::errors.emplace_back(std::unique_ptr<std::runtime_error>(new T(msg, loc)));
+            if (admitted) diagnostics_t::current().record(std::move(diag));
         }
     };
 
     template <typename T, typename V>
     auto operator<<(raise<T>& r, const V& v) -> raise<T>& {
-        r.msg << v;
+        if (r.admitted) r.diag.args.push_back(make_diag_arg(v));
         return r;
     }
 
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/parser/ast.hpp>
+
+namespace bt { namespace analysis {
+    class type_table_t;
+
+    // How fields of structs and tuples are placed: in the order they are
+    // declared, as C places them, or by decreasing alignment, which leaves the
+    // least padding between them.
+    enum class field_order_t { declared, packed };
+
+    // How arrays of structs are stored: one struct after another, or split
+    // into one array for each field, so that loops using only some fields
+    // only load those.
+    enum class records_t { interleaved, split };
+
+    // Values a scalar at some offset in a value never takes: count of them,
+    // from start. Variants store their tag there rather than next to the value.
+    struct niche_t {
+        std::size_t offset;
+        std::size_t size;
+        std::uint64_t start;
+        std::uint64_t count;
+    };
+
+    // Where the tag of a variant is, and the value tagging its first
+    // alternative. A tag in the niche of the alternative it calls untagged
+    // tags the others with start, start + 1, ... in order, skipping it.
+    struct tag_t {
+        std::size_t offset;
+        std::size_t size;
+        std::uint64_t start;
+        std::optional<std::size_t> untagged;
+    };
+
+    // The size and alignment of values of a type, as the ABI of the target
+    // has them, and where their parts are: the offsets of the fields of
+    // structs and tuples, or of the alternatives of variants, in the order
+    // they are declared whatever order they are placed in; and the bytes
+    // between consecutive indices of each dimension of arrays, which are laid
+    // out contiguously, row-major.
+    //
+    // Split arrays of structs have the offsets of the array of each field
+    // instead, the size of each field (widths), and strides in elements: field
+    // f of the element at (i, j) is at offsets[f] + (i * strides[0] + j *
+    // strides[1]) * widths[f].
+    struct layout_t {
+        std::size_t size = 0;
+        std::size_t align = 1;
+        std::vector<std::size_t> offsets;
+        std::vector<std::size_t> strides;
+        std::vector<std::size_t> widths;
+        std::optional<tag_t> tag;
+        std::optional<niche_t> niche;
+    };
+
+    auto layout(const type_t& t,
+                field_order_t order = field_order_t::declared,
+                records_t records = records_t::interleaved) -> layout_t;
+
+    // The number of elements of an array, all dimensions together.
+    auto length(const types::array_t& a) -> std::uint64_t;
+
+    // A loop over an array of structs: the fields of its elements it uses,
+    // and how many elements it visits.
+    struct field_use_t {
+        std::vector<std::size_t> fields;
+        std::uint64_t elements;
+    };
+
+    // How to store an array of structs given the loops over it: split when
+    // they would load at most half the bytes they load from one interleaved.
+    auto preferred_records(const types::array_t& a, const std::vector<field_use_t>& uses)
+        -> records_t;
+
+    // The loops of a program over arrays of structs, by the name of the
+    // array. Loops using an element other than through its fields use all of
+    // them.
+    auto field_uses(const parser::syntax::attr_node_t<type_t>& ast)
+        -> std::unordered_map<std::string, std::vector<field_use_t>>;
+
+    // The layouts of the types of one compilation, computed once for each
+    // (interned) type, along with those of the types it is made of.
+    class layout_table_t {
+        using key_t = std::tuple<const type_value*, field_order_t, records_t>;
+
+        struct key_hash_t {
+            auto operator()(const key_t& key) const -> std::size_t;
+        };
+
+        type_table_t& types_;
+        mutable std::mutex mutex_;
+        std::unordered_map<key_t, layout_t, key_hash_t> layouts_;
+
+    public:
+        explicit layout_table_t(type_table_t& types) : types_(types) {}
+
+        // Layouts stay where they are as more are computed.
+        auto of(const type_t& t,
+                field_order_t order = field_order_t::declared,
+                records_t records = records_t::interleaved) -> const layout_t&;
+        auto size() const -> std::size_t;
+    };
+}}  // namespace bt::analysis
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace bt { namespace analysis {
+    // A fork-join pool with one task deque per worker. Workers run their own
+    // tasks newest first and, when they run dry, steal the oldest ones of
+    // their peers, so large subproblems migrate to idle threads while small
+    // ones stay where their data is warm.
+    class scheduler_t {
+    public:
+        // Tasks must not throw; report failures through the state they share
+        // with whoever waits for them.
+        using task_t = std::function<void()>;
+
+        explicit scheduler_t(std::size_t workers);
+        ~scheduler_t();
+        scheduler_t(const scheduler_t&) = delete;
+        scheduler_t& operator=(const scheduler_t&) = delete;
+
+        // Queues a task: on the worker's own deque when called from one of the
+        // workers, on a shared injection queue otherwise.
+        auto spawn(task_t task) -> void;
+
+        // Runs queued tasks on the calling thread until done is set by
+        // signal(). Once it is, the waiter may return at any moment, so
+        // signalling has to be the last thing a task does with the waiter's
+        // state.
+        auto run_until(const std::atomic<bool>& done) -> void;
+        auto signal(std::atomic<bool>& done) -> void;
+
+        auto workers() const -> std::size_t { return threads_.size(); }
+
+        // Shared by all compilations; one worker per hardware thread besides
+        // the caller, which always helps while it waits.
+        static auto shared() -> scheduler_t&;
+
+    private:
+        struct queue_t {
+            std::mutex mutex;
+            std::deque<task_t> tasks;
+        };
+
+        // queues_[i] belongs to worker i; the last one is the injection queue.
+        std::vector<std::unique_ptr<queue_t>> queues_;
+        std::vector<std::thread> threads_;
+
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+        std::atomic<std::size_t> queued_ = 0;
+        bool stopping_ = false;
+
+        auto take(std::size_t self) -> std::optional<task_t>;
+        auto work(std::size_t self) -> void;
+    };
+}}  // namespace bt::analysis
@@ -1,10 +1,10 @@
 #pragma once
 
-#include <atomic>
 #include <compare>
 #include <iostream>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <variant>
 #include <vector>
@@ -75,6 +75,12 @@ namespace bt { namespace analysis {
             name_and_type_vector_t formal_parameters;
         };
 
+        // What calling a function which yields gives: the values it yields,
+        // one at a time, to the loop iterating over it.
+        struct generator_t {
+            type_t value_type;
+        };
+
         struct struct_t : name_and_type_vector_t {
             using base_t = name_and_type_vector_t;
             using base_t::base_t;
@@ -123,11 +129,10 @@ namespace bt { namespace analysis {
             std::string fqn;
             type_t type;
 
-            explicit nominal_type_t(std::string name, type_t type);
+            // ids are handed out by the type table of the owning compilation.
+            nominal_type_t(int id, std::string name, type_t type);
             nominal_type_t(const nominal_type_t&) = default;
             nominal_type_t& operator=(const nominal_type_t&) = default;
-
-            static std::atomic<int> next_id;
         };
 
         struct placeholder_t {};
@@ -192,6 +197,7 @@ namespace bt { namespace analysis {
         auto operator<<(std::ostream& os, const name_and_type_t&) -> std::ostream&;
         auto operator<<(std::ostream& os, const struct_t&) -> std::ostream&;
         auto operator<<(std::ostream& os, const function_t&) -> std::ostream&;
+        auto operator<<(std::ostream& os, const generator_t&) -> std::ostream&;
         auto operator<<(std::ostream& os, const name_and_type_vector_t&) -> std::ostream&;
         auto operator<<(std::ostream& os, const tuple_t&) -> std::ostream&;
         auto operator<<(std::ostream& os, const ptr_t&) -> std::ostream&;
@@ -210,6 +216,7 @@ namespace bt { namespace analysis {
         auto operator==(const name_and_type_vector_t& lhs, const name_and_type_vector_t& rhs)
             -> bool;
         auto operator==(const function_t&, const function_t&) -> bool;
+        auto operator==(const generator_t&, const generator_t&) -> bool;
         auto operator==(const struct_t&, const struct_t&) -> bool;
         auto operator==(const tuple_t&, const tuple_t&) -> bool;
         auto operator==(const ptr_t&, const ptr_t&) -> bool;
@@ -228,6 +235,7 @@ namespace bt { namespace analysis {
         auto operator!=(const name_and_type_vector_t& lhs, const name_and_type_vector_t& rhs)
             -> bool;
         auto operator!=(const function_t&, const function_t&) -> bool;
+        auto operator!=(const generator_t&, const generator_t&) -> bool;
         auto operator!=(const struct_t&, const struct_t&) -> bool;
         auto operator!=(const tuple_t&, const tuple_t&) -> bool;
         auto operator!=(const ptr_t&, const ptr_t&) -> bool;
@@ -260,6 +268,7 @@ namespace bt { namespace analysis {
                                      types::bool_t,
                                      types::char_t,
                                      types::function_t,
+                                     types::generator_t,
                                      types::struct_t,
                                      types::tuple_t,
                                      types::ptr_t,
@@ -318,32 +327,32 @@ namespace bt { namespace analysis {
     auto operator<<(std::ostream& os, const type_value&) -> std::ostream&;
     auto operator<<(std::ostream& os, const type_t&) -> std::ostream&;
 
-    const type_t VOID = type_value(types::void_t{});
-    const type_t I8 = type_value(types::i8_t{});
-    const type_t I16 = type_value(types::i16_t{});
-    const type_t I32 = type_value(types::i32_t{});
-    const type_t I64 = type_value(types::i64_t{});
-    const type_t U8 = type_value(types::u8_t{});
-    const type_t U16 = type_value(types::u16_t{});
-    const type_t U32 = type_value(types::u32_t{});
-    const type_t U64 = type_value(types::u64_t{});
-    const type_t F32 = type_value(types::f32_t{});
-    const type_t F64 = type_value(types::f64_t{});
-    const type_t INTLIT = type_value(types::intlit_t{});
-    const type_t FLOATLIT = type_value(types::floatlit_t{});
-    const type_t BOOL = type_value(types::bool_t{});
-    const type_t CHAR = type_value(types::char_t{});
-    const type_t PTR = type_value(types::ptr_t{});
-    const type_t SLICE = type_value(types::slice_t{});
-    const type_t STRUCT = type_value(types::struct_t{});
-    const type_t ARRAY = type_value(types::array_t{});
-    const type_t DYNARR = type_value(types::dynarr_t{});
-    const type_t VARIANT = type_value(types::variant_t{});
-    const type_t FUNCTION = type_value(types::function_t{});
-    const type_t TUPLE = type_value(types::tuple_t{});
-    const type_t UNKOWN = type_value(std::monostate{});
-    const type_t STRLIT = type_value(types::strlit_t{});
-    const type_t STRING = type_value(types::string_t{});
+    inline const type_t VOID = type_value(types::void_t{});
+    inline const type_t I8 = type_value(types::i8_t{});
+    inline const type_t I16 = type_value(types::i16_t{});
+    inline const type_t I32 = type_value(types::i32_t{});
+    inline const type_t I64 = type_value(types::i64_t{});
+    inline const type_t U8 = type_value(types::u8_t{});
+    inline const type_t U16 = type_value(types::u16_t{});
+    inline const type_t U32 = type_value(types::u32_t{});
+    inline const type_t U64 = type_value(types::u64_t{});
+    inline const type_t F32 = type_value(types::f32_t{});
+    inline const type_t F64 = type_value(types::f64_t{});
+    inline const type_t INTLIT = type_value(types::intlit_t{});
+    inline const type_t FLOATLIT = type_value(types::floatlit_t{});
+    inline const type_t BOOL = type_value(types::bool_t{});
+    inline const type_t CHAR = type_value(types::char_t{});
+    inline const type_t PTR = type_value(types::ptr_t{});
+    inline const type_t SLICE = type_value(types::slice_t{});
+    inline const type_t STRUCT = type_value(types::struct_t{});
+    inline const type_t ARRAY = type_value(types::array_t{});
+    inline const type_t DYNARR = type_value(types::dynarr_t{});
+    inline const type_t VARIANT = type_value(types::variant_t{});
+    inline const type_t FUNCTION = type_value(types::function_t{});
+    inline const type_t TUPLE = type_value(types::tuple_t{});
+    inline const type_t UNKOWN = type_value(std::monostate{});
+    inline const type_t STRLIT = type_value(types::strlit_t{});
+    inline const type_t STRING = type_value(types::string_t{});
 
     auto is_integral(const type_t& t) -> bool;
     auto is_floating_point(const type_t& t) -> bool;
@@ -359,4 +368,40 @@ namespace bt { namespace analysis {
     auto decay_ptr(type_t p, int n_levels) -> type_t;
     auto is_immutable(const type_t& t) -> bool;
     auto regularized_type(const type_t& t) -> type_t;
+
+    // The type of the elements of arrays, slices and dynamic arrays of
+    // integers or floats; nothing for other types.
+    auto numeric_elements(const type_t& t) -> std::optional<type_t>;
+    // What operating on two sequences of numbers of the same type element by
+    // element yields, with results of type element: an array of the same
+    // shape for arrays of one shape, an array for arrays and slices of as
+    // many elements, a dynamic array for any other sequences; nothing if they
+    // can't be operated on together.
+    auto elementwise_type(const type_t& t, const type_t& u, const type_t& element)
+        -> std::optional<type_t>;
+
+    // The number of elements of arrays, all dimensions together, and of
+    // slices; nothing for sequences whose length isn't known until they run.
+    auto element_count(const type_t& t) -> std::optional<std::uint64_t>;
+    // The slice of the elements begin, begin + stride, ... before end of a
+    // sequence, in which they must fit; nothing if they don't, or for what
+    // isn't a sequence. Slices of slices view what those view: their bounds
+    // count elements of the storage underneath, and end just after the last
+    // element they view.
+    auto slice_type(const type_t& t, std::int64_t begin, std::int64_t end, std::int64_t stride)
+        -> std::optional<type_t>;
+    auto slice_count(const types::slice_t& s) -> std::uint64_t;
+
+    // The reductions of sequences of numbers programs may call without
+    // defining them, by their name.
+    enum class reduction_t { sum, min, max };
+    auto reduction(std::string_view name) -> std::optional<reduction_t>;
+
+    // A hash of the structure of a type, consistent with ==: nominal types hash
+    // by their id.
+    auto hash_value(const type_t& t) -> std::size_t;
+
+    struct type_hash_t {
+        auto operator()(const type_t& t) const -> std::size_t { return hash_value(t); }
+    };
 }}  // namespace bt::analysis
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <optional>
+#include <sstream>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
@@ -13,11 +15,16 @@
 #include <range/v3/core.hpp>
 #include <range/v3/view/zip.hpp>
 
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/analysis/constant.hpp>
+#include <bullet/analysis/environment.hpp>
 #include <bullet/analysis/error.hpp>
 #include <bullet/analysis/symtab.hpp>
 #include <bullet/analysis/type.hpp>
+#include <bullet/analysis/walk.hpp>
 #include <bullet/lexer/location.hpp>
 #include <bullet/parser/ast.hpp>
+#include <bullet/parser/traversal.hpp>
 
 namespace bt { namespace analysis {
     using namespace std;
@@ -27,31 +34,458 @@ namespace bt { namespace analysis {
     namespace rng = ranges;
     namespace views = rng::views;
 
-    using st_type_t = symtab<type_t>;
+    auto type_check(parser::syntax::attr_node_t<type_t>& ast, const environment_t& parent_scope)
+        -> void;
 
-    enum class context_t { var, fn, type };
+    // The yields in the body of a function, outside of the functions it
+    // defines: a function with any is a generator of the type it declares.
+    inline auto yields_of(const attr_node_t<type_t>& body)
+        -> vector<const attr_node_t<type_t>*> {
+        auto result = vector<const attr_node_t<type_t>*>();
+        parser::traverse_pre_order(body, [&](const attr_node_t<type_t>& n) {
+            if (n.get().is<fn_expr_t<type_t>>()) return parser::traverse_action_t::skip;
+            if (n.get().is<yield_t<type_t>>()) result.push_back(&n);
+            return parser::traverse_action_t::descend;
+        });
+        return result;
+    }
 
-    inline auto operator<<(ostream& os, context_t ctx) -> ostream& {
-        if (ctx == context_t::var)
-            os << "<VAR>";
-        else if (ctx == context_t::fn)
-            os << "<FN>";
-        else if (ctx == context_t::type)
-            os << "<TYPE>";
-        return os;
+    // Whether values of a type hold memory allocated as the program runs,
+    // which the with block it is allocated in frees when it ends: arrays,
+    // slices and strings, and aggregates of them.
+    inline auto allocated(const type_t& t) -> bool {
+        const auto u = decay_ptr(t);
+        const auto& v = u.get();
+        if (v.is<types::array_t>() || v.is<types::dynarr_t>() || v.is<types::slice_t>() ||
+            v.is<types::string_t>())
+            return true;
+        if (const auto s = v.get_if<types::struct_t>())
+            return rng::any_of(*s, [](const auto& field) { return allocated(field.type); });
+        if (const auto t = v.get_if<types::tuple_t>()) return rng::any_of(*t, allocated);
+        if (const auto n = v.get_if<types::nominal_type_t>()) return allocated(n->type);
+        return false;
     }
 
-    struct environment_t {
-        std::string name;
-        context_t context;
-        int next_type_id = 0;
-        st_type_t vars{}, fns{}, types{};
-    };
+    // The variable an assignment stores into, or into an element or field
+    // of.
+    inline auto root_variable(const attr_node_t<type_t>& target) -> const lexer::identifier_t* {
+        auto result = static_cast<const lexer::identifier_t*>(nullptr);
+        parser::traverse_pre_order(target, [&](const attr_node_t<type_t>& n) {
+            result = n.get().get_if<lexer::identifier_t>();
+            return result ? parser::traverse_action_t::stop : parser::traverse_action_t::descend;
+        });
+        return result;
+    }
 
-    auto type_check(parser::syntax::attr_node_t<type_t>& ast, const environment_t& parent_scope)
-        -> void;
+    // The type a function is declared with, before its body is checked: that
+    // of its parameters and of the result it declares, generated if it
+    // yields.
+    inline auto declared_type(const attr_node_t<type_t>& at,
+                              fn_expr_t<type_t>& fn_ast,
+                              environment_t& scope) -> type_t {
+        type_t fn_type = type_value(types::function_t{});
+        auto& o = fn_type.get().get<types::function_t>();
+
+        scope.context = context_t::type;
+        type_check(fn_ast.result_type, scope);
+        o.result_type = fn_ast.result_type.get().attribute;
+        if (!yields_of(fn_ast.body).empty())
+            o.result_type = type_value(types::generator_t{o.result_type});
+
+        auto names = unordered_map<string, int>();
+        for (auto&& arg_id : fn_ast.arg_names) names[arg_id.name]++;
+
+        for (auto&& [name, count] : names) {
+            if (count > 1) {
+                auto err = raise<analysis::error>(at, diag_code_t::duplicate_parameter);
+                err << "Formal parameter \"" << name << "\" is duplicated (occurring " << count
+                    << " times) in function expression.";
+            }
+        }
+
+        for (auto j = 0; j < fn_ast.arg_names.size(); j++) {
+            auto& arg_nm = fn_ast.arg_names[j].name;
+            auto& arg_ty = fn_ast.arg_types[j];
+            type_check(arg_ty, scope);
+            o.formal_parameters.push_back(types::name_and_type_t{arg_nm, arg_ty.get().attribute});
+        }
+
+        return fn_type;
+    }
+
+    using template_argument_t = template_table_t::argument_t;
+    using template_instance_t = template_table_t::instance_t;
+
+    // Instances of instances of templates, nested more deeply than this, are
+    // taken to never end.
+    inline constexpr auto max_template_depth = 64;
+
+    // Whether a template node defines a template rather than instantiating one:
+    // the arguments of definitions name their parameters.
+    inline auto defines_template(const template_t<type_t>& t) -> bool {
+        return !t.arguments.empty() && !t.arguments.front().first.name.empty();
+    }
+
+    // The template a statement defines, if any: "def f[T](...)" or
+    // "type t[T](...)".
+    inline auto defined_template(attr_node_t<type_t>& stmt)
+        -> pair<const lexer::with_loc<lexer::identifier_t>*, template_t<type_t>*> {
+        auto& tree = stmt.get();
+        auto name = (const lexer::with_loc<lexer::identifier_t>*)(nullptr);
+        auto node = (attr_node_t<type_t>*)(nullptr);
+        if (const auto pe = tree.get_if<var_def_t<type_t>>()) {
+            name = &pe->name;
+            node = &pe->rhs;
+        } else if (const auto pe = tree.get_if<def_type_t<type_t>>()) {
+            name = &pe->name;
+            node = &pe->type;
+        }
+        const auto pt = node ? node->get().get_if<template_t<type_t>>() : nullptr;
+        if (!pt || !defines_template(*pt)) return {nullptr, nullptr};
+        return {name, pt};
+    }
+
+    // The name of an instance: that of its template, followed by its
+    // arguments.
+    inline auto instance_name(const string& name, const vector<template_argument_t>& arguments)
+        -> string {
+        auto os = stringstream();
+        os << name << '[';
+        for (auto j = 0u; j < arguments.size(); j++) {
+            const auto& a = arguments[j];
+            if (j) os << ", ";
+            if (!a.value) {
+                os << a.type;
+                continue;
+            }
+            visit(hana::overload([&](bool b) { os << (b ? "true" : "false"); },
+                                 [&](uint64_t u) {
+                                     if (is_signed(a.type))
+                                         os << int64_t(u);
+                                     else
+                                         os << u;
+                                 },
+                                 [&](double d) { os << d; }),
+                  *a.value);
+        }
+        os << ']';
+        return os.str();
+    }
+
+    // The instance of a template for the given arguments. The first time it is
+    // asked for, a copy of the body of the template is checked in the scope
+    // the template is defined in, with the type parameters naming the types
+    // given for them and constant parameters replaced with their values;
+    // every later time, that instance is looked up. Nothing if the instance
+    // can't be made.
+    inline auto instantiate(const attr_node_t<type_t>& at,
+                            int id,
+                            vector<template_argument_t> arguments)
+        -> const template_instance_t* {
+        auto& compilation = compilation_t::current();
+        auto& templates = compilation.templates;
+        if (const auto p = templates.find(id, arguments)) return p;
+
+        static thread_local auto depth = 0;
+        if (depth >= max_template_depth) {
+            auto err = raise<error>(at, diag_code_t::template_recursion);
+            err << "Instances of \"" << templates.definition(id).name.name
+                << "\" need instances of themselves without end";
+            return nullptr;
+        }
+        const struct nested_t {
+            nested_t() { depth++; }
+            ~nested_t() { depth--; }
+        } nested;
+
+        const auto& definition = templates.definition(id);
+        const auto& parameters = definition.ast.arguments;
+        const auto name = instance_name(definition.name.name, arguments);
+        auto scope = definition.scope;
+
+        auto body = attr_node_t<type_t>(walk_post_order<type_t>(
+            definition.ast.body.get(), [](const auto&, const auto&) { return type_t(); }));
+        for (auto j = 0u; j < parameters.size(); j++) {
+            const auto& parameter = parameters[j].first.name;
+            const auto& a = arguments[j];
+            if (!a.value) {
+                scope.types.insert(parameter, a.type);
+                continue;
+            }
+            const auto c = constant_t{a.type, *a.value};
+            parser::traverse_pre_order(body, [&](const attr_node_t<type_t>& n) {
+                const auto p = n.get().get_if<lexer::identifier_t>();
+                if (!p || p->name != parameter) return;
+                auto substituted = n;
+                substituted.get() = literal_of(n.get(), c).get();
+            });
+        }
+
+        // functions are declared before their bodies are checked, so those may
+        // use the instance they belong to.
+        if (auto fn = body.get().get_if<fn_expr_t<type_t>>()) {
+            const auto type = declared_type(at, *fn, scope);
+            body.get().attribute = type;
+
+            auto& instance = templates.add(id, move(arguments), {name, type, {}});
+            auto def = attr_tree_t<type_t>(var_def_t<type_t>{
+                lexer::with_loc<lexer::identifier_t>(lexer::identifier_t(instance.name),
+                                                     definition.name.location),
+                0, attr_node_t<type_t>(), body});
+            def.location = body.get().location;
+            def.get<var_def_t<type_t>>().type.get().attribute = type;
+            instance.definition = attr_node_t<type_t>(move(def));
+
+            scope.context = context_t::var;
+            type_check(instance.definition, scope);
+            return &instance;
+        }
+
+        scope.context = context_t::type;
+        type_check(body, scope);
+        auto& instance = templates.add(id, move(arguments), {name, UNKOWN, {}});
+        instance.type = compilation.types.make_nominal(instance.name, body.get().attribute);
+        return &instance;
+    }
+
+    // The arguments a template is instantiated with, checked against its
+    // parameters: types, and constants of the types of the constant ones.
+    // Nothing if any is wrong.
+    inline auto template_arguments(const attr_node_t<type_t>& at,
+                                   const template_table_t::definition_t& definition,
+                                   named_group_t<type_t>& arguments,
+                                   const environment_t& scope)
+        -> optional<vector<template_argument_t>> {
+        const auto& parameters = definition.ast.arguments;
+        if (arguments.size() != parameters.size()) {
+            auto err = raise<error>(at, diag_code_t::generic_arity);
+            err << "Template \"" << definition.name.name << "\" takes " << parameters.size()
+                << " arguments, but got " << arguments.size();
+            return nullopt;
+        }
+
+        auto& types = compilation_t::current().types;
+        auto result = vector<template_argument_t>();
+        for (auto j = 0u; j < arguments.size(); j++) {
+            auto& argument = arguments[j].second;
+            const auto& parameter = parameters[j].second;
+            auto s = scope;
+            if (!parameter.get()) {
+                s.context = context_t::type;
+                type_check(argument, s);
+                if (argument.get().attribute.get().empty()) return nullopt;
+                result.push_back({types.intern(argument.get().attribute), nullopt});
+                continue;
+            }
+
+            s.context = context_t::var;
+            type_check(argument, s);
+            const auto& t = parameter.get().attribute;
+            const auto c = evaluate(argument);
+            const auto v = c && implicit_conversion_distance(c->type, t) >= 0
+                               ? convert(argument, *c, t)
+                               : nullopt;
+            if (!v) {
+                auto err = raise<error>(argument, diag_code_t::not_a_constant);
+                err << "Template parameter \"" << parameters[j].first.name
+                    << "\" takes a constant of type \"" << t << "\", but got: \"" << argument
+                    << "\"";
+                return nullopt;
+            }
+            result.push_back({types.intern(t), v->value});
+        }
+        return result;
+    }
+
+    // Whether a type node is the name of a type parameter.
+    inline auto names_parameter(const attr_node_t<type_t>& type, const string& parameter) -> bool {
+        const auto e = type.get().get_if<type_expr_t<type_t>>();
+        const auto id = e ? e->type.get().get_if<lexer::identifier_t>() : nullptr;
+        return id && id->name == parameter;
+    }
+
+    // The arguments of a function template called with values of the given
+    // types, deduced from the parameters of the function whose types are type
+    // parameters: the types of the values passed, as variables would be
+    // declared with them. Nothing if any can't be deduced.
+    inline auto deduced_arguments(const attr_node_t<type_t>& at,
+                                  const template_table_t::definition_t& definition,
+                                  const vector<type_t>& actual)
+        -> optional<vector<template_argument_t>> {
+        const auto fn = definition.ast.body.get().get_if<fn_expr_t<type_t>>();
+        auto& types = compilation_t::current().types;
+        auto result = vector<template_argument_t>();
+        for (const auto& [parameter, type] : definition.ast.arguments) {
+            auto deduced = UNKOWN;
+            for (auto k = 0u; fn && !type.get() && k < fn->arg_types.size(); k++) {
+                if (k >= actual.size() || !names_parameter(fn->arg_types[k], parameter.name))
+                    continue;
+                const auto t = decay_ptr(actual[k]);
+                // literals take the type of other values passed for the
+                // parameter, if any.
+                if (deduced.get().empty() || deduced == INTLIT || deduced == FLOATLIT)
+                    deduced = t;
+            }
+            if (deduced == INTLIT)
+                deduced = I32;
+            else if (deduced == FLOATLIT)
+                deduced = F64;
+
+            if (deduced.get().empty()) {
+                auto err = raise<error>(at, diag_code_t::template_deduction);
+                err << "Can't deduce the template parameter \"" << parameter.name << "\" of \""
+                    << definition.name.name << "\" from the arguments of the call";
+                return nullopt;
+            }
+            result.push_back({types.intern(deduced), nullopt});
+        }
+        return result;
+    }
+
+    // String literals naming variables between braces are strings, their
+    // text with the values of the variables in place of the names; other
+    // literals are strlits of their length.
+    inline auto string_literal_type(const attr_node_t<type_t>& at,
+                                    const string_literal_t& s,
+                                    const environment_t& scope) -> type_t {
+        if (!lexer::interpolates(s))
+            return type_t(types::strlit_t{static_cast<int>(s.value.length())});
+
+        for (const auto& p : lexer::pieces(s)) {
+            if (!p.interpolated) continue;
+            const auto v = scope.vars.lookup(p.text);
+            if (!v) {
+                auto err = raise<error>(at, diag_code_t::undefined_identifier);
+                err << "\"" << p.text << "\" isn't a variable, but the string interpolates it";
+                continue;
+            }
+            const auto t = deref(*v);
+            if (!is_integral(t) && !is_floating_point(t) && !t->is<types::bool_t>() &&
+                !t->is<types::strlit_t>() && !t->is<types::string_t>()) {
+                auto err = raise<error>(at, diag_code_t::invalid_interpolation);
+                err << "Strings interpolate numbers, bools and strings, but \"" << p.text
+                    << "\" is a " << t;
+            }
+        }
+        return STRING;
+    }
+
+    // Calls of sum, min and max, unless the program defines them, reduce a
+    // sequence of numbers to the sum of its elements, or the smallest or
+    // largest one. The type of the call, if it is one.
+    inline auto reduction_call(const attr_node_t<type_t>& at,
+                               invoc_t<type_t>& i,
+                               environment_t scope) -> optional<type_t> {
+        const auto id = i.target.get().get_if<lexer::identifier_t>();
+        if (!id || !reduction(id->name) || scope.fns.lookup(id->name) ||
+            scope.vars.lookup(id->name) || scope.templates.lookup(id->name))
+            return nullopt;
+
+        scope.context = context_t::var;
+        for (auto& argument : i.arguments) type_check(argument, scope);
+        const auto element = i.arguments.size() == 1
+                                 ? numeric_elements(i.arguments.front().get().attribute)
+                                 : nullopt;
+        if (!element) {
+            auto err = raise<error>(at, diag_code_t::argument_mismatch);
+            err << "\"" << id->name
+                << "\" takes an array, slice or dynamic array of numbers, but got: \""
+                << i.arguments << "\"";
+            return UNKOWN;
+        }
+
+        i.target.get().attribute = type_value(types::function_t{
+            *element, {{"xs", i.arguments.front().get().attribute}}});
+        return *element;
+    }
+
+    // The begin, end and stride of a slice, given from arguments[first] on as
+    // integer constants, the stride defaulting to 1.
+    inline auto slice_bounds(data_t<type_t>& arguments, size_t first, environment_t scope)
+        -> optional<array<int64_t, 3>> {
+        auto bounds = array<int64_t, 3>{0, 0, 1};
+        scope.context = context_t::var;
+        for (auto k = first; k < arguments.size(); k++) {
+            auto& argument = arguments[k];
+            type_check(argument, scope);
+            const auto c = evaluate(argument);
+            const auto v = c ? get_if<uint64_t>(&c->value) : nullptr;
+            if (!v) {
+                auto err = raise<error>(argument, diag_code_t::not_a_constant);
+                err << "Slice bounds must be integer constants, but got: \"" << argument << "\"";
+                return nullopt;
+            }
+            bounds[k - first] = int64_t(*v);
+        }
+        return bounds;
+    }
+
+    // slice(xs, begin, end) and slice(xs, begin, end, stride), called where
+    // a value is expected rather than a type, view the elements begin, begin +
+    // stride, ... before end of xs without copying them.
+    inline auto slice_call(const attr_node_t<type_t>& at,
+                           invoc_t<type_t>& i,
+                           environment_t scope) -> optional<type_t> {
+        const auto keyword = i.target.get().get_if<primitive_type_t>();
+        if (!keyword || !holds_alternative<lexer::token::slice_t>(*keyword)) return nullopt;
+
+        if (i.arguments.size() != 3 && i.arguments.size() != 4) {
+            auto err = raise<error>(at, diag_code_t::argument_mismatch);
+            err << "\"slice\" takes a sequence, where it begins and ends, and a stride, but got: \""
+                << i.arguments << "\"";
+            return UNKOWN;
+        }
+        scope.context = context_t::var;
+        auto& sequence = i.arguments.front();
+        type_check(sequence, scope);
+        const auto bounds = slice_bounds(i.arguments, 1, scope);
+        if (!bounds) return UNKOWN;
+
+        const auto& [begin, end, stride] = *bounds;
+        const auto t = slice_type(sequence.get().attribute, begin, end, stride);
+        if (!t) {
+            auto err = raise<error>(at, diag_code_t::invalid_slice);
+            err << "Can't slice \"" << deref(sequence.get().attribute) << "\" from " << begin
+                << " to " << end << " by " << stride;
+            return UNKOWN;
+        }
+        i.target.get().attribute =
+            type_value(types::function_t{*t, {{"xs", sequence.get().attribute}}});
+        return *t;
+    }
+
+    // Calls of function templates, rather than of their instances, call the
+    // instance for the arguments deduced from those of the call. Whether the
+    // call is of a template.
+    inline auto instantiate_call(invoc_t<type_t>& i, environment_t scope) -> bool {
+        const auto id = i.target.get().get_if<lexer::identifier_t>();
+        if (!id || scope.fns.lookup(id->name) || scope.vars.lookup(id->name)) return false;
+        const auto pid = scope.templates.lookup(id->name);
+        if (!pid) return false;
+
+        const auto& definition = compilation_t::current().templates.definition(*pid);
+        auto actual = vector<type_t>();
+        scope.context = context_t::var;
+        for (auto& argument : i.arguments) {
+            type_check(argument, scope);
+            actual.push_back(argument.get().attribute);
+        }
+
+        const auto arguments = deduced_arguments(i.target, definition, actual);
+        const auto instance = arguments ? instantiate(i.target, *pid, *arguments) : nullptr;
+        if (!instance) {
+            i.target.get().attribute = UNKOWN;
+            return true;
+        }
 
-    auto type_check_block(block_t<type_t>& block, environment_t& scope) -> type_t {
+        auto target = attr_tree_t<type_t>(lexer::identifier_t(instance->name));
+        target.location = i.target.get().location;
+        target.attribute = instance->type;
+        i.target = attr_node_t<type_t>(move(target));
+        return true;
+    }
+
+    inline auto type_check_block(block_t<type_t>& block, environment_t& scope) -> type_t {
         auto scope_locs = symtab<lexer::location_t>();
 
         type_t last_type = UNKOWN;
@@ -66,38 +500,12 @@ namespace bt { namespace analysis {
                     const auto s = "F:"s + name;
 
                     if (auto ploc = scope_locs.lookup(s)) {
-                        auto err = raise<error>(stmt);
+                        auto err = raise<error>(stmt, diag_code_t::duplicate_function);
                         err << "Duplicate function \"" << name << "\" (with duplicate at " << *ploc
                             << ")";
                     }
 
-                    auto& fn_ast = *pfn_ast;
-
-                    type_t fn_type = type_value(types::function_t{});
-                    auto& o = fn_type.get().get<types::function_t>();
-
-                    scope.context = context_t::type;
-                    type_check(fn_ast.result_type, scope);
-                    o.result_type = fn_ast.result_type.get().attribute;
-
-                    auto names = unordered_map<string, int>();
-                    for (auto&& arg_id : fn_ast.arg_names) names[arg_id.name]++;
-
-                    for (auto&& [name, count] : names) {
-                        if (count > 1) {
-                            auto err = raise<analysis::error>(stmt);
-                            err << "Formal parameter \"" << name << "\" is duplicated (occurring "
-                                << count << " times) in function expression.";
-                        }
-                    }
-
-                    for (auto j = 0; j < fn_ast.arg_names.size(); j++) {
-                        auto& arg_nm = fn_ast.arg_names[j].name;
-                        auto& arg_ty = fn_ast.arg_types[j];
-                        type_check(arg_ty, scope);
-                        o.formal_parameters.push_back(
-                            types::name_and_type_t{arg_nm, arg_ty.get().attribute});
-                    }
+                    const auto fn_type = declared_type(stmt, *pfn_ast, scope);
 
                     if (pe->type.get().attribute.get().empty()) pe->type.get().attribute = fn_type;
 
@@ -112,7 +520,42 @@ namespace bt { namespace analysis {
             }
         }
 
-        for (auto& stmt : block) {
+        // templates are visible throughout their block too, and their instances
+        // are checked in its scope.
+        auto& templates = compilation_t::current().templates;
+        auto defined = vector<pair<size_t, int>>();
+        for (auto k = size_t(0); k < block.size(); k++) {
+            const auto [name, pt] = defined_template(block[k]);
+            if (!pt) continue;
+
+            const auto s = (pt->body.get().is<fn_expr_t<type_t>>() ? "F:"s : "T:"s) + name->name;
+            if (auto ploc = scope_locs.lookup(s)) {
+                auto err = raise<error>(block[k], diag_code_t::duplicate_function);
+                err << "Duplicate template \"" << name->name << "\" (with duplicate at " << *ploc
+                    << ")";
+            }
+
+            scope.context = context_t::type;
+            for (auto& [parameter, type] : pt->arguments)
+                if (type.get()) type_check(type, scope);
+            scope.context = context_t::var;
+
+            const auto id = templates.define({*name, *pt, scope});
+            scope.templates.insert(name->name, id);
+            scope_locs.insert(s, name->location);
+            defined.emplace_back(k, id);
+        }
+        for (const auto& [k, id] : defined) templates.definition(id).scope = scope;
+
+        for (auto k = size_t(0); k < block.size(); k++) {
+            auto& stmt = block[k];
+            if (defined_template(stmt).second) {
+                // with what the block declared up to their definition.
+                for (const auto& [j, id] : defined)
+                    if (j == k) templates.definition(id).scope = scope;
+                continue;
+            }
+
             if (auto pe = stmt.get().get_if<let_type_t<type_t>>()) {
                 scope.context = context_t::type;
                 const auto& name = pe->name.name;
@@ -120,7 +563,7 @@ namespace bt { namespace analysis {
                 const auto s = "T:"s + name;
 
                 if (auto ploc = scope_locs.lookup(s)) {
-                    auto err = raise<error>(stmt);
+                    auto err = raise<error>(stmt, diag_code_t::duplicate_type);
                     err << "Duplicate type name \"" << name << "\" (with duplicate at " << *ploc
                         << ") in type alias";
                 }
@@ -139,7 +582,7 @@ namespace bt { namespace analysis {
                 const auto s = "T:"s + name;
 
                 if (auto ploc = scope_locs.lookup(s)) {
-                    auto err = raise<error>(stmt);
+                    auto err = raise<error>(stmt, diag_code_t::duplicate_type);
                     err << "Duplicate type name \"" << name << "\" (with duplicate at " << *ploc
                         << ") in type definition";
                 }
@@ -147,7 +590,7 @@ namespace bt { namespace analysis {
                 type_check(pe->type, scope);
 
                 auto td_ty = pe->type.get().attribute;
-                td_ty = type_t(type_value(types::nominal_type_t(name, td_ty)));
+                td_ty = compilation_t::current().types.make_nominal(name, td_ty);
 
                 stmt.get().attribute = td_ty;
 
@@ -163,12 +606,13 @@ namespace bt { namespace analysis {
                     const auto s = "V:"s + name;
 
                     if (auto ploc = scope_locs.lookup(s)) {
-                        auto err = raise<error>(stmt);
+                        auto err = raise<error>(stmt, diag_code_t::duplicate_variable);
                         err << "Duplicate (let) variable declaration of \"" << name
                             << "\", with duplicate at " << *ploc;
                     }
 
                     scope.vars.insert(name, stmt.get().attribute);
+                    scope.var_regions.insert(name, scope.regions);
                     scope_locs.insert(s, pe->name.location);
                 } else {
                     auto& fn_ty = pe->rhs.get().attribute;
@@ -186,12 +630,13 @@ namespace bt { namespace analysis {
                     const auto s = "V:"s + name;
 
                     if (auto ploc = scope_locs.lookup(s)) {
-                        auto err = raise<error>(stmt);
+                        auto err = raise<error>(stmt, diag_code_t::duplicate_variable);
                         err << "Duplicate variable declaration of \"" << name
                             << "\", with duplicate at " << *ploc;
                     }
 
                     scope.vars.insert(name, stmt.get().attribute);
+                    scope.var_regions.insert(name, scope.regions);
                     scope_locs.insert(s, pe->name.location);
                 } else {
                     auto& fn_ty = pe->rhs.get().attribute;
@@ -203,11 +648,21 @@ namespace bt { namespace analysis {
             if (stmt.get().attribute.get()) last_type = stmt.get().attribute;
         }
 
+        // instances of function templates are defined next to their template.
+        for (auto d = defined.rbegin(); d != defined.rend(); d++) {
+            auto definitions = vector<attr_node_t<type_t>>();
+            for (const auto instance : templates.instances(d->second))
+                if (instance->definition.get()) definitions.push_back(instance->definition);
+            block.insert(block.begin() + d->first + 1, definitions.begin(), definitions.end());
+        }
+
         return last_type;
     }
 
-    auto type_check(parser::syntax::attr_node_t<type_t>& ast, const environment_t& parent_scope)
-        -> void {
+    inline auto type_check(parser::syntax::attr_node_t<type_t>& ast,
+                           const environment_t& parent_scope) -> void {
+        // the instance of a function template the node names, if any.
+        auto instantiated = optional<string>();
         try {
             ast.get().attribute = visit(
                 hana::overload(
@@ -262,7 +717,8 @@ namespace bt { namespace analysis {
                                         case 32: type = type_value(types::i32_t()); break;
                                         case 64: type = type_value(types::i64_t()); break;
                                         default: {
-                                            auto err = raise<error>(ast);
+                                            auto err = raise<error>(
+                                                ast, diag_code_t::illegal_literal_width);
                                             err << "Illegal integer literal width " << e.width
                                                 << ", should be 8, 16, 32, or 64 (or unspecified)";
                                         }
@@ -274,7 +730,8 @@ namespace bt { namespace analysis {
                                         case 32: type = type_value(types::u32_t()); break;
                                         case 64: type = type_value(types::u64_t()); break;
                                         default: {
-                                            auto err = raise<analysis::error>(ast);
+                                            auto err = raise<analysis::error>(
+                                                ast, diag_code_t::illegal_literal_width);
                                             err << "Illegal integer literal width " << e.width
                                                 << ", should be 8, 16, 32, or 64 (or unspecified)";
                                         }
@@ -282,16 +739,16 @@ namespace bt { namespace analysis {
                                     } else if (e.type == '?') {
                                         type = type_value(types::intlit_t());
                                     } else {
-                                        auto err = raise<analysis::error>(ast);
+                                        auto err = raise<analysis::error>(
+                                            ast, diag_code_t::illegal_literal_signedness);
                                         err << "Integer literals should be either signed (i) or "
                                                "unsigned "
                                                "(u)";
                                     }
                                     return type;
                                 },
-                                [](string_literal_t& s) -> type_t {
-                                    return analysis::type_t(
-                                        types::strlit_t{static_cast<int>(s.value.length())});
+                                [&](string_literal_t& s) -> type_t {
+                                    return string_literal_type(ast, s, parent_scope);
                                 },
                                 [&](floating_point_literal_t& e) -> type_t {
                                     type_value type;
@@ -300,7 +757,8 @@ namespace bt { namespace analysis {
                                     case 32: type = type_value(types::f32_t()); break;
                                     case 64: type = type_value(types::f64_t()); break;
                                     default: {
-                                        auto err = raise<analysis::error>(ast);
+                                        auto err = raise<analysis::error>(
+                                            ast, diag_code_t::illegal_literal_width);
                                         err << "Illegal floating point literal width " << e.width
                                             << ", should be 32 or 64 (or unspecified)";
                                     }
@@ -323,6 +781,11 @@ namespace bt { namespace analysis {
                         switch (int(parent_scope.context)) {
                         case int(context_t::fn): {
                             if (auto pt = parent_scope.fns.lookup(id.name)) return *pt;
+                            // variables holding functions, like parameters
+                            // of function type, are called as well.
+                            if (auto pt = parent_scope.vars.lookup(id.name);
+                                pt && decay_ptr(*pt)->is<types::function_t>())
+                                return decay_ptr(*pt);
                             break;
                         }
                         case int(context_t::type): {
@@ -335,13 +798,16 @@ namespace bt { namespace analysis {
                                 cout << "found: " << *pt << endl;
                                 return *pt;
                             }
+                            // functions are values, passed to those taking
+                            // functions.
+                            if (auto pt = parent_scope.fns.lookup(id.name)) return *pt;
                             break;
                         }
                         }
 
                         cout << "not found." << endl;
 
-                        auto err = raise<analysis::error>(ast);
+                        auto err = raise<analysis::error>(ast, diag_code_t::undefined_identifier);
                         err << "Internal error. No type information in inherited scope for \""
                             << id.name << "\" in context " << parent_scope.context;
 
@@ -379,13 +845,19 @@ namespace bt { namespace analysis {
                         const auto& t = op.operand->attribute;
 
                         const auto error = [&](auto&& op_type) {
-                            auto err = raise<analysis::error>(ast);
+                            auto err = raise<analysis::error>(
+                                ast, diag_code_t::invalid_unary_operand);
                             err << "Invalid operand to unary operator \"" << opstr << "\": \"" << t
                                 << "\"";
                         };
 
                         using namespace lexer;
 
+                        // arithmetic on literals yields a literal, typed by its use.
+                        const auto literal = t->is<types::intlit_t>() ||
+                                             (opt != TILDE && t->is<types::floatlit_t>());
+                        if (literal && opt != NOT) return t;
+
                         if (opt == TILDE) {
                             if (is_convertible_to(t, U8)) return U8;
                             if (is_convertible_to(t, U16)) return U16;
@@ -421,6 +893,30 @@ namespace bt { namespace analysis {
                         const auto opstr = lexer::token_symbol(opt);
 
                         type_check(op.lhs, parent_scope);
+
+                        // the fields of structs, which are variables when the
+                        // struct is one.
+                        if (opt == lexer::DOT) {
+                            const auto& lhs_a = op.lhs.get().attribute;
+                            auto record = decay_ptr(lhs_a);
+                            if (const auto n = record.get().get_if<types::nominal_type_t>())
+                                record = n->type;
+
+                            const auto s = record.get().get_if<types::struct_t>();
+                            const auto id = op.rhs.get().get_if<lexer::identifier_t>();
+                            for (const auto& field : s && id ? *s : types::struct_t()) {
+                                if (field.name != id->name) continue;
+                                op.rhs.get().attribute = field.type;
+                                if (!ptr_depth(lhs_a)) return field.type;
+                                return type_value(types::ptr_t{field.type});
+                            }
+
+                            auto err = raise<analysis::error>(ast, diag_code_t::undefined_field);
+                            err << "No field \"" << (id ? id->name : "?"s)
+                                << "\" in values of type \"" << lhs_a << "\"";
+                            return UNKOWN;
+                        }
+
                         type_check(op.rhs, parent_scope);
 
                         auto& lhs_a = op.lhs.get().attribute;
@@ -431,7 +927,8 @@ namespace bt { namespace analysis {
                         auto pt = promoted_type(lhs_a, rhs_a);
 
                         const auto error = [&](auto&& op_type) {
-                            auto err = raise<analysis::error>(ast);
+                            auto err = raise<analysis::error>(
+                                ast, diag_code_t::invalid_binary_operands);
                             err << "Invalid arguments to " << op_type << "operator \"" << opstr
                                 << "\": left-hand side has type \"" << lhs_a
                                 << "\", right-hand side has type \"" << rhs_a << "\"";
@@ -439,6 +936,23 @@ namespace bt { namespace analysis {
 
                         using namespace lexer;
 
+                        // sequences of numbers are operated on element by
+                        // element, comparisons yielding sequences of bools.
+                        const auto comparison = opt == EQUAL || opt == NOT_EQUAL || opt == LT ||
+                                                opt == GT || opt == GEQ || opt == LEQ;
+                        const auto arithmetic =
+                            opt == PLUS || opt == MINUS || opt == STAR || opt == SLASH;
+                        if ((comparison || arithmetic) &&
+                            (numeric_elements(lhs_a) || numeric_elements(rhs_a))) {
+                            const auto element = numeric_elements(lhs_a);
+                            const auto t = element ? elementwise_type(lhs_a, rhs_a,
+                                                                      comparison ? BOOL : *element)
+                                                   : nullopt;
+                            if (t) return *t;
+                            error(comparison ? "comparison " : "arithmetic ");
+                            return VOID;
+                        }
+
                         if (opt == EQUAL || opt == NOT_EQUAL || opt == LT || opt == GT ||
                             opt == GEQ || opt == LEQ || opt == IS || opt == IN) {
                             if (!pt) {
@@ -469,6 +983,8 @@ namespace bt { namespace analysis {
                             cout << "Bin op type checking: promoted type in bin op " << opstr
                                  << " is " << *pt << endl;
 
+                            if (t->is<types::intlit_t>()) return t;
+
                             if (is_convertible_to(t, U8)) return U8;
                             if (is_convertible_to(t, U16)) return U16;
                             if (is_convertible_to(t, U32)) return U32;
@@ -492,6 +1008,8 @@ namespace bt { namespace analysis {
 
                             const auto& t = *pt;
 
+                            if (t->is<types::intlit_t>() || t->is<types::floatlit_t>()) return t;
+
                             if (is_convertible_to(t, U8)) return U8;
                             if (is_convertible_to(t, U16)) return U16;
                             if (is_convertible_to(t, U32)) return U32;
@@ -521,10 +1039,20 @@ namespace bt { namespace analysis {
                             cout << "function call: " << i.target << " (" << i.target->attribute
                                  << ")" << endl;
                             scope.context = context_t::fn;
-                            type_check(i.target, scope);
+                            if (const auto t = reduction_call(ast, i, scope)) return *t;
+                            if (const auto t = slice_call(ast, i, scope)) return *t;
+                            if (instantiate_call(i, scope)) {
+                                if (i.target.get().attribute.get().empty()) return UNKOWN;
+                            } else {
+                                type_check(i.target, scope);
+                                // templates which couldn't be instantiated are reported.
+                                if (i.target.get().is<template_t<type_t>>() &&
+                                    i.target.get().attribute.get().empty())
+                                    return UNKOWN;
+                            }
 
                             if (!i.target.get().attribute.is<types::function_t>()) {
-                                auto err = raise<error>(ast);
+                                auto err = raise<error>(ast, diag_code_t::not_a_function);
                                 auto& tgt_ty = i.target.get().attribute.get();
                                 err << "Expected function type, got " << tgt_ty;
                             }
@@ -541,18 +1069,19 @@ namespace bt { namespace analysis {
 
                             if (not(act_params.is<types::tuple_t>() or
                                     act_params.is<types::array_t>())) {
-                                auto err = raise<analysis::error>(ast);
+                                auto err = raise<analysis::error>(
+                                    ast, diag_code_t::argument_mismatch);
                                 err << "Expected actual argument pack (data), got: " << act_params;
                                 act_params = TUPLE;
                             }
 
                             if (auto pap = act_params.get_if<types::tuple_t>()) {
                                 cout << "ARGUMENT TUPLE" << endl;
-                                auto problem = pap->size() != i.arguments.size();
+                                auto problem = pap->size() != form_params.size();
 
                                 if (!problem) {
                                     for (auto j = 0; j < form_params.size(); j++) {
-                                        if (is_convertible_to((*pap)[j], form_params[j].type)) {
+                                        if (!is_convertible_to((*pap)[j], form_params[j].type)) {
                                             problem = true;
                                             break;
                                         }
@@ -560,22 +1089,23 @@ namespace bt { namespace analysis {
                                 }
 
                                 if (problem) {
-                                    auto err = raise<analysis::error>(ast);
+                                    auto err = raise<analysis::error>(
+                                        ast, diag_code_t::argument_mismatch);
                                     err << "Mismatch between actual and formal parameters. "
                                         << "\nFormal parameters: " << form_params
                                         << "\nActual parameters: " << act_params;
                                 }
                             } else if (auto p = act_params.get_if<types::array_t>()) {
                                 cout << "ARGUMENT ARRAY" << endl;
-                                if (i.arguments.size() != 1) {
-                                    auto err = raise<analysis::error>(ast);
-                                    err << "Mismatch between actual and formal parameters. "
-                                        << "\nFormal parameters: " << form_params
-                                        << "\nActual parameters: " << act_params;
-                                }
+                                // arguments which all have the same type make an array.
+                                auto problem = i.arguments.size() != form_params.size();
+                                for (auto j = 0; !problem && j < form_params.size(); j++)
+                                    problem = !is_convertible_to(p->value_type,
+                                                                 form_params[j].type);
 
-                                if (!is_convertible_to(p->value_type, form_params.front().type)) {
-                                    auto err = raise<analysis::error>(ast);
+                                if (problem) {
+                                    auto err = raise<analysis::error>(
+                                        ast, diag_code_t::argument_mismatch);
                                     err << "Mismatch between actual and formal parameters. "
                                         << "\nFormal parameters: " << form_params
                                         << "\nActual parameters: " << act_params;
@@ -591,6 +1121,11 @@ namespace bt { namespace analysis {
                             auto& tgt_ty = i.target->attribute;
                             auto result_ty = UNKOWN;
 
+                            // the target usually is a generic shared through the prelude (PTR,
+                            // ARRAY, ...): instantiate a private copy rather than filling in the
+                            // shared one, which other compilations may be reading concurrently.
+                            tgt_ty = tgt_ty.get();
+
                             cout << "type call statement (template): " << i.target << " ("
                                  << i.target->attribute << ")" << endl;
 
@@ -598,7 +1133,8 @@ namespace bt { namespace analysis {
                                 hana::overload(
                                     [&](types::ptr_t& x) {
                                         if (args.size() != 1) {
-                                            auto err = raise<error>(ast);
+                                            auto err = raise<error>(
+                                                ast, diag_code_t::generic_arity);
                                             err << "Pointer generic type \"ptr()\"accepts a single "
                                                    "underlying value type argument, "
                                                    "but got: \""
@@ -610,7 +1146,8 @@ namespace bt { namespace analysis {
                                     },
                                     [&](types::array_t& x) {
                                         if (args.size() != 2) {
-                                            auto err = raise<error>(ast);
+                                            auto err = raise<error>(
+                                                ast, diag_code_t::generic_arity);
                                             err << "Fixed array generic type \"array()\" accepts "
                                                    "a value type argument, and a sequence of "
                                                    "dimension sizes, "
@@ -619,13 +1156,37 @@ namespace bt { namespace analysis {
                                         }
                                         type_check(args.front(), scope);
                                         x.value_type = args.front()->attribute;
-                                        type_check(args.back(), scope);
-                                        x.value_type = args.back()->attribute;
+
+                                        // dimensions are computed at compile time.
+                                        auto dimensions = scope;
+                                        dimensions.context = context_t::var;
+                                        type_check(args.back(), dimensions);
+                                        const auto dimension = [&](const attr_node_t<type_t>& n) {
+                                            const auto c = evaluate(n);
+                                            const auto size = c ? get_if<uint64_t>(&c->value)
+                                                                : nullptr;
+                                            const auto unsigned_size =
+                                                size && is_integral(c->type) && !is_signed(c->type);
+                                            if (unsigned_size ? *size > 0
+                                                              : size && int64_t(*size) > 0) {
+                                                x.size.push_back(*size);
+                                                return;
+                                            }
+                                            auto err = raise<error>(n, diag_code_t::not_a_constant);
+                                            err << "Array dimensions must be positive integer "
+                                                   "constants, but got: \""
+                                                << n << "\"";
+                                        };
+                                        if (auto p = args.back()->get_if<data_t<type_t>>())
+                                            for (const auto& n : *p) dimension(n);
+                                        else
+                                            dimension(args.back());
                                         result_ty = tgt_ty;
                                     },
                                     [&](types::dynarr_t& x) {
                                         if (args.size() != 1) {
-                                            auto err = raise<error>(ast);
+                                            auto err = raise<error>(
+                                                ast, diag_code_t::generic_arity);
                                             err << "Dynamic array generic type \"dynarr()\" "
                                                    "accepts "
                                                    "a single value type argument, "
@@ -636,19 +1197,50 @@ namespace bt { namespace analysis {
                                         x.value_type = args.front().get().attribute;
                                         result_ty = tgt_ty;
                                     },
+                                    [&](types::slice_t& x) {
+                                        if (args.size() != 3 && args.size() != 4) {
+                                            auto err = raise<error>(
+                                                ast, diag_code_t::generic_arity);
+                                            err << "Slice generic type \"slice()\" accepts a "
+                                                   "value type argument, where slices begin "
+                                                   "and end, and a stride, but got: \""
+                                                << args << "\"";
+                                            return;
+                                        }
+                                        type_check(args.front(), scope);
+                                        const auto bounds = slice_bounds(args, 1, scope);
+                                        if (!bounds) return;
+                                        // Bounds are checked as those of a slice of an array
+                                        // ending where the slice does.
+                                        const auto& [begin, end, stride] = *bounds;
+                                        const auto a = type_value(
+                                            types::array_t{args.front()->attribute,
+                                                           {size_t(max(end, int64_t(0)))}});
+                                        const auto t = slice_type(a, begin, end, stride);
+                                        if (!t) {
+                                            auto err =
+                                                raise<error>(ast, diag_code_t::invalid_slice);
+                                            err << "Invalid slice bounds: from " << begin << " to "
+                                                << end << " by " << stride;
+                                            return;
+                                        }
+                                        result_ty = *t;
+                                    },
                                     [&](types::strlit_t& x) {
                                         if (args.size() != 1) {
-                                            auto err = raise<error>(ast);
+                                            auto err = raise<error>(
+                                                ast, diag_code_t::generic_arity);
                                             err << "Static (literal) \"strlit()\" generic type "
                                                    "accepts a single value type argument, "
                                                    "but got following argument pack: \""
                                                 << args << "\"";
                                         }
-                                        x.size = visit(
-                                            hana::overload([](parser::syntax::integral_literal_t& i)
-                                                               -> int { return i.value; },
-                                                           [](auto& v) -> int { return 0; }),
-                                            args.front().get().get<literal_t>());
+                                        auto size = scope;
+                                        size.context = context_t::var;
+                                        type_check(args.front(), size);
+                                        const auto c = evaluate(args.front());
+                                        const auto n = c ? get_if<uint64_t>(&c->value) : nullptr;
+                                        x.size = n ? int(*n) : 0;
                                         result_ty = tgt_ty;
                                     },
                                     [&](types::tuple_t& x) {
@@ -661,7 +1253,8 @@ namespace bt { namespace analysis {
                                     },
                                     [&](types::function_t& x) {
                                         if (args.size() < 1) {
-                                            auto err = raise<error>(ast);
+                                            auto err = raise<error>(
+                                                ast, diag_code_t::generic_arity);
                                             err << "Function generic type \"fn()\" accepts at "
                                                    "least "
                                                    "a single value type argument "
@@ -669,9 +1262,22 @@ namespace bt { namespace analysis {
                                                    "pack: \""
                                                 << args << "\"";
                                         }
+                                        // fn(R, A...) takes arguments of the
+                                        // types A... and returns an R.
+                                        for (auto j = 0u; j < args.size(); j++) {
+                                            type_check(args[j], scope);
+                                            const auto& t = args[j].get().attribute;
+                                            if (j == 0)
+                                                x.result_type = t;
+                                            else
+                                                x.formal_parameters.push_back(
+                                                    types::name_and_type_t{"", t});
+                                        }
+                                        result_ty = tgt_ty;
                                     },
                                     [&](auto&) {
-                                        auto err = raise<error>(ast);
+                                        auto err = raise<error>(
+                                            ast, diag_code_t::not_a_generic_type);
                                         auto& tgt_ty = i.target.get().attribute.get();
                                         err << "Expected generic type, got " << tgt_ty;
                                     }),
@@ -701,7 +1307,7 @@ namespace bt { namespace analysis {
                         }
 
                         if (!is_convertible_to(test_ty, BOOL)) {
-                            auto err = raise<error>(ast);
+                            auto err = raise<error>(ast, diag_code_t::condition_not_bool);
                             err << "While test condition must have type \"bool\", found: \""
                                 << test_ty << "\"";
                         }
@@ -727,7 +1333,7 @@ namespace bt { namespace analysis {
                             }
 
                             if (!is_convertible_to(test_ty, BOOL)) {
-                                auto err = raise<error>(ast);
+                                auto err = raise<error>(ast, diag_code_t::condition_not_bool);
                                 err << "If condition must have type \"bool\", found: \"" << test_ty
                                     << "\"";
                             }
@@ -760,10 +1366,25 @@ namespace bt { namespace analysis {
                         scope.context = context_t::var;
                         type_check(i.rhs, scope);
 
-                        if (is_assignable_to(i.rhs->attribute, i.lhs->attribute))
+                        if (is_assignable_to(i.rhs->attribute, i.lhs->attribute)) {
+                            // what a with block allocates is stored only in
+                            // the variables declared in it.
+                            const auto target = root_variable(i.lhs);
+                            const auto pregion =
+                                target ? scope.var_regions.lookup(target->name) : nullptr;
+                            const auto region = pregion ? *pregion : 0;
+                            if (region < scope.regions && allocated(i.rhs->attribute)) {
+                                auto err = raise<analysis::error>(ast, diag_code_t::invalid_region);
+                                err << "Can't assign value of type \"" << i.rhs->attribute
+                                    << "\", freed at the end of the with block, to a variable "
+                                       "declared outside it";
+                            }
                             return i.lhs->attribute;
+                        }
 
-                        auto err = raise<analysis::error>(ast);
+                        auto err = raise<analysis::error>(ast, diag_code_t::not_assignable);
+                        err << "Can't assign value of type \"" << i.rhs->attribute
+                            << "\" to target of type \"" << i.lhs->attribute << "\"";
 
                         return UNKOWN;
                     },
@@ -772,6 +1393,8 @@ namespace bt { namespace analysis {
                         type_t result = type_value(types::function_t{});
                         auto& o = result.get().get<types::function_t>();
                         auto scope = parent_scope;
+                        scope.regions = 0;
+                        scope.var_regions = {};
 
                         scope.context = context_t::type;
                         type_check(f.result_type, scope);
@@ -782,12 +1405,38 @@ namespace bt { namespace analysis {
 
                         for (auto&& [name, count] : names) {
                             if (count > 1) {
-                                auto err = raise<analysis::error>(ast);
+                                auto err = raise<analysis::error>(
+                                    ast, diag_code_t::duplicate_parameter);
                                 err << "Name \"" << name << "\" is duplicated (occurring " << count
                                     << " times) in function expression.";
                             }
                         }
 
+                        // "with" names values when the function is made:
+                        // copies of variables or expressions, or the
+                        // variables themselves with "var".
+                        for (auto& closure : f.closure_params) {
+                            auto t = UNKOWN;
+                            if (closure.expression.get()) {
+                                auto captured = parent_scope;
+                                captured.context = context_t::var;
+                                type_check(closure.expression, captured);
+                                t = decay_ptr(closure.expression.get().attribute);
+                                if (closure.var) t = type_value(types::ptr_t{t});
+                            } else if (closure.identifier) {
+                                const auto& name = closure.identifier->name;
+                                if (auto pt = parent_scope.vars.lookup(name)) {
+                                    t = closure.var ? *pt : decay_ptr(*pt);
+                                } else {
+                                    auto err = raise<analysis::error>(
+                                        ast, diag_code_t::undefined_identifier);
+                                    err << "Function captures \"" << name
+                                        << "\", which isn't a variable";
+                                }
+                            }
+                            if (closure.identifier) scope.vars.insert(closure.identifier->name, t);
+                        }
+
                         for (auto j = 0; j < f.arg_names.size(); j++) {
                             auto& arg_nm = f.arg_names[j].name;
                             auto& arg_ty = f.arg_types[j];
@@ -802,11 +1451,39 @@ namespace bt { namespace analysis {
 
                         type_check(f.body, scope);
 
+                        // generators yield values of the type they declare, and
+                        // return nothing.
+                        if (const auto yields = yields_of(f.body); !yields.empty()) {
+                            const auto value_type = o.result_type;
+                            o.result_type = type_value(types::generator_t{value_type});
+                            if (value_type.get().empty()) {
+                                auto err = raise<analysis::error>(
+                                    ast, diag_code_t::invalid_yield);
+                                err << "Generators must declare the type of the values they "
+                                       "yield";
+                                return result;
+                            }
+                            for (const auto y : yields) {
+                                const auto& v = y->get().get_if<yield_t<type_t>>()->value;
+                                if (v.get() && implicit_conversion_distance(v.get().attribute,
+                                                                            value_type) >= 0)
+                                    continue;
+                                auto err = raise<analysis::error>(*y, diag_code_t::invalid_yield);
+                                err << "Generator of \"" << value_type << "\" yields ";
+                                if (v.get())
+                                    err << "a value of type \"" << v.get().attribute << "\"";
+                                else
+                                    err << "no value";
+                            }
+                            return result;
+                        }
+
                         if (o.result_type.get().empty()) o.result_type = f.body.get().attribute;
 
                         if (implicit_conversion_distance(f.body.get().attribute, o.result_type) <
                             0) {
-                            auto err = raise<analysis::error>(ast);
+                            auto err = raise<analysis::error>(
+                                ast, diag_code_t::return_type_mismatch);
                             err << "Type mismatch: function purports to return a \""
                                 << o.result_type << "\", but actually "
                                 << "returns a value of type \"" << f.body.get().attribute << "\"";
@@ -829,7 +1506,7 @@ namespace bt { namespace analysis {
                         if (decl_ty->empty()) {
                             deduced_ty = decay_ptr(deduced_ty);
                         } else if (!is_immutable(decl_ty)) {
-                            auto err = raise<analysis::error>(ast);
+                            auto err = raise<analysis::error>(ast, diag_code_t::let_not_immutable);
                             err << "Let variable statement must have an immutable type, but the "
                                 << "declared type \"" << decl_ty
                                 << "\" has at least \"ptr\" nested "
@@ -850,7 +1527,8 @@ namespace bt { namespace analysis {
                                 return decl_ty;
                             }
 
-                            auto err = raise<analysis::error>(ast);
+                            auto err = raise<analysis::error>(
+                                ast, diag_code_t::assign_type_mismatch);
                             err << "Can't assign value of type \"" << deduced_ty
                                 << "\" to variable \"" << f.name.name << "\" of type \"" << decl_ty
                                 << "\"";
@@ -891,7 +1569,8 @@ namespace bt { namespace analysis {
                             if (z > 0)
                                 deduced_ty = decay_ptr(deduced_ty, z);
                             else if (z < 0) {
-                                auto err = raise<analysis::error>(ast);
+                                auto err = raise<analysis::error>(
+                                    ast, diag_code_t::indirection_mismatch);
                                 err << "In variable declaration, the left-hand side has "
                                     << f.n_indirections << " '*' (pointer) symbols suggesting the "
                                     << "right-hand side has at least " << f.n_indirections << ", "
@@ -912,7 +1591,8 @@ namespace bt { namespace analysis {
                         if (!deduced_ty->empty()) {
                             if (is_assignable_to(deduced_ty, var_ty)) return var_ty;
 
-                            auto err = raise<analysis::error>(ast);
+                            auto err = raise<analysis::error>(
+                                ast, diag_code_t::assign_type_mismatch);
                             err << "Can't assign value of type \"" << deduced_ty
                                 << "\" to variable \"" << f.name.name << "\" of type \"" << decl_ty
                                 << "\"";
@@ -934,7 +1614,9 @@ namespace bt { namespace analysis {
                         const auto seq_is_ptr = seq_ty->is<types::ptr_t>();
                         v.var_rhs->attribute = deref(seq_ty);
 
-                        const auto err = [](auto&& t) { return raise<analysis::error>(t); };
+                        const auto err = [](auto&& t) {
+                            return raise<analysis::error>(t, diag_code_t::invalid_iteration_target);
+                        };
 
                         if (seq_ty->empty()) {
                             auto e = err(v.var_rhs);
@@ -946,6 +1628,10 @@ namespace bt { namespace analysis {
                             scope.vars.insert(v.var_lhs.name, parray->value_type);
                         } else if (auto pdynarr = seq_ty->get_if<types::dynarr_t>()) {
                             scope.vars.insert(v.var_lhs.name, pdynarr->value_type);
+                        } else if (auto pslice = seq_ty->get_if<types::slice_t>()) {
+                            scope.vars.insert(v.var_lhs.name, pslice->value_type);
+                        } else if (auto pgen = seq_ty->get_if<types::generator_t>()) {
+                            scope.vars.insert(v.var_lhs.name, pgen->value_type);
                         } else if (auto pdynarr = seq_ty->get_if<types::string_t>()) {
                             scope.vars.insert(v.var_lhs.name, CHAR);
                         } else if (auto pdynarr = seq_ty->get_if<types::strlit_t>()) {
@@ -955,6 +1641,7 @@ namespace bt { namespace analysis {
                             e << "Invalid iteration target for iteration variable \"" << v.var_lhs
                               << "\" has type \"" << v.var_rhs->attribute << "\"";
                         }
+                        scope.var_regions.insert(v.var_lhs.name, scope.regions);
 
                         scope.context = context_t::var;
                         type_check(v.body, scope);
@@ -971,16 +1658,80 @@ namespace bt { namespace analysis {
                     },
                     [&](return_t<type_t>& v) -> type_t {
                         type_check(v.value, parent_scope);
+                        if (parent_scope.regions && v.value.get() &&
+                            allocated(v.value.get().attribute)) {
+                            auto err = raise<analysis::error>(ast, diag_code_t::invalid_region);
+                            err << "Can't return value of type \"" << v.value.get().attribute
+                                << "\" from a with block, which frees it";
+                        }
                         return v.value.get().attribute;
                     },
                     [&](yield_t<type_t>& v) -> type_t {
-                        type_check(v.value, parent_scope);
-                        return v.value.get().attribute;
+                        if (v.value.get()) type_check(v.value, parent_scope);
+                        if (parent_scope.regions) {
+                            auto err = raise<analysis::error>(ast, diag_code_t::invalid_region);
+                            err << "Generators can't yield in with blocks";
+                        }
+                        return VOID;
+                    },
+                    [&](with_t<type_t>& v) -> type_t {
+                        auto scope = parent_scope;
+                        scope.regions++;
+                        scope.context = context_t::var;
+                        type_check(v.body, scope);
+
+                        // blocks ending in an assignment or a definition
+                        // are run for their effects.
+                        const auto block = v.body->get_if<block_t<type_t>>();
+                        if (block && !block->empty()) {
+                            const auto& last = block->back().get();
+                            if (last.is<assign_t<type_t>>() || last.is<var_def_t<type_t>>() ||
+                                last.is<let_var_t<type_t>>())
+                                return VOID;
+                        }
+
+                        const auto& t = v.body->attribute;
+                        if (allocated(t)) {
+                            auto err = raise<analysis::error>(ast, diag_code_t::invalid_region);
+                            err << "With block can't result in a value of type \"" << t
+                                << "\", which it frees";
+                        }
+                        return t;
+                    },
+                    [&](struct_t<type_t>& v) -> type_t {
+                        auto scope = parent_scope;
+                        scope.context = context_t::type;
+                        auto fields = types::struct_t();
+                        for (auto& [name, field] : v) {
+                            type_check(field, scope);
+                            fields.push_back(types::name_and_type_t{name.name, field->attribute});
+                        }
+                        return type_value(move(fields));
                     },
-                    [&](struct_t<type_t>& v) -> type_t { return UNKOWN; },
                     [&](def_type_t<type_t>& f) -> type_t { return UNKOWN; },
                     [&](let_type_t<type_t>& f) -> type_t { return UNKOWN; },
-                    [&](template_t<type_t>& v) -> type_t { return UNKOWN; },
+                    [&](template_t<type_t>& v) -> type_t {
+                        // definitions are checked as they are instantiated.
+                        if (defines_template(v)) return UNKOWN;
+
+                        const auto id = v.body.get().get_if<lexer::identifier_t>();
+                        const auto pid = id ? parent_scope.templates.lookup(id->name) : nullptr;
+                        if (!pid) {
+                            auto err = raise<error>(ast, diag_code_t::not_a_template);
+                            err << "Expected a template, got \"" << v.body << "\"";
+                            return UNKOWN;
+                        }
+
+                        auto& templates = compilation_t::current().templates;
+                        const auto& definition = templates.definition(*pid);
+                        const auto arguments =
+                            template_arguments(ast, definition, v.arguments, parent_scope);
+                        const auto instance =
+                            arguments ? instantiate(ast, *pid, *arguments) : nullptr;
+                        if (!instance) return UNKOWN;
+                        if (instance->definition.get()) instantiated = instance->name;
+                        return instance->type;
+                    },
                     [&](attr_node_t<type_t>& n) -> type_t { return UNKOWN; },
                     [&](std::monostate& e) -> type_t { return UNKOWN; },
                     [&](auto&& e) -> type_t { return UNKOWN; }),
@@ -989,6 +1740,15 @@ namespace bt { namespace analysis {
             cerr << e.what() << endl;
             // cerr << boost::stacktrace::stacktrace() << endl;
         }
+
+        // uses of instances of function templates call, and pass, the
+        // instance by its name.
+        if (instantiated) {
+            auto node = attr_tree_t<type_t>(lexer::identifier_t(*instantiated));
+            node.location = ast.get().location;
+            node.attribute = ast.get().attribute;
+            ast.get() = move(node);
+        }
     }
 
 }}  // namespace bt::analysis
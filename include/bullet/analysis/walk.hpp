@@ -1,689 +1,333 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
 #include <boost/hana/all.hpp>
 
 #include <bullet/analysis/error.hpp>
+#include <bullet/analysis/scheduler.hpp>
 #include <bullet/parser/ast.hpp>
 #include <bullet/parser/attribute.hpp>
+#include <bullet/parser/traversal.hpp>
 #include <bullet/util.hpp>
 
 namespace bt { namespace analysis {
 
     namespace details {
-        template <typename OutputAttr, class... Fn, typename InputAttr>
-        inline auto walk_post_order_impl(const parser::syntax::attr_node_t<InputAttr>& node,
-                                         Fn*... fn) -> parser::syntax::attr_tree_t<OutputAttr> {
+        template <typename Attr>
+        inline auto reject_dangling(const parser::syntax::attr_tree_t<Attr>& tree) -> void {
             using namespace parser::syntax;
-            using namespace std;
-            using in_tree_t = attr_tree_t<InputAttr>;
-            using out_tree_t = attr_tree_t<OutputAttr>;
-
-            namespace hana = boost::hana;
-
-            const auto f = hana::overload((*fn)...);
-            const auto l = node.get().location;
-            const auto& attribute = node.get().attribute;
-
-            return std::visit(
-                boost::hana::overload(
-                    [&](const primitive_type_t& i) {
-                        auto result = out_tree_t(i);
-                        result.location = l;
-                        result.attribute = f(result.template get<primitive_type_t>(), node);
-                        return result;
-                    },
-                    [&](const literal_t& literal) {
-                        auto result = out_tree_t(literal);
-                        result.location = l;
-                        result.attribute = f(result.template get<literal_t>(), node);
-                        return result;
-                    },
-                    [&](const lexer::identifier_t& id) {
-                        auto result = out_tree_t(id);
-                        result.location = l;
-                        result.attribute = f(id, node);
-                        return result;
-                    },
-                    [&](const block_t<InputAttr>& block) {
-                        auto result = out_tree_t(block_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-
-                        for (const auto& stmt : block)
-                            result.template get<block_t<OutputAttr>>().push_back(
-                                walk_post_order_impl<OutputAttr>(stmt, fn...));
-
-                        result.attribute = f(result.template get<block_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const data_t<InputAttr>& data) {
-                        auto result = out_tree_t(data_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-
-                        for (const auto& stmt : data)
-                            result.template get<data_t<OutputAttr>>().push_back(
-                                walk_post_order_impl<OutputAttr>(stmt, fn...));
-
-                        result.attribute = f(result.template get<data_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const unary_op_t<InputAttr>& op) {
-                        auto result = out_tree_t(unary_op_t<OutputAttr>{
-                            op.op, walk_post_order_impl<OutputAttr>(op.operand, fn...)});
-                        result.location = l;
-                        result.attribute = f(result.template get<unary_op_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const bin_op_t<InputAttr>& op) {
-                        auto result = out_tree_t(bin_op_t<OutputAttr>{
-                            op.op, walk_post_order_impl<OutputAttr>(op.lhs, fn...),
-                            walk_post_order_impl<OutputAttr>(op.rhs, fn...)});
-                        result.location = l;
-                        result.attribute = f(result.template get<bin_op_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const invoc_t<InputAttr>& i) {
-                        auto result = out_tree_t(invoc_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-
-                        auto& o = result.template get<invoc_t<OutputAttr>>();
-                        o.target = attr_node_t<OutputAttr>(
-                            walk_post_order_impl<OutputAttr>(i.target, fn...));
-
-                        for (const auto& arg : i.arguments)
-                            o.arguments.push_back(walk_post_order_impl<OutputAttr>(arg, fn...));
-
-                        result.attribute = f(o, node);
-
-                        return result;
-                    },
-                    [&](const if_t<InputAttr>& i) {
-                        auto result = out_tree_t(if_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-
-                        auto& o = result.template get<if_t<OutputAttr>>();
-
-                        for (int j = 0; j < i.elif_tests.size(); j++) {
-                            o.elif_tests.push_back(
-                                walk_post_order_impl<OutputAttr>(i.elif_tests[j], fn...));
-
-                            o.elif_branches.push_back(
-                                walk_post_order_impl<OutputAttr>(i.elif_branches[j], fn...));
-                        }
-
-                        o.else_branch = attr_node_t<OutputAttr>(
-                            walk_post_order_impl<OutputAttr>(i.else_branch, fn...));
-
-                        result.attribute = f(o, node);
-
-                        return result;
-                    },
-                    [&](const elif_t<InputAttr>& i) -> out_tree_t {
-                        throw error("Illegal dangling \"elif\"", l);
-                    },
-                    [&](const else_t<InputAttr>& i) -> out_tree_t {
-                        throw error("Illegal dangling \"else\"", l);
-                    },
-                    [&](const fn_expr_t<InputAttr>& i) {
-                        auto result = out_tree_t(fn_expr_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-
-                        auto& o = result.template get<fn_expr_t<OutputAttr>>();
-
-                        o.arg_names = i.arg_names;
-
-                        for (int j = 0; j < i.arg_names.size(); j++)
-                            o.arg_types.push_back(
-                                walk_post_order_impl<OutputAttr>(i.arg_types[j], fn...));
-
-                        o.result_type = attr_node_t<OutputAttr>(
-                            walk_post_order_impl<OutputAttr>(i.result_type, fn...));
-                        o.body = attr_node_t<OutputAttr>(
-                            walk_post_order_impl<OutputAttr>(i.body, fn...));
-
-                        for (int j = 0; j < i.closure_params.size(); j++) {
-                            const auto& p = i.closure_params[j];
-                            o.closure_params.push_back(fn_closure_param_t<OutputAttr>{
-                                p.var, p.identifier,
-                                walk_post_order_impl<OutputAttr>(p.expression, fn...)});
-                        }
-
-                        result.attribute = f(o, node);
-
-                        return result;
-                    },
-                    [&](const assign_t<InputAttr>& i) {
-                        auto result = out_tree_t(
-                            assign_t<OutputAttr>{walk_post_order_impl<OutputAttr>(i.lhs, fn...),
-                                                 walk_post_order_impl<OutputAttr>(i.rhs, fn...)});
-                        result.location = l;
-                        result.attribute = f(result.template get<assign_t<OutputAttr>>(), node);
-                        return result;
-                    },
-                    [&](const let_var_t<InputAttr>& i) {
-                        auto result = out_tree_t(let_var_t<OutputAttr>{
-                            i.name, walk_post_order_impl<OutputAttr>(i.type, fn...),
-                            walk_post_order_impl<OutputAttr>(i.rhs, fn...)});
-                        result.location = l;
-                        result.attribute = f(result.template get<let_var_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const var_def_t<InputAttr>& i) {
-                        auto result = out_tree_t(
-                            var_def_t<OutputAttr>{i.name, i.n_indirections,
-                                                  walk_post_order_impl<OutputAttr>(i.type, fn...),
-                                                  walk_post_order_impl<OutputAttr>(i.rhs, fn...)});
-                        result.location = l;
-                        result.attribute = f(result.template get<var_def_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const for_t<InputAttr>& i) {
-                        auto result = out_tree_t(for_t<OutputAttr>{
-                            i.var_lhs, walk_post_order_impl<OutputAttr>(i.var_rhs, fn...),
-                            walk_post_order_impl<OutputAttr>(i.body, fn...)});
-                        result.location = l;
-                        result.attribute = f(result.template get<for_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const while_t<InputAttr>& i) {
-                        auto result = out_tree_t(
-                            while_t<OutputAttr>{walk_post_order_impl<OutputAttr>(i.test, fn...),
-                                                walk_post_order_impl<OutputAttr>(i.body, fn...)});
-                        result.location = l;
-                        result.attribute = f(result.template get<while_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const break_t& i) {
-                        auto result = out_tree_t(i);
-                        result.location = l;
-                        result.attribute = f(result.template get<break_t>(), node);
-                        return result;
-                    },
-                    [&](const continue_t& i) {
-                        auto result = out_tree_t(i);
-                        result.location = l;
-                        result.attribute = f(result.template get<continue_t>(), node);
-                        return result;
-                    },
-                    [&](const type_expr_t<InputAttr>& i) {
-                        auto result = out_tree_t(type_expr_t<OutputAttr>{
-                            walk_post_order_impl<OutputAttr>(i.type, fn...),
-                        });
-                        result.location = l;
-                        result.attribute = f(result.template get<type_expr_t<OutputAttr>>(), node);
 
-                        return result;
-                    },
-                    [&](const return_t<InputAttr>& i) {
-                        auto result = out_tree_t(return_t<OutputAttr>{
-                            walk_post_order_impl<OutputAttr>(i.value, fn...),
-                        });
-                        result.location = l;
-                        result.attribute = f(result.template get<return_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const yield_t<InputAttr>& i) {
-                        auto result = out_tree_t(yield_t<OutputAttr>{
-                            walk_post_order_impl<OutputAttr>(i.value, fn...),
-                        });
-                        result.location = l;
-                        result.attribute = f(result.template get<yield_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const struct_t<InputAttr>& i) {
-                        auto result = out_tree_t(struct_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-
-                        auto& o = result.template get<struct_t<OutputAttr>>();
-
-                        for (const auto& e : i)
-                            o.emplace_back(e.first,
-                                           walk_post_order_impl<OutputAttr>(e.second, fn...));
-
-                        result.attribute = f(o, node);
-
-                        return result;
-                    },
-                    [&](const def_type_t<InputAttr>& i) {
-                        auto result = out_tree_t(def_type_t<OutputAttr>{
-                            i.name,
-                            walk_post_order_impl<OutputAttr>(i.type, fn...),
-                        });
-                        result.location = l;
-                        result.attribute = f(result.template get<def_type_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const let_type_t<InputAttr>& i) {
-                        auto result = out_tree_t(let_type_t<OutputAttr>{
-                            i.name,
-                            walk_post_order_impl<OutputAttr>(i.type, fn...),
-                        });
-                        result.location = l;
-                        result.attribute = f(result.template get<let_type_t<OutputAttr>>(), node);
-
-                        return result;
-                    },
-                    [&](const template_t<InputAttr>& i) {
-                        auto result = out_tree_t(template_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-
-                        auto& o = result.template get<template_t<OutputAttr>>();
-
-                        for (const auto& e : i.arguments)
-                            o.arguments.emplace_back(
-                                e.first, walk_post_order_impl<OutputAttr>(e.second, fn...));
-
-                        o.body = attr_node_t<OutputAttr>(
-                            walk_post_order_impl<OutputAttr>(i.body, fn...));
-
-                        result.attribute = f(o, node);
+            if (tree.template is<elif_t<Attr>>())
+                throw error("Illegal dangling \"elif\"", tree.location);
+            if (tree.template is<else_t<Attr>>())
+                throw error("Illegal dangling \"else\"", tree.location);
+        }
 
-                        return result;
-                    },
-                    [&](const attr_node_t<InputAttr>& i) {
-                        auto result = out_tree_t(
-                            attr_node_t<OutputAttr>(walk_post_order_impl<OutputAttr>(i, fn...)));
-                        result.location = l;
-                        result.attribute = f(result.template get<attr_node_t<OutputAttr>>(), node);
-                        return result;
-                    },
-                    [&](const auto&) {
-                        auto result = out_tree_t();
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-                        return result;
-                    }),
-                node.get());
+        // Pops the converted children of a node off the work stack and builds
+        // the converted node from them.
+        template <typename OutputAttr, typename InputAttr>
+        inline auto rebuild(const parser::syntax::attr_tree_t<InputAttr>& tree,
+                            std::vector<parser::syntax::attr_node_t<OutputAttr>>& done)
+            -> parser::syntax::attr_tree_t<OutputAttr> {
+            const auto n = parser::details::child_count(tree);
+            auto result = parser::details::rebuild<OutputAttr>(tree, done.data() + done.size() - n);
+            done.resize(done.size() - n);
+            result.location = tree.location;
+            return result;
         }
 
-        template <typename OutputAttr, class... Fn, typename InputAttr>
-        inline auto walk_pre_order_impl(const parser::syntax::attr_node_t<InputAttr>& node,
-                                        const InputAttr& parent_attrib,
-                                        Fn*... fn) -> parser::syntax::attr_tree_t<OutputAttr> {
+        // Builds the converted node from its converted children, which are moved
+        // from, and synthesizes its attribute.
+        template <typename OutputAttr, typename F, typename InputAttr>
+        inline auto synthesize(const F& f,
+                               const parser::syntax::attr_node_t<InputAttr>& node,
+                               parser::syntax::attr_node_t<OutputAttr>* children)
+            -> parser::syntax::attr_node_t<OutputAttr> {
             using namespace parser::syntax;
-            using namespace std;
-            using namespace boost::hana;
 
-            using in_tree_t = attr_tree_t<InputAttr>;
-            using out_tree_t = attr_tree_t<OutputAttr>;
-
-            namespace hana = boost::hana;
-
-            const auto l = node.get().location;
-            const auto& attribute = node.get().attribute;
-
-            const auto f = hana::overload((*fn)...);
-
-            return std::visit(
-                boost::hana::overload(
-                    [&](const primitive_type_t& i) {
-                        auto result = out_tree_t(i);
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-                        return result;
-                    },
-                    [&](const literal_t& literal) {
-                        auto result = out_tree_t(literal);
-                        result.location = l;
-                        result.attribute = f(literal, node, parent_attrib);
-                        return result;
-                    },
-                    [&](const lexer::identifier_t& id) {
-                        auto result = out_tree_t(id);
-                        result.location = l;
-                        result.attribute = f(id, node, parent_attrib);
-                        return result;
-                    },
-                    [&](const block_t<InputAttr>& block) {
-                        auto result = out_tree_t(block_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = f(block, node, parent_attrib);
+            auto result = parser::details::rebuild<OutputAttr>(node.get(), children);
+            result.location = node.get().location;
+            result.attribute = std::visit(
+                [&](auto& e) -> OutputAttr {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(e)>, std::monostate>)
+                        return OutputAttr{};
+                    else
+                        return f(e, node);
+                },
+                static_cast<node_base_t<OutputAttr>&>(result));
+            return attr_node_t<OutputAttr>(std::move(result));
+        }
 
-                        for (const auto& stmt : block)
-                            result.template get<block_t<OutputAttr>>().push_back(
-                                walk_pre_order_impl<OutputAttr>(stmt, result.attribute, fn...));
+        template <typename OutputAttr, typename F, typename InputAttr>
+        inline auto synthesize_subtree(const F& f,
+                                       const parser::syntax::attr_node_t<InputAttr>& root)
+            -> parser::syntax::attr_node_t<OutputAttr> {
+            using namespace parser::syntax;
+            using in_node_t = attr_node_t<InputAttr>;
+
+            auto done = std::vector<attr_node_t<OutputAttr>>();
+            parser::traverse(
+                root, [](const in_node_t& node) { reject_dangling(node.get()); },
+                [&](const in_node_t& node) {
+                    const auto n = parser::details::child_count(node.get());
+                    auto result = synthesize<OutputAttr>(f, node, done.data() + done.size() - n);
+                    done.resize(done.size() - n);
+                    done.push_back(std::move(result));
+                });
+            return std::move(done.back());
+        }
+    }  // namespace details
 
-                        return result;
-                    },
-                    [&](const data_t<InputAttr>& data) {
-                        auto result = out_tree_t(data_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = f(data, node, parent_attrib);
-                        for (const auto& stmt : data)
-                            result.template get<data_t<OutputAttr>>().push_back(
-                                walk_pre_order_impl<OutputAttr>(stmt, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const unary_op_t<InputAttr>& op) {
-                        auto result = out_tree_t(unary_op_t<OutputAttr>{});
-                        result.attribute = f(op, node, parent_attrib);
+    // Synthesizes an attribute for every node, children first: fn is called
+    // with the converted node and the original one. The walk runs on an
+    // explicit stack, so arbitrarily deep trees can be walked.
+    template <typename OutputAttr, class... Fn, typename InputAttr = parser::empty_attribute_t>
+    inline auto walk_post_order(const parser::syntax::attr_tree_t<InputAttr>& tree, Fn&&... fn)
+        -> parser::syntax::attr_tree_t<OutputAttr> {
+        const auto f = boost::hana::overload(fn...);
+        const auto root = parser::syntax::attr_node_t<InputAttr>(tree);
+        return std::move(details::synthesize_subtree<OutputAttr>(f, root).get());
+    }
 
-                        auto& o = result.template get<unary_op_t<OutputAttr>>();
-                        o.op = op.op;
-                        o.operand = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(op.operand, result.attribute, fn...));
-                        result.location = l;
+    // Whether the visitors of a pass may be called concurrently, on different
+    // nodes and threads, in any order consistent with children first. A pass
+    // declares so by wrapping its visitors with pure(), by specializing the
+    // trait, or with a static constexpr bool side_effect_free member.
+    template <typename Fn, typename = void>
+    struct is_side_effect_free : std::false_type {};
 
-                        return result;
-                    },
-                    [&](const bin_op_t<InputAttr>& op) {
-                        auto result = out_tree_t(bin_op_t<OutputAttr>{});
-                        auto& o = result.template get<bin_op_t<OutputAttr>>();
-                        result.location = l;
-                        result.attribute = f(op, node, parent_attrib);
-
-                        o.op = op.op;
-                        o.lhs = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(op.lhs, result.attribute, fn...));
-                        o.rhs = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(op.rhs, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const invoc_t<InputAttr>& i) {
-                        auto result = out_tree_t(invoc_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
+    template <typename Fn>
+    struct is_side_effect_free<Fn, std::enable_if_t<Fn::side_effect_free>> : std::true_type {};
 
-                        auto& o = result.template get<invoc_t<OutputAttr>>();
-                        o.target = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.target, result.attribute, fn...));
+    template <typename Fn>
+    inline constexpr bool is_side_effect_free_v = is_side_effect_free<std::decay_t<Fn>>::value;
 
-                        for (const auto& arg : i.arguments)
-                            o.arguments.push_back(
-                                walk_pre_order_impl<OutputAttr>(arg, result.attribute, fn...));
+    template <typename F>
+    struct pure_t {
+        static constexpr bool side_effect_free = true;
 
-                        return result;
-                    },
-                    [&](const if_t<InputAttr>& i) {
-                        auto result = out_tree_t(if_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
+        F fn;
 
-                        auto& o = result.template get<if_t<OutputAttr>>();
+        template <typename... Args>
+        auto operator()(Args&&... args) const
+            -> decltype(fn(std::forward<Args>(args)...)) {
+            return fn(std::forward<Args>(args)...);
+        }
+    };
+
+    // Declares a pass side effect free; the visitors are overloaded as they
+    // would be by the walkers.
+    template <class... Fn>
+    inline auto pure(Fn&&... fn) {
+        using overload_t = decltype(boost::hana::overload(std::forward<Fn>(fn)...));
+        return pure_t<overload_t>{boost::hana::overload(std::forward<Fn>(fn)...)};
+    }
 
-                        for (int j = 0; j < i.elif_tests.size(); j++) {
-                            o.elif_tests.push_back(walk_pre_order_impl<OutputAttr>(
-                                i.elif_tests[j], result.attribute, fn...));
+    // Subtrees of at most this many nodes are walked by a single task.
+    inline constexpr std::size_t default_parallel_grain = 4096;
 
-                            o.elif_branches.push_back(walk_pre_order_impl<OutputAttr>(
-                                i.elif_branches[j], result.attribute, fn...));
+    // walk_post_order with the sibling subtrees of every node larger than grain
+    // forked onto the scheduler; the calling thread helps until the walk is
+    // done. Passes which are not side effect free are walked sequentially.
+    template <typename OutputAttr, class... Fn, typename InputAttr = parser::empty_attribute_t>
+    inline auto parallel_walk_post_order(scheduler_t& scheduler,
+                                         std::size_t grain,
+                                         const parser::syntax::attr_tree_t<InputAttr>& tree,
+                                         Fn&&... fn) -> parser::syntax::attr_tree_t<OutputAttr> {
+        using namespace parser::syntax;
+        using in_node_t = attr_node_t<InputAttr>;
+        using out_node_t = attr_node_t<OutputAttr>;
+
+        if constexpr (!(is_side_effect_free_v<Fn> && ...)) {
+            return walk_post_order<OutputAttr>(tree, std::forward<Fn>(fn)...);
+        } else {
+            const auto f = boost::hana::overload(fn...);
+            const auto root = in_node_t(tree);
+
+            // sizes the subtrees, remembering the children's sizes of the nodes
+            // too large for a single task.
+            auto large = std::unordered_map<const attr_tree_t<InputAttr>*,
+                                            std::vector<std::size_t>>();
+            {
+                auto sizes = std::vector<std::size_t>();
+                auto firsts = std::vector<std::size_t>();
+                parser::traverse(
+                    root, [&](const in_node_t&) { firsts.push_back(sizes.size()); },
+                    [&](const in_node_t& node) {
+                        const auto first = firsts.back();
+                        firsts.pop_back();
+
+                        auto size = std::size_t(1);
+                        for (auto j = first; j < sizes.size(); j++) size += sizes[j];
+                        if (size > grain)
+                            large.emplace(&node.get(),
+                                          std::vector<std::size_t>(sizes.begin() + first,
+                                                                   sizes.end()));
+                        sizes.resize(first);
+                        sizes.push_back(size);
+                    });
+            }
+
+            if (!large.count(&root.get()))
+                return std::move(details::synthesize_subtree<OutputAttr>(f, root).get());
+
+            // a large node waiting for its children. Whichever task converts the
+            // last of them converts the node itself and hands it to the parent,
+            // so the walk needs no joins and no recursion.
+            struct job_t {
+                const in_node_t* node;
+                job_t* parent;
+                std::size_t slot;
+                std::vector<out_node_t> children;
+                std::atomic<std::size_t> remaining = 1;
+            };
+
+            struct state_t {
+                out_node_t result;
+                std::atomic<bool> done = false;
+                std::atomic<bool> failed = false;
+                std::mutex mutex;
+                std::exception_ptr exception;
+            } state;
+
+            const auto fail = [&] {
+                const auto lock = std::lock_guard(state.mutex);
+                if (!state.exception) state.exception = std::current_exception();
+                state.failed = true;
+            };
+
+            const auto complete = [&](job_t* job) {
+                while (job && --job->remaining == 0) {
+                    auto owned = std::unique_ptr<job_t>(job);
+                    auto converted = out_node_t();
+                    if (!state.failed) try {
+                            converted = details::synthesize<OutputAttr>(f, *job->node,
+                                                                        job->children.data());
+                        } catch (...) {
+                            fail();
                         }
 
-                        o.else_branch = attr_node_t<OutputAttr>(walk_pre_order_impl<OutputAttr>(
-                            i.else_branch, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const elif_t<InputAttr>& i) -> out_tree_t {
-                        throw error("Illegal dangling \"elif\"", l);
-                    },
-                    [&](const else_t<InputAttr>& i) -> out_tree_t {
-                        throw error("Illegal dangling \"else\"", l);
-                    },
-                    [&](const fn_expr_t<InputAttr>& i) {
-                        auto result = out_tree_t(fn_expr_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        auto& o = result.template get<fn_expr_t<OutputAttr>>();
-
-                        o.arg_names = i.arg_names;
-
-                        for (int j = 0; j < i.arg_names.size(); j++)
-                            o.arg_types.push_back(walk_pre_order_impl<OutputAttr>(
-                                i.arg_types[j], result.attribute, fn...));
-
-                        o.result_type = attr_node_t<OutputAttr>(walk_pre_order_impl<OutputAttr>(
-                            i.result_type, result.attribute, fn...));
-                        o.body = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.body, result.attribute, fn...));
-
-                        for (int j = 0; j < i.closure_params.size(); j++) {
-                            const auto& p = i.closure_params[j];
-                            o.closure_params.push_back(fn_closure_param_t<OutputAttr>{
-                                p.var, p.identifier,
-                                walk_pre_order_impl<OutputAttr>(p.expression, result.attribute,
-                                                                fn...)});
+                    job = owned->parent;
+                    if (job)
+                        job->children[owned->slot] = std::move(converted);
+                    else {
+                        state.result = std::move(converted);
+                        scheduler.signal(state.done);
+                    }
+                }
+            };
+
+            auto fork = std::function<void(job_t*)>();
+            fork = [&](job_t* job) {
+                try {
+                    details::reject_dangling(job->node->get());
+
+                    const auto& sizes = large.at(&job->node->get());
+                    auto children = std::vector<const in_node_t*>();
+                    parser::details::for_each_child(
+                        job->node->get(), [&](const in_node_t& c) { children.push_back(&c); });
+                    job->children.resize(children.size());
+
+                    // large children become jobs of their own; runs of small
+                    // ones are walked sequentially, grain nodes at a time.
+                    for (std::size_t j = 0; j < children.size();) {
+                        job->remaining++;
+                        if (sizes[j] > grain) {
+                            auto child = new job_t{children[j], job, j};
+                            scheduler.spawn([&, child] { fork(child); });
+                            j++;
+                            continue;
                         }
 
-                        return result;
-                    },
-                    [&](const assign_t<InputAttr>& i) {
-                        auto result = out_tree_t(assign_t<OutputAttr>{});
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        auto& o = result.template get<assign_t<OutputAttr>>();
-
-                        o.lhs = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.lhs, result.attribute, fn...));
-                        o.rhs = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.rhs, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const let_var_t<InputAttr>& i) {
-                        auto result = out_tree_t(let_var_t<OutputAttr>{});
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        auto& o = result.template get<let_var_t<OutputAttr>>();
-
-                        o.name = i.name;
-                        o.type = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.type, result.attribute, fn...));
-                        o.rhs = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.rhs, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const var_def_t<InputAttr>& i) {
-                        auto result = out_tree_t(var_def_t<OutputAttr>{});
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        auto& o = result.template get<var_def_t<OutputAttr>>();
-
-                        o.name = i.name;
-                        o.n_indirections = i.n_indirections;
-                        o.type = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.type, result.attribute, fn...));
-                        o.rhs = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.rhs, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const for_t<InputAttr>& i) {
-                        auto result = out_tree_t(for_t<OutputAttr>{});
-
-                        auto& o = result.template get<for_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        o.var_lhs = i.var_lhs,
-                        o.var_rhs = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.var_rhs, result.attribute, fn...));
-                        o.body = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.body, result.attribute, fn...));
-                        return result;
-                    },
-                    [&](const while_t<InputAttr>& i) {
-                        auto result = out_tree_t(while_t<OutputAttr>{});
-                        auto& o = result.template get<while_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        o.test = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.test, result.attribute, fn...));
-                        o.body = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.body, result.attribute, fn...));
-                        return result;
-                    },
-                    [&](const break_t& i) {
-                        auto result = out_tree_t(i);
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-                        return result;
-                    },
-                    [&](const continue_t& i) {
-                        auto result = out_tree_t(i);
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-                        return result;
-                    },
-                    [&](const type_expr_t<InputAttr>& i) {
-                        auto result = out_tree_t(type_expr_t<OutputAttr>{});
-                        auto& o = result.template get<type_expr_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        o.type = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.type, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const return_t<InputAttr>& i) {
-                        auto result = out_tree_t(return_t<OutputAttr>{});
-                        auto& o = result.template get<return_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        o.value = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.value, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const yield_t<InputAttr>& i) {
-                        auto result = out_tree_t(yield_t<OutputAttr>{});
-                        auto& o = result.template get<yield_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        o.value = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.value, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const struct_t<InputAttr>& i) {
-                        auto result = out_tree_t(struct_t<OutputAttr>{});
-                        auto& o = result.template get<struct_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        for (const auto& e : i)
-                            o.emplace_back(e.first, walk_pre_order_impl<OutputAttr>(
-                                                        e.second, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const def_type_t<InputAttr>& i) {
-                        auto result = out_tree_t(def_type_t<OutputAttr>{});
-
-                        auto& o = result.template get<def_type_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        o.name = i.name;
-                        o.type = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.type, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const let_type_t<InputAttr>& i) {
-                        auto result = out_tree_t(let_type_t<OutputAttr>{});
-
-                        auto& o = result.template get<let_type_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        o.name = i.name;
-                        o.type = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.type, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const template_t<InputAttr>& i) {
-                        auto result = out_tree_t(template_t<OutputAttr>{});
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        auto& o = result.template get<template_t<OutputAttr>>();
-
-                        for (const auto& e : i.arguments)
-                            o.arguments.emplace_back(
-                                e.first,
-                                walk_pre_order_impl<OutputAttr>(e.second, result.attribute, fn...));
-
-                        o.body = attr_node_t<OutputAttr>(
-                            walk_pre_order_impl<OutputAttr>(i.body, result.attribute, fn...));
-
-                        return result;
-                    },
-                    [&](const attr_node_t<InputAttr>& i) {
-                        auto result = out_tree_t(attr_node_t<OutputAttr>());
-
-                        auto& o = result.template get<attr_node_t<OutputAttr>>();
-
-                        result.location = l;
-                        result.attribute = f(i, node, parent_attrib);
-
-                        o = walk_pre_order_impl<OutputAttr>(i, result.attribute, fn...);
-
-                        return result;
-                    },
-                    [&](const auto&) {
-                        auto result = out_tree_t();
-                        result.location = l;
-                        result.attribute = OutputAttr{};
-                        return result;
-                    }),
-                node.get());
+                        auto end = j;
+                        for (auto total = std::size_t(0);
+                             end < children.size() && sizes[end] <= grain &&
+                             (end == j || total + sizes[end] <= grain);
+                             end++)
+                            total += sizes[end];
+
+                        auto run = std::vector<const in_node_t*>(children.begin() + j,
+                                                                 children.begin() + end);
+                        scheduler.spawn([&, job, j, run = std::move(run)] {
+                            try {
+                                for (std::size_t k = 0; k < run.size() && !state.failed; k++)
+                                    job->children[j + k] =
+                                        details::synthesize_subtree<OutputAttr>(f, *run[k]);
+                            } catch (...) {
+                                fail();
+                            }
+                            complete(job);
+                        });
+                        j = end;
+                    }
+                } catch (...) {
+                    fail();
+                }
+                complete(job);
+            };
+
+            fork(new job_t{&root, nullptr, 0});
+            scheduler.run_until(state.done);
+
+            if (state.exception) std::rethrow_exception(state.exception);
+            return std::move(state.result.get());
         }
-    }  // namespace details
+    }
 
     template <typename OutputAttr, class... Fn, typename InputAttr = parser::empty_attribute_t>
-    inline auto walk_post_order(const parser::syntax::attr_tree_t<InputAttr>& tree, Fn&&... fn)
-        -> parser::syntax::attr_tree_t<OutputAttr> {
-        const auto node = parser::syntax::attr_node_t<InputAttr>(tree);
-        return details::walk_post_order_impl<OutputAttr>(node, &fn...);
+    inline auto parallel_walk_post_order(const parser::syntax::attr_tree_t<InputAttr>& tree,
+                                         Fn&&... fn) -> parser::syntax::attr_tree_t<OutputAttr> {
+        return parallel_walk_post_order<OutputAttr>(scheduler_t::shared(), default_parallel_grain,
+                                                    tree, std::forward<Fn>(fn)...);
     }
 
+    // Inherits an attribute for every node, parents first: fn is called with
+    // the original node and the attribute computed for its parent.
     template <typename OutputAttr, class... Fn, typename InputAttr = parser::empty_attribute_t>
     inline auto walk_pre_order(const parser::syntax::attr_tree_t<InputAttr>& tree, Fn&&... fn)
         -> parser::syntax::attr_tree_t<OutputAttr> {
-        const auto root_attribute = InputAttr{};
-        const auto node = parser::syntax::attr_node_t<InputAttr>(tree);
-        return details::walk_pre_order_impl<OutputAttr>(node, root_attribute, &fn...);
+        using namespace parser::syntax;
+        using in_node_t = attr_node_t<InputAttr>;
+
+        const auto f = boost::hana::overload(fn...);
+        const auto root = in_node_t(tree);
+        const auto root_attribute = OutputAttr{};
+        auto attributes = std::vector<OutputAttr>();
+        auto done = std::vector<attr_node_t<OutputAttr>>();
+
+        parser::traverse(
+            root,
+            [&](const in_node_t& node) {
+                details::reject_dangling(node.get());
+                const auto& parent = attributes.empty() ? root_attribute : attributes.back();
+                auto attribute = std::visit(
+                    [&](const auto& e) -> OutputAttr {
+                        if constexpr (std::is_same_v<std::decay_t<decltype(e)>, std::monostate>)
+                            return OutputAttr{};
+                        else
+                            return f(e, node, parent);
+                    },
+                    static_cast<const node_base_t<InputAttr>&>(node.get()));
+                attributes.push_back(std::move(attribute));
+            },
+            [&](const in_node_t& node) {
+                auto result = details::rebuild<OutputAttr>(node.get(), done);
+                result.attribute = std::move(attributes.back());
+                attributes.pop_back();
+                done.push_back(attr_node_t<OutputAttr>(std::move(result)));
+            });
+
+        return std::move(done.back().get());
     }
 
     template <typename Attr>
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/backend/error.hpp>
+#include <bullet/ir/ir.hpp>
+#include <bullet/parser/ast.hpp>
+
+namespace bt { namespace backend {
+    // Translates a module of the IR to a C11 translation unit whose main runs
+    // the top level and prints its result, as btc --run does.
+    //
+    // Primitive types map to <stdint.h> ones, bool to bool; structs, arrays
+    // and variants become typedefs of C structs, arrays wrapping a fixed-size
+    // C array and variants a tag and a union, and declared types keep their
+    // name. Functions, nested or not, become static C functions, whose blocks
+    // are labels and values locals. Integer arithmetic goes through unsigned
+    // types, so it wraps at the width of its type without undefined
+    // behaviour, and faults exit with status 1, as in the VM. Throws
+    // backend::error for values it can't translate yet.
+    auto emit_c(const ir::module_t& module, const std::string& name = "bullet") -> std::string;
+
+    // Lowers a type checked program to the IR, unoptimized, and translates
+    // it.
+    auto emit_c(const parser::syntax::attr_node_t<analysis::type_t>& ast,
+                const std::string& name = "bullet") -> std::string;
+
+    // Compiles a translation to an executable with the system's C compiler:
+    // $CC if it is set, cc otherwise. Throws backend::error if it fails.
+    auto compile_c(const std::string& source,
+                   const std::string& output,
+                   const std::string& flags = "-O2") -> void;
+}}  // namespace bt::backend
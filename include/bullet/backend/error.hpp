@@ -0,0 +1,22 @@
+#pragma once
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <bullet/parser/location.hpp>
+
+namespace bt { namespace backend {
+    // Raised by the backends for programs they can't compile yet, for
+    // failures of the toolchain underneath, and for faults at run time.
+    struct error : std::runtime_error {
+        explicit error(const std::string& s) : std::runtime_error(s) {}
+
+        error(const std::string& s, const parser::location_t& l)
+            : std::runtime_error([&] {
+                  auto msg = std::stringstream();
+                  msg << s << ", at " << l << ".";
+                  return msg.str();
+              }()) {}
+    };
+}}  // namespace bt::backend
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/backend/error.hpp>
+#include <bullet/ir/ir.hpp>
+#include <bullet/parser/ast.hpp>
+#include <bullet/vm/bytecode.hpp>
+
+namespace bt { namespace backend {
+    // A module of the IR compiled to an LLVM module: a function for each of
+    // the program's, and bt_main, which runs the top level and returns its
+    // result as a 64-bit word laid out like a vm::value_t.
+    //
+    // Globals of the module become globals, slots stack slots of their
+    // function, arrays fixed-size arrays on the stack. Integer arithmetic
+    // wraps at the width of its type and division by zero faults, as in the
+    // VM. Throws backend::error for values it can't compile yet.
+    class llvm_module_t {
+    public:
+        explicit llvm_module_t(const ir::module_t& module, const std::string& name = "bullet");
+        // Lowers a type checked program to the IR, unoptimized, and compiles
+        // it.
+        explicit llvm_module_t(const parser::syntax::attr_node_t<analysis::type_t>& ast,
+                               const std::string& name = "bullet");
+        llvm_module_t(llvm_module_t&&) noexcept;
+        llvm_module_t& operator=(llvm_module_t&&) noexcept;
+        ~llvm_module_t();
+
+        // Runs LLVM's default pipeline for -O<level>, 0 to 3.
+        auto optimize(int level) -> void;
+
+        // The module as textual IR.
+        auto ir() const -> std::string;
+
+        // Writes an object file for the host, which defines bt_main and
+        // expects the program it is linked into to define
+        // `void bt_fault(const char*)` and `int64_t bt_ipow(int64_t, int64_t)`.
+        auto emit_object(const std::string& path) const -> void;
+
+        // Compiles the module with ORC's LLJIT, on first use, and runs
+        // bt_main. Faults throw backend::error.
+        auto run() -> vm::value_t;
+
+        auto result_type() const -> const analysis::type_t&;
+
+    private:
+        struct impl_t;
+        std::unique_ptr<impl_t> impl_;
+    };
+}}  // namespace bt::backend
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <bullet/parser/location.hpp>
+
+namespace bt { namespace ir {
+    // Raised by the lowering for programs it can't lower yet, and by the
+    // verifier for malformed IR.
+    struct error : std::runtime_error {
+        explicit error(const std::string& s) : std::runtime_error(s) {}
+
+        error(const std::string& s, const parser::location_t& l)
+            : std::runtime_error([&] {
+                  auto msg = std::stringstream();
+                  msg << s << ", at " << l << ".";
+                  return msg.str();
+              }()) {}
+    };
+}}  // namespace bt::ir
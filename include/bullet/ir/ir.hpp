@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/ir/error.hpp>
+#include <bullet/parser/location.hpp>
+
+namespace bt { namespace ir {
+    // The operations of the mid-level IR, which sits between the type
+    // checked AST and the backends. Instructions take values of their
+    // function as operands, and yield a value of the instruction's type.
+    //
+    // Types are the ones the checker attributed, except that literals
+    // nothing gave a type to take the widest one. Integer arithmetic wraps at
+    // the width of its type, f32 arithmetic rounds to float precision, and
+    // integer division by zero faults, as in the VM.
+    enum class opcode_t : std::uint8_t {
+        // a value known at compile time, whose bits are the immediate; the
+        // immediate-th parameter of the function.
+        constant,
+        parameter,
+
+        // arithmetic on operands of the instruction's type; neg and bnot
+        // take one operand. add, sub, mul and div also operate on arrays and
+        // slices of numbers, element by element, into arrays.
+        add,
+        sub,
+        mul,
+        div,
+        rem,
+        pow,
+        neg,
+        band,
+        bor,
+        bxor,
+        bnot,
+
+        // comparisons of two operands of the same type, and the negation of
+        // a bool, yielding a bool; comparisons of arrays and slices of
+        // numbers yield an array of bools, comparing them element by element.
+        eq,
+        ne,
+        lt,
+        le,
+        gt,
+        ge,
+        lnot,
+
+        // the operand converted to the instruction's type, the way the VM
+        // converts values.
+        convert,
+
+        // the address of a variable of the function, which lives as long as
+        // the call does; of the immediate-th global.
+        slot,
+        global,
+        // reads the address given; writes the second operand to the first.
+        load,
+        store,
+
+        // an array of the operands; the number of elements of an array, as a
+        // u64; the element of the first operand at the index given by the
+        // second, faulting when it is out of range.
+        array,
+        length,
+        index,
+        // the slice of the instruction's type of an array or slice operand,
+        // without copying: its value is the storage the operand's elements
+        // are in, which the bounds of the type index, and index indexes
+        // slices there.
+        view,
+        // the sum, the smallest or the largest element of an array or slice
+        // of numbers, as the immediate is analysis::reduction_t::sum, min or
+        // max. Sums of floats add the elements in the order the VM does.
+        reduce,
+        // a string of the text of the operands one after the other: strings
+        // as they are, numbers and bools as the VM prints them, written at
+        // once into storage of the size they take together.
+        format,
+        // Regions: a u64 marking what was allocated so far; frees what was
+        // allocated since the mark operand, which must not be used after.
+        mark,
+        release,
+
+        // calls the immediate-th function of the module with the operands.
+        call,
+        // the operand coming from the predecessor at the same position in
+        // blocks.
+        phi,
+
+        // Terminators, which end every block: to blocks[0]; to blocks[0] if
+        // the operand is true, to blocks[1] otherwise; returns the operand,
+        // or nothing without one.
+        jump,
+        branch,
+        ret,
+
+        count
+    };
+
+    auto opcode_name(opcode_t op) -> std::string_view;
+    auto operator<<(std::ostream& os, opcode_t op) -> std::ostream&;
+
+    auto is_terminator(opcode_t op) -> bool;
+    // Operands which may be listed in any order.
+    auto is_commutative(opcode_t op) -> bool;
+
+    struct instruction_t {
+        opcode_t op = opcode_t::constant;
+        // the type of the value it yields: void if none, a pointer for
+        // addresses.
+        analysis::type_t type = analysis::VOID;
+        std::vector<int> operands;
+        // the blocks a terminator goes to; a phi's incoming blocks, one for
+        // each operand.
+        std::vector<int> blocks;
+        // a constant's bits, as a 64-bit word: integers sign- (signed types)
+        // or zero-extended (unsigned types and bools), floats as a double,
+        // rounded to float precision for f32, the index of their text in the
+        // module's strings for strings, and 0 for the zero value of other
+        // types. The index of a parameter, global or callee.
+        std::uint64_t immediate = 0;
+        // the variable a slot or parameter holds, for listings and for the
+        // names backends give them.
+        std::string name;
+        // what it was lowered from, for the backends' errors.
+        parser::location_t location;
+    };
+
+    struct block_t {
+        // for listings and the backends' labels.
+        std::string name;
+        // the ids of its instructions: phis first, a terminator last.
+        std::vector<int> instructions;
+    };
+
+    struct function_t {
+        std::string name;
+        // the function's type; void for the top level.
+        analysis::type_t type = analysis::VOID;
+        analysis::type_t result_type = analysis::VOID;
+        // every instruction ever created, by id: those no block lists any
+        // more are dead.
+        std::vector<instruction_t> values;
+        // blocks[0] is the entry, which no block branches to.
+        std::vector<block_t> blocks;
+
+        auto add(instruction_t i) -> int;
+
+        auto operator[](int id) -> instruction_t& { return values[id]; }
+        auto operator[](int id) const -> const instruction_t& { return values[id]; }
+
+        auto terminator(int block) const -> const instruction_t& {
+            return values[blocks[block].instructions.back()];
+        }
+        auto successors(int block) const -> const std::vector<int>& {
+            return terminator(block).blocks;
+        }
+    };
+
+    struct global_t {
+        std::string name;
+        analysis::type_t type;
+    };
+
+    // A lowered program. functions[0] is the top level, which takes no
+    // arguments and returns the value of the program's last statement if it
+    // is a number, a bool, an array or a string.
+    struct module_t {
+        std::vector<function_t> functions;
+        std::vector<global_t> globals;
+        // types the program declares, used or not, for backends which name
+        // them.
+        std::vector<analysis::type_t> types;
+        // the text of string constants, each once; the first is empty, the
+        // zero value of strings.
+        std::vector<std::string> strings = {""};
+        analysis::type_t result_type = analysis::VOID;
+    };
+
+    // Whether an instruction only computes its value: deleting it, or
+    // computing it once for two identical ones, changes nothing else. Integer
+    // division is, if it divides by a constant which isn't 0.
+    auto is_pure(const function_t& fn, const instruction_t& i) -> bool;
+    // Whether an instruction allocates the storage of its value, which the
+    // region it is in frees: arrays and strings it makes.
+    auto allocates(const instruction_t& i) -> bool;
+
+    // The type of a pointer to values of type t, as slots and globals have.
+    auto pointer_to(const analysis::type_t& t) -> analysis::type_t;
+
+    // The block listing each value, -1 for values no block lists.
+    auto block_of(const function_t& fn) -> std::vector<int>;
+    // The distinct blocks branching to each block, by increasing index.
+    auto predecessors(const function_t& fn) -> std::vector<std::vector<int>>;
+    // The blocks reachable from the entry, in reverse post order.
+    auto reverse_post_order(const function_t& fn) -> std::vector<int>;
+    // The immediate dominator of each block: the entry's is itself, and
+    // unreachable blocks have -1.
+    auto dominators(const function_t& fn) -> std::vector<int>;
+    auto dominates(const std::vector<int>& idom, int a, int b) -> bool;
+    // The instructions each value is an operand of, among the listed ones.
+    auto users(const function_t& fn) -> std::vector<std::vector<int>>;
+    // Rewrites operands: replacement[v] stands for v where it isn't -1.
+    // Chains of replacements are followed.
+    auto substitute(function_t& fn, std::vector<int> replacement) -> void;
+    // Drops blocks nothing reaches, and the phi operands coming from them,
+    // numbering the others in order. Returns whether any was dropped.
+    auto remove_unreachable(function_t& fn) -> bool;
+
+    // Checks that every block ends with its only terminator, has its phis
+    // first and with an operand for each predecessor, and that operands are
+    // listed values which dominate their uses. Throws ir::error otherwise.
+    auto verify(const module_t& module) -> void;
+
+    auto operator<<(std::ostream& os, const function_t& fn) -> std::ostream&;
+    auto operator<<(std::ostream& os, const module_t& module) -> std::ostream&;
+}}  // namespace bt::ir
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/ir/ir.hpp>
+#include <bullet/parser/ast.hpp>
+
+namespace bt { namespace ir {
+    // Lowers a type checked program to the IR, following the types the
+    // checker attributed, and converting values explicitly where a type is
+    // used as another.
+    //
+    // Every variable becomes a slot of its function, read and written by
+    // loads and stores, and top level variables globals; values flowing out
+    // of conditionals and loops meet in phis.
+    //
+    // Functions are closure converted: the variables of enclosing functions
+    // they use are passed to them after their arguments, so closures which
+    // don't escape need no environment beyond their caller's frame, and no
+    // allocation. Functions taking functions are specialized for the ones
+    // each call passes, which the inliner can then inline. Functions which
+    // escape where they are defined, stored or returned, can't be lowered
+    // yet. Throws ir::error for constructs it can't lower yet.
+    auto lower(const parser::syntax::attr_node_t<analysis::type_t>& ast) -> module_t;
+
+    // The type of the values an expression of type t yields: variables are
+    // read, literals nothing gave a type to take the widest one, and declared
+    // numbers are what they name.
+    auto value_type(const analysis::type_t& t) -> analysis::type_t;
+}}  // namespace bt::ir
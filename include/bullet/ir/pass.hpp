@@ -0,0 +1,81 @@
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <bullet/ir/ir.hpp>
+
+namespace bt { namespace ir {
+    // Transformations of a module, each written once for every backend. They
+    // keep the module verifiable, leave no unreachable blocks, and return
+    // whether they changed anything.
+
+    // Deletes instructions whose values nothing uses and which have no effect,
+    // and stores to slots nothing loads.
+    auto eliminate_dead_code(module_t& module) -> bool;
+
+    // Promotes variables whose address never escapes, which the checker
+    // types as pointers, to SSA values: loads become the value last stored,
+    // with phis where stores meet, and the slot is dropped. Variables read
+    // before any store hold their type's zero value.
+    auto promote_variables(module_t& module) -> bool;
+
+    // Sparse conditional constant propagation: values computed from constants
+    // become constants, folded exactly as the VM computes them, and branches
+    // on constants jumps, dropping the code they skip.
+    auto propagate_constants(module_t& module) -> bool;
+
+    // Global value numbering over the dominator tree: pure instructions
+    // computing what another one dominating them does are replaced by it.
+    // Within a block, loads of an address are replaced by the value last
+    // stored or loaded there, until a call may have changed it.
+    auto number_values(module_t& module) -> bool;
+
+    // Replaces calls to small functions, which don't call themselves, with
+    // their body, once the calls in it have been inlined in turn.
+    auto inline_calls(module_t& module, int threshold = 30) -> bool;
+
+    // Folds branches whose targets are the same, merges blocks into their
+    // only predecessor, skips blocks which only jump, and drops phis with a
+    // single operand.
+    auto simplify_cfg(module_t& module) -> bool;
+
+    // Runs passes in order, timing each.
+    class pass_manager_t {
+    public:
+        using pass_t = std::function<bool(module_t&)>;
+
+        struct statistics_t {
+            std::string name;
+            double seconds = 0;
+            int runs = 0;
+            // runs which changed the module.
+            int changes = 0;
+        };
+
+        auto add(const std::string& name, pass_t pass) -> pass_manager_t&;
+
+        // Runs every pass once, checking the module after each if
+        // verify_each is set. Returns whether any changed it.
+        auto run(module_t& module) -> bool;
+
+        auto statistics() const -> const std::vector<statistics_t>& { return statistics_; }
+
+        bool verify_each = false;
+
+    private:
+        std::vector<std::pair<std::size_t, pass_t>> passes_;
+        // one entry for each distinct name, in the order they were added.
+        std::vector<statistics_t> statistics_;
+    };
+
+    // The passes of an optimization level: none at 0, promotion of variables
+    // and scalar clean-ups at 1, which 2 and up follow promotion with
+    // inlining.
+    auto pipeline(int level) -> pass_manager_t;
+
+    // The time each pass took, and how often it changed the module.
+    auto operator<<(std::ostream& os, const pass_manager_t& passes) -> std::ostream&;
+}}  // namespace bt::ir
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bt { namespace jit {
+    struct error : std::runtime_error {
+        explicit error(const std::string& s) : std::runtime_error(s) {}
+    };
+
+    enum class reg_t : std::uint8_t {
+        rax,
+        rcx,
+        rdx,
+        rbx,
+        rsp,
+        rbp,
+        rsi,
+        rdi,
+        r8,
+        r9,
+        r10,
+        r11,
+        r12,
+        r13,
+        r14,
+        r15
+    };
+
+    enum class xmm_t : std::uint8_t { xmm0, xmm1, xmm2, xmm3 };
+
+    // [base + disp]
+    struct mem_t {
+        reg_t base;
+        std::int32_t disp = 0;
+    };
+
+    // condition codes, as encoded in jcc and setcc.
+    enum class cond_t : std::uint8_t {
+        o,
+        no,
+        b,
+        ae,
+        e,
+        ne,
+        be,
+        a,
+        s,
+        ns,
+        p,
+        np,
+        l,
+        ge,
+        le,
+        g
+    };
+
+    using label_t = int;
+
+    // Encodes the handful of x86-64 instructions the JIT needs. Operands are
+    // 64 bits wide unless the name says otherwise; memory operands are always
+    // a base register and a displacement. Branches go to labels, which may be
+    // bound before or after them.
+    class assembler_t {
+    public:
+        auto label() -> label_t;
+        auto bind(label_t l) -> void;
+
+        auto mov(reg_t dst, mem_t src) -> void;
+        auto mov(mem_t dst, reg_t src) -> void;
+        auto mov(reg_t dst, reg_t src) -> void;
+        auto mov(reg_t dst, std::uint64_t imm) -> void;
+        // the immediate is sign-extended.
+        auto mov(mem_t dst, std::int32_t imm) -> void;
+        auto lea(reg_t dst, mem_t src) -> void;
+
+        auto add(reg_t dst, mem_t src) -> void;
+        auto sub(reg_t dst, mem_t src) -> void;
+        auto and_(reg_t dst, mem_t src) -> void;
+        auto or_(reg_t dst, mem_t src) -> void;
+        auto xor_(reg_t dst, mem_t src) -> void;
+        auto imul(reg_t dst, mem_t src) -> void;
+        auto cmp(reg_t lhs, mem_t rhs) -> void;
+        auto cmp(mem_t lhs, std::int8_t imm) -> void;
+        auto cmp(reg_t lhs, std::int8_t imm) -> void;
+
+        auto and_(reg_t dst, reg_t src) -> void;
+        auto or_(reg_t dst, reg_t src) -> void;
+        auto xor_(reg_t dst, reg_t src) -> void;
+        auto test(reg_t lhs, reg_t rhs) -> void;
+        auto add(reg_t dst, std::int32_t imm) -> void;
+        auto sub(reg_t dst, std::int32_t imm) -> void;
+
+        auto neg(reg_t r) -> void;
+        auto not_(reg_t r) -> void;
+        auto btc(reg_t r, std::uint8_t bit) -> void;
+        // sign-extends rax into rdx.
+        auto cqo() -> void;
+        // rdx:rax divided by r: quotient in rax, remainder in rdx.
+        auto idiv(reg_t r) -> void;
+        auto div(reg_t r) -> void;
+        auto inc(mem_t m) -> void;
+        auto dec(mem_t m) -> void;
+
+        // loads of narrower values, sign- or zero-extended to 64 bits.
+        auto movsx8(reg_t dst, mem_t src) -> void;
+        auto movsx16(reg_t dst, mem_t src) -> void;
+        auto movsx32(reg_t dst, mem_t src) -> void;
+        auto movzx8(reg_t dst, mem_t src) -> void;
+        auto movzx16(reg_t dst, mem_t src) -> void;
+        auto movzx32(reg_t dst, mem_t src) -> void;
+        // dst = the low byte of dst, zero-extended.
+        auto movzx8(reg_t r) -> void;
+        auto setcc(cond_t c, reg_t dst) -> void;
+
+        auto push(reg_t r) -> void;
+        auto pop(reg_t r) -> void;
+        auto jmp(label_t target) -> void;
+        auto jcc(cond_t c, label_t target) -> void;
+        auto call(label_t target) -> void;
+        auto call(reg_t target) -> void;
+        auto ret() -> void;
+
+        auto movsd(xmm_t dst, mem_t src) -> void;
+        auto movsd(mem_t dst, xmm_t src) -> void;
+        auto addsd(xmm_t dst, mem_t src) -> void;
+        auto subsd(xmm_t dst, mem_t src) -> void;
+        auto mulsd(xmm_t dst, mem_t src) -> void;
+        auto divsd(xmm_t dst, mem_t src) -> void;
+        auto ucomisd(xmm_t lhs, mem_t rhs) -> void;
+        auto cvtsi2sd(xmm_t dst, mem_t src) -> void;
+        auto cvttsd2si(reg_t dst, mem_t src) -> void;
+        auto cvtsd2ss(xmm_t dst, xmm_t src) -> void;
+        auto cvtss2sd(xmm_t dst, xmm_t src) -> void;
+
+        // the offset of a bound label.
+        auto offset(label_t l) const -> std::size_t;
+        auto size() const -> std::size_t { return code_.size(); }
+
+        // The code, with every branch resolved. Throws jit::error if a label
+        // is used but never bound.
+        auto finish() -> std::vector<std::uint8_t>;
+
+    private:
+        struct fixup_t {
+            std::size_t at;
+            label_t target;
+        };
+
+        auto byte(std::uint8_t b) -> void { code_.push_back(b); }
+        auto dword(std::uint32_t d) -> void;
+        auto rex(bool wide, int reg, int base, bool force = false) -> void;
+        auto encode(std::initializer_list<std::uint8_t> prefixes,
+                    bool wide,
+                    std::initializer_list<std::uint8_t> opcode,
+                    int reg,
+                    mem_t rm) -> void;
+        auto encode(std::initializer_list<std::uint8_t> prefixes,
+                    bool wide,
+                    std::initializer_list<std::uint8_t> opcode,
+                    int reg,
+                    int rm,
+                    bool byte_registers = false) -> void;
+        auto branch(label_t target) -> void;
+
+        std::vector<std::uint8_t> code_;
+        std::vector<std::ptrdiff_t> labels_;
+        std::vector<fixup_t> fixups_;
+    };
+}}  // namespace bt::jit
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <bullet/jit/assembler.hpp>
+#include <bullet/vm/bytecode.hpp>
+
+namespace bt { namespace jit {
+    // Whether this platform can run native code: Linux on x86-64.
+    auto supported() -> bool;
+
+    // Compiles to x86-64 the functions of a lowered program which take and
+    // return integers, floats and bools only, and call no functions but such
+    // ones; the VM then runs them natively instead of interpreting them. The
+    // top level is always interpreted.
+    //
+    // Each instruction is translated on its own, from a fixed template which
+    // keeps the registers in the VM's frame: a baseline to run numeric code
+    // without interpreting it, not an optimizer. Array operations and a few
+    // arithmetic ones call back into the runtime.
+    //
+    // Returns the number of functions compiled, which is 0 if the platform
+    // isn't supported.
+    auto compile(vm::program_t& program) -> int;
+}}  // namespace bt::jit
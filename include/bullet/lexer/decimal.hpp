@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace bt { namespace lexer { namespace decimal {
+    // Whether the eight bytes at p are all ASCII digits, tested at once.
+    auto is_eight_digits(const char* p) -> bool;
+    // The value of eight ASCII digits, combined pairwise within one word.
+    auto parse_eight_digits(const char* p) -> std::uint32_t;
+
+    // The value of a run of decimal digits, which may contain '_' separators,
+    // or nothing if it doesn't fit in 64 bits.
+    auto to_integer(std::string_view digits) -> std::optional<unsigned long long>;
+
+    // A decimal floating point literal: integer and fraction digits (either
+    // may contain '_' separators) and the decimal exponent which follows them.
+    struct literal_t {
+        std::string_view integer;
+        std::string_view fraction;
+        long long exponent = 0;
+    };
+
+    // The nearest binary64/binary32 value to the literal, ties to even. Exact
+    // cases are computed with a single floating point operation, the rest with
+    // the Eisel-Lemire algorithm; the rare literals it cannot decide are left
+    // to strtod/strtof.
+    auto to_f64(const literal_t& literal) -> double;
+    auto to_f32(const literal_t& literal) -> float;
+}}}  // namespace bt::lexer::decimal
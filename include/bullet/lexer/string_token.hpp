@@ -3,6 +3,7 @@
 #include <iostream>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace bt { namespace lexer {
     struct string_token_t {
@@ -16,6 +17,21 @@ namespace bt { namespace lexer {
         string_token_t& operator=(string_token_t&&) = default;
     };
 
+    // A piece of the text of a string literal: text as it is written, or the
+    // name of a variable between braces, whose value the text interpolates.
+    struct string_piece_t {
+        std::string text;
+        bool interpolated = false;
+
+        auto operator==(const string_piece_t&) const -> bool = default;
+    };
+
+    // The pieces of a literal, in order, text pieces never empty nor next to
+    // each other. "{{" and "}}" stand for braces, and braces around anything
+    // but an identifier are text.
+    auto pieces(const string_token_t& s) -> std::vector<string_piece_t>;
+    auto interpolates(const string_token_t& s) -> bool;
+
     auto token_value(const string_token_t& i) -> std::string_view;
     auto token_symbol(const string_token_t& i) -> std::string_view;
 
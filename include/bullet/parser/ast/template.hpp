@@ -8,6 +8,10 @@
 #include <bullet/parser/ast_fwd.hpp>
 
 namespace bt { namespace parser { namespace syntax {
+    // A template, "def f[T, N: u64](...)" or "type t[T](...)", whose arguments
+    // name its parameters: types, or constants of the type they are given.
+    // With no names, "f[i64, 3]", the arguments instantiate the template the
+    // body names.
     template <typename Attr>
     struct template_t {
         BOOST_HANA_DEFINE_STRUCT(template_t,
@@ -18,7 +22,7 @@ namespace bt { namespace parser { namespace syntax {
 
     template <typename Attr>
     auto operator<<(std::ostream& os, const template_t<Attr>& t) -> std::ostream& {
-        os << "template[args=" << t.arguments << ", body=" << t << "]";
+        os << "template[args=" << t.arguments << ", body=" << t.body << "]";
         return os;
     }
 
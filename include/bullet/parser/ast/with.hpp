@@ -0,0 +1,23 @@
+#pragma once
+
+#include <iostream>
+
+#include <boost/hana/all.hpp>
+
+#include <bullet/parser/ast_fwd.hpp>
+
+namespace bt { namespace parser { namespace syntax {
+
+    template <typename Attr>
+    struct with_t {
+        BOOST_HANA_DEFINE_STRUCT(with_t, (attr_node_t<Attr>, body));
+        auto operator<=>(const with_t&) const = default;
+    };
+
+    template <typename Attr>
+    auto operator<<(std::ostream& os, const with_t<Attr>& w) -> std::ostream& {
+        os << "with[" << w.body << "]";
+        return os;
+    }
+
+}}}  // namespace bt::parser::syntax
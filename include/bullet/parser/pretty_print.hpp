@@ -0,0 +1,209 @@
+#pragma once
+
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include <bullet/parser/ast.hpp>
+#include <bullet/parser/traversal.hpp>
+
+namespace bt { namespace parser {
+    namespace details {
+        inline auto margin(std::stringstream& out, int indent_level) -> std::stringstream& {
+            out << std::string(indent_level, ' ');
+            return out;
+        }
+
+        // Prints the labels which precede the child-th child of a node printed at
+        // indent_level, and returns the indentation of that child, or nothing if
+        // the child isn't printed.
+        template <typename Attr>
+        inline auto print_child_label(const syntax::attr_tree_t<Attr>& tree,
+                                      std::size_t child,
+                                      std::stringstream& out,
+                                      int indent_level) -> std::optional<int> {
+            using namespace syntax;
+            using namespace std;
+
+            const auto label = [&](const auto& text) {
+                margin(out, indent_level + 4) << text << endl;
+                return indent_level + 8;
+            };
+
+            return visit(
+                [&](const auto& e) -> optional<int> {
+                    using E = remove_cv_t<remove_reference_t<decltype(e)>>;
+
+                    if constexpr (is_same_v<E, invoc_t<Attr>>) {
+                        if (child == 0) return label("target:");
+                        if (child == 1) return label("arguments:");
+                        return indent_level + 8;
+                    } else if constexpr (is_same_v<E, if_t<Attr>>) {
+                        if (child == 2 * e.elif_tests.size()) return label("else:");
+                        return label(child % 2 == 0 ? "cond:" : "then:");
+                    } else if constexpr (is_same_v<E, elif_t<Attr>>) {
+                        return label(child == 0 ? "test:" : "then:");
+                    } else if constexpr (is_same_v<E, assign_t<Attr>>) {
+                        return label(child == 0 ? "lhs:" : " rhs:");
+                    } else if constexpr (is_same_v<E, fn_expr_t<Attr>>) {
+                        const auto n = e.arg_types.size();
+                        if (child == 0) label("arguments:");
+                        if (child < n) {
+                            margin(out, indent_level + 8) << "name:" << e.arg_names[child] << endl;
+                            margin(out, indent_level + 8) << "type:" << endl;
+                            return indent_level + 12;
+                        }
+                        if (child == n) return label("result_type:");
+                        if (child == n + 1) return label("body:");
+                        return nullopt;
+                    } else if constexpr (is_same_v<E, let_var_t<Attr>> ||
+                                         is_same_v<E, var_def_t<Attr>>) {
+                        return label(child == 0 ? "type:" : "rhs:");
+                    } else if constexpr (is_same_v<E, for_t<Attr>>) {
+                        return label(child == 0 ? "sequence:" : "body:");
+                    } else if constexpr (is_same_v<E, while_t<Attr>>) {
+                        return label(child == 0 ? "cond:" : "body:");
+                    } else if constexpr (is_same_v<E, with_t<Attr>>) {
+                        return label("body:");
+                    } else if constexpr (is_same_v<E, struct_t<Attr>>) {
+                        margin(out, indent_level + 4) << e[child].first << ":" << endl;
+                        return indent_level + 8;
+                    } else if constexpr (is_same_v<E, def_type_t<Attr>> ||
+                                         is_same_v<E, let_type_t<Attr>>) {
+                        return label("defn:");
+                    } else {
+                        return indent_level + 4;
+                    }
+                },
+                tree);
+        }
+
+        // Prints the heading of a node; false if its children aren't printed.
+        template <typename Attr>
+        inline auto print_heading(const syntax::attr_tree_t<Attr>& tree,
+                                  std::stringstream& out,
+                                  int indent_level) -> bool {
+            using namespace syntax;
+            using namespace std;
+
+            const auto line = [&](const auto&... text) {
+                (margin(out, indent_level) << ... << text) << endl;
+            };
+            const auto field = [&](const auto&... text) {
+                (margin(out, indent_level + 4) << ... << text) << endl;
+            };
+
+            margin(out, indent_level) << "location=" << tree.location << endl;
+            margin(out, indent_level) << "attribute=" << tree.attribute << endl;
+
+            return visit(
+                [&](const auto& e) -> bool {
+                    using E = remove_cv_t<remove_reference_t<decltype(e)>>;
+
+                    if constexpr (is_same_v<E, primitive_type_t> || is_same_v<E, literal_t> ||
+                                  is_same_v<E, lexer::identifier_t>)
+                        line(e);
+                    else if constexpr (is_same_v<E, block_t<Attr>>)
+                        line("block:");
+                    else if constexpr (is_same_v<E, data_t<Attr>>)
+                        line("data:");
+                    else if constexpr (is_same_v<E, unary_op_t<Attr>>) {
+                        line("unary_op:");
+                        field(e.op);
+                    } else if constexpr (is_same_v<E, bin_op_t<Attr>>) {
+                        line("binary_op:");
+                        field(e.op);
+                    } else if constexpr (is_same_v<E, invoc_t<Attr>>)
+                        line("invoke:");
+                    else if constexpr (is_same_v<E, if_t<Attr>>)
+                        line("if:");
+                    else if constexpr (is_same_v<E, elif_t<Attr>>)
+                        line("elif:");
+                    else if constexpr (is_same_v<E, else_t<Attr>>)
+                        line("else:");
+                    else if constexpr (is_same_v<E, assign_t<Attr>>)
+                        line("assign:");
+                    else if constexpr (is_same_v<E, fn_expr_t<Attr>>)
+                        line("fn_expr:");
+                    else if constexpr (is_same_v<E, let_var_t<Attr>>) {
+                        line("let_var:");
+                        field("name:", e.name);
+                    } else if constexpr (is_same_v<E, var_def_t<Attr>>) {
+                        line("var_def:");
+                        field("name:", e.name);
+                        field("n_indirections:", e.n_indirections);
+                    } else if constexpr (is_same_v<E, for_t<Attr>>) {
+                        line("for:");
+                        field("var:", e.var_lhs);
+                    } else if constexpr (is_same_v<E, while_t<Attr>>)
+                        line("while:");
+                    else if constexpr (is_same_v<E, with_t<Attr>>)
+                        line("with:");
+                    else if constexpr (is_same_v<E, break_t>)
+                        line("break");
+                    else if constexpr (is_same_v<E, continue_t>)
+                        line("continue");
+                    else if constexpr (is_same_v<E, type_expr_t<Attr>>)
+                        line("type_expr:");
+                    else if constexpr (is_same_v<E, return_t<Attr>> || is_same_v<E, yield_t<Attr>>)
+                        line("return:");
+                    else if constexpr (is_same_v<E, struct_t<Attr>>)
+                        line("struct:");
+                    else if constexpr (is_same_v<E, def_type_t<Attr>>) {
+                        line("def_type:");
+                        field("name:", e.name);
+                    } else if constexpr (is_same_v<E, let_type_t<Attr>>) {
+                        line("let_type:");
+                        field("name:", e.name);
+                    } else if constexpr (is_same_v<E, template_t<Attr>>) {
+                        line("template");
+                        return false;
+                    } else if constexpr (is_same_v<E, attr_node_t<Attr>>) {
+                        out << e.get();
+                        return false;
+                    }
+                    return true;
+                },
+                tree);
+        }
+    }  // namespace details
+
+    template <typename Attr>
+    inline void pretty_print(const syntax::attr_tree_t<Attr>& tree,
+                             std::stringstream& out,
+                             int indent_level) {
+        using namespace syntax;
+        using node_t = attr_node_t<Attr>;
+
+        // indentation of the nodes entered but not yet left; -1 for nodes which
+        // aren't printed.
+        auto indents = std::vector<int>();
+
+        traverse(
+            node_t(tree),
+            [&](const node_t& node, const traverse_context_t<Attr>& context) {
+                auto indent = std::optional<int>(indent_level);
+                if (context.parent)
+                    indent = details::print_child_label(context.parent->get(), context.index, out,
+                                                        indents.back());
+
+                indents.push_back(indent.value_or(-1));
+                if (!indent || !details::print_heading(node.get(), out, *indent))
+                    return traverse_action_t::skip;
+                return traverse_action_t::descend;
+            },
+            [&](const node_t& node) {
+                const auto indent = indents.back();
+                indents.pop_back();
+
+                // arguments are labelled before the first one, so the label is
+                // still owed when there are none.
+                if (const auto i = node.get().template get_if<invoc_t<Attr>>();
+                    indent >= 0 && i && i->arguments.empty())
+                    details::margin(out, indent + 4) << "arguments:" << std::endl;
+            });
+    }
+}}  // namespace bt::parser
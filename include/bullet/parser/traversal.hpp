@@ -0,0 +1,329 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <bullet/parser/ast.hpp>
+
+namespace bt { namespace parser {
+    // What a visitor wants the traversal to do next. Returned by pre-order
+    // visitors to decide whether to enter the children of a node; returning
+    // stop from either visitor ends the traversal immediately.
+    enum class traverse_action_t { descend, skip, stop };
+
+    // Where a node sits in the tree being traversed.
+    template <typename Attr>
+    struct traverse_context_t {
+        const syntax::attr_node_t<Attr>* parent;  // null for the root
+        std::size_t index;                        // position among the parent's children
+        std::size_t depth;
+    };
+
+    namespace details {
+        // Calls f on every child node of the tree, in evaluation (and printing)
+        // order. Works on const and mutable trees alike.
+        template <typename Tree, typename F>
+        inline auto for_each_child(Tree& tree, F&& f) -> void {
+            using namespace syntax;
+            using Attr = std::remove_cv_t<decltype(tree.attribute)>;
+
+            std::visit(
+                [&](auto& e) {
+                    using E = std::remove_cv_t<std::remove_reference_t<decltype(e)>>;
+
+                    if constexpr (std::is_same_v<E, block_t<Attr>> ||
+                                  std::is_same_v<E, data_t<Attr>>) {
+                        for (auto& n : e) f(n);
+                    } else if constexpr (std::is_same_v<E, unary_op_t<Attr>>) {
+                        f(e.operand);
+                    } else if constexpr (std::is_same_v<E, bin_op_t<Attr>>) {
+                        f(e.lhs);
+                        f(e.rhs);
+                    } else if constexpr (std::is_same_v<E, invoc_t<Attr>>) {
+                        f(e.target);
+                        for (auto& n : e.arguments) f(n);
+                    } else if constexpr (std::is_same_v<E, if_t<Attr>>) {
+                        for (std::size_t j = 0; j < e.elif_tests.size(); j++) {
+                            f(e.elif_tests[j]);
+                            f(e.elif_branches[j]);
+                        }
+                        f(e.else_branch);
+                    } else if constexpr (std::is_same_v<E, elif_t<Attr>>) {
+                        f(e.test);
+                        f(e.body);
+                    } else if constexpr (std::is_same_v<E, else_t<Attr>>) {
+                        f(e.body);
+                    } else if constexpr (std::is_same_v<E, fn_expr_t<Attr>>) {
+                        for (auto& n : e.arg_types) f(n);
+                        f(e.result_type);
+                        f(e.body);
+                        for (auto& p : e.closure_params) f(p.expression);
+                    } else if constexpr (std::is_same_v<E, assign_t<Attr>>) {
+                        f(e.lhs);
+                        f(e.rhs);
+                    } else if constexpr (std::is_same_v<E, let_var_t<Attr>> ||
+                                         std::is_same_v<E, var_def_t<Attr>>) {
+                        f(e.type);
+                        f(e.rhs);
+                    } else if constexpr (std::is_same_v<E, for_t<Attr>>) {
+                        f(e.var_rhs);
+                        f(e.body);
+                    } else if constexpr (std::is_same_v<E, while_t<Attr>>) {
+                        f(e.test);
+                        f(e.body);
+                    } else if constexpr (std::is_same_v<E, type_expr_t<Attr>> ||
+                                         std::is_same_v<E, def_type_t<Attr>> ||
+                                         std::is_same_v<E, let_type_t<Attr>>) {
+                        f(e.type);
+                    } else if constexpr (std::is_same_v<E, return_t<Attr>> ||
+                                         std::is_same_v<E, yield_t<Attr>>) {
+                        f(e.value);
+                    } else if constexpr (std::is_same_v<E, with_t<Attr>>) {
+                        f(e.body);
+                    } else if constexpr (std::is_same_v<E, struct_t<Attr>>) {
+                        for (auto& n : e) f(n.second);
+                    } else if constexpr (std::is_same_v<E, template_t<Attr>>) {
+                        for (auto& n : e.arguments) f(n.second);
+                        f(e.body);
+                    } else if constexpr (std::is_same_v<E, attr_node_t<Attr>>) {
+                        f(e);
+                    }
+                },
+                tree);
+        }
+
+        template <typename Tree>
+        inline auto child_count(const Tree& tree) -> std::size_t {
+            auto n = std::size_t(0);
+            for_each_child(tree, [&](const auto&) { n++; });
+            return n;
+        }
+
+        // Builds the OutputAttr counterpart of a node from its already converted
+        // children, given in for_each_child order. The children are moved from.
+        template <typename OutputAttr, typename InputAttr>
+        inline auto rebuild(const syntax::attr_tree_t<InputAttr>& tree,
+                            syntax::attr_node_t<OutputAttr>* c)
+            -> syntax::attr_tree_t<OutputAttr> {
+            using namespace syntax;
+            using out_tree_t = syntax::attr_tree_t<OutputAttr>;
+            using out_node_t = attr_node_t<OutputAttr>;
+
+            return std::visit(
+                [&](const auto& e) -> out_tree_t {
+                    using E = std::remove_cv_t<std::remove_reference_t<decltype(e)>>;
+
+                    if constexpr (std::is_same_v<E, std::monostate>) {
+                        return out_tree_t();
+                    } else if constexpr (std::is_same_v<E, primitive_type_t> ||
+                                         std::is_same_v<E, literal_t> ||
+                                         std::is_same_v<E, lexer::identifier_t> ||
+                                         std::is_same_v<E, break_t> ||
+                                         std::is_same_v<E, continue_t>) {
+                        return out_tree_t(e);
+                    } else if constexpr (std::is_same_v<E, block_t<InputAttr>>) {
+                        auto o = block_t<OutputAttr>();
+                        o.reserve(e.size());
+                        for (std::size_t j = 0; j < e.size(); j++) o.push_back(std::move(c[j]));
+                        return out_tree_t(std::move(o));
+                    } else if constexpr (std::is_same_v<E, data_t<InputAttr>>) {
+                        auto o = data_t<OutputAttr>();
+                        o.reserve(e.size());
+                        for (std::size_t j = 0; j < e.size(); j++) o.push_back(std::move(c[j]));
+                        return out_tree_t(std::move(o));
+                    } else if constexpr (std::is_same_v<E, unary_op_t<InputAttr>>) {
+                        return out_tree_t(unary_op_t<OutputAttr>{e.op, std::move(c[0])});
+                    } else if constexpr (std::is_same_v<E, bin_op_t<InputAttr>>) {
+                        return out_tree_t(
+                            bin_op_t<OutputAttr>{e.op, std::move(c[0]), std::move(c[1])});
+                    } else if constexpr (std::is_same_v<E, invoc_t<InputAttr>>) {
+                        auto o = invoc_t<OutputAttr>{std::move(c[0])};
+                        o.arguments.reserve(e.arguments.size());
+                        for (std::size_t j = 0; j < e.arguments.size(); j++)
+                            o.arguments.push_back(std::move(c[1 + j]));
+                        return out_tree_t(std::move(o));
+                    } else if constexpr (std::is_same_v<E, if_t<InputAttr>>) {
+                        auto o = if_t<OutputAttr>();
+                        const auto n = e.elif_tests.size();
+                        for (std::size_t j = 0; j < n; j++) {
+                            o.elif_tests.push_back(std::move(c[2 * j]));
+                            o.elif_branches.push_back(std::move(c[2 * j + 1]));
+                        }
+                        o.else_branch = std::move(c[2 * n]);
+                        return out_tree_t(std::move(o));
+                    } else if constexpr (std::is_same_v<E, elif_t<InputAttr>>) {
+                        return out_tree_t(elif_t<OutputAttr>{std::move(c[0]), std::move(c[1])});
+                    } else if constexpr (std::is_same_v<E, else_t<InputAttr>>) {
+                        return out_tree_t(else_t<OutputAttr>{std::move(c[0])});
+                    } else if constexpr (std::is_same_v<E, fn_expr_t<InputAttr>>) {
+                        auto o = fn_expr_t<OutputAttr>();
+                        const auto n = e.arg_types.size();
+                        o.arg_names = e.arg_names;
+                        for (std::size_t j = 0; j < n; j++) o.arg_types.push_back(std::move(c[j]));
+                        o.result_type = std::move(c[n]);
+                        o.body = std::move(c[n + 1]);
+                        for (std::size_t j = 0; j < e.closure_params.size(); j++) {
+                            const auto& p = e.closure_params[j];
+                            o.closure_params.push_back(fn_closure_param_t<OutputAttr>{
+                                p.var, p.identifier, std::move(c[n + 2 + j])});
+                        }
+                        return out_tree_t(std::move(o));
+                    } else if constexpr (std::is_same_v<E, assign_t<InputAttr>>) {
+                        return out_tree_t(assign_t<OutputAttr>{std::move(c[0]), std::move(c[1])});
+                    } else if constexpr (std::is_same_v<E, let_var_t<InputAttr>>) {
+                        return out_tree_t(
+                            let_var_t<OutputAttr>{e.name, std::move(c[0]), std::move(c[1])});
+                    } else if constexpr (std::is_same_v<E, var_def_t<InputAttr>>) {
+                        return out_tree_t(var_def_t<OutputAttr>{e.name, e.n_indirections,
+                                                                std::move(c[0]), std::move(c[1])});
+                    } else if constexpr (std::is_same_v<E, for_t<InputAttr>>) {
+                        return out_tree_t(
+                            for_t<OutputAttr>{e.var_lhs, std::move(c[0]), std::move(c[1])});
+                    } else if constexpr (std::is_same_v<E, while_t<InputAttr>>) {
+                        return out_tree_t(while_t<OutputAttr>{std::move(c[0]), std::move(c[1])});
+                    } else if constexpr (std::is_same_v<E, type_expr_t<InputAttr>>) {
+                        return out_tree_t(type_expr_t<OutputAttr>{std::move(c[0])});
+                    } else if constexpr (std::is_same_v<E, return_t<InputAttr>>) {
+                        return out_tree_t(return_t<OutputAttr>{std::move(c[0])});
+                    } else if constexpr (std::is_same_v<E, yield_t<InputAttr>>) {
+                        return out_tree_t(yield_t<OutputAttr>{std::move(c[0])});
+                    } else if constexpr (std::is_same_v<E, with_t<InputAttr>>) {
+                        return out_tree_t(with_t<OutputAttr>{std::move(c[0])});
+                    } else if constexpr (std::is_same_v<E, struct_t<InputAttr>>) {
+                        auto o = struct_t<OutputAttr>();
+                        for (std::size_t j = 0; j < e.size(); j++)
+                            o.emplace_back(e[j].first, std::move(c[j]));
+                        return out_tree_t(std::move(o));
+                    } else if constexpr (std::is_same_v<E, def_type_t<InputAttr>>) {
+                        return out_tree_t(def_type_t<OutputAttr>{e.name, std::move(c[0])});
+                    } else if constexpr (std::is_same_v<E, let_type_t<InputAttr>>) {
+                        return out_tree_t(let_type_t<OutputAttr>{e.name, std::move(c[0])});
+                    } else if constexpr (std::is_same_v<E, template_t<InputAttr>>) {
+                        auto o = template_t<OutputAttr>();
+                        const auto n = e.arguments.size();
+                        for (std::size_t j = 0; j < n; j++)
+                            o.arguments.emplace_back(e.arguments[j].first, std::move(c[j]));
+                        o.body = std::move(c[n]);
+                        return out_tree_t(std::move(o));
+                    } else {
+                        static_assert(std::is_same_v<E, attr_node_t<InputAttr>>);
+                        return out_tree_t(out_node_t(std::move(c[0])));
+                    }
+                },
+                tree);
+        }
+
+        template <typename F, typename Attr>
+        inline auto invoke_visitor(F& f,
+                                   const syntax::attr_node_t<Attr>& node,
+                                   const traverse_context_t<Attr>& context)
+            -> traverse_action_t {
+            using node_t = syntax::attr_node_t<Attr>;
+            using context_t = traverse_context_t<Attr>;
+
+            if constexpr (std::is_invocable_v<F&, const node_t&, const context_t&>) {
+                if constexpr (std::is_void_v<std::invoke_result_t<F&, const node_t&,
+                                                                  const context_t&>>) {
+                    f(node, context);
+                    return traverse_action_t::descend;
+                } else {
+                    return f(node, context);
+                }
+            } else {
+                if constexpr (std::is_void_v<std::invoke_result_t<F&, const node_t&>>) {
+                    f(node);
+                    return traverse_action_t::descend;
+                } else {
+                    return f(node);
+                }
+            }
+        }
+    }  // namespace details
+
+    // Depth-first traversal driven by an explicit work stack, so the depth of
+    // the tree is bounded by memory rather than by the call stack. pre is
+    // called on entering a node and decides whether its children are visited;
+    // post is called once all of them have been. Visitors take the node and
+    // optionally its traverse_context_t, and may return void (carry on) or a
+    // traverse_action_t. Returns false if a visitor stopped the traversal.
+    template <typename Attr, typename Pre, typename Post>
+    inline auto traverse(const syntax::attr_node_t<Attr>& root, Pre&& pre, Post&& post) -> bool {
+        using node_t = syntax::attr_node_t<Attr>;
+        using context_t = traverse_context_t<Attr>;
+
+        struct frame_t {
+            const node_t* node;
+            context_t context;
+            std::size_t first, count, next;
+        };
+
+        auto frames = std::vector<frame_t>();
+        auto pending = std::vector<const node_t*>();
+
+        const auto enter = [&](const node_t& node, const context_t& context) {
+            const auto action = details::invoke_visitor(pre, node, context);
+            if (action == traverse_action_t::stop) return false;
+
+            const auto first = pending.size();
+            if (action == traverse_action_t::descend)
+                details::for_each_child(node.get(),
+                                        [&](const node_t& child) { pending.push_back(&child); });
+            frames.push_back(frame_t{&node, context, first, pending.size() - first, 0});
+            return true;
+        };
+
+        if (!enter(root, context_t{nullptr, 0, 0})) return false;
+
+        while (!frames.empty()) {
+            auto& top = frames.back();
+            if (top.next < top.count) {
+                const auto i = top.next++;
+                const auto context = context_t{top.node, i, frames.size()};
+                if (!enter(*pending[top.first + i], context)) return false;
+            } else {
+                const auto frame = top;
+                frames.pop_back();
+                pending.resize(frame.first);
+                if (details::invoke_visitor(post, *frame.node, frame.context) ==
+                    traverse_action_t::stop)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    template <typename Attr, typename Pre>
+    inline auto traverse_pre_order(const syntax::attr_node_t<Attr>& root, Pre&& pre) -> bool {
+        return traverse(root, std::forward<Pre>(pre), [](const syntax::attr_node_t<Attr>&) {});
+    }
+
+    template <typename Attr, typename Post>
+    inline auto traverse_post_order(const syntax::attr_node_t<Attr>& root, Post&& post) -> bool {
+        return traverse(root, [](const syntax::attr_node_t<Attr>&) {}, std::forward<Post>(post));
+    }
+
+    // Releases a tree without recursing through the destructors of its nodes,
+    // which would exhaust the call stack on very deep trees. Subtrees still
+    // shared with other owners are left alone. The node is reset to an empty
+    // tree.
+    template <typename Attr>
+    inline auto dismantle(syntax::attr_node_t<Attr>& root) -> void {
+        using node_t = syntax::attr_node_t<Attr>;
+
+        auto stack = std::vector<node_t>();
+        stack.push_back(std::move(root));
+        root = node_t();
+
+        while (!stack.empty()) {
+            auto node = std::move(stack.back());
+            stack.pop_back();
+            if (node.value.use_count() == 1)
+                details::for_each_child(node.get(),
+                                        [&](node_t& child) { stack.push_back(std::move(child)); });
+        }
+    }
+}}  // namespace bt::parser
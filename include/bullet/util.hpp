@@ -19,7 +19,7 @@ namespace file = boost::filesystem;
 using namespace std::literals;
 using clock = std::chrono::system_clock;
 
-auto match = [](auto&& x, auto&&... fn) {
+inline auto match = [](auto&& x, auto&&... fn) {
     return std::visit(boost::hana::overload(std::forward(fn)...), std::forward(x));
 };
 
@@ -65,10 +65,13 @@ struct ref {
     ptr<T> value;
 
     ref(const T& t) : value{std::make_shared<T>(t)} {}
+    ref(T&& t) : value{std::make_shared<T>(std::move(t))} {}
 
     ref() : value{std::make_shared<T>()} {}
     ref(const ref&) = default;
+    ref(ref&&) noexcept = default;
     ref& operator=(const ref&) = default;
+    ref& operator=(ref&&) noexcept = default;
     ref& operator=(const T& t) {
         value = std::make_shared<T>(t);
         return *this;
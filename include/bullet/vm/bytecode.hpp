@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/vm/string.hpp>
+
+namespace bt { namespace vm {
+    // The operations of the VM. Operands name registers of the current frame
+    // unless noted otherwise: A is the destination, B and C the sources.
+    //
+    // Values are untyped 64 bit words; the opcode says how to read them.
+    // Integers are kept sign- (signed types) or zero-extended (unsigned types)
+    // to 64 bits, so arithmetic is done on full words and only results of
+    // narrower types are truncated again. f32 values are kept as doubles
+    // rounded to float precision, which yields the correctly rounded f32
+    // result for every arithmetic operation.
+    enum class opcode_t : std::uint8_t {
+        // A = B; A = constants[Bx]; A = sBx; A = globals[Bx]; globals[Bx] = A.
+        move,
+        loadk,
+        loadi,
+        getg,
+        setg,
+
+        // A = B op C on 64 bit words; neg_i and bnot take B only.
+        add_i,
+        sub_i,
+        mul_i,
+        div_i,
+        div_u,
+        rem_i,
+        rem_u,
+        pow_i,
+        neg_i,
+        band,
+        bor,
+        bxor,
+        bnot,
+
+        // A = B op C on doubles; neg_f takes B only.
+        add_f,
+        sub_f,
+        mul_f,
+        div_f,
+        rem_f,
+        pow_f,
+        neg_f,
+
+        // A = B op C, as 0 or 1; not_b takes B only.
+        eq_i,
+        ne_i,
+        lt_i,
+        le_i,
+        lt_u,
+        le_u,
+        eq_f,
+        ne_f,
+        lt_f,
+        le_f,
+        not_b,
+
+        // A = B converted: int64 or uint64 to double and back, truncation to
+        // 8, 16 or 32 bits followed by sign or zero extension, and rounding to
+        // float precision.
+        i2f,
+        u2f,
+        f2i,
+        f2u,
+        sext8,
+        sext16,
+        sext32,
+        zext8,
+        zext16,
+        zext32,
+        round_f32,
+
+        // A = an array of the C registers from B on; A = the length of array
+        // B; A = B[C], bounds checked.
+        newarr,
+        len,
+        index,
+        // A = the array of kernel C (see kernels.hpp) applied to the elements
+        // of the arrays B and B + 1, of the same length; A = reduction C of
+        // the elements of array B.
+        kernel,
+        reduce,
+        // The same on elements of arrays stride elements apart: B, B + 1 and
+        // B + 2 are the array, the first element and the stride of one
+        // operand, B + 3 to B + 5 those of the other and B + 6 the number of
+        // elements; B to B + 3 those of the elements reduced.
+        kernel_strided,
+        reduce_strided,
+        // A = the string of the C values from B + 1 on, written one after the
+        // other as the array B of piece_t (see string.hpp) says.
+        format,
+        // A = a mark of what is allocated so far; frees everything allocated
+        // since the mark A was taken.
+        mark,
+        release,
+
+        // pc += sJ; if A: pc += sBx; if not A: pc += sBx.
+        jmp,
+        jmp_if,
+        jmp_ifnot,
+        // A = functions[Bx](A, A + 1, ...): the callee's frame starts at A.
+        call,
+        // returns A to the caller.
+        ret,
+
+        // Superinstructions, which only vm::fuse emits. Each does the work of
+        // the instruction it replaces and of the one or two following it,
+        // which stay in place: their operands are read from there, and jumps
+        // to them still run them on their own.
+        //
+        // compare, then jmp_ifnot; loadi, then add_i or sub_i; getg, add_i,
+        // then setg; add_i, then jmp.
+        lt_i_jmp_ifnot,
+        le_i_jmp_ifnot,
+        lt_u_jmp_ifnot,
+        le_u_jmp_ifnot,
+        eq_i_jmp_ifnot,
+        ne_i_jmp_ifnot,
+        loadi_add_i,
+        loadi_sub_i,
+        getg_add_i_setg,
+        add_i_jmp,
+
+        count
+    };
+
+    auto opcode_name(opcode_t op) -> std::string_view;
+    // The number of instruction words an operation spans: 1 except for
+    // superinstructions.
+    auto opcode_length(opcode_t op) -> int;
+    auto operator<<(std::ostream& os, opcode_t op) -> std::ostream&;
+
+    // Instructions are 32 bits wide: an opcode in the low byte followed by
+    // three 8 bit operands A, B and C; or by A and a 16 bit operand Bx (sBx
+    // when signed); or by a signed 24 bit offset sJ. Jump offsets are relative
+    // to the instruction following the jump.
+    class instruction_t {
+        std::uint32_t bits_ = 0;
+
+        constexpr explicit instruction_t(std::uint32_t bits) : bits_(bits) {}
+
+    public:
+        constexpr instruction_t() = default;
+
+        static constexpr auto abc(opcode_t op, int a, int b, int c) -> instruction_t {
+            return instruction_t(std::uint32_t(op) | std::uint32_t(a & 0xff) << 8 |
+                                 std::uint32_t(b & 0xff) << 16 | std::uint32_t(c & 0xff) << 24);
+        }
+
+        static constexpr auto abx(opcode_t op, int a, int bx) -> instruction_t {
+            return instruction_t(std::uint32_t(op) | std::uint32_t(a & 0xff) << 8 |
+                                 std::uint32_t(bx & 0xffff) << 16);
+        }
+
+        static constexpr auto sj(opcode_t op, int offset) -> instruction_t {
+            return instruction_t(std::uint32_t(op) | std::uint32_t(offset) << 8);
+        }
+
+        constexpr auto op() const -> opcode_t { return opcode_t(bits_ & 0xff); }
+        constexpr auto a() const -> int { return (bits_ >> 8) & 0xff; }
+        constexpr auto b() const -> int { return (bits_ >> 16) & 0xff; }
+        constexpr auto c() const -> int { return bits_ >> 24; }
+        constexpr auto bx() const -> int { return bits_ >> 16; }
+        constexpr auto sbx() const -> int { return std::int16_t(bits_ >> 16); }
+        constexpr auto sj() const -> int { return std::int32_t(bits_) >> 8; }
+
+        constexpr auto bits() const -> std::uint32_t { return bits_; }
+
+        // the same instruction with another operation, for fusing.
+        constexpr auto with_op(opcode_t op) const -> instruction_t {
+            return instruction_t((bits_ & ~std::uint32_t(0xff)) | std::uint32_t(op));
+        }
+
+        // retargets a jump once its destination is known.
+        auto patch(int offset) -> void;
+
+        static constexpr int max_register = 0xff;
+        static constexpr int max_bx = 0xffff;
+        static constexpr int min_sbx = -0x8000;
+        static constexpr int max_sbx = 0x7fff;
+        static constexpr int min_sj = -0x800000;
+        static constexpr int max_sj = 0x7fffff;
+    };
+
+    static_assert(sizeof(instruction_t) == 4);
+
+    auto operator<<(std::ostream& os, instruction_t i) -> std::ostream&;
+
+    union value_t {
+        std::int64_t i;
+        std::uint64_t u;
+        double f;
+        const std::pmr::vector<value_t>* a;
+        const string_t* s;
+    };
+
+    static_assert(sizeof(value_t) == 8);
+
+    // Arrays the program creates are allocated in the VM's arena, elements
+    // included; those of constants, on the heap.
+    using array_t = std::pmr::vector<value_t>;
+
+    // The state native code shares with the VM running it.
+    struct native_context_t {
+        value_t* globals;
+        const value_t* stack_end;
+        // calls native code may still nest before the stack overflows.
+        std::int64_t depth;
+        // why native code stopped, if it failed; nullptr otherwise.
+        const char* fault;
+        // where arrays and strings are allocated.
+        arena_t* arena;
+    };
+
+    // Native code for a function: runs it on the frame at base, as the VM
+    // would, leaving its result in base[0]. On failure, it sets the
+    // context's fault and returns.
+    using native_t = void (*)(value_t* base, native_context_t* context);
+
+    struct function_t {
+        std::string name;
+        int n_parameters = 0;
+        // registers used by a frame, parameters included.
+        int n_registers = 1;
+        std::vector<instruction_t> code;
+        std::vector<value_t> constants;
+        // the function's type; void for the top level.
+        analysis::type_t type = analysis::VOID;
+    };
+
+    // A lowered program. functions[0] is the top level, which takes no
+    // arguments and returns the value of the program's last statement.
+    struct program_t {
+        std::vector<function_t> functions;
+        std::vector<std::string> globals;
+        // arrays referenced by constants, and the string literals, sealed
+        // once the program is lowered.
+        std::vector<std::unique_ptr<array_t>> arrays;
+        literal_pool_t literals;
+        analysis::type_t result_type = analysis::VOID;
+        // native code of the functions jit::compile compiled, null for the
+        // others, and the memory holding it.
+        std::vector<native_t> native;
+        std::shared_ptr<const void> native_code;
+    };
+
+    // base ** exponent, wrapping around like the other integer operations;
+    // negative exponents truncate the result towards 0.
+    auto ipow(std::int64_t base, std::int64_t exponent) -> std::int64_t;
+
+    // A listing of every function, for tracing.
+    auto operator<<(std::ostream& os, const program_t& program) -> std::ostream&;
+
+    // Prints a value the way a literal of its type would be written.
+    auto print_value(std::ostream& os, value_t value, const analysis::type_t& type) -> void;
+}}  // namespace bt::vm
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <immer/map.hpp>
+#include <immer/memory_policy.hpp>
+#include <immer/set.hpp>
+#include <immer/vector.hpp>
+
+#include <bullet/vm/bytecode.hpp>
+#include <bullet/vm/heap.hpp>
+
+namespace bt { namespace vm {
+    // The heap of the collections programs make: the arena of the VM running
+    // on the thread, which frees their nodes along with everything else it
+    // holds. Outside of a run, which only the static owner of immer's
+    // transients allocates in, memory comes from malloc, and is never freed.
+    struct arena_heap_t {
+        // Makes the heap of the thread allocate in an arena while it exists.
+        class scope_t {
+        public:
+            explicit scope_t(arena_t& arena);
+            scope_t(const scope_t&) = delete;
+            auto operator=(const scope_t&) -> scope_t& = delete;
+            ~scope_t();
+
+        private:
+            arena_t* outer_;
+        };
+
+        template <typename... Tags>
+        static auto allocate(std::size_t n, Tags...) -> void* {
+            return arena ? arena->bump(n) : allocate_unowned(n);
+        }
+
+        template <typename... Tags>
+        static auto deallocate(std::size_t, void*, Tags...) -> void {}
+
+    private:
+        static auto allocate_unowned(std::size_t n) -> void*;
+
+        static thread_local arena_t* arena;
+    };
+
+    // How collections hold their nodes, as immer::memory_policy says: the
+    // refcounted policy frees each node once nothing refers to it, and the
+    // region policy counts nothing, keeping nodes in the arena until it is
+    // released, as immer's garbage collected policy keeps them until they
+    // are collected. Both share nodes between the versions of a collection,
+    // so copies are O(1) and updates copy O(log n) of it.
+    using refcounted_policy = immer::default_memory_policy;
+    using region_policy = immer::memory_policy<immer::heap_policy<arena_heap_t>,
+                                               immer::no_refcount_policy>;
+
+    // Keys are words, compared and hashed by their bits.
+    struct key_hash_t {
+        auto operator()(std::uint64_t key) const -> std::size_t {
+            key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9u;
+            key = (key ^ (key >> 27)) * 0x94d049bb133111ebu;
+            return std::size_t(key ^ (key >> 31));
+        }
+    };
+
+    template <typename MemoryPolicy>
+    struct collections_t {
+        using vector_t = immer::vector<value_t, MemoryPolicy>;
+        using map_t = immer::
+            map<std::uint64_t, value_t, key_hash_t, std::equal_to<std::uint64_t>, MemoryPolicy>;
+        using set_t =
+            immer::set<std::uint64_t, key_hash_t, std::equal_to<std::uint64_t>, MemoryPolicy>;
+    };
+
+    // The collections of programs, which the VM and native code keep in the
+    // arena as they do arrays: nothing is destroyed, and the region policy
+    // frees their nodes with them.
+    using runtime_collections_t = collections_t<region_policy>;
+
+    struct persistent_vector_t {
+        runtime_collections_t::vector_t items;
+    };
+
+    struct persistent_map_t {
+        runtime_collections_t::map_t items;
+    };
+
+    struct persistent_set_t {
+        runtime_collections_t::set_t items;
+    };
+
+    // What the collection instructions do, to the kind of collection their
+    // code says:
+    //
+    //   make     an empty collection
+    //   from     a vector or set of the elements of the array args[0],
+    //            vectors built through a transient
+    //   push     args[0] with args[1] appended
+    //   get      the element at index args[1], or the value of key args[1]
+    //   put      args[0] with the element at index args[1], or the value of
+    //            key args[1], set to args[2]
+    //   has      whether the key or element args[1] is in args[0]
+    //   insert   the set args[0] with args[1] added
+    //   size     the number of elements or keys, as a u64
+    //   extend   the vector args[0] with the elements of the array args[1]
+    //            appended, through a transient
+    enum class collection_op_t : std::uint8_t {
+        make,
+        from,
+        push,
+        get,
+        put,
+        has,
+        insert,
+        size,
+        extend,
+    };
+
+    enum class collection_kind_t : std::uint8_t { vector, map, set };
+
+    // The code of an operation on a kind of collection, as the C operand of
+    // the VM's collection instruction.
+    constexpr auto collection_code(collection_op_t op, collection_kind_t kind) -> int {
+        return int(op) | int(kind) << 4;
+    }
+
+    // Runs the operation of a code on args, setting result: the message of
+    // the fault it raises, like an index out of range or a missing key, or
+    // nullptr. New collections are allocated in the arena.
+    auto collection(int code, const value_t* args, value_t& result, arena_t& arena)
+        -> const char*;
+}}  // namespace bt::vm
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <bullet/parser/location.hpp>
+
+namespace bt { namespace vm {
+    // Raised by the lowering for programs the VM can't run, and by the VM for
+    // faults at run time (division by zero, exhausted stack, ...).
+    struct error : std::runtime_error {
+        explicit error(const std::string& s) : std::runtime_error(s) {}
+
+        error(const std::string& s, const parser::location_t& l)
+            : std::runtime_error([&] {
+                  auto msg = std::stringstream();
+                  msg << s << ", at " << l << ".";
+                  return msg.str();
+              }()) {}
+    };
+}}  // namespace bt::vm
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <bullet/vm/bytecode.hpp>
+
+namespace bt { namespace vm {
+    // How often each operation was executed right after another one, as
+    // recorded by vm_t::run(program, profile).
+    class profile_t {
+    public:
+        struct pair_t {
+            opcode_t first;
+            opcode_t second;
+            std::uint64_t count;
+        };
+
+        profile_t();
+
+        auto record(opcode_t first, opcode_t second) -> void {
+            pairs_[std::size_t(first) * n + std::size_t(second)]++;
+        }
+
+        auto count(opcode_t first, opcode_t second) const -> std::uint64_t {
+            return pairs_[std::size_t(first) * n + std::size_t(second)];
+        }
+
+        // pairs executed, in total.
+        auto total() const -> std::uint64_t;
+
+        // the n most frequent pairs, most frequent first.
+        auto hottest(std::size_t n) const -> std::vector<pair_t>;
+
+    private:
+        static constexpr auto n = std::size_t(opcode_t::count);
+
+        std::vector<std::uint64_t> pairs_;
+    };
+
+    // Lists the ten most frequent pairs.
+    auto operator<<(std::ostream& os, const profile_t& profile) -> std::ostream&;
+
+    // Replaces sequences of instructions by superinstructions, where the
+    // profile shows the sequence to account for at least `threshold` of the
+    // pairs executed. Sequences are fused from the start of each function on,
+    // preferring the most frequent one where several start at the same
+    // instruction. Returns the number of superinstructions introduced.
+    auto fuse(program_t& program, const profile_t& profile, double threshold = 0.01) -> int;
+}}  // namespace bt::vm
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace bt { namespace vm {
+    // The memory programs allocate while they run.
+    //
+    // Blocks of up to max_block_size bytes come from pools of blocks of a few
+    // sizes, powers of two from 16 bytes: freeing a block puts it on the
+    // freeing thread's list of blocks of its size, which the next allocations
+    // of that size on the thread take from, without locking. Larger blocks
+    // come from malloc.
+    constexpr std::size_t max_block_size = 2048;
+
+    auto allocate_block(std::size_t n) -> void*;
+    // frees a block allocated with the same size.
+    auto free_block(void* p, std::size_t n) noexcept -> void;
+
+    // A region of memory which allocates by bumping a pointer through chunks
+    // of it, and frees everything at once: all of it, or all that was
+    // allocated since a mark, in time proportional to the chunks freed.
+    // Nothing allocated in an arena is destroyed: it holds values which
+    // needn't be, like arrays whose elements it also holds, and strings
+    // borrowing their text from it.
+    //
+    // Chunks of chunk_size bytes are kept on a list shared by the threads
+    // when freed, for arenas to take them from; larger allocations get a
+    // chunk of their own.
+    class arena_t : public std::pmr::memory_resource {
+    public:
+        static constexpr std::size_t chunk_size = std::size_t(64) << 10;
+
+        // How much of an arena is in use: the chunks it uses, in the top
+        // bits, and the bytes used of the last one.
+        using mark_t = std::uint64_t;
+
+        arena_t() = default;
+        arena_t(const arena_t&) = delete;
+        auto operator=(const arena_t&) -> arena_t& = delete;
+        ~arena_t() override;
+
+        auto bump(std::size_t n, std::size_t alignment = alignof(std::max_align_t)) -> void* {
+            const auto at = (reinterpret_cast<std::uintptr_t>(next_) + alignment - 1) &
+                            ~std::uintptr_t(alignment - 1);
+            if (!next_ || at + n > reinterpret_cast<std::uintptr_t>(end_))
+                return grow(n, alignment);
+            next_ = reinterpret_cast<char*>(at + n);
+            return reinterpret_cast<void*>(at);
+        }
+
+        template <typename T, typename... Args>
+        auto make(Args&&... args) -> T* {
+            return new (bump(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        auto mark() const -> mark_t;
+        // Frees what was allocated since the mark was taken.
+        auto release(mark_t mark) -> void;
+        auto clear() -> void { release(0); }
+
+        auto chunks() const -> std::size_t { return chunks_.size(); }
+
+    private:
+        struct chunk_t {
+            char* data;
+            std::size_t size;
+        };
+
+        auto grow(std::size_t n, std::size_t alignment) -> void*;
+
+        auto do_allocate(std::size_t n, std::size_t alignment) -> void* override {
+            return bump(n ? n : 1, alignment);
+        }
+        auto do_deallocate(void*, std::size_t, std::size_t) -> void override {}
+        auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override {
+            return this == &other;
+        }
+
+        std::vector<chunk_t> chunks_;
+        char* next_ = nullptr;
+        char* end_ = nullptr;
+    };
+}}  // namespace bt::vm
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/vm/bytecode.hpp>
+
+namespace bt { namespace vm {
+    // The kernels operating on whole arrays of numbers, which the VM runs
+    // for element-wise arithmetic, comparisons and reductions. Elements are
+    // the VM's 64 bit words, kept as it keeps values of their type.
+    //
+    // Kernels are compiled once for each of the vector instruction sets below
+    // and run with the widest one the processor supports, as CPUID tells, or
+    // one word at a time elsewhere. They compute the same results whichever
+    // one runs: reductions of floats, which depend on the order elements are
+    // combined in, keep eight partial results whatever the width of vectors,
+    // element k going to partial k % 8, and combine them pairwise, as
+    // ((p0 . p1) . (p2 . p3)) . ((p4 . p5) . (p6 . p7)).
+
+    // The element types of arrays kernels operate on.
+    enum class lane_t : std::uint8_t { i8, i16, i32, i64, u8, u16, u32, u64, f32, f64, count };
+
+    // Element-wise operations: A op B, the comparisons yielding 0 or 1.
+    enum class kernel_op_t : std::uint8_t { add, sub, mul, div, eq, ne, lt, le, count };
+
+    // Reductions to the sum, the smallest or the largest element. min and
+    // max keep the first of two elements unless the second is less, or
+    // greater; sums of integers wrap around.
+    enum class reduction_t : std::uint8_t { sum, min, max, count };
+
+    enum class isa_t : std::uint8_t { scalar, sse4_2, avx2, avx512 };
+
+    // The lane of arrays whose elements have type t, if kernels take them.
+    auto lane(const analysis::type_t& t) -> std::optional<lane_t>;
+
+    // The widest instruction set of the processor kernels have a version
+    // for, detected on the first call.
+    auto detect_isa() -> isa_t;
+    auto isa_name(isa_t isa) -> std::string_view;
+
+    // out[k] = a[k] op b[k] for the n elements of a and b, with the
+    // instructions of isa, which must be supported. False if an integer
+    // division by zero stopped it, leaving out partly written.
+    auto elementwise(kernel_op_t op,
+                     lane_t lane,
+                     const value_t* a,
+                     const value_t* b,
+                     value_t* out,
+                     std::size_t n,
+                     isa_t isa = detect_isa()) -> bool;
+
+    // The same for elements a_stride and b_stride words apart: out[k] =
+    // a[k * a_stride] op b[k * b_stride]. Vector instruction sets gather
+    // elements which aren't next to each other.
+    auto elementwise(kernel_op_t op,
+                     lane_t lane,
+                     const value_t* a,
+                     std::ptrdiff_t a_stride,
+                     const value_t* b,
+                     std::ptrdiff_t b_stride,
+                     value_t* out,
+                     std::size_t n,
+                     isa_t isa = detect_isa()) -> bool;
+
+    // Reduces the n elements of a, at least one; stride words apart.
+    auto reduce(reduction_t r,
+                lane_t lane,
+                const value_t* a,
+                std::size_t n,
+                isa_t isa = detect_isa()) -> value_t;
+    auto reduce(reduction_t r,
+                lane_t lane,
+                const value_t* a,
+                std::ptrdiff_t stride,
+                std::size_t n,
+                isa_t isa = detect_isa()) -> value_t;
+
+    // Whether the n elements of a view, three registers holding an array,
+    // the index of the first element and how far apart elements are, are
+    // elements of the array.
+    auto in_view(const value_t* view, std::size_t n) -> bool;
+
+    // How instructions name a kernel in an 8 bit operand.
+    constexpr auto kernel_code(kernel_op_t op, lane_t lane) -> int {
+        return int(op) << 4 | int(lane);
+    }
+    constexpr auto kernel_code(reduction_t r, lane_t lane) -> int {
+        return int(r) << 4 | int(lane);
+    }
+    constexpr auto code_lane(int code) -> lane_t { return lane_t(code & 0xf); }
+}}  // namespace bt::vm
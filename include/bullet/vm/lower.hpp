@@ -0,0 +1,25 @@
+#pragma once
+
+#include <bullet/analysis/type.hpp>
+#include <bullet/ir/ir.hpp>
+#include <bullet/parser/ast.hpp>
+#include <bullet/vm/bytecode.hpp>
+#include <bullet/vm/error.hpp>
+
+namespace bt { namespace vm {
+    // Compiles a module of the IR to bytecode, following the types of its
+    // values: an i32 addition wraps at 32 bits, an f32 one rounds to float
+    // precision.
+    //
+    // Globals of the module become globals of the VM, variables a register of
+    // their function's frame each and other values registers allocated over
+    // the intervals they are live in. Throws vm::error for values the VM
+    // can't hold yet.
+    auto lower(const ir::module_t& module) -> program_t;
+
+    // Lowers a type checked program to the IR, unoptimized, and compiles it.
+    // Functions may refer to globals and to other functions, but not capture
+    // the variables of the functions enclosing them. Throws vm::error for
+    // constructs the VM can't run yet.
+    auto lower(const parser::syntax::attr_node_t<analysis::type_t>& ast) -> program_t;
+}}  // namespace bt::vm
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <bullet/vm/heap.hpp>
+
+namespace bt { namespace vm {
+    union value_t;
+
+    // The strings of programs the VM runs: bytes of text, which don't change
+    // once built. Strings of up to small_capacity bytes are kept in the 24
+    // bytes of the object itself; longer ones own a block of the heap, or
+    // borrow text which outlives them, like that of a literal, without
+    // copying it.
+    //
+    // Strings have a single owner: they are moved, and clone() copies them,
+    // except that copies of borrowed strings borrow the same text.
+    class string_t {
+    public:
+        static constexpr std::size_t small_capacity = 23;
+
+        string_t() noexcept;
+        explicit string_t(std::string_view text);
+
+        string_t(string_t&& other) noexcept;
+        auto operator=(string_t&& other) noexcept -> string_t&;
+        string_t(const string_t&) = delete;
+        auto operator=(const string_t&) -> string_t& = delete;
+
+        ~string_t();
+
+        // A string viewing text which outlives it.
+        static auto borrow(std::string_view text) noexcept -> string_t;
+        // A string of n bytes, which buffer() writes before anything reads
+        // them.
+        static auto uninitialized(std::size_t n) -> string_t;
+
+        auto clone() const -> string_t;
+
+        auto data() const noexcept -> const char*;
+        auto size() const noexcept -> std::size_t;
+        auto view() const noexcept -> std::string_view { return {data(), size()}; }
+
+        // The bytes of a string which doesn't borrow them.
+        auto buffer() noexcept -> char*;
+
+        auto is_small() const noexcept -> bool { return tag() <= small_capacity; }
+        auto is_borrowed() const noexcept -> bool;
+
+    private:
+        // Small strings keep small_capacity - size in their last byte, which
+        // is 0, ending the text, when they are full. The others keep their
+        // text's address, size and capacity, 0 if they borrow it, with the
+        // last byte of the capacity, as it is little endian, set to large.
+        struct large_t {
+            char* data;
+            std::size_t size;
+            std::size_t capacity;
+        };
+
+        static constexpr unsigned char large = 0x80;
+
+        auto tag() const noexcept -> unsigned char { return bytes_[sizeof bytes_ - 1]; }
+        auto get() const noexcept -> large_t;
+        auto set(char* data, std::size_t size, std::size_t capacity) noexcept -> void;
+        auto reset() noexcept -> void;
+
+        alignas(large_t) unsigned char bytes_[sizeof(large_t)];
+    };
+
+    static_assert(sizeof(string_t) == 24);
+
+    auto operator==(const string_t& lhs, const string_t& rhs) -> bool;
+    auto operator<<(std::ostream& os, const string_t& s) -> std::ostream&;
+
+    // The string literals of a program, each stored once: interning equal
+    // text yields the same string. Sealing moves the text of the literals
+    // interned so far to pages mapped read only, which they then borrow.
+    class literal_pool_t {
+    public:
+        literal_pool_t();
+        literal_pool_t(literal_pool_t&&) noexcept;
+        auto operator=(literal_pool_t&&) noexcept -> literal_pool_t&;
+        ~literal_pool_t();
+
+        // The literal with this text, which stays where it is for as long as
+        // the pool does.
+        auto intern(std::string_view text) -> const string_t*;
+        auto seal() -> void;
+
+        auto size() const -> std::size_t { return literals_.size(); }
+        // the bytes the text of the literals takes.
+        auto bytes() const -> std::size_t { return bytes_; }
+
+    private:
+        struct pages_t;
+
+        std::unordered_map<std::string, const string_t*> index_;
+        std::vector<std::unique_ptr<string_t>> literals_;
+        std::vector<std::unique_ptr<pages_t>> pages_;
+        // literals whose text is in the pages.
+        std::size_t sealed_ = 0;
+        std::size_t bytes_ = 0;
+    };
+
+    // How format writes a value as text: strings as they are, numbers and
+    // bools as print_value does.
+    enum class piece_t : std::uint8_t { text, signed_int, unsigned_int, f32, f64, boolean };
+
+    // The text of the n values, one after the other, as pieces[k].u says to
+    // write values[k]: a string allocated in the arena, along with its text,
+    // once, of the size they take together.
+    auto format(const value_t* values, const value_t* pieces, std::size_t n, arena_t& arena)
+        -> const string_t*;
+}}  // namespace bt::vm
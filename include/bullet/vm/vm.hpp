@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <bullet/vm/bytecode.hpp>
+#include <bullet/vm/error.hpp>
+#include <bullet/vm/fuse.hpp>
+#include <bullet/vm/heap.hpp>
+
+namespace bt { namespace vm {
+    // Runs lowered programs. All frames live on one register stack: a callee's
+    // frame starts at the register holding its first argument, so arguments
+    // are passed without copying and the result is left where the caller
+    // expects it. Functions with native code run on the same frames.
+    //
+    // Instructions are dispatched through a switch, or, when built with
+    // BT_VM_THREADED_DISPATCH and a compiler supporting computed gotos, by
+    // jumping from each handler straight to the next one's address.
+    class vm_t {
+    public:
+        static constexpr std::size_t default_stack_size = std::size_t(1) << 20;
+
+        explicit vm_t(std::size_t stack_size = default_stack_size);
+
+        // The value the top level returns. Arrays and strings created by the
+        // program, outside the regions it frees, stay alive until the next
+        // run.
+        auto run(const program_t& program) -> value_t;
+        // Runs a program, recording in the profile which operations follow
+        // each other.
+        auto run(const program_t& program, profile_t& profile) -> value_t;
+
+        // Instructions interpreted by the last run, a superinstruction
+        // counting as the instructions it replaces; functions running as
+        // native code count none.
+        auto executed() const -> std::uint64_t { return executed_; }
+        // What the program allocated, and didn't free, in the last run.
+        auto arena() const -> const arena_t& { return arena_; }
+
+        // "threaded" or "switch".
+        static auto dispatch() -> std::string_view;
+
+    private:
+        // an instruction along with the address of its handler.
+        struct threaded_t {
+            const void* handler;
+            instruction_t i;
+        };
+
+        template <bool profiling>
+        auto execute(const program_t& program, profile_t* profile) -> value_t;
+
+        std::vector<std::vector<threaded_t>> threaded_;
+        std::vector<value_t> stack_;
+        std::vector<value_t> globals_;
+        // what the program allocates.
+        arena_t arena_;
+        std::uint64_t executed_ = 0;
+    };
+}}  // namespace bt::vm
@@ -0,0 +1,146 @@
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/analysis/constant.hpp>
+#include <bullet/analysis/prelude_environment.hpp>
+#include <bullet/analysis/type_checking.hpp>
+#include <bullet/analysis/walk.hpp>
+
+namespace bt { namespace analysis {
+    using namespace std;
+
+    auto interner_t::intern(string_view s) -> string_view {
+        const auto lock = lock_guard(mutex_);
+        return *strings_.emplace(s).first;
+    }
+
+    auto interner_t::size() const -> size_t {
+        const auto lock = lock_guard(mutex_);
+        return strings_.size();
+    }
+
+    auto type_table_t::make_nominal(string name, type_t type) -> type_t {
+        const auto key = interner_.intern(name);
+
+        const auto lock = lock_guard(mutex_);
+        const auto id = int(nominals_.size()) + 1;
+        auto result = type_t(type_value(types::nominal_type_t(id, move(name), move(type))));
+        by_name_[key] = nominals_.size();
+        nominals_.push_back(result);
+        return result;
+    }
+
+    auto type_table_t::lookup_nominal(string_view name) const -> optional<type_t> {
+        const auto lock = lock_guard(mutex_);
+        if (auto it = by_name_.find(name); it != by_name_.end()) return nominals_[it->second];
+        return nullopt;
+    }
+
+    auto type_table_t::size() const -> size_t {
+        const auto lock = lock_guard(mutex_);
+        return nominals_.size();
+    }
+
+    auto type_table_t::intern(const type_t& type) -> type_t {
+        const auto lock = lock_guard(mutex_);
+        return *interned_.insert(type).first;
+    }
+
+    auto template_table_t::key_hash_t::operator()(const key_t& key) const -> size_t {
+        auto h = hash<int>()(key.id);
+        for (const auto& a : key.arguments) {
+            h = h * 31 + hash<const type_value*>()(&a.type.get());
+            if (a.value)
+                h = h * 31 + visit([](auto v) { return hash<decltype(v)>()(v); }, *a.value);
+        }
+        return h;
+    }
+
+    auto template_table_t::key_equal_t::operator()(const key_t& lhs, const key_t& rhs) const
+        -> bool {
+        if (lhs.id != rhs.id || lhs.arguments.size() != rhs.arguments.size()) return false;
+        for (auto j = size_t(0); j < lhs.arguments.size(); j++) {
+            const auto &a = lhs.arguments[j], &b = rhs.arguments[j];
+            if (&a.type.get() != &b.type.get() || a.value != b.value) return false;
+        }
+        return true;
+    }
+
+    auto template_table_t::define(definition_t definition) -> int {
+        const auto lock = lock_guard(mutex_);
+        definitions_.push_back(move(definition));
+        made_.emplace_back();
+        return int(definitions_.size()) - 1;
+    }
+
+    auto template_table_t::definition(int id) -> definition_t& {
+        const auto lock = lock_guard(mutex_);
+        return definitions_.at(id);
+    }
+
+    auto template_table_t::find(int id, const vector<argument_t>& arguments) const
+        -> const instance_t* {
+        const auto lock = lock_guard(mutex_);
+        const auto it = instances_.find(key_t{id, arguments});
+        return it == instances_.end() ? nullptr : &it->second;
+    }
+
+    auto template_table_t::add(int id, vector<argument_t> arguments, instance_t instance)
+        -> instance_t& {
+        const auto lock = lock_guard(mutex_);
+        auto name = instance.name;
+        while (names_.contains(name)) name += "'";
+        instance.name = name;
+        names_.insert(interner_.intern(name));
+
+        auto& result = instances_.emplace(key_t{id, move(arguments)}, move(instance)).first->second;
+        made_.at(id).push_back(&result);
+        return result;
+    }
+
+    auto template_table_t::instances(int id) const -> vector<const instance_t*> {
+        const auto lock = lock_guard(mutex_);
+        return made_.at(id);
+    }
+
+    auto template_table_t::size() const -> size_t {
+        const auto lock = lock_guard(mutex_);
+        return instances_.size();
+    }
+
+    compilation_t::compilation_t(string name, size_t max_errors)
+        : name(move(name)),
+          types(interner),
+          templates(interner),
+          layouts(types),
+          diagnostics(max_errors),
+          prelude(lang::prelude::environment()) {}
+
+    auto compilation_t::check(const parser::syntax::tree_t& ast)
+        -> parser::syntax::attr_node_t<type_t> {
+        const auto scope = scope_t(*this);
+
+        parser::syntax::attr_node_t<type_t> typed_ast =
+            parallel_walk_post_order<type_t>(ast, pure([](auto, auto) { return type_t(); }));
+        type_check(typed_ast, prelude);
+        fold_constants(typed_ast);
+        return typed_ast;
+    }
+
+    namespace {
+        thread_local compilation_t* current_compilation = nullptr;
+    }
+
+    auto compilation_t::current() -> compilation_t& {
+        if (current_compilation) return *current_compilation;
+
+        // nobody installed a compilation on this thread: fall back to a per-thread one.
+        thread_local auto fallback = compilation_t();
+        return fallback;
+    }
+
+    compilation_t::scope_t::scope_t(compilation_t& c)
+        : previous_(current_compilation), diagnostics_scope_(c.diagnostics) {
+        current_compilation = &c;
+    }
+
+    compilation_t::scope_t::~scope_t() { current_compilation = previous_; }
+}}  // namespace bt::analysis
@@ -0,0 +1,553 @@
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <bullet/analysis/constant.hpp>
+#include <bullet/analysis/error.hpp>
+
+namespace bt { namespace analysis {
+    using namespace std;
+    using namespace parser::syntax;
+
+    namespace hana = boost::hana;
+
+    namespace {
+        using typed_node_t = attr_node_t<type_t>;
+        using typed_tree_t = attr_tree_t<type_t>;
+        using int128_t = __int128;
+
+        // The type constants of type t are computed in: literals nothing gave a
+        // type to take the widest one, as in the backends.
+        auto value_type(const type_t& t) -> type_t {
+            const auto u = deref(t);
+            if (u.get().is<types::intlit_t>()) return I64;
+            if (u.get().is<types::floatlit_t>()) return F64;
+            return u;
+        }
+
+        // bits, narrowed to the width of the integer type t.
+        auto narrow(uint64_t bits, const type_t& t) -> uint64_t {
+            const auto w = width(t);
+            if (w >= 64) return bits;
+            if (is_signed(t)) return uint64_t(int64_t(bits << (64 - w)) >> (64 - w));
+            return bits & ~uint64_t(0) >> (64 - w);
+        }
+
+        // An integer value as its type reads the bits.
+        auto exact(uint64_t bits, const type_t& t) -> int128_t {
+            return is_signed(t) ? int128_t(int64_t(bits)) : int128_t(bits);
+        }
+
+        // The value of an integer constant computed by a node: as i64 for
+        // integer literals nothing gave a type to, unless they are written out.
+        auto exact(const typed_node_t& at, const constant_t& c) -> int128_t {
+            const auto bits = get<uint64_t>(c.value);
+            if (c.type.get().is<types::intlit_t>())
+                return at.get().is<literal_t>() ? int128_t(bits) : int128_t(int64_t(bits));
+            return exact(bits, c.type);
+        }
+
+        auto fits(int128_t v, const type_t& t) -> bool {
+            const auto w = width(t);
+            if (is_signed(t)) return v >= -(int128_t(1) << (w - 1)) && v < int128_t(1) << (w - 1);
+            return v >= 0 && v < int128_t(1) << w;
+        }
+
+        auto to_string(int128_t v) -> string {
+            if (v < 0) return "-" + to_string(-v);
+            auto s = string();
+            do {
+                s.insert(s.begin(), char('0' + int(v % 10)));
+                v /= 10;
+            } while (v != 0);
+            return s;
+        }
+
+        // as vm::ipow computes it, on 64-bit words.
+        auto ipow(int64_t base, int64_t exponent) -> int64_t {
+            if (exponent < 0) return base == 1 ? 1 : base == -1 ? (exponent & 1 ? -1 : 1) : 0;
+            auto result = uint64_t(1), b = uint64_t(base);
+            for (auto e = uint64_t(exponent); e; e >>= 1) {
+                if (e & 1) result *= b;
+                b *= b;
+            }
+            return int64_t(result);
+        }
+
+        // base ** exponent, or nothing if it doesn't fit 65 bits.
+        auto exact_pow(int128_t base, int64_t exponent) -> optional<int128_t> {
+            if (exponent < 0) return ipow(int64_t(base), exponent);
+            const auto limit = int128_t(1) << 65;
+            auto result = int128_t(1);
+            for (auto e = exponent; e > 0; e--) {
+                if (result == 0 || base == 1) return result;
+                if (base == -1) return e % 2 ? -result : result;
+                result *= base;
+                if (result >= limit || result <= -limit) return nullopt;
+            }
+            return result;
+        }
+
+        auto scalar(const type_t& t) -> bool {
+            return is_integral(t) || is_floating_point(t) || t.get().is<types::bool_t>();
+        }
+
+        // The literal of a constant: negative numbers are the negation of
+        // their magnitude.
+        auto literal_node(const typed_tree_t& at, const constant_t& c) -> typed_node_t {
+            const auto make = [&](literal_t literal) {
+                auto node = typed_tree_t(move(literal));
+                node.location = at.location;
+                node.attribute = c.type;
+                return typed_node_t(move(node));
+            };
+            const auto negate = [&](typed_node_t operand) {
+                auto node = typed_tree_t(unary_op_t<type_t>{lexer::MINUS, move(operand)});
+                node.location = at.location;
+                node.attribute = c.type;
+                return typed_node_t(move(node));
+            };
+
+            if (const auto b = get_if<bool>(&c.value))
+                return *b ? make(lexer::token::true_t()) : make(lexer::token::false_t());
+
+            const auto& t = c.type;
+            if (const auto d = get_if<double>(&c.value)) {
+                const auto w = t.get().is<types::floatlit_t>() ? 0 : width(t);
+                const auto magnitude = make(floating_point_literal_t(fabs(*d), w));
+                return signbit(*d) ? negate(magnitude) : magnitude;
+            }
+
+            const auto u = get<uint64_t>(c.value);
+            const auto intlit = t.get().is<types::intlit_t>();
+            const auto negative = (intlit || is_signed(t)) && int64_t(u) < 0;
+            const auto magnitude = make(integral_literal_t(negative ? 0 - u : u,
+                                                           intlit        ? '?'
+                                                           : is_signed(t) ? 'i'
+                                                                          : 'u',
+                                                           intlit ? 0 : width(t)));
+            return negative ? negate(magnitude) : magnitude;
+        }
+
+        class folder_t {
+            // reports overflow and substitutes let variables when set.
+            bool folding_;
+            // the values of let variables in scope; nothing for names which
+            // shadow one.
+            vector<unordered_map<string, optional<constant_t>>> scopes_;
+
+            auto overflow(const typed_node_t& at, const type_t& t, int128_t v) -> void {
+                if (!folding_) return;
+                auto err = raise<error>(at, diag_code_t::constant_overflow);
+                err << "Constant value " << to_string(v) << " overflows type \"" << t << "\"";
+            }
+
+            auto literal(const typed_tree_t& at, const literal_t& e) -> optional<constant_t> {
+                const auto t = at.attribute;
+                return visit(
+                    hana::overload(
+                        [&](const integral_literal_t& x) -> optional<constant_t> {
+                            if (t.get().is<types::intlit_t>()) return constant_t{t, uint64_t(x.value)};
+                            if (!is_integral(t)) return nullopt;
+                            return constant_t{t, narrow(x.value, t)};
+                        },
+                        [&](const floating_point_literal_t& x) -> optional<constant_t> {
+                            if (!is_floating_point(t) && !t.get().is<types::floatlit_t>())
+                                return nullopt;
+                            const auto d = width(t) == 32 ? double(float(x.value)) : double(x.value);
+                            return constant_t{t, d};
+                        },
+                        [&](const lexer::token::true_t&) -> optional<constant_t> {
+                            return constant_t{BOOL, true};
+                        },
+                        [&](const lexer::token::false_t&) -> optional<constant_t> {
+                            return constant_t{BOOL, false};
+                        },
+                        [&](const string_literal_t&) -> optional<constant_t> { return nullopt; }),
+                    e);
+            }
+
+            auto unary(const typed_node_t& at, const unary_op_t<type_t>& e)
+                -> optional<constant_t> {
+                using namespace lexer;
+
+                const auto x = evaluate(e.operand);
+                if (!x) return nullopt;
+
+                if (e.op == NOT) {
+                    const auto b = convert(e.operand, *x, BOOL);
+                    if (!b) return nullopt;
+                    return constant_t{BOOL, !get<bool>(b->value)};
+                }
+
+                // literals are negated as written, so -128i8 fits.
+                const auto written = e.operand.get().get_if<literal_t>();
+                const auto magnitude = written && e.op == MINUS
+                                           ? get_if<integral_literal_t>(written)
+                                           : nullptr;
+
+                const auto t = value_type(at.get().attribute);
+                const auto v = magnitude && is_integral(t)
+                                   ? optional(constant_t{t, narrow(magnitude->value, t)})
+                                   : convert(e.operand, *x, t);
+                if (!v) return nullopt;
+                auto result = constant_t{at.get().attribute, v->value};
+
+                if (e.op == PLUS) return result;
+                if (const auto d = get_if<double>(&v->value); d && e.op == MINUS) {
+                    result.value = -*d;
+                    return result;
+                }
+                const auto u = get_if<uint64_t>(&v->value);
+                if (!u) return nullopt;
+                if (e.op == MINUS) {
+                    const auto negated =
+                        magnitude ? -int128_t(magnitude->value)
+                        : x->type.get().is<types::intlit_t>() ? -exact(e.operand, *x)
+                                                               : -exact(*u, t);
+                    result.value = narrow(0 - *u, t);
+                    if (!fits(negated, t)) overflow(at, t, negated);
+                    return result;
+                }
+                if (e.op == TILDE) {
+                    result.value = narrow(~*u, t);
+                    return result;
+                }
+                return nullopt;
+            }
+
+            auto compare(lexer::token_t op, const constant_t& a, const constant_t& b) -> bool {
+                using namespace lexer;
+
+                const auto ordering = [&]() -> partial_ordering {
+                    if (const auto x = get_if<double>(&a.value)) return *x <=> get<double>(b.value);
+                    if (const auto x = get_if<bool>(&a.value)) return *x <=> get<bool>(b.value);
+                    const auto x = get<uint64_t>(a.value), y = get<uint64_t>(b.value);
+                    if (is_signed(a.type)) return int64_t(x) <=> int64_t(y);
+                    return x <=> y;
+                }();
+                return op == EQUAL       ? ordering == 0
+                       : op == NOT_EQUAL ? ordering != 0
+                       : op == LT        ? ordering < 0
+                       : op == GT        ? ordering > 0
+                       : op == LEQ       ? ordering <= 0
+                                         : ordering >= 0;
+            }
+
+            auto arithmetic(const typed_node_t& at,
+                            lexer::token_t op,
+                            const type_t& t,
+                            const constant_t& a,
+                            const constant_t& b) -> optional<constant_t> {
+                using namespace lexer;
+
+                if (const auto x = get_if<double>(&a.value)) {
+                    const auto y = get<double>(b.value);
+                    auto d = op == PLUS         ? *x + y
+                             : op == MINUS      ? *x - y
+                             : op == STAR       ? *x * y
+                             : op == SLASH      ? *x / y
+                             : op == PERCENTAGE ? fmod(*x, y)
+                             : op == STAR_STAR  ? pow(*x, y)
+                                                : NAN;
+                    if (width(t) == 32) d = float(d);
+                    if (!isfinite(d)) return nullopt;
+                    return constant_t{at.get().attribute, d};
+                }
+
+                const auto x = get_if<uint64_t>(&a.value);
+                if (!x) return nullopt;
+                const auto y = get<uint64_t>(b.value);
+                const auto s = is_signed(t);
+                const auto ex = exact(*x, t), ey = exact(y, t);
+
+                auto bits = uint64_t(0);
+                auto value = optional<int128_t>();
+                if (op == PLUS) {
+                    bits = *x + y, value = ex + ey;
+                } else if (op == MINUS) {
+                    bits = *x - y, value = ex - ey;
+                } else if (op == STAR) {
+                    bits = *x * y, value = ex * ey;
+                } else if (op == AMPERSAND) {
+                    bits = *x & y;
+                } else if (op == BAR) {
+                    bits = *x | y;
+                } else if (op == HAT) {
+                    bits = *x ^ y;
+                } else if (op == STAR_STAR) {
+                    bits = uint64_t(ipow(int64_t(*x), int64_t(y)));
+                    value = exact_pow(ex, int64_t(y));
+                    if (!value) value = int128_t(1) << 65;
+                } else if (op == SLASH || op == PERCENTAGE) {
+                    // division by zero faults when the program runs.
+                    if (y == 0) return nullopt;
+                    if (s && int64_t(y) == -1) {
+                        bits = op == SLASH ? 0 - *x : 0;
+                        value = op == SLASH ? -ex : 0;
+                    } else if (s) {
+                        bits = uint64_t(op == SLASH ? int64_t(*x) / int64_t(y)
+                                                    : int64_t(*x) % int64_t(y));
+                    } else {
+                        bits = op == SLASH ? *x / y : *x % y;
+                    }
+                } else {
+                    return nullopt;
+                }
+
+                if (value && !fits(*value, t)) overflow(at, t, *value);
+                return constant_t{at.get().attribute, narrow(bits, t)};
+            }
+
+            auto binary(const typed_node_t& at, const bin_op_t<type_t>& e)
+                -> optional<constant_t> {
+                using namespace lexer;
+
+                const auto op = e.op;
+                const auto a = evaluate(e.lhs);
+
+                if (op == AND || op == OR) {
+                    const auto lhs = a ? convert(e.lhs, *a, BOOL) : nullopt;
+                    // the right-hand side isn't evaluated if the left decides.
+                    if (lhs && get<bool>(lhs->value) == (op == OR)) return lhs;
+                    const auto b = evaluate(e.rhs);
+                    const auto rhs = b ? convert(e.rhs, *b, BOOL) : nullopt;
+                    if (!lhs || !rhs) return nullopt;
+                    return rhs;
+                }
+
+                const auto b = evaluate(e.rhs);
+                if (!a || !b) return nullopt;
+
+                if (op == EQUAL || op == NOT_EQUAL || op == LT || op == GT || op == LEQ ||
+                    op == GEQ) {
+                    const auto promoted = promoted_type(e.lhs.get().attribute, e.rhs.get().attribute);
+                    if (!promoted) return nullopt;
+                    const auto t = value_type(*promoted);
+                    const auto x = convert(e.lhs, *a, t);
+                    const auto y = convert(e.rhs, *b, t);
+                    if (!x || !y) return nullopt;
+                    return constant_t{BOOL, compare(op, *x, *y)};
+                }
+
+                const auto t = value_type(at.get().attribute);
+                if (!is_integral(t) && !is_floating_point(t)) return nullopt;
+                const auto x = convert(e.lhs, *a, t);
+                const auto y = convert(e.rhs, *b, t);
+                if (!x || !y) return nullopt;
+                return arithmetic(at, op, t, *x, *y);
+            }
+
+            auto lookup(const string& name) -> optional<constant_t> {
+                for (auto s = scopes_.rbegin(); s != scopes_.rend(); s++)
+                    if (const auto p = s->find(name); p != s->end()) return p->second;
+                return nullopt;
+            }
+
+            auto shadow(const string& name) -> void { scopes_.back()[name] = nullopt; }
+
+            // Reports literals a value of type t is initialized or assigned
+            // with which don't fit it.
+            auto check(const typed_node_t& value, const type_t& t) -> void {
+                const auto c = evaluate(value);
+                if (c && is_integral(value_type(t))) convert(value, *c, value_type(t));
+            }
+
+            auto function(fn_expr_t<type_t>& e) -> void {
+                for (auto& closure : e.closure_params)
+                    if (closure.expression.get()) fold(closure.expression);
+
+                scopes_.emplace_back();
+                for (const auto& name : e.arg_names) shadow(name.name);
+                for (const auto& closure : e.closure_params)
+                    if (closure.identifier) shadow(closure.identifier->name);
+                fold(e.body);
+                scopes_.pop_back();
+            }
+
+        public:
+            explicit folder_t(bool folding) : folding_(folding) { scopes_.emplace_back(); }
+
+            // Converts a constant the way the VM converts values between types.
+            auto convert(const typed_node_t& at, const constant_t& c, const type_t& to)
+                -> optional<constant_t> {
+                if (!scalar(to)) return nullopt;
+                const auto& v = c.value;
+
+                if (to.get().is<types::bool_t>()) {
+                    if (const auto b = get_if<bool>(&v)) return constant_t{to, *b};
+                    if (const auto u = get_if<uint64_t>(&v)) return constant_t{to, uint8_t(*u) != 0};
+                    const auto d = get<double>(v);
+                    if (!(d > -1 && d < 0x1p64)) return nullopt;
+                    return constant_t{to, uint8_t(uint64_t(d)) != 0};
+                }
+
+                if (is_floating_point(to)) {
+                    auto d = 0.0;
+                    if (const auto b = get_if<bool>(&v))
+                        d = *b;
+                    else if (holds_alternative<uint64_t>(v))
+                        d = double(exact(at, c));
+                    else
+                        d = get<double>(v);
+                    return constant_t{to, width(to) == 32 ? double(float(d)) : d};
+                }
+
+                auto bits = uint64_t(0);
+                if (const auto b = get_if<bool>(&v)) {
+                    bits = *b;
+                } else if (const auto u = get_if<uint64_t>(&v)) {
+                    bits = *u;
+                    const auto value = exact(at, c);
+                    // literals nothing gave a type to take the one they are
+                    // used at, which they must fit.
+                    if (c.type.get().is<types::intlit_t>() && !fits(value, to))
+                        overflow(at, to, value);
+                } else {
+                    const auto d = get<double>(v);
+                    if (is_signed(to) ? !(d >= -0x1p63 && d < 0x1p63) : !(d > -1 && d < 0x1p64))
+                        return nullopt;
+                    bits = is_signed(to) ? uint64_t(int64_t(d)) : uint64_t(d);
+                }
+                return constant_t{to, narrow(bits, to)};
+            }
+
+            auto evaluate(const typed_node_t& node) -> optional<constant_t> {
+                const auto& tree = node.get();
+                return visit(
+                    hana::overload(
+                        [&](const literal_t& e) { return literal(tree, e); },
+                        [&](const unary_op_t<type_t>& e) { return unary(node, e); },
+                        [&](const bin_op_t<type_t>& e) { return binary(node, e); },
+                        [&](const typed_node_t& e) { return evaluate(e); },
+                        [&](const auto&) -> optional<constant_t> { return nullopt; }),
+                    static_cast<const node_base_t<type_t>&>(tree));
+            }
+
+            // Folds the constant expressions of a subtree, children first.
+            auto fold(typed_node_t& node) -> void {
+                auto& tree = node.get();
+                const auto constant = [&]() -> bool {
+                    const auto c = evaluate(node);
+                    if (c) node = literal_node(tree, *c);
+                    return bool(c);
+                };
+
+                visit(
+                    hana::overload(
+                        [&](lexer::identifier_t& e) {
+                            if (const auto c = lookup(e.name)) node = literal_node(tree, *c);
+                        },
+                        [&](unary_op_t<type_t>& e) {
+                            const auto literal = e.operand.get().is<literal_t>();
+                            fold(e.operand);
+                            if (!(e.op == lexer::MINUS && literal)) constant();
+                        },
+                        [&](bin_op_t<type_t>& e) {
+                            using namespace lexer;
+
+                            fold(e.lhs);
+                            fold(e.rhs);
+                            if (constant() || e.op == AND || e.op == OR) return;
+
+                            const auto comparison = e.op == EQUAL || e.op == NOT_EQUAL ||
+                                                    e.op == LT || e.op == GT || e.op == LEQ ||
+                                                    e.op == GEQ;
+                            const auto promoted =
+                                promoted_type(e.lhs.get().attribute, e.rhs.get().attribute);
+                            const auto t = comparison ? promoted : optional(tree.attribute);
+                            if (!t) return;
+                            check(e.lhs, *t);
+                            check(e.rhs, *t);
+                        },
+                        [&](data_t<type_t>& e) {
+                            for (auto& x : e) fold(x);
+                        },
+                        [&](invoc_t<type_t>& e) {
+                            for (auto& x : e.arguments) fold(x);
+                            const auto f = e.target.get().attribute.get().get_if<types::function_t>();
+                            if (!f || f->formal_parameters.size() != e.arguments.size()) return;
+                            for (auto i = 0u; i < e.arguments.size(); i++)
+                                check(e.arguments[i], f->formal_parameters[i].type);
+                        },
+                        [&](if_t<type_t>& e) {
+                            for (auto& x : e.elif_tests) fold(x);
+                            for (auto& x : e.elif_branches) fold(x);
+                            if (e.else_branch.get()) fold(e.else_branch);
+                        },
+                        [&](block_t<type_t>& e) {
+                            scopes_.emplace_back();
+                            // functions are visible throughout their block.
+                            for (auto& x : e)
+                                if (const auto def = x.get().get_if<var_def_t<type_t>>())
+                                    shadow(def->name.name);
+                            for (auto& x : e) fold(x);
+                            scopes_.pop_back();
+                        },
+                        [&](var_def_t<type_t>& e) {
+                            if (const auto fn = e.rhs.get().get_if<fn_expr_t<type_t>>()) {
+                                function(*fn);
+                            } else if (e.rhs.get()) {
+                                fold(e.rhs);
+                                check(e.rhs, deref(tree.attribute));
+                            }
+                            shadow(e.name.name);
+                        },
+                        [&](let_var_t<type_t>& e) {
+                            if (const auto fn = e.rhs.get().get_if<fn_expr_t<type_t>>()) {
+                                function(*fn);
+                                shadow(e.name.name);
+                                return;
+                            }
+                            fold(e.rhs);
+                            const auto c = evaluate(e.rhs);
+                            const auto t = deref(tree.attribute);
+                            scopes_.back()[e.name.name] = c ? convert(e.rhs, *c, t) : nullopt;
+                        },
+                        [&](assign_t<type_t>& e) {
+                            fold(e.rhs);
+                            check(e.rhs, e.lhs.get().attribute);
+                        },
+                        [&](while_t<type_t>& e) {
+                            fold(e.test);
+                            fold(e.body);
+                        },
+                        [&](with_t<type_t>& e) { fold(e.body); },
+                        [&](for_t<type_t>& e) {
+                            fold(e.var_rhs);
+                            scopes_.emplace_back();
+                            shadow(e.var_lhs.name);
+                            fold(e.body);
+                            scopes_.pop_back();
+                        },
+                        [&](return_t<type_t>& e) {
+                            if (e.value.get()) fold(e.value);
+                        },
+                        [&](yield_t<type_t>& e) {
+                            if (e.value.get()) fold(e.value);
+                        },
+                        [&](fn_expr_t<type_t>& e) { function(e); },
+                        [&](typed_node_t& e) { fold(e); },
+                        // types, and definitions of types, hold no values.
+                        [&](auto&) {}),
+                    static_cast<node_base_t<type_t>&>(tree));
+            }
+        };
+    }  // namespace
+
+    auto evaluate(const attr_node_t<type_t>& node) -> optional<constant_t> {
+        return folder_t(false).evaluate(node);
+    }
+
+    auto fold_constants(attr_node_t<type_t>& ast) -> void { folder_t(true).fold(ast); }
+
+    auto convert(const attr_node_t<type_t>& at, const constant_t& c, const type_t& t)
+        -> optional<constant_t> {
+        return folder_t(true).convert(at, c, t);
+    }
+
+    auto literal_of(const attr_tree_t<type_t>& at, const constant_t& c) -> attr_node_t<type_t> {
+        return literal_node(at, c);
+    }
+}}  // namespace bt::analysis
@@ -0,0 +1,129 @@
+#include <bullet/analysis/diagnostics.hpp>
+
+namespace bt { namespace analysis {
+    using namespace std;
+
+    auto diag_code_name(diag_code_t code) -> string_view {
+        switch (code) {
+        case diag_code_t::generic: return "generic";
+        case diag_code_t::duplicate_function: return "duplicate_function";
+        case diag_code_t::duplicate_parameter: return "duplicate_parameter";
+        case diag_code_t::duplicate_type: return "duplicate_type";
+        case diag_code_t::duplicate_variable: return "duplicate_variable";
+        case diag_code_t::illegal_literal_width: return "illegal_literal_width";
+        case diag_code_t::illegal_literal_signedness: return "illegal_literal_signedness";
+        case diag_code_t::undefined_identifier: return "undefined_identifier";
+        case diag_code_t::invalid_unary_operand: return "invalid_unary_operand";
+        case diag_code_t::invalid_binary_operands: return "invalid_binary_operands";
+        case diag_code_t::not_a_function: return "not_a_function";
+        case diag_code_t::argument_mismatch: return "argument_mismatch";
+        case diag_code_t::not_a_generic_type: return "not_a_generic_type";
+        case diag_code_t::generic_arity: return "generic_arity";
+        case diag_code_t::condition_not_bool: return "condition_not_bool";
+        case diag_code_t::not_assignable: return "not_assignable";
+        case diag_code_t::return_type_mismatch: return "return_type_mismatch";
+        case diag_code_t::let_not_immutable: return "let_not_immutable";
+        case diag_code_t::assign_type_mismatch: return "assign_type_mismatch";
+        case diag_code_t::indirection_mismatch: return "indirection_mismatch";
+        case diag_code_t::invalid_iteration_target: return "invalid_iteration_target";
+        case diag_code_t::invalid_yield: return "invalid_yield";
+        case diag_code_t::constant_overflow: return "constant_overflow";
+        case diag_code_t::not_a_constant: return "not_a_constant";
+        case diag_code_t::not_a_template: return "not_a_template";
+        case diag_code_t::template_deduction: return "template_deduction";
+        case diag_code_t::template_recursion: return "template_recursion";
+        case diag_code_t::undefined_field: return "undefined_field";
+        case diag_code_t::invalid_slice: return "invalid_slice";
+        case diag_code_t::invalid_interpolation: return "invalid_interpolation";
+        case diag_code_t::invalid_region: return "invalid_region";
+        }
+        return "unknown";
+    }
+
+    auto operator<<(ostream& os, diag_code_t code) -> ostream& {
+        os << diag_code_name(code);
+        return os;
+    }
+
+    auto operator<<(ostream& os, const diag_arg_t& arg) -> ostream& {
+        visit([&](const auto& v) { os << v; }, arg);
+        return os;
+    }
+
+    auto diagnostic_t::message() const -> string {
+        auto s = stringstream();
+        s << *this;
+        return s.str();
+    }
+
+    auto operator<<(ostream& os, const diagnostic_t& d) -> ostream& {
+        for (const auto& arg : d.args) os << arg;
+        os << ", at " << d.location << ".";
+        return os;
+    }
+
+    diagnostics_t::diagnostics_t(size_t max_errors) : budget_(make_shared<budget_t>()) {
+        budget_->max_errors = max_errors;
+    }
+
+    auto diagnostics_t::admit() -> bool {
+        if (budget_->admitted.fetch_add(1, memory_order_relaxed) < budget_->max_errors)
+            return true;
+        budget_->dropped.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+    auto diagnostics_t::record(diagnostic_t&& d) -> void { diagnostics_.push_back(move(d)); }
+
+    auto diagnostics_t::fork() const -> diagnostics_t {
+        auto child = diagnostics_t(budget_->max_errors);
+        child.budget_ = budget_;
+        return child;
+    }
+
+    auto diagnostics_t::merge(diagnostics_t&& child) -> void {
+        if (diagnostics_.empty()) {
+            diagnostics_ = move(child.diagnostics_);
+        } else {
+            diagnostics_.reserve(diagnostics_.size() + child.diagnostics_.size());
+            for (auto& d : child.diagnostics_) diagnostics_.push_back(move(d));
+        }
+        child.diagnostics_.clear();
+    }
+
+    auto diagnostics_t::clear() -> void {
+        diagnostics_.clear();
+        budget_->admitted = 0;
+        budget_->dropped = 0;
+    }
+
+    auto diagnostics_t::print(ostream& os) const -> void {
+        for (const auto& d : diagnostics_) os << d << endl;
+        if (const auto n = dropped())
+            os << "(" << n << " further errors suppressed after the first " << max_errors()
+               << ")" << endl;
+    }
+
+    auto operator<<(ostream& os, const diagnostics_t& d) -> ostream& {
+        d.print(os);
+        return os;
+    }
+
+    namespace {
+        thread_local diagnostics_t* current_diagnostics = nullptr;
+    }
+
+    auto diagnostics_t::current() -> diagnostics_t& {
+        if (current_diagnostics) return *current_diagnostics;
+
+        // nobody installed an engine on this thread: fall back to a per-thread one.
+        thread_local auto fallback = diagnostics_t();
+        return fallback;
+    }
+
+    diagnostics_t::scope_t::scope_t(diagnostics_t& d) : previous_(current_diagnostics) {
+        current_diagnostics = &d;
+    }
+
+    diagnostics_t::scope_t::~scope_t() { current_diagnostics = previous_; }
+}}  // namespace bt::analysis
@@ -15,6 +15,4 @@ namespace bt { namespace analysis {
               msg << ", at " << l << ".";
               return msg.str();
           }()) {}
-
-    vector<unique_ptr<runtime_error>> error::errors;
 }}  // namespace bt::analysis
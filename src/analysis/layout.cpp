@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <numeric>
+
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/analysis/layout.hpp>
+#include <bullet/parser/traversal.hpp>
+
+namespace bt { namespace analysis {
+    using namespace std;
+
+    namespace {
+        auto align_up(size_t n, size_t align) -> size_t { return (n + align - 1) / align * align; }
+
+        auto scalar(size_t size, optional<niche_t> niche = nullopt) -> layout_t {
+            auto result = layout_t{size, size};
+            result.niche = niche;
+            return result;
+        }
+
+        // pointers are never null.
+        auto pointer() -> layout_t { return scalar(8, niche_t{0, 8, 0, 1}); }
+
+        // a pointer and a u64 length.
+        auto buffer() -> layout_t {
+            auto result = pointer();
+            result.size = 16;
+            return result;
+        }
+
+        // the niche with room for more values, the first of two as roomy.
+        auto roomier(const optional<niche_t>& a, const optional<niche_t>& b)
+            -> optional<niche_t> {
+            if (!a || (b && b->count > a->count)) return b;
+            return a;
+        }
+
+        // the order parts are placed in.
+        auto placement(const vector<layout_t>& parts, field_order_t order) -> vector<size_t> {
+            auto placed = vector<size_t>(parts.size());
+            iota(placed.begin(), placed.end(), 0);
+            if (order == field_order_t::packed)
+                stable_sort(placed.begin(), placed.end(),
+                            [&](size_t i, size_t j) { return parts[i].align > parts[j].align; });
+            return placed;
+        }
+
+        // the struct the elements of an array are, if they are one.
+        auto record(const types::array_t& a) -> const types::struct_t* {
+            auto element = a.value_type;
+            if (const auto n = element.get().get_if<types::nominal_type_t>()) element = n->type;
+            return element.get().get_if<types::struct_t>();
+        }
+
+        template <typename Nested>
+        auto fields(const vector<type_t>& types, field_order_t order, Nested& nested)
+            -> layout_t {
+            auto parts = vector<layout_t>();
+            for (const auto& t : types) parts.push_back(nested(t));
+
+            auto result = layout_t();
+            result.offsets.resize(parts.size());
+            auto end = size_t(0);
+            for (const auto i : placement(parts, order)) {
+                const auto& part = parts[i];
+                end = align_up(end, part.align);
+                result.offsets[i] = end;
+                result.align = max(result.align, part.align);
+                if (auto niche = part.niche) {
+                    niche->offset += end;
+                    result.niche = roomier(result.niche, niche);
+                }
+                end += part.size;
+            }
+            result.size = align_up(end, result.align);
+            return result;
+        }
+
+        // The tag goes in the niche of the largest alternative when it has
+        // room for tagging the others and they fit before, or after, it;
+        // otherwise after the largest alternative, in as few bytes as hold it.
+        template <typename Nested>
+        auto variant(const types::variant_t& v, Nested& nested) -> layout_t {
+            auto parts = vector<layout_t>();
+            for (const auto& t : v) parts.push_back(nested(t));
+            if (parts.empty()) return layout_t();
+            if (parts.size() == 1) {
+                auto result = parts[0];
+                result.offsets = {0};
+                result.strides.clear();
+                result.widths.clear();
+                result.tag.reset();
+                return result;
+            }
+
+            const auto n = parts.size();
+            auto result = layout_t();
+            result.offsets.assign(n, 0);
+            for (const auto& part : parts) result.align = max(result.align, part.align);
+
+            const auto largest = size_t(
+                max_element(parts.begin(), parts.end(),
+                            [](const auto& a, const auto& b) { return a.size < b.size; }) -
+                parts.begin());
+            const auto& dataful = parts[largest];
+            if (const auto niche = dataful.niche; niche && niche->count >= n - 1) {
+                auto fits = true;
+                for (auto i = size_t(0); i < n && fits; i++) {
+                    if (i == largest || parts[i].size <= niche->offset) continue;
+                    const auto at = align_up(niche->offset + niche->size, parts[i].align);
+                    result.offsets[i] = at;
+                    fits = at + parts[i].size <= dataful.size;
+                }
+
+                if (fits) {
+                    result.size = align_up(dataful.size, result.align);
+                    result.tag = tag_t{niche->offset, niche->size, niche->start, largest};
+                    if (niche->count > n - 1)
+                        result.niche = niche_t{niche->offset, niche->size,
+                                               niche->start + (n - 1), niche->count - (n - 1)};
+                    return result;
+                }
+                result.offsets.assign(n, 0);
+            }
+
+            const auto tag_size = size_t(n <= 1u << 8 ? 1 : n <= 1u << 16 ? 2 : 4);
+            const auto at = align_up(dataful.size, tag_size);
+            result.align = max(result.align, tag_size);
+            result.size = align_up(at + tag_size, result.align);
+            result.tag = tag_t{at, tag_size, 0, nullopt};
+            if (const auto values = uint64_t(1) << (8 * tag_size); values > n)
+                result.niche = niche_t{at, tag_size, n, values - n};
+            return result;
+        }
+
+        // One array for each field, in the order fields are placed in.
+        template <typename Nested>
+        auto split(const types::array_t& a,
+                   const types::struct_t& s,
+                   field_order_t order,
+                   Nested& nested) -> layout_t {
+            auto parts = vector<layout_t>();
+            for (const auto& field : s) parts.push_back(nested(field.type));
+
+            auto result = layout_t();
+            result.strides.resize(a.size.size());
+            auto n = size_t(1);
+            for (auto j = a.size.size(); j-- > 0;) {
+                result.strides[j] = n;
+                n *= a.size[j];
+            }
+            if (a.size.empty()) n = 0;
+
+            result.offsets.resize(parts.size());
+            result.widths.resize(parts.size());
+            auto end = size_t(0);
+            for (const auto i : placement(parts, order)) {
+                const auto& part = parts[i];
+                end = align_up(end, part.align);
+                result.offsets[i] = end;
+                result.widths[i] = part.size;
+                result.align = max(result.align, part.align);
+                if (auto niche = part.niche; niche && n) {
+                    niche->offset += end;
+                    result.niche = roomier(result.niche, niche);
+                }
+                end += n * part.size;
+            }
+            result.size = align_up(end, result.align);
+            return result;
+        }
+
+        template <typename Nested>
+        auto array(const types::array_t& a, Nested& nested) -> layout_t {
+            const auto element = nested(a.value_type);
+
+            auto result = layout_t();
+            result.align = element.align;
+            result.strides.resize(a.size.size());
+            auto stride = element.size;
+            for (auto j = a.size.size(); j-- > 0;) {
+                result.strides[j] = stride;
+                stride *= a.size[j];
+            }
+            result.size = a.size.empty() ? 0 : stride;
+            if (result.size) result.niche = element.niche;
+            return result;
+        }
+
+        template <typename Nested>
+        auto compute(const type_t& t, field_order_t order, records_t records, Nested&& nested)
+            -> layout_t {
+            return visit(
+                hana::overload(
+                    [](const types::bool_t&) { return scalar(1, niche_t{0, 1, 2, 254}); },
+                    [](const types::char_t&) {
+                        return scalar(4, niche_t{0, 4, 0x110000, (1ull << 32) - 0x110000});
+                    },
+                    []<bool S, int W>(const types::int_t<S, W>&) { return scalar(W / 8); },
+                    []<int W>(const types::float_t<W>&) { return scalar(W / 8); },
+                    // literals are laid out as what they default to.
+                    [](const types::intlit_t&) { return scalar(4); },
+                    [](const types::floatlit_t&) { return scalar(8); },
+                    [](const types::ptr_t&) { return pointer(); },
+                    [](const types::function_t&) { return pointer(); },
+                    [](const types::generator_t&) { return pointer(); },
+                    [](const types::slice_t&) { return pointer(); },
+                    [](const types::dynarr_t&) { return buffer(); },
+                    [](const types::string_t&) { return buffer(); },
+                    [](const types::strlit_t& s) {
+                        auto result = layout_t();
+                        result.size = size_t(s.size);
+                        return result;
+                    },
+                    [&](const types::struct_t& s) {
+                        auto types = vector<type_t>();
+                        for (const auto& field : s) types.push_back(field.type);
+                        return fields(types, order, nested);
+                    },
+                    [&](const types::tuple_t& tuple) { return fields(tuple, order, nested); },
+                    [&](const types::variant_t& v) { return variant(v, nested); },
+                    [&](const types::array_t& a) {
+                        const auto s = record(a);
+                        if (s && !s->empty() && records == records_t::split)
+                            return split(a, *s, order, nested);
+                        return array(a, nested);
+                    },
+                    [&](const types::nominal_type_t& n) { return nested(n.type); },
+                    [](const auto&) { return layout_t(); }),
+                static_cast<const type_base_t&>(t.get()));
+        }
+    }  // namespace
+
+    auto layout(const type_t& t, field_order_t order, records_t records) -> layout_t {
+        return compute(
+            t, order, records, [&](const type_t& u) { return layout(u, order, records); });
+    }
+
+    auto length(const types::array_t& a) -> uint64_t {
+        auto n = uint64_t(1);
+        for (const auto d : a.size) n *= d;
+        return n;
+    }
+
+    auto preferred_records(const types::array_t& a, const vector<field_use_t>& uses)
+        -> records_t {
+        const auto s = record(a);
+        if (!s || s->size() < 2 || uses.empty()) return records_t::interleaved;
+
+        // what loops load: whole elements, or the fields they use.
+        const auto whole = layout(type_value(*s)).size;
+        auto loaded = uint64_t(0), used = uint64_t(0);
+        for (const auto& use : uses) {
+            loaded += use.elements * whole;
+            for (const auto f : use.fields)
+                if (f < s->size()) used += use.elements * layout((*s)[f].type).size;
+        }
+        return used * 2 <= loaded ? records_t::split : records_t::interleaved;
+    }
+
+    auto field_uses(const parser::syntax::attr_node_t<type_t>& ast)
+        -> unordered_map<string, vector<field_use_t>> {
+        using namespace parser::syntax;
+        using parser::traverse_action_t;
+
+        auto result = unordered_map<string, vector<field_use_t>>();
+        parser::traverse_pre_order(ast, [&](const attr_node_t<type_t>& n) {
+            const auto loop = n.get().get_if<for_t<type_t>>();
+            if (!loop) return;
+            const auto sequence = loop->var_rhs.get().get_if<lexer::identifier_t>();
+            const auto a = decay_ptr(loop->var_rhs.get().attribute).get().get_if<types::array_t>();
+            const auto s = a ? record(*a) : nullptr;
+            if (!sequence || !s) return;
+
+            const auto& element = loop->var_lhs.name;
+            auto use = field_use_t{{}, length(*a)};
+            auto whole = false;
+            parser::traverse_pre_order(loop->body, [&](const attr_node_t<type_t>& m) {
+                const auto op = m.get().get_if<bin_op_t<type_t>>();
+                const auto x = op && op->op == lexer::DOT
+                                   ? op->lhs.get().get_if<lexer::identifier_t>()
+                                   : nullptr;
+                const auto f = x ? op->rhs.get().get_if<lexer::identifier_t>() : nullptr;
+                if (f && x->name == element) {
+                    for (auto i = size_t(0); i < s->size(); i++)
+                        if ((*s)[i].name == f->name) use.fields.push_back(i);
+                    return traverse_action_t::skip;
+                }
+
+                const auto id = m.get().get_if<lexer::identifier_t>();
+                if (id && id->name == element) whole = true;
+                return traverse_action_t::descend;
+            });
+
+            use.fields.resize(whole ? s->size() : use.fields.size());
+            if (whole) iota(use.fields.begin(), use.fields.end(), 0);
+            sort(use.fields.begin(), use.fields.end());
+            use.fields.erase(unique(use.fields.begin(), use.fields.end()), use.fields.end());
+            result[sequence->name].push_back(move(use));
+        });
+        return result;
+    }
+
+    auto layout_table_t::key_hash_t::operator()(const key_t& key) const -> size_t {
+        const auto& [t, order, records] = key;
+        return (hash<const type_value*>()(t) * 31 + size_t(order)) * 31 + size_t(records);
+    }
+
+    auto layout_table_t::of(const type_t& t, field_order_t order, records_t records)
+        -> const layout_t& {
+        const auto interned = types_.intern(t);
+        const auto key = key_t(&interned.get(), order, records);
+        {
+            const auto lock = lock_guard(mutex_);
+            if (auto it = layouts_.find(key); it != layouts_.end()) return it->second;
+        }
+
+        // the parts of the type are laid out, and cached, first.
+        auto result = compute(interned, order, records, [&](const type_t& u) {
+            return of(u, order, records);
+        });
+        const auto lock = lock_guard(mutex_);
+        return layouts_.emplace(key, move(result)).first->second;
+    }
+
+    auto layout_table_t::size() const -> size_t {
+        const auto lock = lock_guard(mutex_);
+        return layouts_.size();
+    }
+}}  // namespace bt::analysis
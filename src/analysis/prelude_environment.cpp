@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <bullet/analysis/prelude_environment.hpp>
+
+namespace bt { namespace lang { namespace prelude {
+    using namespace std;
+    using namespace bt::analysis;
+
+    namespace {
+        struct builtin_t {
+            string_view name;
+            const type_t& type;
+        };
+
+        // canonical names of the builtin types; the first name listed for a type
+        // is the one snapshots use.
+        const builtin_t builtins[] = {
+            {"i8", I8},           {"i16", I16},         {"i32", I32},
+            {"i64", I64},         {"u8", U8},           {"u16", U16},
+            {"u32", U32},         {"u64", U64},         {"f32", F32},
+            {"f64", F64},         {"ptr", PTR},         {"array", ARRAY},
+            {"dynarr", DYNARR},   {"bool", BOOL},       {"char", CHAR},
+            {"slice", SLICE},     {"variant", VARIANT}, {"fn", FUNCTION},
+            {"tuple", TUPLE},     {"strlit", STRLIT},   {"UNKNOWN", UNKOWN},
+            {"void", VOID},       {"string", STRING},
+        };
+
+        struct binding_t {
+            string_view table;
+            string_view name;
+            string_view builtin;
+        };
+
+        const binding_t bindings[] = {
+            {"types", "i8", "i8"},
+            {"types", "i16", "i16"},
+            {"types", "i32", "i32"},
+            {"types", "i64", "i64"},
+            {"types", "u8", "u8"},
+            {"types", "u16", "u16"},
+            {"types", "u32", "u32"},
+            {"types", "u64", "u64"},
+            {"types", "f32", "f32"},
+            {"types", "f64", "f64"},
+
+            {"types", "byte", "i8"},
+            {"types", "short", "i16"},
+            {"types", "int", "i32"},
+            {"types", "long", "i64"},
+
+            {"types", "ubyte", "u8"},
+            {"types", "ushort", "u16"},
+            {"types", "uint", "u32"},
+            {"types", "ulong", "u64"},
+
+            {"types", "ptr", "ptr"},
+            {"types", "array", "array"},
+            {"types", "dynarr", "dynarr"},
+            {"types", "bool", "bool"},
+            {"types", "char", "char"},
+            {"types", "slice", "slice"},
+            {"types", "variant", "variant"},
+            {"types", "fn", "fn"},
+            {"types", "tuple", "tuple"},
+            {"types", "strlit", "strlit"},
+            {"types", "UNKNOWN", "UNKNOWN"},
+            {"types", "void", "void"},
+            {"types", "string", "string"},
+
+            {"fns", "print", "fn"},
+        };
+
+        auto builtin(string_view name) -> const type_t& {
+            for (const auto& b : builtins)
+                if (b.name == name) return b.type;
+            throw runtime_error("Unknown builtin type \""s + string(name) + "\" in prelude.");
+        }
+
+        auto builtin_name(const type_t& type) -> string_view {
+            for (const auto& b : builtins)
+                if (&b.type.get() == &type.get()) return b.name;
+            auto s = stringstream();
+            s << "Only builtin types can be saved in a prelude snapshot, got \"" << type << "\".";
+            throw runtime_error(s.str());
+        }
+
+        auto table(environment_t& env, string_view name) -> st_type_t& {
+            if (name == "types") return env.types;
+            if (name == "fns") return env.fns;
+            if (name == "vars") return env.vars;
+            throw runtime_error("Unknown symbol table \""s + string(name) + "\" in prelude.");
+        }
+
+        auto define(environment_t& env, string_view tbl, string_view name, string_view b) -> void {
+            table(env, tbl).insert(string(name), builtin(b));
+        }
+    }  // namespace
+
+    auto environment() -> const environment_t& {
+        static const auto prelude = [] {
+            auto env = environment_t();
+            env.context = context_t::fn;
+            for (const auto& b : bindings) define(env, b.table, b.name, b.builtin);
+            return env;
+        }();
+        return prelude;
+    }
+
+    auto save(ostream& os, const environment_t& env) -> void {
+        auto lines = vector<string>();
+        const auto save_table = [&](string_view tbl, const st_type_t& st) {
+            for (const auto& [name, type] : st.scope)
+                lines.push_back(string(tbl) + " " + name + " " + string(builtin_name(type)));
+        };
+        save_table("types", env.types);
+        save_table("fns", env.fns);
+        save_table("vars", env.vars);
+
+        // symbol tables iterate in hash order; sort to keep snapshots diffable.
+        sort(lines.begin(), lines.end());
+        for (const auto& line : lines) os << line << '\n';
+    }
+
+    auto load(istream& is) -> environment_t {
+        auto env = environment_t();
+        env.context = context_t::fn;
+
+        auto tbl = string(), name = string(), b = string();
+        while (is >> tbl >> name >> b) define(env, tbl, name, b);
+        return env;
+    }
+}}}  // namespace bt::lang::prelude
@@ -0,0 +1,112 @@
+#include <algorithm>
+
+#include <bullet/analysis/scheduler.hpp>
+
+namespace bt { namespace analysis {
+    using namespace std;
+
+    namespace {
+        // The scheduler the calling thread works for, and its queue there.
+        thread_local const scheduler_t* this_scheduler = nullptr;
+        thread_local size_t this_worker = 0;
+    }  // namespace
+
+    scheduler_t::scheduler_t(size_t workers) {
+        for (size_t i = 0; i <= workers; i++) queues_.push_back(make_unique<queue_t>());
+        for (size_t i = 0; i < workers; i++) threads_.emplace_back([this, i] { work(i); });
+    }
+
+    scheduler_t::~scheduler_t() {
+        {
+            const auto lock = lock_guard(sleep_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    auto scheduler_t::spawn(task_t task) -> void {
+        const auto self = this_scheduler == this ? this_worker : queues_.size() - 1;
+        {
+            auto& queue = *queues_[self];
+            const auto lock = lock_guard(queue.mutex);
+            queue.tasks.push_back(move(task));
+        }
+        queued_++;
+
+        // taking the lock orders the increment before any sleeper's last check.
+        { const auto lock = lock_guard(sleep_mutex_); }
+        wake_.notify_one();
+    }
+
+    auto scheduler_t::signal(atomic<bool>& done) -> void {
+        {
+            const auto lock = lock_guard(sleep_mutex_);
+            done = true;
+        }
+        wake_.notify_all();
+    }
+
+    auto scheduler_t::take(size_t self) -> optional<task_t> {
+        const auto n = queues_.size();
+        const auto take_from = [&](size_t i, bool newest) -> optional<task_t> {
+            auto& queue = *queues_[i];
+            const auto lock = lock_guard(queue.mutex);
+            if (queue.tasks.empty()) return nullopt;
+
+            auto task = newest ? move(queue.tasks.back()) : move(queue.tasks.front());
+            if (newest)
+                queue.tasks.pop_back();
+            else
+                queue.tasks.pop_front();
+            queued_--;
+            return task;
+        };
+
+        // own work first, then the injection queue, then the victims in turn.
+        if (self < n - 1)
+            if (auto task = take_from(self, true)) return task;
+        for (size_t k = 0; k < n; k++) {
+            const auto victim = (n - 1 + k) % n;
+            if (victim == self) continue;
+            if (auto task = take_from(victim, false)) return task;
+        }
+        return nullopt;
+    }
+
+    auto scheduler_t::work(size_t self) -> void {
+        this_scheduler = this;
+        this_worker = self;
+
+        while (true) {
+            if (auto task = take(self)) {
+                (*task)();
+                continue;
+            }
+
+            auto lock = unique_lock(sleep_mutex_);
+            wake_.wait(lock, [&] { return stopping_ || queued_ > 0; });
+            if (stopping_ && queued_ == 0) return;
+        }
+    }
+
+    auto scheduler_t::run_until(const atomic<bool>& done) -> void {
+        // helpers outside the pool share the injection queue.
+        const auto self = this_scheduler == this ? this_worker : queues_.size() - 1;
+
+        while (!done) {
+            if (auto task = take(self)) {
+                (*task)();
+                continue;
+            }
+
+            auto lock = unique_lock(sleep_mutex_);
+            wake_.wait(lock, [&] { return queued_ > 0 || done; });
+        }
+    }
+
+    auto scheduler_t::shared() -> scheduler_t& {
+        static auto scheduler = scheduler_t(max(thread::hardware_concurrency(), 1u) - 1);
+        return scheduler;
+    }
+}}  // namespace bt::analysis
@@ -16,10 +16,8 @@ namespace views = rng::views;
 
 namespace bt { namespace analysis {
     namespace types {
-        atomic<int> nominal_type_t::next_id{0};
-
-        nominal_type_t::nominal_type_t(string fqn, type_t type)
-            : id(++nominal_type_t::next_id), fqn(fqn), type(type) {}
+        nominal_type_t::nominal_type_t(int id, string fqn, type_t type)
+            : id(id), fqn(move(fqn)), type(move(type)) {}
 
         auto operator<<(ostream& os, const nominal_type_t& n) -> ostream& {
             os << n.fqn;
@@ -61,7 +59,8 @@ namespace bt { namespace analysis {
 
         auto operator==(const name_and_type_vector_t& lhs, const name_and_type_vector_t& rhs)
             -> bool {
-            return rng::all_of(views::zip(lhs, rhs),
+            return lhs.size() == rhs.size() &&
+                   rng::all_of(views::zip(lhs, rhs),
                                [](auto&& e) { return get<0>(e) == get<1>(e); });
         }
 
@@ -96,8 +95,20 @@ namespace bt { namespace analysis {
             return os;
         }
 
+        auto operator==(const generator_t& lhs, const generator_t& rhs) -> bool {
+            return lhs.value_type == rhs.value_type;
+        }
+        auto operator!=(const generator_t& lhs, const generator_t& rhs) -> bool {
+            return !(lhs == rhs);
+        }
+        auto operator<<(ostream& os, const generator_t& g) -> ostream& {
+            os << "generator(" << g.value_type << ")";
+            return os;
+        }
+
         auto operator==(const struct_t& lhs, const struct_t& rhs) -> bool {
-            return static_cast<const struct_t&>(lhs) == static_cast<const struct_t&>(rhs);
+            return static_cast<const name_and_type_vector_t&>(lhs) ==
+                   static_cast<const name_and_type_vector_t&>(rhs);
         }
         auto operator!=(const struct_t& lhs, const struct_t& rhs) -> bool { return !(lhs == rhs); }
         auto operator<<(ostream& os, const struct_t& v) -> ostream& {
@@ -115,7 +126,8 @@ namespace bt { namespace analysis {
         }
 
         auto operator==(const tuple_t& lhs, const tuple_t& rhs) -> bool {
-            return rng::all_of(views::zip(lhs, rhs),
+            return lhs.size() == rhs.size() &&
+                   rng::all_of(views::zip(lhs, rhs),
                                [](auto&& e) { return get<0>(e) == get<1>(e); });
         }
         auto operator!=(const tuple_t& lhs, const tuple_t& rhs) -> bool { return !(lhs == rhs); }
@@ -192,7 +204,8 @@ namespace bt { namespace analysis {
         }
 
         auto operator==(const variant_t& lhs, const variant_t& rhs) -> bool {
-            return rng::all_of(views::zip(lhs, rhs),
+            return lhs.size() == rhs.size() &&
+                   rng::all_of(views::zip(lhs, rhs),
                                [](auto&& e) { return get<0>(e) == get<1>(e); });
         }
         auto operator!=(const variant_t& lhs, const variant_t& rhs) -> bool {
@@ -315,14 +328,18 @@ namespace bt { namespace analysis {
         return nullopt;
         */
 
-        auto d_u = implicit_conversion_distance(t_input, u_input);
-        auto d_t = implicit_conversion_distance(u_input, t_input);
+        // operands are values: variables (pointers) promote as what they hold.
+        const auto t = deref(t_input);
+        const auto u = deref(u_input);
+
+        auto d_u = implicit_conversion_distance(t, u);
+        auto d_t = implicit_conversion_distance(u, t);
 
         if (d_u < 0 && d_t < 0) return nullopt;
-        if (d_u >= 0) return u_input;
-        if (d_t >= 0) return t_input;
+        if (d_u >= 0) return u;
+        if (d_t >= 0) return t;
 
-        return d_u < d_t ? u_input : t_input;
+        return d_u < d_t ? u : t;
     }
 
     auto ptr_depth(type_t t) -> int {
@@ -382,6 +399,89 @@ namespace bt { namespace analysis {
         return u;
     }
 
+    auto numeric_elements(const type_t& t) -> optional<type_t> {
+        const auto element =
+            visit(hana::overload([](const types::array_t& a) { return a.value_type; },
+                                 [](const types::slice_t& s) { return s.value_type; },
+                                 [](const types::dynarr_t& d) { return d.value_type; },
+                                 [](const auto&) { return UNKOWN; }),
+                  deref(t).get());
+        if (!is_integral(element) && !is_floating_point(element)) return nullopt;
+        return element;
+    }
+
+    auto elementwise_type(const type_t& t, const type_t& u, const type_t& element)
+        -> optional<type_t> {
+        const auto e_t = numeric_elements(t);
+        const auto e_u = numeric_elements(u);
+        if (!e_t || !e_u || *e_t != *e_u) return nullopt;
+
+        const auto a = deref(t).get().get_if<types::array_t>();
+        const auto b = deref(u).get().get_if<types::array_t>();
+        if (a && b) {
+            if (a->size != b->size) return nullopt;
+            return type_t(type_value(types::array_t{element, a->size}));
+        }
+        const auto n = element_count(t), m = element_count(u);
+        if (n && m) {
+            if (*n != *m) return nullopt;
+            return type_t(type_value(types::array_t{element, {*n}}));
+        }
+        return type_t(type_value(types::dynarr_t{element}));
+    }
+
+    auto slice_count(const types::slice_t& s) -> uint64_t {
+        if (s.stride <= 0 || s.end <= s.begin) return 0;
+        return uint64_t((s.end - s.begin + s.stride - 1) / s.stride);
+    }
+
+    auto element_count(const type_t& t) -> optional<uint64_t> {
+        return visit(hana::overload(
+                         [](const types::array_t& a) -> optional<uint64_t> {
+                             auto n = uint64_t(1);
+                             for (const auto d : a.size) n *= d;
+                             return n;
+                         },
+                         [](const types::slice_t& s) -> optional<uint64_t> {
+                             return slice_count(s);
+                         },
+                         [](const auto&) -> optional<uint64_t> { return nullopt; }),
+                     deref(t).get());
+    }
+
+    auto slice_type(const type_t& t, int64_t begin, int64_t end, int64_t stride)
+        -> optional<type_t> {
+        const auto sequence = deref(t);
+        const auto& u = sequence.get();
+        if (begin < 0 || end < begin || stride < 1) return nullopt;
+        if (const auto n = element_count(sequence); n && uint64_t(end) > *n) return nullopt;
+
+        auto result = types::slice_t{UNKOWN, begin, end, stride};
+        if (const auto a = u.get_if<types::array_t>())
+            result.value_type = a->value_type;
+        else if (const auto d = u.get_if<types::dynarr_t>())
+            result.value_type = d->value_type;
+        else if (u.is<types::string_t>() || u.is<types::strlit_t>())
+            result.value_type = CHAR;
+        else if (const auto s = u.get_if<types::slice_t>()) {
+            result.value_type = s->value_type;
+            result.begin = s->begin + begin * s->stride;
+            result.stride = s->stride * stride;
+        } else
+            return nullopt;
+
+        const auto count = int64_t(slice_count(types::slice_t{UNKOWN, begin, end, stride}));
+        result.end = count ? result.begin + (count - 1) * result.stride + 1 : result.begin;
+        return type_t(type_value(result));
+    }
+
+    auto reduction(string_view name) -> optional<reduction_t> {
+        if (name == "sum") return reduction_t::sum;
+        if (name == "min") return reduction_t::min;
+        if (name == "max") return reduction_t::max;
+        return nullopt;
+    }
+
     auto implicit_conversion_distance(const type_t& src, const type_t& dst) -> int {
         auto& d = dst.get();
 
@@ -405,6 +505,15 @@ namespace bt { namespace analysis {
                 return length;
             }
 
+            // functions convert to the types of functions with their
+            // signature, whatever their parameters are called.
+            if (auto f = candidate.get_if<types::function_t>(), g = d.get_if<types::function_t>();
+                f && g && f->result_type == g->result_type &&
+                f->formal_parameters.size() == g->formal_parameters.size() &&
+                rng::all_of(views::zip(f->formal_parameters, g->formal_parameters),
+                            [](auto&& p) { return get<0>(p).type == get<1>(p).type; }))
+                return length;
+
             using namespace types;
 
             visit(
@@ -487,7 +596,9 @@ namespace bt { namespace analysis {
                             else
                                 candidates.push_back(type_value(types::array_t{t.value_type, nsz}));
                         }
-                        // TODO: slice!
+                        if (t.size.size() == 1)
+                            candidates.push_back(type_value(
+                                types::slice_t{t.value_type, 0, int64_t(t.size.front()), 1}));
                     },
                     [&](const types::strlit_t& t) {
                         candidates.push_back(type_value(types::string_t{}));
@@ -503,4 +614,51 @@ namespace bt { namespace analysis {
 
         return numeric_limits<int>::min();
     }
+
+    namespace {
+        auto combine(size_t seed, size_t h) -> size_t {
+            return seed ^ (h + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+        }
+    }  // namespace
+
+    auto hash_value(const type_t& t) -> size_t {
+        auto h = t.get().index();
+        const auto add = [&](size_t x) { h = combine(h, x); };
+        const auto members = [&](const types::name_and_type_vector_t& v) {
+            for (const auto& m : v) {
+                add(hash<string>()(m.name));
+                add(hash_value(m.type));
+            }
+        };
+        const auto elements = [&](const vector<type_t>& v) {
+            for (const auto& e : v) add(hash_value(e));
+        };
+
+        visit(hana::overload(
+                  [&](const types::function_t& f) {
+                      add(hash_value(f.result_type));
+                      members(f.formal_parameters);
+                  },
+                  [&](const types::generator_t& g) { add(hash_value(g.value_type)); },
+                  [&](const types::struct_t& s) { members(s); },
+                  [&](const types::tuple_t& s) { elements(s); },
+                  [&](const types::variant_t& s) { elements(s); },
+                  [&](const types::ptr_t& p) { add(hash_value(p.value_type)); },
+                  [&](const types::array_t& a) {
+                      add(hash_value(a.value_type));
+                      for (const auto n : a.size) add(n);
+                  },
+                  [&](const types::dynarr_t& a) { add(hash_value(a.value_type)); },
+                  [&](const types::slice_t& s) {
+                      add(hash_value(s.value_type));
+                      add(s.begin);
+                      add(s.end);
+                      add(s.stride);
+                  },
+                  [&](const types::strlit_t& s) { add(s.size); },
+                  [&](const types::nominal_type_t& n) { add(n.id); },
+                  [](const auto&) {}),
+              t.get());
+        return h;
+    }
 }}  // namespace bt::analysis
@@ -0,0 +1,820 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <bullet/analysis/layout.hpp>
+#include <bullet/backend/c.hpp>
+#include <bullet/ir/lower.hpp>
+
+namespace bt { namespace backend {
+    using namespace std;
+    using parser::syntax::attr_node_t;
+
+    namespace types = analysis::types;
+
+    using analysis::type_t;
+
+    namespace {
+        // calls nested deeper than this fault, as they do in the VM.
+        constexpr auto max_depth = int64_t(1) << 16;
+
+        // What every translation starts with: faults, and the operations C
+        // leaves undefined where the VM defines them.
+        constexpr auto prelude = R"(#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int64_t bt_depth;
+
+_Noreturn static void bt_fault(const char* message) {
+    fprintf(stderr, "%s\n", message);
+    exit(1);
+}
+
+static inline int64_t bt_ipow(int64_t base, int64_t exponent) {
+    if (exponent < 0) return base == 1 ? 1 : base == -1 ? (exponent & 1 ? -1 : 1) : 0;
+    uint64_t result = 1, b = (uint64_t)base;
+    for (uint64_t e = (uint64_t)exponent; e; e >>= 1) {
+        if (e & 1) result *= b;
+        b *= b;
+    }
+    return (int64_t)result;
+}
+
+static inline uint64_t bt_bound(uint64_t i, uint64_t n) {
+    if (i >= n) bt_fault("Array index out of range");
+    return i;
+}
+
+/* division by zero faults, and the smallest integer divided by -1 wraps. */
+#define BT_SIGNED_DIVISION(T, U, name)                        \
+    static inline T bt_div_##name(T a, T b) {                 \
+        if (b == 0) bt_fault("Integer division by zero");     \
+        return b == -1 ? (T)(0 - (U)a) : (T)(a / b);          \
+    }                                                         \
+    static inline T bt_rem_##name(T a, T b) {                 \
+        if (b == 0) bt_fault("Integer division by zero");     \
+        return b == -1 ? 0 : (T)(a % b);                      \
+    }
+#define BT_UNSIGNED_DIVISION(T, name)                         \
+    static inline T bt_div_##name(T a, T b) {                 \
+        if (b == 0) bt_fault("Integer division by zero");     \
+        return (T)(a / b);                                    \
+    }                                                         \
+    static inline T bt_rem_##name(T a, T b) {                 \
+        if (b == 0) bt_fault("Integer division by zero");     \
+        return (T)(a % b);                                    \
+    }
+BT_SIGNED_DIVISION(int8_t, uint32_t, i8)
+BT_SIGNED_DIVISION(int16_t, uint32_t, i16)
+BT_SIGNED_DIVISION(int32_t, uint32_t, i32)
+BT_SIGNED_DIVISION(int64_t, uint64_t, i64)
+BT_UNSIGNED_DIVISION(uint8_t, u8)
+BT_UNSIGNED_DIVISION(uint16_t, u16)
+BT_UNSIGNED_DIVISION(uint32_t, u32)
+BT_UNSIGNED_DIVISION(uint64_t, u64)
+)";
+
+        auto scalar(const type_t& t) -> bool {
+            return analysis::is_integral(t) || analysis::is_floating_point(t) ||
+                   t.get().is<types::bool_t>();
+        }
+
+        auto signed_int(const type_t& t) -> bool {
+            return analysis::is_integral(t) && analysis::is_signed(t);
+        }
+
+        // The number of elements of an array type, all dimensions together.
+        auto length(const type_t& t) -> uint64_t {
+            return analysis::length(t.get().as<types::array_t>());
+        }
+
+        // Bullet names as C identifiers.
+        auto identifier(string_view name) -> string {
+            auto s = string(name);
+            for (auto& c : s)
+                if (!isalnum(static_cast<unsigned char>(c))) c = '_';
+            return s;
+        }
+
+        // Translates a module function by function. Values become locals of
+        // their function, declared on entry and assigned once, phis in the
+        // blocks coming to them; blocks become labels gotos jump to.
+        class translation_t {
+            const ir::module_t& module_;
+            ostringstream types_;
+            ostringstream globals_;
+            ostringstream prototypes_;
+            ostringstream definitions_;
+            // typedef'd names, by definition for anonymous types and by name
+            // for declared ones.
+            unordered_map<string, string> type_names_;
+            unordered_set<string> names_;
+            vector<string> functions_;
+            vector<string> globals_names_;
+
+            // the function being translated.
+            const ir::function_t* fn_ = nullptr;
+            bool top_level_ = false;
+            // the C type of its result, empty for void.
+            string result_;
+            vector<string> parameters_;
+            // the C names of its parameters and slots, by id.
+            vector<string> variables_;
+            // stores its parameters' variables need none of.
+            vector<bool> skipped_;
+            vector<int> block_of_;
+            // the blocks gotos jump to, which get a label.
+            vector<bool> targets_;
+            string body_;
+
+            auto fn() const -> const ir::function_t& { return *fn_; }
+
+            auto line(const string& text) -> void { body_ += "    " + text + "\n"; }
+
+            auto unique(unordered_set<string>& names, const string& base) -> string {
+                auto name = base;
+                for (auto i = 2; !names.insert(name).second; i++) name = base + "_" + to_string(i);
+                return name;
+            }
+
+            auto named(const string& kind, const string& definition) -> string {
+                auto& name = type_names_[definition];
+                if (name.empty()) {
+                    name = "bt_" + kind + "_" + to_string(type_names_.size() - 1);
+                    types_ << "typedef " << definition << " " << name << ";\n";
+                }
+                return name;
+            }
+
+            auto fields(const types::name_and_type_vector_t& members) -> optional<string> {
+                auto s = string("struct {");
+                for (const auto& member : members) {
+                    const auto t = c_type(member.type);
+                    if (t.empty()) return nullopt;
+                    s += " " + t + " " + identifier(member.name) + ";";
+                }
+                return s + " }";
+            }
+
+            // The C type for values of a type, typedef'ing aggregates on first
+            // use; empty if there is none.
+            auto c_type(const type_t& t) -> string {
+                const auto& u = t.get();
+                if (analysis::is_integral(t))
+                    return (analysis::is_signed(t) ? "int" : "uint") +
+                           to_string(analysis::width(t)) + "_t";
+                if (analysis::is_floating_point(t))
+                    return analysis::width(t) == 32 ? "float" : "double";
+                if (u.is<types::bool_t>()) return "bool";
+                if (const auto p = u.get_if<types::ptr_t>()) {
+                    const auto v = c_type(p->value_type);
+                    return v.empty() ? v : v + "*";
+                }
+                if (const auto a = u.get_if<types::array_t>()) {
+                    const auto e = c_type(a->value_type);
+                    if (e.empty() || a->size.empty()) return "";
+                    // laid out flat, as the VM lays arrays out.
+                    const auto n = to_string(length(t));
+                    return named("array", "struct { " + e + " v[" + n + "]; }");
+                }
+                // slices point to the elements of the storage they view.
+                if (const auto s = u.get_if<types::slice_t>()) {
+                    const auto e = c_type(s->value_type);
+                    return e.empty() ? e : e + "*";
+                }
+                if (const auto s = u.get_if<types::struct_t>()) {
+                    const auto f = fields(*s);
+                    return f ? named("struct", *f) : "";
+                }
+                if (const auto v = u.get_if<types::variant_t>()) {
+                    auto s = string("struct { uint8_t tag; union {");
+                    for (auto i = 0u; i < v->size(); i++) {
+                        const auto alternative = c_type((*v)[i]);
+                        if (alternative.empty()) return "";
+                        s += " " + alternative + " as" + to_string(i) + ";";
+                    }
+                    return named("variant", s + " } as; }");
+                }
+                if (const auto n = u.get_if<types::nominal_type_t>()) return declared(*n);
+                return "";
+            }
+
+            // Declared types keep their name; structs are declared ahead of
+            // their fields, which may point back at them.
+            auto declared(const types::nominal_type_t& n) -> string {
+                const auto key = "nominal " + to_string(n.id);
+                if (const auto p = type_names_.find(key); p != type_names_.end()) return p->second;
+
+                const auto name = unique(names_, "bt_t_" + identifier(n.fqn));
+                if (const auto s = n.type.get().get_if<types::struct_t>()) {
+                    type_names_[key] = name;
+                    types_ << "typedef struct " << name << " " << name << ";\n";
+                    const auto f = fields(*s);
+                    if (!f) return type_names_[key] = "";
+                    types_ << "struct " << name << f->substr(string_view("struct").size())
+                           << ";\n";
+                    return name;
+                }
+
+                const auto t = c_type(n.type);
+                if (!t.empty()) types_ << "typedef " << t << " " << name << ";\n";
+                return type_names_[key] = t.empty() ? "" : name;
+            }
+
+            auto zero(const type_t& t) -> string {
+                if (t.get().is<types::bool_t>()) return "false";
+                if (scalar(t) || t.get().is<types::ptr_t>()) return "0";
+                if (const auto s = t.get().get_if<types::slice_t>()) {
+                    const auto n = to_string(max(s->end, int64_t(1)));
+                    return "(" + c_type(s->value_type) + "[" + n + "]){0}";
+                }
+                return "(" + c_type(t) + "){0}";
+            }
+
+            // the unsigned type integer arithmetic on values of t goes through.
+            static auto unsigned_type(const type_t& t) -> string {
+                return t.get().is<types::bool_t>() || analysis::width(t) <= 32 ? "uint32_t"
+                                                                                 : "uint64_t";
+            }
+
+            static auto suffix(const type_t& t) -> string {
+                if (t.get().is<types::bool_t>()) return "u8";
+                return (analysis::is_signed(t) ? "i" : "u") + to_string(analysis::width(t));
+            }
+
+            auto integer(const type_t& t, uint64_t u) -> string {
+                const auto w = t.get().is<types::bool_t>() ? 8 : analysis::width(t);
+                if (t.get().is<types::bool_t>()) return u & 0xff ? "true" : "false";
+                if (signed_int(t)) {
+                    const auto v = w < 64 ? int64_t(u << (64 - w)) >> (64 - w) : int64_t(u);
+                    if (v == INT64_MIN) return "INT64_MIN";
+                    if (v >= 0 && v <= INT32_MAX) return to_string(v);
+                    if (v > INT32_MIN) return "(" + to_string(v) + ")";
+                    return "INT64_C(" + to_string(v) + ")";
+                }
+                if (w < 64) u &= ~uint64_t(0) >> (64 - w);
+                return u <= INT32_MAX ? to_string(u) : "UINT64_C(" + to_string(u) + ")";
+            }
+
+            static auto floating(const type_t& t, double d) -> string {
+                const auto f32 = analysis::width(t) == 32;
+                if (isinf(d)) return string(d < 0 ? "(-" : "(") + (f32 ? "HUGE_VALF" : "HUGE_VAL") + ")";
+
+                auto s = ostringstream();
+                s << setprecision(f32 ? 9 : 17);
+                if (f32)
+                    s << float(d);
+                else
+                    s << d;
+                auto text = s.str();
+                if (text.find_first_of(".e") == string::npos) text += ".0";
+                if (f32) text += "f";
+                return d < 0 ? "(" + text + ")" : text;
+            }
+
+            // Converts a value of one type to another the way the VM does:
+            // integers to floats through double, floats to integers through 64
+            // bits.
+            auto convert(const string& e, const type_t& from, const type_t& to) -> string {
+                const auto t = c_type(to);
+                if (c_type(from) == t) return e;
+
+                const auto x = "(" + e + ")";
+                auto text = string();
+                if (to.get().is<types::bool_t>() && analysis::is_floating_point(from))
+                    text = "((uint8_t)(uint64_t)" + x + " != 0)";
+                else if (to.get().is<types::bool_t>() && scalar(from))
+                    text = "((uint8_t)" + x + " != 0)";
+                else if (analysis::is_floating_point(to) && analysis::is_floating_point(from))
+                    text = "(" + t + ")" + x;
+                else if (analysis::is_floating_point(to) && scalar(from))
+                    text = analysis::width(to) == 32 ? "(float)(double)" + x : "(double)" + x;
+                else if (analysis::is_integral(to) && analysis::is_floating_point(from))
+                    text = "(" + t + ")(" + (signed_int(to) ? "int64_t" : "uint64_t") + ")" + x;
+                else if (analysis::is_integral(to) && scalar(from))
+                    text = "(" + t + ")" + x;
+                else
+                    throw error("The C backend can't convert between these types yet");
+                return text;
+            }
+
+            // The C expression for a value: constants are written out,
+            // parameters named.
+            auto operand(int v) -> string {
+                const auto& i = fn()[v];
+                if (i.op == ir::opcode_t::parameter) return variables_[v];
+                if (i.op != ir::opcode_t::constant) return "t" + to_string(v);
+                if (analysis::is_floating_point(i.type))
+                    return floating(i.type, bit_cast<double>(i.immediate));
+                if (scalar(i.type)) return integer(i.type, i.immediate);
+                return zero(i.type);
+            }
+
+            // The variable an address names.
+            auto variable(int address) -> string {
+                const auto& i = fn()[address];
+                if (i.op == ir::opcode_t::global) return globals_names_[i.immediate];
+                return variables_[address];
+            }
+
+            auto signature(const string& name,
+                           const types::function_t& f,
+                           const vector<string>& parameters) -> string {
+                const auto result = c_type(ir::value_type(f.result_type));
+                auto s = "static " + (result.empty() ? string("void") : result) + " " + name + "(";
+                for (auto i = 0u; i < f.formal_parameters.size(); i++)
+                    s += (i ? ", " : "") + c_type(ir::value_type(f.formal_parameters[i].type)) +
+                         (parameters.empty() ? "" : " " + parameters[i]);
+                return s + (f.formal_parameters.empty() ? "void)" : ")");
+            }
+
+            // Assignments giving the phis of a block their value coming from
+            // another; through copies if one reads a phi another assigns.
+            auto phi_moves(int from, int to) -> vector<string> {
+                auto moves = vector<pair<int, int>>();
+                for (const auto id : fn().blocks[to].instructions) {
+                    const auto& i = fn()[id];
+                    if (i.op != ir::opcode_t::phi) break;
+                    for (auto k = 0u; k < i.blocks.size(); k++)
+                        if (i.blocks[k] == from) moves.emplace_back(id, i.operands[k]);
+                }
+
+                const auto reads_phi = any_of(moves.begin(), moves.end(), [&](const auto& m) {
+                    return m.second != m.first && fn()[m.second].op == ir::opcode_t::phi &&
+                           block_of_[m.second] == to;
+                });
+                auto lines = vector<string>();
+                if (!reads_phi || moves.size() < 2) {
+                    for (const auto& [phi, v] : moves)
+                        if (phi != v) lines.push_back(operand(phi) + " = " + operand(v) + ";");
+                    return lines;
+                }
+                lines.push_back("{");
+                for (auto k = 0u; k < moves.size(); k++)
+                    lines.push_back("    " + c_type(fn()[moves[k].first].type) + " s" +
+                                    to_string(k) + " = " + operand(moves[k].second) + ";");
+                for (auto k = 0u; k < moves.size(); k++)
+                    lines.push_back(operand(moves[k].first) + " = s" + to_string(k) + ";");
+                lines.push_back("}");
+                return lines;
+            }
+
+            auto goto_(int block) -> string {
+                targets_[block] = true;
+                return "goto b" + to_string(block) + ";";
+            }
+
+            auto ret(const ir::instruction_t& i) -> void {
+                if (!top_level_) line("bt_depth = depth;");
+                if (i.operands.empty() || result_.empty())
+                    line("return;");
+                else
+                    line("return " + operand(i.operands[0]) + ";");
+            }
+
+            // a op b, or op a, on values of type t.
+            auto arithmetic(ir::opcode_t op, const type_t& t, const string& a, const string& b)
+                -> string {
+                const auto ct = c_type(t);
+                const auto f = analysis::is_floating_point(t);
+                const auto f32 = f && analysis::width(t) == 32;
+                const auto u = "(" + unsigned_type(t) + ")";
+                if (op == ir::opcode_t::neg)
+                    return f ? "(-" + a + ")" : "(" + ct + ")(0 - " + u + a + ")";
+                if (op == ir::opcode_t::bnot) return "(" + ct + ")~" + u + a;
+
+                const auto symbol = op == ir::opcode_t::add    ? " + "
+                                    : op == ir::opcode_t::sub  ? " - "
+                                    : op == ir::opcode_t::mul  ? " * "
+                                    : op == ir::opcode_t::div  ? " / "
+                                    : op == ir::opcode_t::band ? " & "
+                                    : op == ir::opcode_t::bor  ? " | "
+                                                               : " ^ ";
+                if (f && op == ir::opcode_t::rem)
+                    return string(f32 ? "(float)" : "") + "fmod(" + a + ", " + b + ")";
+                if (f && op == ir::opcode_t::pow)
+                    return string(f32 ? "(float)" : "") + "pow(" + a + ", " + b + ")";
+                if (f) return "(" + a + symbol + b + ")";
+                if (op == ir::opcode_t::div || op == ir::opcode_t::rem)
+                    return string(op == ir::opcode_t::div ? "bt_div_" : "bt_rem_") + suffix(t) +
+                           "(" + a + ", " + b + ")";
+                if (op == ir::opcode_t::pow)
+                    return "(" + ct + ")bt_ipow((int64_t)" + a + ", (int64_t)" + b + ")";
+                if (op == ir::opcode_t::add || op == ir::opcode_t::sub || op == ir::opcode_t::mul)
+                    return "(" + ct + ")(" + u + a + symbol + u + b + ")";
+                return "(" + ct + ")(" + a + symbol + b + ")";
+            }
+
+            auto arithmetic(const ir::instruction_t& i) -> string {
+                const auto a = operand(i.operands[0]);
+                const auto b = i.operands.size() > 1 ? operand(i.operands[1]) : string();
+                return arithmetic(i.op, i.type, a, b);
+            }
+
+            static auto comparison(ir::opcode_t op) -> string {
+                return op == ir::opcode_t::eq   ? " == "
+                       : op == ir::opcode_t::ne ? " != "
+                       : op == ir::opcode_t::lt ? " < "
+                       : op == ir::opcode_t::gt ? " > "
+                       : op == ir::opcode_t::le ? " <= "
+                                                : " >= ";
+            }
+
+            // The k-th element of an array or slice: slices index the
+            // storage they view.
+            auto element(int v, const string& k) -> string {
+                const auto s = fn()[v].type.get().get_if<types::slice_t>();
+                if (!s) return operand(v) + ".v[" + k + "]";
+                auto j = k;
+                if (s->stride != 1) j = j + " * " + integer(analysis::U64, uint64_t(s->stride));
+                if (s->begin != 0) j = integer(analysis::U64, uint64_t(s->begin)) + " + " + j;
+                return operand(v) + "[" + j + "]";
+            }
+
+            // Element-wise operations on arrays and slices loop over their
+            // elements.
+            auto elementwise(int id) -> void {
+                const auto& i = fn()[id];
+                const auto element_type = *analysis::numeric_elements(fn()[i.operands[0]].type);
+                const auto n = integer(analysis::U64, length(i.type));
+                const auto a = element(i.operands[0], "bt_k");
+                const auto b = element(i.operands[1], "bt_k");
+                const auto e = i.op >= ir::opcode_t::eq && i.op <= ir::opcode_t::ge
+                                   ? a + comparison(i.op) + b
+                                   : arithmetic(i.op, element_type, a, b);
+                line("for (uint64_t bt_k = 0; bt_k < " + n + "; bt_k++) t" + to_string(id) +
+                     ".v[bt_k] = " + e + ";");
+            }
+
+            // Reductions keep the VM's eight partial results, so sums of
+            // floats come out the same.
+            auto reduce(int id) -> void {
+                const auto& i = fn()[id];
+                const auto n = *analysis::element_count(fn()[i.operands[0]].type);
+                if (n == 0) {
+                    line("bt_fault(\"Reduction of an empty array\");");
+                    return;
+                }
+                const auto x = i.operands[0];
+                const auto r = analysis::reduction_t(i.immediate);
+                const auto combine = [&](const string& p, const string& e) {
+                    if (r == analysis::reduction_t::sum)
+                        return arithmetic(ir::opcode_t::add, i.type, p, e);
+                    const auto symbol = r == analysis::reduction_t::min ? " < " : " > ";
+                    return "(" + e + symbol + p + " ? " + e + " : " + p + ")";
+                };
+                const auto first = r == analysis::reduction_t::sum ? zero(i.type) : element(x, "0");
+                line("{");
+                line("    " + c_type(i.type) + " bt_p[8];");
+                line("    for (int bt_j = 0; bt_j < 8; bt_j++) bt_p[bt_j] = " + first + ";");
+                line("    for (uint64_t bt_k = 0; bt_k < " + integer(analysis::U64, n) +
+                     "; bt_k++)");
+                line("        bt_p[bt_k % 8] = " + combine("bt_p[bt_k % 8]", element(x, "bt_k")) +
+                     ";");
+                line("    for (int bt_w = 1; bt_w < 8; bt_w *= 2)");
+                line("        for (int bt_j = 0; bt_j < 8; bt_j += 2 * bt_w)");
+                line("            bt_p[bt_j] = " + combine("bt_p[bt_j]", "bt_p[bt_j + bt_w]") +
+                     ";");
+                line("    t" + to_string(id) + " = bt_p[0];");
+                line("}");
+            }
+
+            auto instruction(int id, int next) -> void {
+                const auto& i = fn()[id];
+                const auto t = "t" + to_string(id);
+                const auto arguments = [&] {
+                    auto s = string();
+                    for (auto k = 0u; k < i.operands.size(); k++)
+                        s += (k ? ", " : "") + operand(i.operands[k]);
+                    return s;
+                };
+
+                switch (i.op) {
+                case ir::opcode_t::constant:
+                case ir::opcode_t::parameter:
+                case ir::opcode_t::slot:
+                case ir::opcode_t::global:
+                case ir::opcode_t::phi: return;
+
+                case ir::opcode_t::add:
+                case ir::opcode_t::sub:
+                case ir::opcode_t::mul:
+                case ir::opcode_t::div:
+                case ir::opcode_t::rem:
+                case ir::opcode_t::pow:
+                case ir::opcode_t::neg:
+                case ir::opcode_t::band:
+                case ir::opcode_t::bor:
+                case ir::opcode_t::bxor:
+                case ir::opcode_t::bnot:
+                    if (i.type.get().is<types::array_t>())
+                        elementwise(id);
+                    else
+                        line(t + " = " + arithmetic(i) + ";");
+                    return;
+
+                case ir::opcode_t::eq:
+                case ir::opcode_t::ne:
+                case ir::opcode_t::lt:
+                case ir::opcode_t::le:
+                case ir::opcode_t::gt:
+                case ir::opcode_t::ge:
+                    if (i.type.get().is<types::array_t>())
+                        elementwise(id);
+                    else
+                        line(t + " = " + operand(i.operands[0]) + comparison(i.op) +
+                             operand(i.operands[1]) + ";");
+                    return;
+                case ir::opcode_t::lnot: line(t + " = !" + operand(i.operands[0]) + ";"); return;
+                case ir::opcode_t::convert: {
+                    const auto& from = fn()[i.operands[0]].type;
+                    line(t + " = " + convert(operand(i.operands[0]), from, i.type) + ";");
+                    return;
+                }
+
+                case ir::opcode_t::load: line(t + " = " + variable(i.operands[0]) + ";"); return;
+                case ir::opcode_t::store:
+                    if (!skipped_[id])
+                        line(variable(i.operands[0]) + " = " + operand(i.operands[1]) + ";");
+                    return;
+
+                case ir::opcode_t::array:
+                    line(t + " = (" + c_type(i.type) + "){{" + arguments() + "}};");
+                    return;
+                case ir::opcode_t::length:
+                    line(t + " = " + integer(analysis::U64, length(fn()[i.operands[0]].type)) +
+                         ";");
+                    return;
+                case ir::opcode_t::index: {
+                    if (fn()[i.operands[0]].type.get().is<types::slice_t>()) {
+                        line(t + " = " + operand(i.operands[0]) + "[" + operand(i.operands[1]) +
+                             "];");
+                        return;
+                    }
+                    const auto n = length(fn()[i.operands[0]].type);
+                    line(t + " = " + operand(i.operands[0]) + ".v[bt_bound(" +
+                         operand(i.operands[1]) + ", " + integer(analysis::U64, n) + ")];");
+                    return;
+                }
+                case ir::opcode_t::view: {
+                    const auto from = i.operands[0];
+                    const auto array = fn()[from].type.get().is<types::array_t>();
+                    line(t + " = " + operand(from) + (array ? ".v;" : ";"));
+                    return;
+                }
+                case ir::opcode_t::reduce: reduce(id); return;
+                // arrays live in the frames of functions, and free nothing
+                // when regions end.
+                case ir::opcode_t::mark: line(t + " = 0;"); return;
+                case ir::opcode_t::release: return;
+
+                case ir::opcode_t::call: {
+                    const auto text = functions_[i.immediate] + "(" + arguments() + ")";
+                    if (c_type(i.type).empty())
+                        line(text + ";");
+                    else
+                        line(t + " = " + text + ";");
+                    return;
+                }
+
+                case ir::opcode_t::jump:
+                    for (const auto& s : phi_moves(block_of_[id], i.blocks[0])) line(s);
+                    if (i.blocks[0] != next) line(goto_(i.blocks[0]));
+                    return;
+                case ir::opcode_t::branch: {
+                    const auto block = block_of_[id];
+                    const auto c = operand(i.operands[0]);
+                    const auto on_true = phi_moves(block, i.blocks[0]);
+                    const auto on_false = phi_moves(block, i.blocks[1]);
+                    if (on_true.empty() && on_false.empty() && i.blocks[0] == next) {
+                        line("if (!" + c + ") " + goto_(i.blocks[1]));
+                        return;
+                    }
+                    if (on_true.empty()) {
+                        line("if (" + c + ") " + goto_(i.blocks[0]));
+                    } else {
+                        line("if (" + c + ") {");
+                        for (const auto& s : on_true) line("    " + s);
+                        line("    " + goto_(i.blocks[0]));
+                        line("}");
+                    }
+                    for (const auto& s : on_false) line(s);
+                    if (i.blocks[1] != next) line(goto_(i.blocks[1]));
+                    return;
+                }
+                case ir::opcode_t::ret: ret(i); return;
+
+                default:
+                    throw error("The C backend can't translate this instruction yet", i.location);
+                }
+            }
+
+            // Names the function's parameters and variables, and declares its
+            // values, checking C has types for them.
+            auto declare(const vector<int>& order) -> void {
+                const auto uses = ir::users(fn());
+                auto names = unordered_set<string>(parameters_.begin(), parameters_.end());
+                for (const auto b : order)
+                    for (const auto id : fn().blocks[b].instructions) {
+                        const auto& i = fn()[id];
+                        if (i.op == ir::opcode_t::parameter) {
+                            variables_[id] = parameters_[i.immediate];
+                            continue;
+                        }
+                        if (i.op == ir::opcode_t::constant || i.op == ir::opcode_t::global ||
+                            i.type.get().is<types::void_t>())
+                            continue;
+
+                        if (i.op != ir::opcode_t::slot) {
+                            const auto ct = c_type(i.type);
+                            if (ct.empty())
+                                throw error("The C backend can't compute values of this type yet",
+                                            i.location);
+                            line(ct + " t" + to_string(id) + ";");
+                            continue;
+                        }
+
+                        // a variable only ever set to a parameter is that
+                        // parameter.
+                        const auto element = i.type.get().as<types::ptr_t>().value_type;
+                        auto stores = vector<int>();
+                        for (const auto u : uses[id])
+                            if (fn()[u].op == ir::opcode_t::store) stores.push_back(u);
+                        if (stores.size() == 1) {
+                            const auto& v = fn()[fn()[stores[0]].operands[1]];
+                            if (v.op == ir::opcode_t::parameter) {
+                                variables_[id] = parameters_[v.immediate];
+                                skipped_[stores[0]] = true;
+                                continue;
+                            }
+                        }
+
+                        const auto ct = c_type(element);
+                        if (ct.empty())
+                            throw error("The C backend can't store values of this type yet",
+                                        i.location);
+                        variables_[id] = unique(names, "v_" + identifier(i.name));
+                        line(ct + " " + variables_[id] + " = " + zero(element) + ";");
+                    }
+            }
+
+            auto function(int index) -> string {
+                fn_ = &module_.functions[index];
+                top_level_ = index == 0;
+                body_.clear();
+                variables_.assign(fn().values.size(), "");
+                skipped_.assign(fn().values.size(), false);
+                block_of_ = ir::block_of(fn());
+
+                parameters_.clear();
+                auto names = unordered_set<string>();
+                if (const auto f = fn().type.get().get_if<types::function_t>()) {
+                    for (const auto& parameter : f->formal_parameters)
+                        parameters_.push_back(unique(names, "v_" + identifier(parameter.name)));
+                    // slices of the function's own values would outlive them.
+                    if (ir::value_type(f->result_type).get().is<types::slice_t>())
+                        throw error("The C backend can't return slices yet");
+                    result_ = c_type(ir::value_type(f->result_type));
+                } else {
+                    result_ = scalar(module_.result_type) ? c_type(module_.result_type) : "";
+                }
+
+                auto order = ir::reverse_post_order(fn());
+                sort(order.begin(), order.end());
+
+                if (!top_level_) {
+                    line("const int64_t depth = bt_depth;");
+                    line("if (depth == 0) bt_fault(\"Stack overflow\");");
+                    line("bt_depth = depth - 1;");
+                }
+                declare(order);
+                const auto prologue = move(body_);
+
+                // blocks in order, labelled if something jumps to them.
+                targets_.assign(fn().blocks.size(), false);
+                auto blocks = vector<string>();
+                for (auto k = 0u; k < order.size(); k++) {
+                    body_.clear();
+                    const auto next = k + 1 < order.size() ? order[k + 1] : -1;
+                    for (const auto id : fn().blocks[order[k]].instructions) instruction(id, next);
+                    blocks.push_back(move(body_));
+                }
+
+                auto s = prologue;
+                for (auto k = 0u; k < order.size(); k++) {
+                    if (targets_[order[k]])
+                        s += "b" + to_string(order[k]) + (blocks[k].empty() ? ":;\n" : ":\n");
+                    s += blocks[k];
+                }
+                return s;
+            }
+
+        public:
+            explicit translation_t(const ir::module_t& module) : module_(module) {}
+
+            // Translates the module; its top level becomes bt_main.
+            auto program(const string& name) -> string {
+                // declared types are typedef'd, whether used or not.
+                for (const auto& t : module_.types) c_type(t);
+                for (const auto& g : module_.globals) {
+                    const auto ct = c_type(g.type);
+                    if (ct.empty())
+                        throw error("The C backend can't store values of this type yet");
+                    globals_names_.push_back(unique(names_, "g_" + identifier(g.name)));
+                    globals_ << "static " << ct << " " << globals_names_.back() << ";\n";
+                }
+
+                functions_.push_back("bt_main");
+                for (auto f = 1u; f < module_.functions.size(); f++) {
+                    const auto& fn = module_.functions[f];
+                    const auto ty = fn.type.get().get_if<types::function_t>();
+                    if (!ty) throw error("Function without a function type");
+                    for (const auto& parameter : ty->formal_parameters)
+                        if (c_type(ir::value_type(parameter.type)).empty())
+                            throw error("The C backend can't pass values of this type yet");
+                    functions_.push_back(unique(names_, "f_" + identifier(fn.name)));
+                    prototypes_ << signature(functions_.back(), *ty, {}) << ";\n";
+                }
+                for (auto f = 1u; f < module_.functions.size(); f++) {
+                    const auto body = function(int(f));
+                    const auto& ty = fn().type.get().as<types::function_t>();
+                    definitions_ << signature(functions_[f], ty, parameters_) << " {\n"
+                                 << body << "}\n\n";
+                }
+
+                const auto main = function(0);
+                const auto& result_type = module_.result_type;
+                const auto result = result_;
+
+                auto s = ostringstream();
+                s << "/* " << identifier(name) << ", translated to C11 by btc. */\n\n"
+                  << prelude << "\n";
+                if (!types_.str().empty()) s << types_.str() << "\n";
+                if (!globals_.str().empty()) s << globals_.str() << "\n";
+                if (!prototypes_.str().empty()) s << prototypes_.str() << "\n";
+                s << definitions_.str();
+                s << "static " << (result.empty() ? "void" : result) << " bt_main(void) {\n"
+                  << main << "}\n\n";
+
+                s << "int main(void) {\n    bt_depth = " << max_depth << ";\n";
+                if (result.empty())
+                    s << "    bt_main();\n";
+                else if (result_type.get().is<types::bool_t>())
+                    s << "    puts(bt_main() ? \"true\" : \"false\");\n";
+                else if (analysis::is_floating_point(result_type))
+                    s << "    printf(\"%g\\n\", (double)bt_main());\n";
+                else if (analysis::is_signed(result_type))
+                    s << "    printf(\"%\" PRId64 \"\\n\", (int64_t)bt_main());\n";
+                else
+                    s << "    printf(\"%\" PRIu64 \"\\n\", (uint64_t)bt_main());\n";
+                s << "    return 0;\n}\n";
+                return s.str();
+            }
+        };
+
+        // quoted for the shell.
+        auto quote(const string& s) -> string {
+            auto q = string("'");
+            for (const auto c : s) q += c == '\'' ? string("'\\''") : string(1, c);
+            return q + "'";
+        }
+    }  // namespace
+
+    auto emit_c(const ir::module_t& module, const string& name) -> string {
+        return translation_t(module).program(name);
+    }
+
+    auto emit_c(const attr_node_t<type_t>& ast, const string& name) -> string {
+        try {
+            return emit_c(ir::lower(ast), name);
+        } catch (const ir::error& e) {
+            throw error(e.what());
+        }
+    }
+
+    auto compile_c(const string& source, const string& output, const string& flags) -> void {
+        const auto cc = getenv("CC");
+        const auto command = string(cc && *cc ? cc : "cc") + " " + flags + " -std=c11 -x c -o " +
+                             quote(output) + " - -lm";
+
+        const auto pipe = popen(command.c_str(), "w");
+        if (!pipe) throw error("Can't run \"" + command + "\"");
+        const auto written = fwrite(source.data(), 1, source.size(), pipe);
+        const auto status = pclose(pipe);
+        if (written != source.size() || status != 0)
+            throw error("\"" + command + "\" failed with status " + to_string(status));
+    }
+}}  // namespace bt::backend
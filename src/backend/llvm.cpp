@@ -0,0 +1,849 @@
+#include <algorithm>
+#include <bit>
+#include <csetjmp>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <bullet/analysis/layout.hpp>
+#include <bullet/backend/llvm.hpp>
+#include <bullet/ir/lower.hpp>
+
+namespace bt { namespace backend {
+    using namespace std;
+    using parser::syntax::attr_node_t;
+
+    namespace types = analysis::types;
+
+    using analysis::type_t;
+
+    namespace {
+        // calls nested deeper than this fault, as they do in the VM.
+        constexpr auto max_depth = int64_t(1) << 16;
+
+        // where faults in compiled code return to: the innermost run().
+        thread_local jmp_buf* fault_handler = nullptr;
+        thread_local const char* fault_message = nullptr;
+
+        [[noreturn]] auto fault(const char* message) -> void {
+            fault_message = message;
+            longjmp(*fault_handler, 1);
+        }
+
+        auto initialize() -> void {
+            static auto once = once_flag();
+            call_once(once, [] {
+                llvm::InitializeNativeTarget();
+                llvm::InitializeNativeTargetAsmPrinter();
+                llvm::InitializeNativeTargetAsmParser();
+            });
+        }
+
+        template <typename T>
+        auto check(llvm::Expected<T> e) -> T {
+            if (!e) throw error(llvm::toString(e.takeError()));
+            return move(*e);
+        }
+
+        auto check(llvm::Error e) -> void {
+            if (e) throw error(llvm::toString(move(e)));
+        }
+
+        // position independent, so objects link into any executable.
+        auto host_target() -> unique_ptr<llvm::TargetMachine> {
+            auto builder = check(llvm::orc::JITTargetMachineBuilder::detectHost());
+            builder.setRelocationModel(llvm::Reloc::PIC_);
+            builder.setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive);
+            return check(builder.createTargetMachine());
+        }
+
+        auto signed_int(const type_t& t) -> bool {
+            return analysis::is_integral(t) && analysis::is_signed(t);
+        }
+
+        // The number of elements of an array type, all dimensions together.
+        auto length(const type_t& t) -> uint64_t {
+            return analysis::length(t.get().as<types::array_t>());
+        }
+
+        // Generates the functions of a module. IR values become LLVM values,
+        // slots stack slots allocated on entry and globals internal globals;
+        // arrays are held by reference to their storage, and slices by a
+        // pointer to the first element of the storage they view.
+        class codegen_t {
+            llvm::LLVMContext& context_;
+            llvm::Module& module_;
+            const ir::module_t& ir_module_;
+            llvm::IRBuilder<> b_;
+            llvm::GlobalVariable* depth_;
+            unordered_map<string, llvm::Constant*> messages_;
+            vector<llvm::Function*> functions_;
+            vector<llvm::GlobalVariable*> globals_;
+
+            // the function being generated.
+            const ir::function_t* ir_ = nullptr;
+            llvm::Function* fn_ = nullptr;
+            // the call depth left on entry, restored on return.
+            llvm::Value* depth_left_ = nullptr;
+            vector<llvm::Value*> values_;
+            vector<llvm::BasicBlock*> blocks_;
+            // the block each IR block ends in, which faults split.
+            vector<llvm::BasicBlock*> ends_;
+
+            auto fn() -> llvm::Function* { return fn_; }
+            auto top_level() const -> bool { return fn_ == functions_[0]; }
+
+            auto block(const string& name) -> llvm::BasicBlock* {
+                return llvm::BasicBlock::Create(context_, name, fn());
+            }
+
+            // A stack slot, allocated once on entry to the function.
+            auto slot(llvm::Type* t, const string& name) -> llvm::AllocaInst* {
+                auto& entry = fn()->getEntryBlock();
+                auto b = llvm::IRBuilder<>(&entry, entry.begin());
+                return b.CreateAlloca(t, nullptr, name);
+            }
+
+            auto fault_if(llvm::Value* condition, const string& message) -> void {
+                auto& text = messages_[message];
+                if (!text) text = b_.CreateGlobalStringPtr(message, "message");
+
+                auto* fail = block("fault");
+                auto* ok = block("ok");
+                b_.CreateCondBr(condition, fail, ok,
+                                llvm::MDBuilder(context_).createBranchWeights(1, 1 << 20));
+                b_.SetInsertPoint(fail);
+                b_.CreateCall(module_.getFunction("bt_fault"), {text});
+                b_.CreateUnreachable();
+                b_.SetInsertPoint(ok);
+            }
+
+            // How values of a type are laid out in memory.
+            auto storage(const type_t& t) -> llvm::Type* {
+                const auto& u = t.get();
+                if (analysis::is_integral(t)) return b_.getIntNTy(analysis::width(t));
+                if (analysis::is_floating_point(t))
+                    return analysis::width(t) == 32 ? b_.getFloatTy() : b_.getDoubleTy();
+                if (u.is<types::bool_t>()) return b_.getInt1Ty();
+                if (const auto p = u.get_if<types::ptr_t>()) {
+                    auto* v = storage(p->value_type);
+                    return v ? v->getPointerTo() : nullptr;
+                }
+                // laid out flat, as the VM lays arrays out.
+                if (const auto a = u.get_if<types::array_t>()) {
+                    auto* e = a->size.empty() ? nullptr : storage(a->value_type);
+                    return e ? llvm::ArrayType::get(e, length(t)) : nullptr;
+                }
+                if (const auto s = u.get_if<types::struct_t>()) {
+                    auto fields = vector<llvm::Type*>();
+                    for (const auto& field : *s) {
+                        fields.push_back(storage(field.type));
+                        if (!fields.back()) return nullptr;
+                    }
+                    return llvm::StructType::get(context_, fields);
+                }
+                if (const auto s = u.get_if<types::slice_t>()) {
+                    auto* e = storage(s->value_type);
+                    return e ? e->getPointerTo() : nullptr;
+                }
+                if (const auto n = u.get_if<types::nominal_type_t>()) return storage(n->type);
+                return nullptr;
+            }
+
+            // How values of a type are held in registers: arrays by reference.
+            auto repr(const type_t& t) -> llvm::Type* {
+                auto* s = storage(t);
+                if (s && t.get().is<types::array_t>()) return s->getPointerTo();
+                return s;
+            }
+
+            auto scalar(const type_t& t) -> bool {
+                auto* r = repr(t);
+                return r && (r->isIntegerTy() || r->isFloatingPointTy());
+            }
+
+            // arrays nested in arrays are stored inline, and read by reference.
+            auto load_element(llvm::Value* address, const type_t& t) -> llvm::Value* {
+                if (t.get().is<types::array_t>()) return address;
+                return b_.CreateLoad(repr(t), address);
+            }
+
+            auto store_element(llvm::Value* v, llvm::Value* address, const type_t& t) -> void {
+                if (t.get().is<types::array_t>()) v = b_.CreateLoad(storage(t), v);
+                b_.CreateStore(v, address);
+            }
+
+            // Converts a value of one type to another the way the VM does:
+            // integers to floats through f64, floats to integers through 64
+            // bits.
+            auto convert(llvm::Value* v, const type_t& from, const type_t& to) -> llvm::Value* {
+                auto* t = repr(to);
+                if (!v || !t) return nullptr;
+                auto* f = v->getType();
+                if (f == t) return v;
+
+                const auto s = signed_int(from);
+                if (f->isIntegerTy() && t->isIntegerTy(1))
+                    return b_.CreateICmpNE(b_.CreateTrunc(v, b_.getInt8Ty()), b_.getInt8(0));
+                if (f->isIntegerTy() && t->isIntegerTy()) return b_.CreateIntCast(v, t, s);
+                if (f->isIntegerTy() && t->isFloatingPointTy()) {
+                    auto* d = s ? b_.CreateSIToFP(v, b_.getDoubleTy())
+                                : b_.CreateUIToFP(v, b_.getDoubleTy());
+                    return b_.CreateFPTrunc(d, t);
+                }
+                if (f->isFloatingPointTy() && t->isIntegerTy()) {
+                    const auto to_signed = signed_int(to);
+                    auto* i = to_signed ? b_.CreateFPToSI(v, b_.getInt64Ty())
+                                        : b_.CreateFPToUI(v, b_.getInt64Ty());
+                    return convert(i, to_signed ? analysis::I64 : analysis::U64, to);
+                }
+                if (f->isFloatingPointTy() && t->isFloatingPointTy()) return b_.CreateFPCast(v, t);
+                throw error("The LLVM backend can't convert between these types yet");
+            }
+
+            // A value as the 64-bit word the VM would hold it in.
+            auto word(llvm::Value* v, const type_t& t) -> llvm::Value* {
+                if (!v) return b_.getInt64(0);
+                auto* ty = v->getType();
+                if (ty->isIntegerTy()) return b_.CreateIntCast(v, b_.getInt64Ty(), signed_int(t));
+                if (ty->isFloatingPointTy())
+                    return b_.CreateBitCast(b_.CreateFPExt(v, b_.getDoubleTy()), b_.getInt64Ty());
+                return b_.getInt64(0);
+            }
+
+            // Integer division and remainder: division by zero faults, and the
+            // one quotient that overflows, of the smallest integer by -1, wraps.
+            auto divide(llvm::Value* lhs, llvm::Value* rhs, bool s, bool remainder)
+                -> llvm::Value* {
+                auto* zero = llvm::Constant::getNullValue(rhs->getType());
+                fault_if(b_.CreateICmpEQ(rhs, zero), "Integer division by zero");
+                if (!s) return remainder ? b_.CreateURem(lhs, rhs) : b_.CreateUDiv(lhs, rhs);
+
+                auto* minus_one =
+                    b_.CreateICmpEQ(rhs, llvm::Constant::getAllOnesValue(rhs->getType()));
+                auto* divisor =
+                    b_.CreateSelect(minus_one, llvm::ConstantInt::get(rhs->getType(), 1), rhs);
+                auto* q = remainder ? b_.CreateSRem(lhs, divisor) : b_.CreateSDiv(lhs, divisor);
+                return b_.CreateSelect(minus_one, remainder ? zero : b_.CreateNeg(lhs), q);
+            }
+
+
+            // The LLVM value of an IR value; constants are made on first use.
+            auto value(int v) -> llvm::Value* {
+                if (values_[v]) return values_[v];
+                const auto& i = (*ir_)[v];
+                if (i.op != ir::opcode_t::constant)
+                    throw error("The LLVM backend found a value used before its definition");
+
+                auto* t = repr(i.type);
+                if (!t)
+                    throw error("The LLVM backend can't represent this constant yet", i.location);
+                if (t->isIntegerTy()) {
+                    const auto w = t->getIntegerBitWidth();
+                    const auto mask = w < 64 ? ~uint64_t(0) >> (64 - w) : ~uint64_t(0);
+                    return values_[v] = llvm::ConstantInt::get(t, i.immediate & mask);
+                }
+                if (t->isFloatingPointTy())
+                    return values_[v] = llvm::ConstantFP::get(t, bit_cast<double>(i.immediate));
+                if (i.type.get().is<types::array_t>()) {
+                    // the zero value of an array type, which nothing writes.
+                    auto* layout = storage(i.type);
+                    auto* g = new llvm::GlobalVariable(module_, layout, true,
+                                                       llvm::GlobalValue::PrivateLinkage,
+                                                       llvm::Constant::getNullValue(layout),
+                                                       "zeros");
+                    g->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+                    return values_[v] = g;
+                }
+                if (const auto s = i.type.get().get_if<types::slice_t>()) {
+                    // and of a slice type, viewing as many zeros.
+                    const auto n = uint64_t(max(s->end, int64_t(1)));
+                    auto* layout = llvm::ArrayType::get(storage(s->value_type), n);
+                    auto* g = new llvm::GlobalVariable(module_, layout, true,
+                                                       llvm::GlobalValue::PrivateLinkage,
+                                                       llvm::Constant::getNullValue(layout),
+                                                       "zeros");
+                    g->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+                    llvm::Constant* indices[] = {b_.getInt64(0), b_.getInt64(0)};
+                    return values_[v] =
+                               llvm::ConstantExpr::getInBoundsGetElementPtr(layout, g, indices);
+                }
+                return values_[v] = llvm::Constant::getNullValue(t);
+            }
+
+            auto arithmetic(const ir::instruction_t& i) -> llvm::Value* {
+                auto* lhs = value(i.operands[0]);
+                auto* rhs = i.operands.size() > 1 ? value(i.operands[1]) : nullptr;
+                return arithmetic(i.op, i.type, lhs, rhs);
+            }
+
+            // lhs op rhs, or op lhs, on values of type t.
+            auto arithmetic(ir::opcode_t op, const type_t& t, llvm::Value* lhs, llvm::Value* rhs)
+                -> llvm::Value* {
+                auto* ty = repr(t);
+                const auto f = ty->isFloatingPointTy();
+                const auto s = signed_int(t);
+                if (op == ir::opcode_t::neg) return f ? b_.CreateFNeg(lhs) : b_.CreateNeg(lhs);
+                if (op == ir::opcode_t::bnot) return b_.CreateNot(lhs);
+
+                switch (op) {
+                case ir::opcode_t::add: return f ? b_.CreateFAdd(lhs, rhs) : b_.CreateAdd(lhs, rhs);
+                case ir::opcode_t::sub: return f ? b_.CreateFSub(lhs, rhs) : b_.CreateSub(lhs, rhs);
+                case ir::opcode_t::mul: return f ? b_.CreateFMul(lhs, rhs) : b_.CreateMul(lhs, rhs);
+                case ir::opcode_t::div:
+                    return f ? b_.CreateFDiv(lhs, rhs) : divide(lhs, rhs, s, false);
+                case ir::opcode_t::rem:
+                    return f ? b_.CreateFRem(lhs, rhs) : divide(lhs, rhs, s, true);
+                case ir::opcode_t::band: return b_.CreateAnd(lhs, rhs);
+                case ir::opcode_t::bor: return b_.CreateOr(lhs, rhs);
+                case ir::opcode_t::bxor: return b_.CreateXor(lhs, rhs);
+                default: break;
+                }
+
+                if (f) {
+                    // in double precision, then rounded, as the VM does.
+                    auto* d = b_.CreateBinaryIntrinsic(llvm::Intrinsic::pow,
+                                                       b_.CreateFPExt(lhs, b_.getDoubleTy()),
+                                                       b_.CreateFPExt(rhs, b_.getDoubleTy()));
+                    return b_.CreateFPTrunc(d, ty);
+                }
+                const auto wide = [&](llvm::Value* x) {
+                    return b_.CreateIntCast(x, b_.getInt64Ty(), s);
+                };
+                auto* p = b_.CreateCall(module_.getFunction("bt_ipow"), {wide(lhs), wide(rhs)});
+                return b_.CreateTrunc(p, ty);
+            }
+
+            auto compare(const ir::instruction_t& i) -> llvm::Value* {
+                const auto& t = (*ir_)[i.operands[0]].type;
+                return compare(i.op, t, value(i.operands[0]), value(i.operands[1]));
+            }
+
+            // lhs op rhs, for values of type t.
+            auto compare(ir::opcode_t op, const type_t& t, llvm::Value* lhs, llvm::Value* rhs)
+                -> llvm::Value* {
+                using p = llvm::CmpInst::Predicate;
+                if (repr(t)->isFloatingPointTy())
+                    return b_.CreateFCmp(op == ir::opcode_t::eq   ? p::FCMP_OEQ
+                                         : op == ir::opcode_t::ne ? p::FCMP_UNE
+                                         : op == ir::opcode_t::lt ? p::FCMP_OLT
+                                         : op == ir::opcode_t::gt ? p::FCMP_OGT
+                                         : op == ir::opcode_t::le ? p::FCMP_OLE
+                                                                  : p::FCMP_OGE,
+                                         lhs,
+                                         rhs);
+                const auto s = signed_int(t);
+                return b_.CreateICmp(op == ir::opcode_t::eq   ? p::ICMP_EQ
+                                     : op == ir::opcode_t::ne ? p::ICMP_NE
+                                     : op == ir::opcode_t::lt ? (s ? p::ICMP_SLT : p::ICMP_ULT)
+                                     : op == ir::opcode_t::gt ? (s ? p::ICMP_SGT : p::ICMP_UGT)
+                                     : op == ir::opcode_t::le ? (s ? p::ICMP_SLE : p::ICMP_ULE)
+                                                              : (s ? p::ICMP_SGE : p::ICMP_UGE),
+                                     lhs,
+                                     rhs);
+            }
+
+            // arrays of constants are constants.
+            auto array(const ir::instruction_t& i) -> llvm::Value* {
+                const auto& element = i.type.get().as<types::array_t>().value_type;
+                auto* layout = storage(i.type);
+                if (!layout || i.operands.size() != length(i.type))
+                    throw error("The LLVM backend can't lay out this array yet", i.location);
+
+                auto elements = vector<llvm::Constant*>();
+                for (const auto v : i.operands) {
+                    if ((*ir_)[v].op != ir::opcode_t::constant || !scalar(element)) break;
+                    elements.push_back(llvm::cast<llvm::Constant>(value(v)));
+                }
+                if (elements.size() == i.operands.size()) {
+                    auto* g = new llvm::GlobalVariable(
+                        module_, layout, true, llvm::GlobalValue::PrivateLinkage,
+                        llvm::ConstantArray::get(llvm::cast<llvm::ArrayType>(layout), elements),
+                        "array");
+                    g->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+                    return g;
+                }
+
+                auto* a = slot(layout, "array");
+                for (auto k = 0u; k < i.operands.size(); k++)
+                    store_element(value(i.operands[k]),
+                                  b_.CreateConstInBoundsGEP2_64(layout, a, 0, k),
+                                  element);
+                return a;
+            }
+
+            auto index(const ir::instruction_t& i) -> llvm::Value* {
+                const auto& t = (*ir_)[i.operands[0]].type;
+                auto* k = value(i.operands[1]);
+                // slices are indexed where lowering keeps them.
+                if (t.get().is<types::slice_t>()) {
+                    auto* address = b_.CreateInBoundsGEP(storage(i.type), value(i.operands[0]), k);
+                    return load_element(address, i.type);
+                }
+                fault_if(b_.CreateICmpUGE(k, b_.getInt64(length(t))), "Array index out of range");
+                llvm::Value* indices[] = {b_.getInt64(0), k};
+                auto* address = b_.CreateInBoundsGEP(storage(t), value(i.operands[0]), indices);
+                return load_element(address, i.type);
+            }
+
+            // Runs body for k from 0 to n - 1, in a loop.
+            template <typename Body>
+            auto loop(uint64_t n, Body&& body) -> void {
+                if (n == 0) return;
+                auto* entry = b_.GetInsertBlock();
+                auto* head = block("loop");
+                auto* done = block("done");
+                b_.CreateBr(head);
+                b_.SetInsertPoint(head);
+                auto* k = b_.CreatePHI(b_.getInt64Ty(), 2, "k");
+                k->addIncoming(b_.getInt64(0), entry);
+                body(k);
+                auto* next = b_.CreateAdd(k, b_.getInt64(1));
+                k->addIncoming(next, b_.GetInsertBlock());
+                b_.CreateCondBr(b_.CreateICmpULT(next, b_.getInt64(n)), head, done);
+                b_.SetInsertPoint(done);
+            }
+
+            // the address of element k of the array a laid out as layout.
+            auto element(llvm::Type* layout, llvm::Value* a, llvm::Value* k) -> llvm::Value* {
+                llvm::Value* indices[] = {b_.getInt64(0), k};
+                return b_.CreateInBoundsGEP(layout, a, indices);
+            }
+
+            // the address of the k-th element of the array or slice v:
+            // slices index the storage they view.
+            auto element(int v, llvm::Value* k) -> llvm::Value* {
+                const auto& t = (*ir_)[v].type;
+                const auto s = t.get().get_if<types::slice_t>();
+                if (!s) return element(storage(t), value(v), k);
+                if (s->stride != 1) k = b_.CreateMul(k, b_.getInt64(uint64_t(s->stride)));
+                if (s->begin != 0) k = b_.CreateAdd(k, b_.getInt64(uint64_t(s->begin)));
+                return b_.CreateInBoundsGEP(storage(s->value_type), value(v), k);
+            }
+
+            // Element-wise operations on arrays and slices loop over their
+            // elements, which LLVM vectorizes.
+            auto elementwise(const ir::instruction_t& i) -> llvm::Value* {
+                const auto e = *analysis::numeric_elements((*ir_)[i.operands[0]].type);
+                auto* layout = storage(i.type);
+                auto* out = slot(layout, "array");
+                loop(length(i.type), [&](llvm::Value* k) {
+                    auto* x = b_.CreateLoad(storage(e), element(i.operands[0], k));
+                    auto* y = b_.CreateLoad(storage(e), element(i.operands[1], k));
+                    auto* v = i.op >= ir::opcode_t::eq && i.op <= ir::opcode_t::ge
+                                  ? compare(i.op, e, x, y)
+                                  : arithmetic(i.op, e, x, y);
+                    b_.CreateStore(v, element(layout, out, k));
+                });
+                return out;
+            }
+
+            // Reductions keep the VM's eight partial results, so sums of
+            // floats come out the same.
+            auto reduce(const ir::instruction_t& i) -> llvm::Value* {
+                const auto n = *analysis::element_count((*ir_)[i.operands[0]].type);
+                auto* t = storage(i.type);
+                if (n == 0) {
+                    fault_if(b_.getTrue(), "Reduction of an empty array");
+                    return llvm::Constant::getNullValue(t);
+                }
+
+                const auto r = analysis::reduction_t(i.immediate);
+                const auto combine = [&](llvm::Value* p, llvm::Value* x) -> llvm::Value* {
+                    if (r == analysis::reduction_t::sum)
+                        return arithmetic(ir::opcode_t::add, i.type, p, x);
+                    const auto op =
+                        r == analysis::reduction_t::min ? ir::opcode_t::lt : ir::opcode_t::gt;
+                    return b_.CreateSelect(compare(op, i.type, x, p), x, p);
+                };
+                const auto a = i.operands[0];
+                auto* eight = llvm::ArrayType::get(t, 8);
+                auto* partials = slot(eight, "partials");
+                llvm::Value* first = llvm::Constant::getNullValue(t);
+                if (r != analysis::reduction_t::sum)
+                    first = b_.CreateLoad(t, element(a, b_.getInt64(0)));
+                for (auto j = 0; j < 8; j++)
+                    b_.CreateStore(first, element(eight, partials, b_.getInt64(j)));
+                loop(n, [&](llvm::Value* k) {
+                    auto* p = element(eight, partials, b_.CreateURem(k, b_.getInt64(8)));
+                    auto* x = b_.CreateLoad(t, element(a, k));
+                    b_.CreateStore(combine(b_.CreateLoad(t, p), x), p);
+                });
+
+                auto q = vector<llvm::Value*>();
+                for (auto j = 0; j < 8; j++)
+                    q.push_back(b_.CreateLoad(t, element(eight, partials, b_.getInt64(j))));
+                for (auto width = 1; width < 8; width *= 2)
+                    for (auto j = 0; j < 8; j += 2 * width) q[j] = combine(q[j], q[j + width]);
+                return q[0];
+            }
+
+            auto ret(const ir::instruction_t& i) -> void {
+                auto* v = i.operands.empty() ? nullptr : value(i.operands[0]);
+                if (top_level()) {
+                    const auto& t = (*ir_)[i.operands.empty() ? 0 : i.operands[0]].type;
+                    b_.CreateRet(v && scalar(t) ? word(v, t) : b_.getInt64(0));
+                    return;
+                }
+                b_.CreateStore(depth_left_, depth_);
+                if (fn()->getReturnType()->isVoidTy())
+                    b_.CreateRetVoid();
+                else
+                    b_.CreateRet(v);
+            }
+
+            auto instruction(int id) -> void {
+                const auto& i = (*ir_)[id];
+                auto& v = values_[id];
+                switch (i.op) {
+                case ir::opcode_t::constant: return;
+                case ir::opcode_t::parameter: v = fn()->getArg(unsigned(i.immediate)); return;
+
+                case ir::opcode_t::add:
+                case ir::opcode_t::sub:
+                case ir::opcode_t::mul:
+                case ir::opcode_t::div:
+                case ir::opcode_t::rem:
+                case ir::opcode_t::pow:
+                case ir::opcode_t::neg:
+                case ir::opcode_t::band:
+                case ir::opcode_t::bor:
+                case ir::opcode_t::bxor:
+                case ir::opcode_t::bnot:
+                    v = i.type.get().is<types::array_t>() ? elementwise(i) : arithmetic(i);
+                    return;
+
+                case ir::opcode_t::eq:
+                case ir::opcode_t::ne:
+                case ir::opcode_t::lt:
+                case ir::opcode_t::le:
+                case ir::opcode_t::gt:
+                case ir::opcode_t::ge:
+                    v = i.type.get().is<types::array_t>() ? elementwise(i) : compare(i);
+                    return;
+                case ir::opcode_t::lnot: v = b_.CreateNot(value(i.operands[0])); return;
+                case ir::opcode_t::convert:
+                    v = convert(value(i.operands[0]), (*ir_)[i.operands[0]].type, i.type);
+                    return;
+
+                case ir::opcode_t::slot: {
+                    const auto& element = i.type.get().as<types::ptr_t>().value_type;
+                    auto* t = repr(element);
+                    if (!t)
+                        throw error("The LLVM backend can't store values of this type yet",
+                                    i.location);
+                    v = slot(t, i.name);
+                    return;
+                }
+                case ir::opcode_t::global: v = globals_[i.immediate]; return;
+                case ir::opcode_t::load: {
+                    const auto& element = i.type;
+                    v = b_.CreateLoad(repr(element), value(i.operands[0]));
+                    return;
+                }
+                case ir::opcode_t::store:
+                    b_.CreateStore(value(i.operands[1]), value(i.operands[0]));
+                    return;
+
+                case ir::opcode_t::array: v = array(i); return;
+                case ir::opcode_t::length:
+                    v = b_.getInt64(length((*ir_)[i.operands[0]].type));
+                    return;
+                case ir::opcode_t::index: v = index(i); return;
+                case ir::opcode_t::view: {
+                    const auto& from = (*ir_)[i.operands[0]].type;
+                    v = value(i.operands[0]);
+                    if (from.get().is<types::array_t>())
+                        v = b_.CreateConstInBoundsGEP2_64(storage(from), v, 0, 0);
+                    return;
+                }
+                case ir::opcode_t::reduce: v = reduce(i); return;
+                // arrays live in the frames of functions, and free nothing
+                // when regions end.
+                case ir::opcode_t::mark: v = b_.getInt64(0); return;
+                case ir::opcode_t::release: return;
+
+                case ir::opcode_t::call: {
+                    auto arguments = vector<llvm::Value*>();
+                    for (const auto a : i.operands) arguments.push_back(value(a));
+                    auto* callee = functions_[i.immediate];
+                    auto* result = b_.CreateCall(callee, arguments);
+                    if (!callee->getReturnType()->isVoidTy()) v = result;
+                    return;
+                }
+                case ir::opcode_t::phi: {
+                    auto* t = repr(i.type);
+                    if (!t)
+                        throw error("The LLVM backend can't compute values of this type yet",
+                                    i.location);
+                    v = b_.CreatePHI(t, unsigned(i.operands.size()));
+                    return;
+                }
+
+                case ir::opcode_t::jump: b_.CreateBr(blocks_[i.blocks[0]]); return;
+                case ir::opcode_t::branch:
+                    b_.CreateCondBr(
+                        value(i.operands[0]), blocks_[i.blocks[0]], blocks_[i.blocks[1]]);
+                    return;
+                case ir::opcode_t::ret: ret(i); return;
+
+                default:
+                    throw error("The LLVM backend can't compile this instruction yet", i.location);
+                }
+            }
+
+            auto function(int index) -> void {
+                ir_ = &ir_module_.functions[index];
+                fn_ = functions_[index];
+                values_.assign(ir_->values.size(), nullptr);
+                blocks_.assign(ir_->blocks.size(), nullptr);
+                ends_.assign(ir_->blocks.size(), nullptr);
+
+                const auto order = ir::reverse_post_order(*ir_);
+                for (const auto b : order) blocks_[b] = block(ir_->blocks[b].name);
+
+                b_.SetInsertPoint(blocks_[0]);
+                if (top_level()) {
+                    b_.CreateStore(b_.getInt64(max_depth), depth_);
+                } else {
+                    depth_left_ = b_.CreateLoad(b_.getInt64Ty(), depth_, "depth");
+                    fault_if(b_.CreateICmpEQ(depth_left_, b_.getInt64(0)), "Stack overflow");
+                    b_.CreateStore(b_.CreateSub(depth_left_, b_.getInt64(1)), depth_);
+                }
+
+                for (const auto b : order) {
+                    if (b != 0) b_.SetInsertPoint(blocks_[b]);
+                    for (const auto id : ir_->blocks[b].instructions) instruction(id);
+                    ends_[b] = b_.GetInsertBlock();
+                }
+
+                // phis last, once every value coming to them is.
+                for (const auto b : order)
+                    for (const auto id : ir_->blocks[b].instructions) {
+                        const auto& i = (*ir_)[id];
+                        if (i.op != ir::opcode_t::phi) break;
+                        auto* phi = llvm::cast<llvm::PHINode>(values_[id]);
+                        for (auto k = 0u; k < i.blocks.size(); k++)
+                            if (ends_[i.blocks[k]])
+                                phi->addIncoming(value(i.operands[k]), ends_[i.blocks[k]]);
+                    }
+            }
+
+        public:
+            codegen_t(llvm::Module& module, const ir::module_t& ir_module)
+                : context_(module.getContext()),
+                  module_(module),
+                  ir_module_(ir_module),
+                  b_(context_) {
+                auto* fault = llvm::Function::Create(
+                    llvm::FunctionType::get(b_.getVoidTy(), {b_.getInt8PtrTy()}, false),
+                    llvm::Function::ExternalLinkage, "bt_fault", module_);
+                fault->setDoesNotReturn();
+                fault->setDoesNotThrow();
+
+                auto* ipow = llvm::Function::Create(
+                    llvm::FunctionType::get(b_.getInt64Ty(), {b_.getInt64Ty(), b_.getInt64Ty()},
+                                            false),
+                    llvm::Function::ExternalLinkage, "bt_ipow", module_);
+                ipow->setDoesNotThrow();
+                ipow->setDoesNotAccessMemory();
+
+                depth_ = new llvm::GlobalVariable(module_, b_.getInt64Ty(), false,
+                                                  llvm::GlobalValue::InternalLinkage,
+                                                  b_.getInt64(0), "depth");
+            }
+
+            // Generates bt_main, which runs the top level, and the module's
+            // other functions; returns the type of its result, void if it
+            // isn't a number.
+            auto program() -> type_t {
+                for (const auto& g : ir_module_.globals) {
+                    auto* t = repr(g.type);
+                    if (!t) throw error("The LLVM backend can't store values of this type yet");
+                    globals_.push_back(new llvm::GlobalVariable(module_, t, false,
+                                                                llvm::GlobalValue::InternalLinkage,
+                                                                llvm::Constant::getNullValue(t),
+                                                                g.name));
+                }
+
+                functions_.push_back(
+                    llvm::Function::Create(llvm::FunctionType::get(b_.getInt64Ty(), false),
+                                           llvm::Function::ExternalLinkage, "bt_main", module_));
+                for (auto f = 1u; f < ir_module_.functions.size(); f++) {
+                    const auto& fn = ir_module_.functions[f];
+                    const auto& signature = fn.type.get().as<types::function_t>();
+                    // arrays live on the stack of the function that builds them,
+                    // as the storage of the slices viewing them may.
+                    const auto result_type = ir::value_type(signature.result_type);
+                    if (result_type.get().is<types::array_t>())
+                        throw error("The LLVM backend can't return arrays yet");
+                    if (result_type.get().is<types::slice_t>())
+                        throw error("The LLVM backend can't return slices yet");
+                    auto* result = repr(result_type);
+                    auto parameters = vector<llvm::Type*>();
+                    for (const auto& parameter : signature.formal_parameters) {
+                        parameters.push_back(repr(ir::value_type(parameter.type)));
+                        if (!parameters.back())
+                            throw error("The LLVM backend can't pass values of this type yet");
+                    }
+                    auto* function = llvm::Function::Create(
+                        llvm::FunctionType::get(result ? result : b_.getVoidTy(), parameters,
+                                                false),
+                        llvm::Function::InternalLinkage, fn.name, module_);
+                    for (auto k = 0u; k < parameters.size(); k++)
+                        function->getArg(k)->setName(signature.formal_parameters[k].name);
+                    functions_.push_back(function);
+                }
+
+                for (auto f = 0u; f < ir_module_.functions.size(); f++) function(int(f));
+                return scalar(ir_module_.result_type) ? ir_module_.result_type : analysis::VOID;
+            }
+        };
+
+        auto lowered(const attr_node_t<type_t>& ast) -> ir::module_t {
+            try {
+                return ir::lower(ast);
+            } catch (const ir::error& e) {
+                throw error(e.what());
+            }
+        }
+    }  // namespace
+
+    struct llvm_module_t::impl_t {
+        llvm::orc::ThreadSafeContext context{make_unique<llvm::LLVMContext>()};
+        unique_ptr<llvm::Module> module;
+        unique_ptr<llvm::TargetMachine> target;
+        type_t result_type;
+
+        unique_ptr<llvm::orc::LLJIT> jit;
+        uint64_t (*main)() = nullptr;
+    };
+
+    llvm_module_t::llvm_module_t(const ir::module_t& module, const string& name)
+        : impl_(make_unique<impl_t>()) {
+        initialize();
+        impl_->module = make_unique<llvm::Module>(name, *impl_->context.getContext());
+        impl_->target = host_target();
+        impl_->module->setDataLayout(impl_->target->createDataLayout());
+        impl_->module->setTargetTriple(impl_->target->getTargetTriple().str());
+        impl_->result_type = codegen_t(*impl_->module, module).program();
+
+        auto message = string();
+        auto os = llvm::raw_string_ostream(message);
+        if (llvm::verifyModule(*impl_->module, &os))
+            throw error("The LLVM backend generated invalid IR: " + os.str());
+    }
+
+    llvm_module_t::llvm_module_t(const attr_node_t<type_t>& ast, const string& name)
+        : llvm_module_t(lowered(ast), name) {}
+
+    llvm_module_t::llvm_module_t(llvm_module_t&&) noexcept = default;
+    llvm_module_t& llvm_module_t::operator=(llvm_module_t&&) noexcept = default;
+    llvm_module_t::~llvm_module_t() = default;
+
+    auto llvm_module_t::optimize(int level) -> void {
+        if (level < 0 || level > 3) throw error("Optimization levels go from 0 to 3");
+
+        auto loops = llvm::LoopAnalysisManager();
+        auto functions = llvm::FunctionAnalysisManager();
+        auto cgscc = llvm::CGSCCAnalysisManager();
+        auto modules = llvm::ModuleAnalysisManager();
+        auto builder = llvm::PassBuilder(impl_->target.get());
+        builder.registerModuleAnalyses(modules);
+        builder.registerCGSCCAnalyses(cgscc);
+        builder.registerFunctionAnalyses(functions);
+        builder.registerLoopAnalyses(loops);
+        builder.crossRegisterProxies(loops, functions, cgscc, modules);
+
+        const llvm::OptimizationLevel levels[] = {llvm::OptimizationLevel::O0,
+                                                  llvm::OptimizationLevel::O1,
+                                                  llvm::OptimizationLevel::O2,
+                                                  llvm::OptimizationLevel::O3};
+        auto pipeline = level == 0 ? builder.buildO0DefaultPipeline(levels[0])
+                                   : builder.buildPerModuleDefaultPipeline(levels[level]);
+        pipeline.run(*impl_->module, modules);
+
+        // compiled again on the next run.
+        impl_->main = nullptr;
+        impl_->jit.reset();
+    }
+
+    auto llvm_module_t::ir() const -> string {
+        auto s = string();
+        auto os = llvm::raw_string_ostream(s);
+        impl_->module->print(os, nullptr);
+        return os.str();
+    }
+
+    auto llvm_module_t::emit_object(const string& path) const -> void {
+        auto ec = std::error_code();
+        auto out = llvm::raw_fd_ostream(path, ec, llvm::sys::fs::OF_None);
+        if (ec) throw error("Can't write \"" + path + "\": " + ec.message());
+
+        // code generation rewrites the module it runs on.
+        auto module = llvm::CloneModule(*impl_->module);
+        auto passes = llvm::legacy::PassManager();
+        if (impl_->target->addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile))
+            throw error("The host target can't emit object files");
+        passes.run(*module);
+        out.flush();
+    }
+
+    auto llvm_module_t::run() -> vm::value_t {
+        if (!impl_->main) {
+            auto jit = check(llvm::orc::LLJITBuilder().create());
+            auto& dylib = jit->getMainJITDylib();
+            auto mangle =
+                llvm::orc::MangleAndInterner(jit->getExecutionSession(), jit->getDataLayout());
+            const auto symbol = [](auto* f) {
+                return llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(f),
+                                                llvm::JITSymbolFlags::Exported);
+            };
+            check(dylib.define(llvm::orc::absoluteSymbols({
+                {mangle("bt_fault"), symbol(&fault)},
+                {mangle("bt_ipow"), symbol(&vm::ipow)},
+            })));
+            // pow, fmod, memcpy and the like.
+            dylib.addGenerator(check(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+                jit->getDataLayout().getGlobalPrefix())));
+
+            check(jit->addIRModule(
+                llvm::orc::ThreadSafeModule(llvm::CloneModule(*impl_->module), impl_->context)));
+            const auto main = check(jit->lookup("bt_main"));
+            impl_->main = llvm::jitTargetAddressToFunction<uint64_t (*)()>(main.getAddress());
+            impl_->jit = move(jit);
+        }
+
+        jmp_buf handler;
+        auto* const previous = fault_handler;
+        fault_handler = &handler;
+        if (setjmp(handler)) {
+            fault_handler = previous;
+            throw error(fault_message);
+        }
+        const auto word = impl_->main();
+        fault_handler = previous;
+        return vm::value_t{.u = word};
+    }
+
+    auto llvm_module_t::result_type() const -> const type_t& { return impl_->result_type; }
+}}  // namespace bt::backend
+
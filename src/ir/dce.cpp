@@ -0,0 +1,59 @@
+#include <algorithm>
+
+#include <bullet/ir/pass.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+
+    namespace {
+        // Slots only ever written: their stores are dead too.
+        auto write_only(const function_t& fn, const vector<vector<int>>& uses, int slot) -> bool {
+            return all_of(uses[slot].begin(), uses[slot].end(), [&](int u) {
+                return fn[u].op == opcode_t::store && fn[u].operands[0] == slot;
+            });
+        }
+
+        auto eliminate(function_t& fn) -> bool {
+            const auto uses = users(fn);
+            auto live = vector<bool>(fn.values.size());
+            auto work = vector<int>();
+
+            for (const auto& block : fn.blocks)
+                for (const auto id : block.instructions) {
+                    const auto& i = fn[id];
+                    if (is_pure(fn, i) || i.op == opcode_t::load) continue;
+                    if (i.op == opcode_t::store && fn[i.operands[0]].op == opcode_t::slot &&
+                        write_only(fn, uses, i.operands[0]))
+                        continue;
+                    live[id] = true;
+                    work.push_back(id);
+                }
+
+            while (!work.empty()) {
+                const auto id = work.back();
+                work.pop_back();
+                for (const auto v : fn[id].operands)
+                    if (!live[v]) {
+                        live[v] = true;
+                        work.push_back(v);
+                    }
+            }
+
+            auto changed = false;
+            for (auto& block : fn.blocks) {
+                auto& instructions = block.instructions;
+                const auto end = remove_if(
+                    instructions.begin(), instructions.end(), [&](int id) { return !live[id]; });
+                changed |= end != instructions.end();
+                instructions.erase(end, instructions.end());
+            }
+            return changed;
+        }
+    }  // namespace
+
+    auto eliminate_dead_code(module_t& module) -> bool {
+        auto changed = false;
+        for (auto& fn : module.functions) changed |= eliminate(fn);
+        return changed;
+    }
+}}  // namespace bt::ir
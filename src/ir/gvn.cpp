@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include <bullet/ir/pass.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+
+    namespace {
+        auto same(const instruction_t& a, const instruction_t& b) -> bool {
+            return a.op == b.op && a.immediate == b.immediate && a.operands == b.operands &&
+                   a.type == b.type;
+        }
+
+        auto hash_of(const instruction_t& i) -> size_t {
+            auto h = hash<uint64_t>()(i.immediate) * 31 + size_t(i.op);
+            for (const auto v : i.operands) h = h * 31 + size_t(v);
+            return h;
+        }
+
+        class numbering_t {
+            function_t& fn_;
+            vector<int> replacement_;
+            vector<vector<int>> children_;
+            // the instructions available in the block being numbered, by hash,
+            // and what each block added, to forget on the way back up.
+            unordered_map<size_t, vector<int>> available_;
+            vector<vector<pair<size_t, int>>> added_;
+            bool changed_ = false;
+            bool regions_ = false;
+
+            auto resolve(int v) -> int {
+                while (replacement_[v] != -1) v = replacement_[v];
+                return v;
+            }
+
+            auto replace(int id, int by) -> void {
+                replacement_[id] = by;
+                changed_ = true;
+            }
+
+            // A phi whose operands are all one value, or itself, is that value.
+            auto trivial(int id) -> int {
+                auto value = -1;
+                for (const auto v : fn_[id].operands) {
+                    if (v == id || v == value) continue;
+                    if (value != -1) return -1;
+                    value = v;
+                }
+                return value;
+            }
+
+            auto number(int block) -> void {
+                auto& added = added_.emplace_back();
+                // what each address holds, as last stored or loaded.
+                auto memory = unordered_map<int, int>();
+
+                for (const auto id : fn_.blocks[block].instructions) {
+                    auto& i = fn_[id];
+                    for (auto& v : i.operands) v = resolve(v);
+
+                    if (i.op == opcode_t::phi) {
+                        if (const auto v = trivial(id); v != -1) replace(id, v);
+                        continue;
+                    }
+                    if (i.op == opcode_t::load) {
+                        const auto p = memory.find(i.operands[0]);
+                        if (p != memory.end())
+                            replace(id, p->second);
+                        else
+                            memory[i.operands[0]] = id;
+                        continue;
+                    }
+                    if (i.op == opcode_t::store) {
+                        memory[i.operands[0]] = i.operands[1];
+                        continue;
+                    }
+                    if (i.op == opcode_t::call) {
+                        // the callee may write any global, but no slot.
+                        erase_if(memory, [&](const auto& entry) {
+                            return fn_[entry.first].op != opcode_t::slot;
+                        });
+                        continue;
+                    }
+                    if (!is_pure(fn_, i) || i.op == opcode_t::slot) continue;
+                    // what a region allocates may be freed before an identical
+                    // value is computed again.
+                    if (regions_ && allocates(i)) continue;
+
+                    if (is_commutative(i.op) && i.operands[0] > i.operands[1])
+                        swap(i.operands[0], i.operands[1]);
+                    const auto h = hash_of(i);
+                    auto& candidates = available_[h];
+                    const auto found = find_if(candidates.begin(), candidates.end(), [&](int c) {
+                        return same(fn_[c], i);
+                    });
+                    if (found != candidates.end()) {
+                        replace(id, *found);
+                        continue;
+                    }
+                    candidates.push_back(id);
+                    added.emplace_back(h, id);
+                }
+            }
+
+            auto forget() -> void {
+                for (const auto& [h, id] : added_.back()) {
+                    auto& candidates = available_[h];
+                    candidates.erase(find(candidates.begin(), candidates.end(), id));
+                }
+                added_.pop_back();
+            }
+
+        public:
+            explicit numbering_t(function_t& fn)
+                : fn_(fn), replacement_(fn.values.size(), -1), children_(fn.blocks.size()) {
+                const auto idom = dominators(fn);
+                for (auto b = 1u; b < fn.blocks.size(); b++)
+                    if (idom[b] != -1) children_[idom[b]].push_back(int(b));
+                for (const auto& block : fn.blocks)
+                    for (const auto id : block.instructions)
+                        regions_ |= fn[id].op == opcode_t::release;
+            }
+
+            auto run() -> bool {
+                // a preorder walk of the dominator tree: values available in a
+                // block are the ones its dominators computed.
+                auto stack = vector<pair<int, size_t>>{{0, 0}};
+                number(0);
+                while (!stack.empty()) {
+                    auto& [b, next] = stack.back();
+                    if (next < children_[b].size()) {
+                        const auto c = children_[b][next++];
+                        number(c);
+                        stack.emplace_back(c, 0);
+                    } else {
+                        forget();
+                        stack.pop_back();
+                    }
+                }
+                if (!changed_) return false;
+
+                for (auto& block : fn_.blocks) {
+                    auto& instructions = block.instructions;
+                    instructions.erase(remove_if(instructions.begin(),
+                                                 instructions.end(),
+                                                 [&](int id) { return replacement_[id] != -1; }),
+                                       instructions.end());
+                }
+                substitute(fn_, replacement_);
+                return true;
+            }
+        };
+    }  // namespace
+
+    auto number_values(module_t& module) -> bool {
+        auto changed = false;
+        for (auto& fn : module.functions) changed |= numbering_t(fn).run();
+        return changed;
+    }
+}}  // namespace bt::ir
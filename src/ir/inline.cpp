@@ -0,0 +1,160 @@
+#include <algorithm>
+
+#include <bullet/ir/pass.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+
+    namespace {
+        auto size(const function_t& fn) -> int {
+            auto n = 0;
+            for (const auto& block : fn.blocks) n += int(block.instructions.size());
+            return n;
+        }
+
+        auto recursive(const function_t& fn, int index) -> bool {
+            for (const auto& block : fn.blocks)
+                for (const auto id : block.instructions)
+                    if (fn[id].op == opcode_t::call && fn[id].immediate == uint64_t(index))
+                        return true;
+            return false;
+        }
+
+        // Replaces the call at position k of a block with a copy of the
+        // callee's blocks, which return to a block holding the rest of it.
+        auto expand(function_t& fn, int block, size_t k, const function_t& callee) -> void {
+            const auto call = fn.blocks[block].instructions[k];
+            const auto arguments = fn[call].operands;
+
+            // the rest of the block, which the block's successors now come
+            // from.
+            const auto rest = int(fn.blocks.size());
+            fn.blocks.push_back(block_t{"after." + callee.name});
+            {
+                auto& instructions = fn.blocks[block].instructions;
+                fn.blocks[rest].instructions.assign(instructions.begin() + k + 1,
+                                                    instructions.end());
+                instructions.resize(k);
+            }
+            for (const auto s : fn.successors(rest))
+                for (const auto id : fn.blocks[s].instructions) {
+                    auto& i = fn[id];
+                    if (i.op != opcode_t::phi) break;
+                    replace(i.blocks.begin(), i.blocks.end(), block, rest);
+                }
+
+            // copies every instruction first, so operands may refer to values
+            // defined later, as phis' do.
+            const auto base = int(fn.blocks.size());
+            auto copy = vector<int>(callee.values.size(), -1);
+            for (const auto& b : callee.blocks)
+                for (const auto id : b.instructions) {
+                    const auto& i = callee[id];
+                    if (i.op == opcode_t::parameter)
+                        copy[id] = arguments[i.immediate];
+                    else
+                        copy[id] = fn.add(i);
+                }
+
+            auto result = instruction_t{opcode_t::phi, callee.result_type};
+            result.location = fn[call].location;
+            auto slots = vector<int>();
+            for (auto b = 0u; b < callee.blocks.size(); b++) {
+                auto& clone = fn.blocks.emplace_back(
+                    block_t{callee.name + "." + callee.blocks[b].name});
+                for (const auto id : callee.blocks[b].instructions) {
+                    if (callee[id].op == opcode_t::parameter) continue;
+                    auto& i = fn[copy[id]];
+                    for (auto& v : i.operands) v = copy[v];
+                    for (auto& s : i.blocks) s += base;
+                    if (i.op == opcode_t::slot) {
+                        slots.push_back(copy[id]);
+                        continue;
+                    }
+                    if (i.op == opcode_t::ret) {
+                        if (!i.operands.empty()) {
+                            result.operands.push_back(i.operands[0]);
+                            result.blocks.push_back(base + int(b));
+                        }
+                        i = instruction_t{
+                            opcode_t::jump, analysis::VOID, {}, {rest}, 0, "", i.location};
+                    }
+                    clone.instructions.push_back(copy[id]);
+                }
+            }
+
+            // the callee's variables become the caller's, allocated on entry.
+            auto& entry = fn.blocks[0].instructions;
+            entry.insert(entry.begin(), slots.begin(), slots.end());
+
+            fn.blocks[block].instructions.push_back(
+                fn.add(instruction_t{opcode_t::jump, analysis::VOID, {}, {base}}));
+
+            if (fn[call].type.get().is<analysis::types::void_t>()) return;
+            auto& after = fn.blocks[rest].instructions;
+            const auto phi = fn.add(move(result));
+            after.insert(after.begin(), phi);
+            auto replacement = vector<int>(fn.values.size(), -1);
+            replacement[call] = phi;
+            substitute(fn, move(replacement));
+        }
+    }  // namespace
+
+    auto inline_calls(module_t& module, int threshold) -> bool {
+        // callees are inlined into before their callers, so calls to the
+        // functions a specialization is passed are gone when it is inlined.
+        // Functions calling each other are copied as they are when the first
+        // is reached again, so the pass ends.
+        const auto n = module.functions.size();
+        auto order = vector<int>();
+        auto seen = vector<bool>(n);
+        for (auto root = 0u; root < n; root++) {
+            if (seen[root]) continue;
+            seen[root] = true;
+            auto stack = vector<pair<int, size_t>>{{int(root), 0}};
+            while (!stack.empty()) {
+                auto& [f, next] = stack.back();
+                const auto& fn = module.functions[f];
+                auto callee = -1;
+                for (; callee == -1 && next < fn.values.size(); next++)
+                    if (fn.values[next].op == opcode_t::call && !seen[fn.values[next].immediate])
+                        callee = int(fn.values[next].immediate);
+                if (callee == -1) {
+                    order.push_back(f);
+                    stack.pop_back();
+                    continue;
+                }
+                seen[callee] = true;
+                stack.emplace_back(callee, 0);
+            }
+        }
+
+        auto changed = false;
+        for (const auto f : order) {
+            auto& fn = module.functions[f];
+            const auto inlinable = [&](int callee) {
+                return callee != 0 && callee != f &&
+                       size(module.functions[callee]) <= threshold &&
+                       !recursive(module.functions[callee], callee);
+            };
+
+            auto sites = vector<int>();
+            for (const auto& block : fn.blocks)
+                for (const auto id : block.instructions)
+                    if (fn[id].op == opcode_t::call && inlinable(int(fn[id].immediate)))
+                        sites.push_back(id);
+
+            for (const auto call : sites) {
+                const auto where = block_of(fn)[call];
+                if (where == -1) continue;
+                const auto& instructions = fn.blocks[where].instructions;
+                const auto k = size_t(
+                    find(instructions.begin(), instructions.end(), call) - instructions.begin());
+                expand(fn, where, k, module.functions[fn[call].immediate]);
+                changed = true;
+            }
+            remove_unreachable(fn);
+        }
+        return changed;
+    }
+}}  // namespace bt::ir
@@ -0,0 +1,438 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <iomanip>
+
+#include <bullet/ir/ir.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+
+    namespace types = analysis::types;
+
+    using analysis::type_t;
+
+    namespace {
+        constexpr auto names = array<string_view, size_t(opcode_t::count)>{
+            "constant", "parameter", "add",    "sub",   "mul",    "div",    "rem",
+            "pow",      "neg",       "band",   "bor",   "bxor",   "bnot",   "eq",
+            "ne",       "lt",        "le",     "gt",    "ge",     "lnot",   "convert",
+            "slot",     "global",    "load",   "store", "array",  "length", "index",
+            "view",     "reduce",    "format", "mark",  "release", "call",  "phi",
+            "jump",     "branch",    "ret",
+        };
+
+        auto label(const function_t& fn, int block) -> string {
+            return fn.blocks[block].name + to_string(block);
+        }
+
+        auto is_text(const type_t& t) -> bool {
+            return t.get().is<types::strlit_t>() || t.get().is<types::string_t>();
+        }
+
+        auto print_constant(ostream& os, const instruction_t& i, const module_t* module) -> void {
+            const auto& t = i.type;
+            if (analysis::is_integral(t))
+                os << (analysis::is_signed(t) ? to_string(int64_t(i.immediate))
+                                              : to_string(i.immediate));
+            else if (analysis::is_floating_point(t))
+                os << bit_cast<double>(i.immediate);
+            else if (t.get().is<types::bool_t>())
+                os << (i.immediate ? "true" : "false");
+            else if (is_text(t) && module && i.immediate < module->strings.size())
+                os << quoted(module->strings[i.immediate]);
+            else if (is_text(t))
+                os << "string #" << i.immediate;
+            else
+                os << "zero";
+        }
+
+        // Lists a function; with a module, calls and globals go by name.
+        auto print(ostream& os, const function_t& fn, const module_t* module) -> void {
+            os << "function " << fn.name;
+            if (const auto f = fn.type.get().get_if<types::function_t>())
+                os << "(" << f->formal_parameters << ")";
+            os << ": " << fn.result_type << endl;
+
+            const auto value = [&](int v) {
+                os << "%" << v;
+            };
+            const auto list = [&](const vector<int>& values) {
+                for (auto k = 0u; k < values.size(); k++) {
+                    if (k) os << ", ";
+                    value(values[k]);
+                }
+            };
+
+            for (auto b = 0u; b < fn.blocks.size(); b++) {
+                os << "  " << label(fn, int(b)) << ":" << endl;
+                for (const auto id : fn.blocks[b].instructions) {
+                    const auto& i = fn[id];
+                    os << "    ";
+                    if (!i.type.get().is<types::void_t>()) {
+                        value(id);
+                        os << ": " << i.type << " = ";
+                    }
+                    os << i.op;
+
+                    switch (i.op) {
+                    case opcode_t::constant:
+                        os << " ";
+                        print_constant(os, i, module);
+                        break;
+                    case opcode_t::parameter: os << " " << i.immediate << " " << i.name; break;
+                    case opcode_t::slot: os << " " << i.name; break;
+                    case opcode_t::global:
+                        os << " @";
+                        if (module)
+                            os << module->globals[i.immediate].name;
+                        else
+                            os << i.immediate;
+                        break;
+                    case opcode_t::call:
+                        os << " @";
+                        if (module)
+                            os << module->functions[i.immediate].name;
+                        else
+                            os << i.immediate;
+                        os << "(";
+                        list(i.operands);
+                        os << ")";
+                        break;
+                    case opcode_t::reduce: {
+                        const auto r = analysis::reduction_t(i.immediate);
+                        os << (r == analysis::reduction_t::sum   ? " sum "
+                               : r == analysis::reduction_t::min ? " min "
+                                                                 : " max ");
+                        list(i.operands);
+                        break;
+                    }
+                    case opcode_t::phi:
+                        for (auto k = 0u; k < i.operands.size(); k++) {
+                            os << (k ? ", [" : " [");
+                            value(i.operands[k]);
+                            os << ", " << label(fn, i.blocks[k]) << "]";
+                        }
+                        break;
+                    default:
+                        if (!i.operands.empty()) os << " ";
+                        list(i.operands);
+                        for (auto k = 0u; k < i.blocks.size(); k++)
+                            os << (k || !i.operands.empty() ? ", " : " ") << label(fn, i.blocks[k]);
+                    }
+                    os << endl;
+                }
+            }
+        }
+    }  // namespace
+
+    auto opcode_name(opcode_t op) -> string_view {
+        return op < opcode_t::count ? names[size_t(op)] : "?";
+    }
+
+    auto operator<<(ostream& os, opcode_t op) -> ostream& {
+        os << opcode_name(op);
+        return os;
+    }
+
+    auto is_terminator(opcode_t op) -> bool {
+        return op == opcode_t::jump || op == opcode_t::branch || op == opcode_t::ret;
+    }
+
+    auto is_commutative(opcode_t op) -> bool {
+        switch (op) {
+        case opcode_t::add:
+        case opcode_t::mul:
+        case opcode_t::band:
+        case opcode_t::bor:
+        case opcode_t::bxor:
+        case opcode_t::eq:
+        case opcode_t::ne: return true;
+        default: return false;
+        }
+    }
+
+    auto function_t::add(instruction_t i) -> int {
+        values.push_back(move(i));
+        return int(values.size()) - 1;
+    }
+
+    auto is_pure(const function_t& fn, const instruction_t& i) -> bool {
+        switch (i.op) {
+        case opcode_t::div:
+        case opcode_t::rem: {
+            // arrays of integers may hold a zero anywhere.
+            if (const auto a = i.type.get().get_if<types::array_t>())
+                return !analysis::is_integral(a->value_type);
+            if (!analysis::is_integral(i.type)) return true;
+            const auto& divisor = fn[i.operands[1]];
+            return divisor.op == opcode_t::constant && divisor.immediate != 0;
+        }
+        case opcode_t::index: {
+            // slices are indexed where lowering keeps them.
+            if (analysis::deref(fn[i.operands[0]].type).get().is<types::slice_t>()) return true;
+            const auto& index = fn[i.operands[1]];
+            const auto a = analysis::deref(fn[i.operands[0]].type).get().get_if<types::array_t>();
+            return index.op == opcode_t::constant && a && !a->size.empty() &&
+                   index.immediate < a->size[0];
+        }
+        case opcode_t::load:
+        case opcode_t::store:
+        case opcode_t::mark:
+        case opcode_t::release:
+        case opcode_t::call:
+        case opcode_t::jump:
+        case opcode_t::branch:
+        case opcode_t::ret: return false;
+        default: return true;
+        }
+    }
+
+    auto allocates(const instruction_t& i) -> bool {
+        switch (i.op) {
+        case opcode_t::array:
+        case opcode_t::format: return true;
+        case opcode_t::constant:
+        case opcode_t::parameter:
+        case opcode_t::convert:
+        case opcode_t::load:
+        case opcode_t::index:
+        case opcode_t::view:
+        case opcode_t::call:
+        case opcode_t::phi: return false;
+        // arithmetic on arrays.
+        default: return i.type.get().is<types::array_t>();
+        }
+    }
+
+    auto pointer_to(const type_t& t) -> type_t { return type_t(types::ptr_t{t}); }
+
+    auto block_of(const function_t& fn) -> vector<int> {
+        auto result = vector<int>(fn.values.size(), -1);
+        for (auto b = 0u; b < fn.blocks.size(); b++)
+            for (const auto id : fn.blocks[b].instructions) result[id] = int(b);
+        return result;
+    }
+
+    auto predecessors(const function_t& fn) -> vector<vector<int>> {
+        auto result = vector<vector<int>>(fn.blocks.size());
+        for (auto b = 0u; b < fn.blocks.size(); b++) {
+            if (fn.blocks[b].instructions.empty()) continue;
+            for (const auto s : fn.successors(int(b)))
+                if (result[s].empty() || result[s].back() != int(b)) result[s].push_back(int(b));
+        }
+        return result;
+    }
+
+    auto reverse_post_order(const function_t& fn) -> vector<int> {
+        auto order = vector<int>();
+        auto seen = vector<bool>(fn.blocks.size());
+        // (block, next successor to visit)
+        auto stack = vector<pair<int, size_t>>();
+        if (fn.blocks.empty()) return order;
+        stack.emplace_back(0, 0);
+        seen[0] = true;
+        while (!stack.empty()) {
+            auto& [b, next] = stack.back();
+            const auto& successors = fn.blocks[b].instructions.empty()
+                                         ? vector<int>()
+                                         : fn.successors(b);
+            if (next < successors.size()) {
+                const auto s = successors[next++];
+                if (!seen[s]) {
+                    seen[s] = true;
+                    stack.emplace_back(s, 0);
+                }
+            } else {
+                order.push_back(b);
+                stack.pop_back();
+            }
+        }
+        reverse(order.begin(), order.end());
+        return order;
+    }
+
+    // Cooper, Harvey and Kennedy's iteration over the reverse post order.
+    auto dominators(const function_t& fn) -> vector<int> {
+        const auto order = reverse_post_order(fn);
+        const auto preds = predecessors(fn);
+        auto rank = vector<int>(fn.blocks.size(), -1);
+        for (auto k = 0u; k < order.size(); k++) rank[order[k]] = int(k);
+
+        auto idom = vector<int>(fn.blocks.size(), -1);
+        if (order.empty()) return idom;
+        idom[0] = 0;
+
+        const auto intersect = [&](int a, int b) {
+            while (a != b) {
+                while (rank[a] > rank[b]) a = idom[a];
+                while (rank[b] > rank[a]) b = idom[b];
+            }
+            return a;
+        };
+
+        for (auto changed = true; changed;) {
+            changed = false;
+            for (auto k = 1u; k < order.size(); k++) {
+                const auto b = order[k];
+                auto d = -1;
+                for (const auto p : preds[b]) {
+                    if (idom[p] == -1) continue;
+                    d = d == -1 ? p : intersect(p, d);
+                }
+                if (d != idom[b]) {
+                    idom[b] = d;
+                    changed = true;
+                }
+            }
+        }
+        return idom;
+    }
+
+    auto dominates(const vector<int>& idom, int a, int b) -> bool {
+        if (idom[b] == -1) return false;
+        while (b != a && b != 0) b = idom[b];
+        return b == a;
+    }
+
+    auto users(const function_t& fn) -> vector<vector<int>> {
+        auto result = vector<vector<int>>(fn.values.size());
+        for (const auto& block : fn.blocks)
+            for (const auto id : block.instructions)
+                for (const auto v : fn[id].operands) result[v].push_back(id);
+        return result;
+    }
+
+    auto substitute(function_t& fn, vector<int> replacement) -> void {
+        replacement.resize(fn.values.size(), -1);
+        const auto resolve = [&](int v) {
+            while (replacement[v] != -1 && replacement[v] != v) v = replacement[v];
+            return v;
+        };
+        for (auto& block : fn.blocks)
+            for (const auto id : block.instructions)
+                for (auto& v : fn[id].operands) v = resolve(v);
+    }
+
+    auto remove_unreachable(function_t& fn) -> bool {
+        auto reachable = vector<bool>(fn.blocks.size());
+        for (const auto b : reverse_post_order(fn)) reachable[b] = true;
+        if (find(reachable.begin(), reachable.end(), false) == reachable.end()) return false;
+
+        auto number = vector<int>(fn.blocks.size(), -1);
+        auto blocks = vector<block_t>();
+        for (auto b = 0u; b < fn.blocks.size(); b++) {
+            if (!reachable[b]) continue;
+            number[b] = int(blocks.size());
+            blocks.push_back(move(fn.blocks[b]));
+        }
+        fn.blocks = move(blocks);
+
+        for (auto& block : fn.blocks) {
+            for (const auto id : block.instructions) {
+                auto& i = fn[id];
+                if (i.op != opcode_t::phi) {
+                    for (auto& b : i.blocks) b = number[b];
+                    continue;
+                }
+                auto k = 0u;
+                for (auto j = 0u; j < i.blocks.size(); j++) {
+                    if (number[i.blocks[j]] == -1) continue;
+                    i.operands[k] = i.operands[j];
+                    i.blocks[k++] = number[i.blocks[j]];
+                }
+                i.operands.resize(k);
+                i.blocks.resize(k);
+            }
+        }
+        return true;
+    }
+
+    auto verify(const module_t& module) -> void {
+        for (const auto& fn : module.functions) {
+            const auto fail = [&](const string& what) {
+                throw error("Malformed IR in \"" + fn.name + "\": " + what);
+            };
+
+            if (fn.blocks.empty()) fail("no entry block");
+            auto owner = vector<int>(fn.values.size(), -1);
+            auto position = vector<int>(fn.values.size(), -1);
+            for (auto b = 0u; b < fn.blocks.size(); b++) {
+                const auto& instructions = fn.blocks[b].instructions;
+                if (instructions.empty()) fail("empty block " + label(fn, int(b)));
+                for (auto k = 0u; k < instructions.size(); k++) {
+                    const auto id = instructions[k];
+                    if (id < 0 || id >= int(fn.values.size())) fail("unknown value");
+                    if (owner[id] != -1) fail("%" + to_string(id) + " listed twice");
+                    owner[id] = int(b);
+                    position[id] = int(k);
+
+                    const auto& i = fn[id];
+                    const auto last = k + 1 == instructions.size();
+                    if (is_terminator(i.op) != last)
+                        fail(label(fn, int(b)) + " doesn't end with its only terminator");
+                    if (i.op == opcode_t::phi && k > 0 &&
+                        fn[instructions[k - 1]].op != opcode_t::phi)
+                        fail("phi %" + to_string(id) + " after other instructions");
+                    for (const auto s : i.blocks)
+                        if (s < 0 || s >= int(fn.blocks.size()))
+                            fail("%" + to_string(id) + " names an unknown block");
+                    if (i.op == opcode_t::constant && is_text(i.type) &&
+                        i.immediate >= module.strings.size())
+                        fail("%" + to_string(id) + " names an unknown string");
+                    if (i.op != opcode_t::phi)
+                        for (const auto s : i.blocks)
+                            if (s == 0) fail("a branch to the entry block");
+                }
+            }
+
+            const auto idom = dominators(fn);
+            const auto preds = predecessors(fn);
+            for (auto b = 0u; b < fn.blocks.size(); b++) {
+                if (idom[b] == -1) continue;
+                const auto& instructions = fn.blocks[b].instructions;
+                for (auto k = 0u; k < instructions.size(); k++) {
+                    const auto id = instructions[k];
+                    const auto& i = fn[id];
+
+                    if (i.op == opcode_t::phi) {
+                        auto incoming = i.blocks;
+                        sort(incoming.begin(), incoming.end());
+                        if (i.operands.size() != i.blocks.size() || incoming != preds[b])
+                            fail("phi %" + to_string(id) + " doesn't list the predecessors of " +
+                                 label(fn, int(b)));
+                    }
+
+                    for (auto j = 0u; j < i.operands.size(); j++) {
+                        const auto v = i.operands[j];
+                        if (v < 0 || v >= int(fn.values.size()) || owner[v] == -1)
+                            fail("%" + to_string(id) + " uses a value no block lists");
+                        const auto use = i.op == opcode_t::phi ? i.blocks[j] : int(b);
+                        const auto ok =
+                            owner[v] == use
+                                ? i.op == opcode_t::phi || position[v] < int(k)
+                                : dominates(idom, owner[v], use);
+                        if (!ok && idom[use] != -1)
+                            fail("%" + to_string(v) + " doesn't dominate its use by %" +
+                                 to_string(id));
+                    }
+                }
+            }
+        }
+    }
+
+    auto operator<<(ostream& os, const function_t& fn) -> ostream& {
+        print(os, fn, nullptr);
+        return os;
+    }
+
+    auto operator<<(ostream& os, const module_t& module) -> ostream& {
+        for (auto g = 0u; g < module.globals.size(); g++)
+            os << "global @" << module.globals[g].name << ": " << module.globals[g].type << endl;
+        for (const auto& fn : module.functions) {
+            print(os, fn, &module);
+            os << endl;
+        }
+        return os;
+    }
+}}  // namespace bt::ir
@@ -0,0 +1,1357 @@
+#include <algorithm>
+#include <bit>
+#include <deque>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <bullet/ir/lower.hpp>
+#include <bullet/parser/traversal.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+    using namespace parser::syntax;
+
+    namespace hana = boost::hana;
+    namespace syntax = parser::syntax;
+    namespace types = analysis::types;
+
+    using analysis::type_t;
+
+    namespace {
+        using typed_node_t = attr_node_t<type_t>;
+        using typed_tree_t = attr_tree_t<type_t>;
+
+        auto scalar(const type_t& t) -> bool {
+            return analysis::is_integral(t) || analysis::is_floating_point(t) ||
+                   t.get().is<types::bool_t>();
+        }
+
+        auto is_text(const type_t& t) -> bool {
+            return t.get().is<types::strlit_t>() || t.get().is<types::string_t>();
+        }
+
+        // Values variables may hold.
+        auto storable(const type_t& t) -> bool {
+            const auto& u = t.get();
+            return scalar(t) || is_text(t) || u.is<types::array_t>() || u.is<types::slice_t>() ||
+                   u.is<types::struct_t>() || u.is<types::variant_t>() ||
+                   u.is<types::nominal_type_t>();
+        }
+
+        // Arrays and slices of numbers, which compute element by element.
+        auto numeric_sequence(const type_t& t) -> bool {
+            const auto& u = t.get();
+            return (u.is<types::array_t>() || u.is<types::slice_t>()) &&
+                   analysis::numeric_elements(t);
+        }
+
+        // bits, narrowed to the width of the integer type t.
+        auto narrow(uint64_t bits, const type_t& t) -> uint64_t {
+            const auto w = analysis::width(t);
+            if (w >= 64) return bits;
+            if (analysis::is_signed(t)) return uint64_t(int64_t(bits << (64 - w)) >> (64 - w));
+            return bits & ~uint64_t(0) >> (64 - w);
+        }
+
+        auto floating(double d, const type_t& t) -> uint64_t {
+            return bit_cast<uint64_t>(analysis::width(t) == 32 ? double(float(d)) : d);
+        }
+
+        // A number literal as a constant of type t, if t has numbers like it.
+        auto literal_bits(const literal_t& literal, const type_t& t) -> optional<uint64_t> {
+            if (const auto x = get_if<integral_literal_t>(&literal)) {
+                if (analysis::is_floating_point(t))
+                    return analysis::width(t) == 32 ? floating(float(x->value), t)
+                                                    : floating(double(x->value), t);
+                if (analysis::is_integral(t)) return narrow(x->value, t);
+            }
+            if (const auto x = get_if<floating_point_literal_t>(&literal))
+                if (analysis::is_floating_point(t))
+                    return analysis::width(t) == 32 ? floating(float(x->value), t)
+                                                    : floating(double(x->value), t);
+            return nullopt;
+        }
+
+        auto takes_function(const types::name_and_type_t& parameter) -> bool {
+            return value_type(parameter.type).get().is<types::function_t>();
+        }
+
+        struct binding_t {
+            enum kind_t { local, global, function, generator, higher_order };
+
+            kind_t kind;
+            // a slot, a global, a function, a generator or a function taking
+            // functions.
+            int index;
+            type_t type;
+            // the function a local belongs to.
+            int owner = 0;
+            // whether the local is a copy of a variable of the function
+            // defining the one lowered.
+            bool captured = false;
+        };
+
+        // A variable of an enclosing function which a function uses, as the
+        // function defining it sees it. Its value is passed along the
+        // arguments of every call, so closures which don't escape keep their
+        // environment in their caller's frame.
+        struct capture_t {
+            string name;
+            binding_t variable;
+        };
+
+        // Where break and continue go: jumps to patch once the loop's exit,
+        // and its continuation if it isn't known yet, are.
+        struct loop_t {
+            int next = -1;
+            vector<int> breaks;
+            vector<int> continues;
+            // the regions open where the loop starts, which those opened in
+            // its body are released down to when they leave it.
+            size_t regions = 0;
+        };
+
+        using scopes_t = vector<unordered_map<string, binding_t>>;
+
+        // Functions which yield. They are never called: loops over them run
+        // their body in place of the loop, so their variables are the
+        // caller's.
+        struct generator_def_t {
+            const fn_expr_t<type_t>* ast;
+            type_t type;
+            // the names it sees, once its definition is reached.
+            optional<scopes_t> scopes;
+        };
+
+        // Functions with parameters taking functions. They are specialized
+        // for the functions each call passes, which are called directly
+        // then, and may be inlined.
+        struct higher_order_def_t {
+            const fn_expr_t<type_t>* ast;
+            type_t type;
+            string name;
+            // the names it sees and the variables it captures, once its
+            // definition is reached.
+            optional<scopes_t> scopes;
+            vector<capture_t> captures;
+            // the specializations made, by the functions passed.
+            map<vector<int>, int> specializations;
+        };
+
+        // A for loop over a generator being expanded: each yield of the
+        // generator sets the loop's variable and runs the loop's body where
+        // it is, going on after it when the body continues. Nothing keeps the
+        // generator's state but where the code is and its variables, so no
+        // frame is allocated and nothing dispatches on a state.
+        struct expansion_t {
+            int generator;
+            binding_t variable;
+            const typed_node_t* body;
+            // the names the loop's body sees.
+            scopes_t scopes;
+            // returns from the generator, and breaks from the loop's body,
+            // which end the loop.
+            vector<int> ends;
+            // the expansion the loop is in the generator of, if any, and the
+            // loops break and continue may leave there.
+            expansion_t* outer;
+            size_t floor;
+            // the regions open where the loop starts.
+            size_t regions;
+        };
+
+        // The function being lowered.
+        struct unit_t {
+            int index;
+            type_t result_type;
+            // the block instructions go to.
+            int block = 0;
+            // the parameters and slots leading the entry block.
+            int prologue = 0;
+            vector<loop_t> loops;
+            // the marks of the with blocks being lowered, outermost first.
+            vector<int> regions;
+            // the slots holding the variables it captures, by the function
+            // and slot they are copied from.
+            map<pair<int, int>, int> captured;
+        };
+
+        class lowering_t {
+            module_t& module_;
+            scopes_t scopes_;
+            deque<unit_t> units_;
+            vector<generator_def_t> generators_;
+            vector<higher_order_def_t> higher_order_;
+            // the variables each function defined captures, and the
+            // functions called before their definition.
+            unordered_map<int, vector<capture_t>> captures_;
+            vector<int> called_early_;
+            // where the text of each string constant is in the module.
+            unordered_map<string, uint64_t> strings_;
+            // the expansion whose generator is being lowered, and the loops
+            // below which break and continue can't leave it.
+            expansion_t* expansion_ = nullptr;
+            size_t floor_ = 0;
+            parser::location_t location_;
+
+            auto unit() -> unit_t& { return units_.back(); }
+            auto fn() -> function_t& { return module_.functions[unit().index]; }
+            auto top_level() const -> bool { return units_.size() == 1 && !expansion_; }
+
+            auto new_block(const string& name) -> int {
+                fn().blocks.push_back(block_t{name});
+                return int(fn().blocks.size()) - 1;
+            }
+
+            auto emit(instruction_t i) -> int {
+                i.location = location_;
+                const auto id = fn().add(move(i));
+                fn().blocks[unit().block].instructions.push_back(id);
+                return id;
+            }
+
+            auto emit(opcode_t op, const type_t& t, vector<int> operands = {}) -> int {
+                return emit(instruction_t{op, t, move(operands)});
+            }
+
+            auto jump(int target) -> int {
+                return emit(instruction_t{opcode_t::jump, analysis::VOID, {}, {target}});
+            }
+
+            // Goes on in a block nothing branches to, after a jump or return.
+            auto unreachable_code() -> void { unit().block = new_block("dead"); }
+
+            auto constant(const type_t& t, uint64_t bits) -> int {
+                auto i = instruction_t{opcode_t::constant, t};
+                i.immediate = bits;
+                return emit(move(i));
+            }
+
+            auto text(const string& s) -> int {
+                const auto [it, fresh] = strings_.try_emplace(s, module_.strings.size());
+                if (fresh) module_.strings.push_back(s);
+                return constant(type_t(types::strlit_t{int(s.size())}), it->second);
+            }
+
+            auto zero(const type_t& t) -> int {
+                return constant(t, analysis::is_floating_point(t) ? floating(0, t) : 0);
+            }
+
+            // A variable of the function, allocated on entry.
+            auto slot(const string& name, const type_t& t) -> int {
+                auto i = instruction_t{opcode_t::slot, pointer_to(t)};
+                i.name = name;
+                i.location = location_;
+                const auto id = fn().add(move(i));
+                auto& entry = fn().blocks[0].instructions;
+                entry.insert(entry.begin() + unit().prologue++, id);
+                return id;
+            }
+
+            // A value of one type as one of another, or nothing for void.
+            auto coerce(int v, const type_t& from, const type_t& to) -> int {
+                if (to.get().is<types::void_t>()) return -1;
+                if (v == -1) return zero(to);
+                if (from == to) return v;
+                if (scalar(from) && scalar(to)) return emit(opcode_t::convert, to, {v});
+                // literals are the strings they convert to, without copying.
+                if (from.get().is<types::strlit_t>() && to.get().is<types::string_t>())
+                    return emit(opcode_t::convert, to, {v});
+                // arrays view all their elements as slices.
+                if (from.get().is<types::array_t>() && to.get().is<types::slice_t>())
+                    return emit(opcode_t::view, to, {v});
+                throw error("Can't convert between these types yet", location_);
+            }
+
+            auto bind(const string& name, binding_t binding) -> void {
+                scopes_.back().insert_or_assign(name, move(binding));
+            }
+
+            auto binding(const string& name) const -> const binding_t* {
+                for (auto s = scopes_.rbegin(); s != scopes_.rend(); s++)
+                    if (const auto p = s->find(name); p != s->end()) return &p->second;
+                return nullptr;
+            }
+
+            // Locals of enclosing functions are the copies the function
+            // lowered was passed.
+            auto local(const binding_t& b, const string& name, const parser::location_t& at)
+                -> binding_t {
+                if (b.kind != binding_t::local || b.owner == unit().index) return b;
+                const auto p = unit().captured.find({b.owner, b.index});
+                if (p == unit().captured.end())
+                    throw error("Functions can't capture the local variable \"" + name +
+                                    "\" here yet",
+                                at);
+                return binding_t{binding_t::local, p->second, b.type, unit().index, true};
+            }
+
+            auto lookup(const typed_tree_t& at, const string& name) -> binding_t {
+                if (const auto b = binding(name)) return local(*b, name, at.location);
+                throw error("\"" + name + "\" isn't defined by the program", at.location);
+            }
+
+            auto address(const binding_t& b) -> int {
+                if (b.kind == binding_t::local) return b.index;
+                auto i = instruction_t{opcode_t::global, pointer_to(b.type)};
+                i.immediate = uint64_t(b.index);
+                return emit(move(i));
+            }
+
+        public:
+            explicit lowering_t(module_t& module) : module_(module) {
+                for (auto k = 0u; k < module.strings.size(); k++)
+                    strings_.try_emplace(module.strings[k], k);
+            }
+
+            auto program(const typed_node_t& ast) -> void {
+                auto result_type = value_type(ast.get().attribute);
+                if (!scalar(result_type) && !is_text(result_type) &&
+                    !result_type.get().is<types::array_t>())
+                    result_type = analysis::VOID;
+                module_.result_type = result_type;
+                module_.functions.push_back(function_t{"<top level>"});
+                module_.functions.back().result_type = result_type;
+
+                units_.push_back(unit_t{0, result_type});
+                scopes_.emplace_back();
+                new_block("entry");
+
+                const auto v = value(ast, result_type);
+                emit(opcode_t::ret, analysis::VOID, v == -1 ? vector<int>() : vector{v});
+            }
+
+            // Lowers an expression, converted to want; with a void want, only
+            // for its effects, and yields nothing.
+            auto value(const typed_node_t& node, const type_t& want) -> int {
+                const auto& tree = node.get();
+                const auto outer = location_;
+                location_ = tree.location;
+
+                const auto unsupported = [&](const char* what) -> int {
+                    throw error(string("Can't compile ") + what + " yet", tree.location);
+                };
+                const auto escaping = "functions escaping where they are defined";
+                const auto nothing = [](const auto&) { return -1; };
+
+                auto v = visit(
+                    hana::overload(
+                        [&](const literal_t& e) { return literal(tree, e, want); },
+                        [&](const lexer::identifier_t& e) { return identifier(tree, e, want); },
+                        [&](const unary_op_t<type_t>& e) { return unary(tree, e, want); },
+                        [&](const bin_op_t<type_t>& e) { return binary(tree, e, want); },
+                        [&](const data_t<type_t>& e) { return array(tree, e, want); },
+                        [&](const invoc_t<type_t>& e) { return call(tree, e, want); },
+                        [&](const if_t<type_t>& e) { return if_(e, want); },
+                        [&](const var_def_t<type_t>& e) {
+                            // templates are lowered as their instances.
+                            if (e.rhs.get().is<template_t<type_t>>()) return nothing(e);
+                            const auto fn = e.rhs.get().is<fn_expr_t<type_t>>();
+                            if (!fn && (e.n_indirections != 0 ||
+                                        analysis::ptr_depth(tree.attribute) != 1))
+                                return unsupported("pointers");
+                            return define(tree, e.name.name, e.rhs, want);
+                        },
+                        [&](const let_var_t<type_t>& e) {
+                            return define(tree, e.name.name, e.rhs, want);
+                        },
+                        [&](const syntax::block_t<type_t>& e) { return block(e, want); },
+                        [&](const assign_t<type_t>& e) { return assign(tree, e, want); },
+                        [&](const while_t<type_t>& e) { return while_(e); },
+                        [&](const with_t<type_t>& e) { return with_(e, want); },
+                        [&](const for_t<type_t>& e) { return for_(tree, e); },
+                        [&](const return_t<type_t>& e) { return return_(e); },
+                        [&](const break_t&) { return loop_jump(tree, &loop_t::breaks); },
+                        [&](const continue_t&) { return loop_jump(tree, &loop_t::continues); },
+                        [&](const typed_node_t& e) { return value(e, want); },
+                        // declared types are kept for the backends which name
+                        // them; declarations generate no code.
+                        [&](const def_type_t<type_t>& e) {
+                            if (e.type.get().is<template_t<type_t>>()) return nothing(e);
+                            module_.types.push_back(tree.attribute);
+                            return nothing(e);
+                        },
+                        [&](const primitive_type_t& e) { return nothing(e); },
+                        [&](const type_expr_t<type_t>& e) { return nothing(e); },
+                        [&](const let_type_t<type_t>& e) { return nothing(e); },
+                        [&](const struct_t<type_t>& e) { return nothing(e); },
+                        [&](const template_t<type_t>& e) { return nothing(e); },
+                        [&](const std::monostate& e) { return nothing(e); },
+                        [&](const fn_expr_t<type_t>&) { return unsupported(escaping); },
+                        [&](const yield_t<type_t>& e) { return yield(tree, e); },
+                        [&](const auto&) { return unsupported("this construct"); }),
+                    static_cast<const node_base_t<type_t>&>(tree));
+
+                // code after a return or a jump still needs a value to discard.
+                if (v == -1 && !want.get().is<types::void_t>()) v = zero(want);
+                location_ = outer;
+                return v;
+            }
+
+        private:
+            auto literal(const typed_tree_t& at, const literal_t& e, const type_t& want) -> int {
+                if (want.get().is<types::void_t>()) return -1;
+                const auto truth = holds_alternative<lexer::token::true_t>(e);
+                if (truth || holds_alternative<lexer::token::false_t>(e))
+                    return coerce(constant(analysis::BOOL, truth), analysis::BOOL, want);
+                if (const auto s = get_if<string_literal_t>(&e))
+                    return string_literal(at, *s, want);
+
+                // numbers are written as the type they are used at if they can
+                // be, and converted from their own otherwise.
+                if (const auto bits = literal_bits(e, want)) return constant(want, *bits);
+                const auto t = value_type(at.attribute);
+                if (const auto bits = literal_bits(e, t))
+                    return coerce(constant(t, *bits), t, want);
+                throw error("Can't represent this literal yet", at.location);
+            }
+
+            // Literals naming variables between braces format the text of
+            // their values in place of the names.
+            auto string_literal(const typed_tree_t& at,
+                                const string_literal_t& s,
+                                const type_t& want) -> int {
+                if (!lexer::interpolates(s)) {
+                    const auto v = text(s.value);
+                    return coerce(v, fn()[v].type, want);
+                }
+
+                auto pieces = vector<int>();
+                for (const auto& p : lexer::pieces(s)) {
+                    if (!p.interpolated) {
+                        pieces.push_back(text(p.text));
+                        continue;
+                    }
+                    const auto t = lookup(at, p.text).type;
+                    pieces.push_back(identifier(at, lexer::identifier_t(p.text), t));
+                }
+                return coerce(emit(opcode_t::format, analysis::STRING, move(pieces)),
+                              analysis::STRING,
+                              want);
+            }
+
+            auto identifier(const typed_tree_t& at,
+                            const lexer::identifier_t& id,
+                            const type_t& want) -> int {
+                const auto b = lookup(at, id.name);
+                if (b.kind != binding_t::local && b.kind != binding_t::global)
+                    throw error("Can't compile functions escaping where they are defined yet",
+                                at.location);
+                if (want.get().is<types::void_t>()) return -1;
+                return coerce(emit(opcode_t::load, b.type, {address(b)}), b.type, want);
+            }
+
+            auto unary(const typed_tree_t& at, const unary_op_t<type_t>& e, const type_t& want)
+                -> int {
+                const auto t = value_type(at.attribute);
+
+                if (e.op == lexer::PLUS) return coerce(value(e.operand, t), t, want);
+                if (e.op == lexer::MINUS && scalar(t))
+                    return coerce(emit(opcode_t::neg, t, {value(e.operand, t)}), t, want);
+                if (e.op == lexer::TILDE && analysis::is_integral(t))
+                    return coerce(emit(opcode_t::bnot, t, {value(e.operand, t)}), t, want);
+                if (e.op == lexer::NOT)
+                    return coerce(emit(opcode_t::lnot, analysis::BOOL,
+                                       {value(e.operand, analysis::BOOL)}),
+                                  analysis::BOOL,
+                                  want);
+
+                throw error(string("Can't compile operator \"") +
+                                string(lexer::token_symbol(e.op)) + "\" on this operand yet",
+                            at.location);
+            }
+
+            auto binary(const typed_tree_t& at, const bin_op_t<type_t>& e, const type_t& want)
+                -> int {
+                using namespace lexer;
+
+                const auto op = e.op;
+                const auto unsupported = [&]() -> int {
+                    throw error(string("Can't compile operator \"") + string(token_symbol(op)) +
+                                    "\" on these operands yet",
+                                at.location);
+                };
+
+                // the right operand is only evaluated if the left one doesn't
+                // decide.
+                if (op == AND || op == OR) {
+                    const auto lhs = value(e.lhs, analysis::BOOL);
+                    const auto from = unit().block;
+                    const auto shortcut = constant(analysis::BOOL, op == OR);
+                    const auto test =
+                        emit(instruction_t{opcode_t::branch, analysis::VOID, {lhs}, {-1, -1}});
+
+                    const auto rest = new_block(op == AND ? "and" : "or");
+                    unit().block = rest;
+                    const auto rhs = value(e.rhs, analysis::BOOL);
+                    const auto rest_end = unit().block;
+                    const auto exit = jump(-1);
+
+                    const auto end = new_block("end");
+                    fn()[test].blocks = op == AND ? vector{rest, end} : vector{end, rest};
+                    fn()[exit].blocks[0] = end;
+                    unit().block = end;
+                    const auto result = emit(instruction_t{
+                        opcode_t::phi, analysis::BOOL, {shortcut, rhs}, {from, rest_end}});
+                    return coerce(result, analysis::BOOL, want);
+                }
+
+                // arrays and slices of numbers of the same type compute
+                // element by element.
+                const auto operands = value_type(e.lhs.get().attribute);
+                const auto others = value_type(e.rhs.get().attribute);
+                if (numeric_sequence(operands) || numeric_sequence(others)) {
+                    if (!numeric_sequence(operands) || !numeric_sequence(others) ||
+                        analysis::numeric_elements(operands) != analysis::numeric_elements(others))
+                        return unsupported();
+                    const auto code = op == PLUS        ? opcode_t::add
+                                      : op == MINUS     ? opcode_t::sub
+                                      : op == STAR      ? opcode_t::mul
+                                      : op == SLASH     ? opcode_t::div
+                                      : op == EQUAL     ? opcode_t::eq
+                                      : op == NOT_EQUAL ? opcode_t::ne
+                                      : op == LT        ? opcode_t::lt
+                                      : op == GT        ? opcode_t::gt
+                                      : op == LEQ       ? opcode_t::le
+                                      : op == GEQ       ? opcode_t::ge
+                                                        : opcode_t::count;
+                    if (code == opcode_t::count) return unsupported();
+                    const auto t = value_type(at.attribute);
+                    const auto lhs = value(e.lhs, operands);
+                    const auto rhs = value(e.rhs, others);
+                    return coerce(emit(code, t, {lhs, rhs}), t, want);
+                }
+
+                if (op == EQUAL || op == NOT_EQUAL || op == LT || op == GT || op == LEQ ||
+                    op == GEQ) {
+                    const auto promoted =
+                        analysis::promoted_type(e.lhs.get().attribute, e.rhs.get().attribute);
+                    if (!promoted) return unsupported();
+                    const auto t = value_type(*promoted);
+                    if (!scalar(t)) return unsupported();
+
+                    const auto code = op == EQUAL       ? opcode_t::eq
+                                      : op == NOT_EQUAL ? opcode_t::ne
+                                      : op == LT        ? opcode_t::lt
+                                      : op == GT        ? opcode_t::gt
+                                      : op == LEQ       ? opcode_t::le
+                                                        : opcode_t::ge;
+                    const auto lhs = value(e.lhs, t);
+                    const auto rhs = value(e.rhs, t);
+                    return coerce(emit(code, analysis::BOOL, {lhs, rhs}), analysis::BOOL, want);
+                }
+
+                const auto t = value_type(at.attribute);
+                if (!scalar(t)) return unsupported();
+                const auto f = analysis::is_floating_point(t);
+
+                auto code = opcode_t::count;
+                if (op == PLUS) code = opcode_t::add;
+                if (op == MINUS) code = opcode_t::sub;
+                if (op == STAR) code = opcode_t::mul;
+                if (op == SLASH) code = opcode_t::div;
+                if (op == PERCENTAGE) code = opcode_t::rem;
+                if (op == STAR_STAR) code = opcode_t::pow;
+                if (!f && op == AMPERSAND) code = opcode_t::band;
+                if (!f && op == BAR) code = opcode_t::bor;
+                if (!f && op == HAT) code = opcode_t::bxor;
+                if (code == opcode_t::count) return unsupported();
+
+                const auto lhs = value(e.lhs, t);
+                const auto rhs = value(e.rhs, t);
+                return coerce(emit(code, t, {lhs, rhs}), t, want);
+            }
+
+            auto array(const typed_tree_t& at, const data_t<type_t>& e, const type_t& want) -> int {
+                const auto t = value_type(at.attribute);
+                const auto ty = t.get().get_if<types::array_t>();
+                if (!ty) throw error("Can't compile tuples yet", at.location);
+
+                auto elements = vector<int>();
+                for (const auto& x : e) elements.push_back(value(x, ty->value_type));
+                return coerce(emit(opcode_t::array, t, move(elements)), t, want);
+            }
+
+            auto call(const typed_tree_t& at, const invoc_t<type_t>& e, const type_t& want) -> int {
+                const auto id = e.target.get().get_if<lexer::identifier_t>();
+                if (const auto r = id ? analysis::reduction(id->name) : nullopt;
+                    r && !binding(id->name))
+                    return reduce(at, e, *r, want);
+                const auto keyword = e.target.get().get_if<primitive_type_t>();
+                if (keyword && holds_alternative<lexer::token::slice_t>(*keyword))
+                    return slice(at, e, want);
+                const auto b = id ? optional(lookup(at, id->name)) : nullopt;
+                if (b && b->kind == binding_t::generator)
+                    throw error("Can only iterate over generators with for loops yet",
+                                at.location);
+                if (!b || (b->kind != binding_t::function && b->kind != binding_t::higher_order))
+                    throw error("Can only call functions defined by the program", at.location);
+
+                const auto& parameters = b->type.get().as<types::function_t>().formal_parameters;
+                if (e.arguments.size() != parameters.size())
+                    throw error("Wrong number of arguments", at.location);
+                const auto index =
+                    b->kind == binding_t::higher_order ? specialize(at, *b, e) : b->index;
+
+                // functions passed are known to the specialization; the
+                // variables the callee captures follow the arguments.
+                auto arguments = vector<int>();
+                for (auto i = 0u; i < parameters.size(); i++)
+                    if (!takes_function(parameters[i]))
+                        arguments.push_back(value(e.arguments[i], value_type(parameters[i].type)));
+                for (const auto& c : captures(index)) {
+                    const auto x = local(c.variable, c.name, at.location);
+                    arguments.push_back(emit(opcode_t::load, x.type, {address(x)}));
+                }
+
+                const auto result_type = module_.functions[index].result_type;
+                auto i = instruction_t{opcode_t::call, result_type, move(arguments)};
+                i.immediate = uint64_t(index);
+                const auto v = emit(move(i));
+                if (result_type.get().is<types::void_t>()) return coerce(-1, result_type, want);
+                return coerce(v, result_type, want);
+            }
+
+            auto reduce(const typed_tree_t& at,
+                        const invoc_t<type_t>& e,
+                        analysis::reduction_t r,
+                        const type_t& want) -> int {
+                const auto t = value_type(e.arguments.front().get().attribute);
+                if (!numeric_sequence(t))
+                    throw error("Can only reduce arrays and slices yet", at.location);
+                const auto element = *analysis::numeric_elements(t);
+                auto i = instruction_t{opcode_t::reduce, element, {value(e.arguments.front(), t)}};
+                i.immediate = uint64_t(r);
+                return coerce(emit(move(i)), element, want);
+            }
+
+            // the bounds of slices are in their type, which the checker gave.
+            auto slice(const typed_tree_t& at, const invoc_t<type_t>& e, const type_t& want)
+                -> int {
+                const auto t = value_type(at.attribute);
+                const auto from = value_type(e.arguments.front().get().attribute);
+                if (!from.get().is<types::array_t>() && !from.get().is<types::slice_t>())
+                    throw error("Can only slice arrays yet", at.location);
+                const auto v = emit(opcode_t::view, t, {value(e.arguments.front(), from)});
+                return coerce(v, t, want);
+            }
+
+            auto if_(const if_t<type_t>& e, const type_t& want) -> int {
+                const auto yields = !want.get().is<types::void_t>();
+                auto values = vector<int>();
+                auto blocks = vector<int>();
+                auto exits = vector<int>();
+
+                const auto branch = [&](const typed_node_t& body) {
+                    const auto v = value(body, want);
+                    values.push_back(v);
+                    blocks.push_back(unit().block);
+                    exits.push_back(jump(-1));
+                };
+
+                for (auto i = 0u; i < e.elif_tests.size(); i++) {
+                    const auto test = value(e.elif_tests[i], analysis::BOOL);
+                    const auto then = new_block("then");
+                    const auto br =
+                        emit(instruction_t{opcode_t::branch, analysis::VOID, {test}, {then, -1}});
+                    unit().block = then;
+                    branch(e.elif_branches[i]);
+                    fn()[br].blocks[1] = unit().block = new_block("else");
+                }
+                if (e.else_branch.get()) {
+                    branch(e.else_branch);
+                } else {
+                    values.push_back(yields ? zero(want) : -1);
+                    blocks.push_back(unit().block);
+                    exits.push_back(jump(-1));
+                }
+
+                const auto end = new_block("endif");
+                for (const auto j : exits) fn()[j].blocks[0] = end;
+                unit().block = end;
+                if (!yields) return -1;
+                return emit(instruction_t{opcode_t::phi, want, move(values), move(blocks)});
+            }
+
+            auto result_of(const types::function_t& signature) -> type_t {
+                const auto t = value_type(signature.result_type);
+                return storable(t) ? t : analysis::VOID;
+            }
+
+            auto declare_functions(const syntax::block_t<type_t>& b) -> void {
+                for (const auto& stmt : b) {
+                    const auto def = stmt.get().get_if<var_def_t<type_t>>();
+                    if (!def || !def->rhs.get().is<fn_expr_t<type_t>>()) continue;
+
+                    const auto& at = stmt.get();
+                    const auto& name = def->name.name;
+                    const auto& ast = def->rhs.get().as<fn_expr_t<type_t>>();
+                    const auto& fn_ty = def->rhs.get().attribute;
+                    if (!fn_ty.get().is<types::function_t>())
+                        throw error("Function without a function type", at.location);
+                    const auto& signature = fn_ty.get().as<types::function_t>();
+                    auto higher_order = false;
+                    for (const auto& parameter : signature.formal_parameters) {
+                        higher_order |= takes_function(parameter);
+                        if (!takes_function(parameter) && !storable(value_type(parameter.type)))
+                            throw error("Can't pass values of this type yet", at.location);
+                    }
+
+                    if (signature.result_type.get().is<types::generator_t>()) {
+                        const auto index = int(generators_.size());
+                        generators_.push_back(generator_def_t{&ast, fn_ty});
+                        bind(name, binding_t{binding_t::generator, index, fn_ty});
+                        continue;
+                    }
+                    if (higher_order) {
+                        const auto index = int(higher_order_.size());
+                        higher_order_.push_back(higher_order_def_t{&ast, fn_ty, name});
+                        bind(name, binding_t{binding_t::higher_order, index, fn_ty});
+                        continue;
+                    }
+
+                    const auto index = int(module_.functions.size());
+                    auto& fn = module_.functions.emplace_back();
+                    fn.name = name;
+                    fn.type = fn_ty;
+                    fn.result_type = result_of(signature);
+                    bind(name, binding_t{binding_t::function, index, fn_ty});
+                }
+            }
+
+            // The names "with" gives a function where it is defined: copies of
+            // the values of variables or expressions then, or with "var" and
+            // no value, the variables themselves.
+            auto closure_scope(const fn_expr_t<type_t>& e) -> unordered_map<string, binding_t> {
+                auto scope = unordered_map<string, binding_t>();
+                for (const auto& closure : e.closure_params) {
+                    const auto& x = closure.expression;
+                    if (!closure.identifier) {
+                        if (x.get()) value(x, analysis::VOID);
+                        continue;
+                    }
+
+                    const auto& name = closure.identifier->name;
+                    const auto at = location_;
+                    if (!x.get()) {
+                        const auto b = binding(name);
+                        if (!b || (b->kind != binding_t::local && b->kind != binding_t::global))
+                            throw error("\"" + name + "\" isn't a variable to capture", at);
+                        const auto v = local(*b, name, at);
+                        if (closure.var) {
+                            scope.insert_or_assign(name, v);
+                            continue;
+                        }
+                        const auto s = slot(name, v.type);
+                        const auto copy = emit(opcode_t::load, v.type, {address(v)});
+                        emit(opcode_t::store, analysis::VOID, {s, copy});
+                        const auto copied = binding_t{binding_t::local, s, v.type, unit().index};
+                        scope.insert_or_assign(name, copied);
+                        continue;
+                    }
+
+                    const auto t = value_type(x.get().attribute);
+                    if (!storable(t)) throw error("Can't store values of this type yet", at);
+                    const auto s = slot(name, t);
+                    emit(opcode_t::store, analysis::VOID, {s, value(x, t)});
+                    scope.insert_or_assign(name, binding_t{binding_t::local, s, t, unit().index});
+                }
+                return scope;
+            }
+
+            // The variables of enclosing functions which a function uses, as
+            // the function lowered sees them: those its body names, resolved
+            // in scopes, and those captured by the functions it names.
+            auto free_variables(const fn_expr_t<type_t>& e,
+                                const scopes_t& scopes,
+                                vector<capture_t>& result,
+                                vector<int>& generators) -> void {
+                const auto add = [&](const string& name, const binding_t& b) {
+                    auto x = b;
+                    if (b.owner != unit().index) {
+                        // names the function defines again may resolve to
+                        // variables it doesn't use.
+                        const auto p = unit().captured.find({b.owner, b.index});
+                        if (p == unit().captured.end()) return;
+                        x = binding_t{binding_t::local, p->second, b.type, unit().index, true};
+                    }
+                    for (const auto& c : result)
+                        if (c.variable.index == x.index) return;
+                    result.push_back(capture_t{name, x});
+                };
+
+                const auto use = [&](const string& name) {
+                    for (const auto& parameter : e.arg_names)
+                        if (parameter.name == name) return;
+
+                    const binding_t* b = nullptr;
+                    for (auto s = scopes.rbegin(); !b && s != scopes.rend(); s++)
+                        if (const auto p = s->find(name); p != s->end()) b = &p->second;
+                    if (!b) return;
+
+                    if (b->kind == binding_t::local) add(name, *b);
+                    if (b->kind == binding_t::function)
+                        if (const auto p = captures_.find(b->index); p != captures_.end())
+                            for (const auto& c : p->second) add(c.name, c.variable);
+                    if (b->kind == binding_t::higher_order)
+                        for (const auto& c : higher_order_[b->index].captures)
+                            add(c.name, c.variable);
+                    if (b->kind == binding_t::generator && generators_[b->index].scopes &&
+                        find(generators.begin(), generators.end(), b->index) == generators.end()) {
+                        generators.push_back(b->index);
+                        const auto& g = generators_[b->index];
+                        free_variables(*g.ast, *g.scopes, result, generators);
+                    }
+                };
+
+                parser::traverse_pre_order(e.body, [&](const typed_node_t& n) {
+                    // templates use variables through their instances.
+                    if (n.get().is<template_t<type_t>>()) return parser::traverse_action_t::skip;
+                    if (const auto id = n.get().get_if<lexer::identifier_t>()) use(id->name);
+                    // and string literals those they interpolate.
+                    if (const auto l = n.get().get_if<literal_t>())
+                        if (const auto s = get_if<string_literal_t>(l))
+                            for (const auto& p : lexer::pieces(*s))
+                                if (p.interpolated) use(p.text);
+                    return parser::traverse_action_t::descend;
+                });
+            }
+
+            auto free_variables(const fn_expr_t<type_t>& e) -> vector<capture_t> {
+                auto result = vector<capture_t>();
+                auto generators = vector<int>();
+                free_variables(e, scopes_, result, generators);
+                return result;
+            }
+
+            // The variables a function is passed after its arguments: none for
+            // functions not defined yet, which mustn't capture any then.
+            auto captures(int index) -> vector<capture_t> {
+                if (const auto p = captures_.find(index); p != captures_.end()) return p->second;
+                called_early_.push_back(index);
+                return {};
+            }
+
+            // Lowers a function taking the parameters of its signature, but
+            // those taking functions, which are bound to the functions passed,
+            // and then the variables it captures. Its body sees scopes.
+            auto lower_function(int index,
+                                const fn_expr_t<type_t>& e,
+                                const types::function_t& signature,
+                                scopes_t scopes,
+                                const vector<binding_t>& functions) -> void {
+                const auto outer = location_;
+                units_.push_back(unit_t{index, module_.functions[index].result_type});
+                swap(scopes_, scopes);
+                scopes_.emplace_back();
+                const auto expansion = exchange(expansion_, nullptr);
+                const auto floor = exchange(floor_, 0);
+                new_block("entry");
+
+                // parameters are variables like the others.
+                auto type = types::function_t{signature.result_type};
+                auto next = functions.begin();
+                for (const auto& parameter : signature.formal_parameters) {
+                    if (takes_function(parameter))
+                        bind(parameter.name, *next++);
+                    else
+                        type.formal_parameters.push_back(
+                            types::name_and_type_t{parameter.name, value_type(parameter.type)});
+                }
+                const auto named = type.formal_parameters.size();
+                const auto& captures = captures_.at(index);
+                for (const auto& c : captures)
+                    type.formal_parameters.push_back(
+                        types::name_and_type_t{c.name, c.variable.type});
+
+                const auto& parameters = type.formal_parameters;
+                auto arguments = vector<int>();
+                for (auto i = 0u; i < parameters.size(); i++) {
+                    auto p = instruction_t{opcode_t::parameter, parameters[i].type};
+                    p.immediate = i;
+                    p.name = parameters[i].name;
+                    arguments.push_back(emit(move(p)));
+                    unit().prologue++;
+                }
+                for (auto i = 0u; i < parameters.size(); i++) {
+                    const auto& t = parameters[i].type;
+                    const auto s = slot(parameters[i].name, t);
+                    emit(opcode_t::store, analysis::VOID, {s, arguments[i]});
+                    if (i < named) {
+                        bind(parameters[i].name, binding_t{binding_t::local, s, t, index});
+                    } else {
+                        const auto& x = captures[i - named].variable;
+                        unit().captured[{x.owner, x.index}] = s;
+                    }
+                }
+                module_.functions[index].type = type_t(move(type));
+
+                const auto v = value(e.body, unit().result_type);
+                emit(opcode_t::ret, analysis::VOID, v == -1 ? vector<int>() : vector{v});
+
+                expansion_ = expansion;
+                floor_ = floor;
+                scopes_.pop_back();
+                swap(scopes_, scopes);
+                units_.pop_back();
+                location_ = outer;
+            }
+
+            // Functions are lowered where they are defined, capturing what
+            // they use of the variables there; generators and functions
+            // taking functions are only lowered where they are used.
+            auto function(const typed_tree_t& at, const string& name, const fn_expr_t<type_t>& e)
+                -> void {
+                const auto b = lookup(at, name);
+                scopes_.push_back(closure_scope(e));
+                if (b.kind == binding_t::generator) {
+                    generators_[b.index].scopes = scopes_;
+                } else if (b.kind == binding_t::higher_order) {
+                    higher_order_[b.index].captures = free_variables(e);
+                    higher_order_[b.index].scopes = scopes_;
+                } else {
+                    auto captures = free_variables(e);
+                    const auto early = find(called_early_.begin(), called_early_.end(), b.index);
+                    if (!captures.empty() && early != called_early_.end())
+                        throw error("Closures can only be called after their definition yet",
+                                    at.location);
+                    captures_[b.index] = move(captures);
+                    lower_function(b.index, e, b.type.get().as<types::function_t>(), scopes_, {});
+                }
+                scopes_.pop_back();
+            }
+
+            // A function passed to one taking functions: one named, or one
+            // written in place, which is lifted out of its caller.
+            auto function_argument(const typed_node_t& node) -> binding_t {
+                const auto& tree = node.get();
+                const auto nested = [&]() -> binding_t {
+                    throw error(
+                        "Can only pass functions which neither yield nor take functions yet",
+                        tree.location);
+                };
+
+                if (const auto id = tree.get_if<lexer::identifier_t>()) {
+                    const auto b = lookup(tree, id->name);
+                    if (b.kind == binding_t::function) return b;
+                    if (b.kind == binding_t::generator || b.kind == binding_t::higher_order)
+                        return nested();
+                }
+                const auto e = tree.get_if<fn_expr_t<type_t>>();
+                if (!e)
+                    throw error("Can't compile functions escaping where they are defined yet",
+                                tree.location);
+
+                const auto& signature = tree.attribute.get().as<types::function_t>();
+                if (signature.result_type.get().is<types::generator_t>()) return nested();
+                for (const auto& parameter : signature.formal_parameters) {
+                    if (takes_function(parameter)) return nested();
+                    if (!storable(value_type(parameter.type)))
+                        throw error("Can't pass values of this type yet", tree.location);
+                }
+
+                const auto index = int(module_.functions.size());
+                auto& fn = module_.functions.emplace_back();
+                fn.name = "lambda";
+                fn.type = tree.attribute;
+                fn.result_type = result_of(signature);
+
+                scopes_.push_back(closure_scope(*e));
+                captures_[index] = free_variables(*e);
+                lower_function(index, *e, signature, scopes_, {});
+                scopes_.pop_back();
+                return binding_t{binding_t::function, index, tree.attribute};
+            }
+
+            // The specialization of a function taking functions for those a
+            // call passes, made at the first such call.
+            auto specialize(const typed_tree_t& at, const binding_t& b, const invoc_t<type_t>& e)
+                -> int {
+                if (!higher_order_[b.index].scopes)
+                    throw error("Can only call functions taking functions after their definition "
+                                "yet",
+                                at.location);
+                const auto& signature = b.type.get().as<types::function_t>();
+                const auto& parameters = signature.formal_parameters;
+
+                auto functions = vector<binding_t>();
+                auto key = vector<int>();
+                for (auto i = 0u; i < parameters.size(); i++) {
+                    if (!takes_function(parameters[i])) continue;
+                    functions.push_back(function_argument(e.arguments[i]));
+                    key.push_back(functions.back().index);
+                }
+                const auto& specializations = higher_order_[b.index].specializations;
+                if (const auto p = specializations.find(key); p != specializations.end())
+                    return p->second;
+
+                auto name = higher_order_[b.index].name + "<";
+                for (const auto& f : functions) {
+                    if (&f != &functions.front()) name += ", ";
+                    name += module_.functions[f.index].name;
+                }
+                const auto index = int(module_.functions.size());
+                auto& fn = module_.functions.emplace_back();
+                fn.name = name + ">";
+                fn.type = b.type;
+                fn.result_type = result_of(signature);
+                higher_order_[b.index].specializations.emplace(key, index);
+
+                // it uses what it captures, and what the functions passed do.
+                auto captures = higher_order_[b.index].captures;
+                for (const auto& f : functions)
+                    for (const auto& c : this->captures(f.index))
+                        if (none_of(captures.begin(), captures.end(), [&](const capture_t& d) {
+                                return d.variable.owner == c.variable.owner &&
+                                       d.variable.index == c.variable.index;
+                            }))
+                            captures.push_back(c);
+                captures_[index] = move(captures);
+
+                const auto& h = higher_order_[b.index];
+                lower_function(index, *h.ast, signature, *h.scopes, functions);
+                return index;
+            }
+
+            // slots of their function.
+            auto define(const typed_tree_t& at,
+                        const string& name,
+                        const typed_node_t& rhs,
+                        const type_t& want) -> int {
+                if (const auto fn_expr = rhs.get().get_if<fn_expr_t<type_t>>()) {
+                    function(at, name, *fn_expr);
+                    return -1;
+                }
+
+                const auto t = value_type(at.attribute);
+                if (!storable(t)) throw error("Can't store values of this type yet", at.location);
+
+                const auto v = value(rhs, t);
+                if (top_level()) {
+                    const auto g = int(module_.globals.size());
+                    module_.globals.push_back(global_t{name, t});
+                    const auto b = binding_t{binding_t::global, g, t};
+                    emit(opcode_t::store, analysis::VOID, {address(b), v});
+                    bind(name, b);
+                } else {
+                    const auto s = slot(name, t);
+                    emit(opcode_t::store, analysis::VOID, {s, v});
+                    bind(name, binding_t{binding_t::local, s, t, unit().index});
+                }
+                return coerce(v, t, want);
+            }
+
+            auto block(const syntax::block_t<type_t>& b, const type_t& want) -> int {
+                scopes_.emplace_back();
+                declare_functions(b);
+
+                auto v = -1;
+                for (auto i = 0u; i < b.size(); i++)
+                    v = value(b[i], i + 1 == b.size() ? want : analysis::VOID);
+
+                scopes_.pop_back();
+                return v;
+            }
+
+            auto assign(const typed_tree_t& at, const assign_t<type_t>& e, const type_t& want)
+                -> int {
+                const auto id = e.lhs.get().get_if<lexer::identifier_t>();
+                if (!id) throw error("Can only assign to variables yet", at.location);
+
+                const auto b = lookup(e.lhs.get(), id->name);
+                if (b.kind != binding_t::local && b.kind != binding_t::global)
+                    throw error("Functions can't be assigned to", at.location);
+                if (b.captured)
+                    throw error("Closures can't assign to the variables they capture yet",
+                                at.location);
+
+                const auto v = value(e.rhs, b.type);
+                emit(opcode_t::store, analysis::VOID, {address(b), v});
+                return coerce(v, b.type, want);
+            }
+
+            auto while_(const while_t<type_t>& e) -> int {
+                const auto test = new_block("while");
+                jump(test);
+                unit().block = test;
+                const auto condition = value(e.test, analysis::BOOL);
+                const auto body = new_block("do");
+                const auto br =
+                    emit(instruction_t{opcode_t::branch, analysis::VOID, {condition}, {body, -1}});
+
+                unit().block = body;
+                unit().loops.push_back(loop_t{test, {}, {}, unit().regions.size()});
+                value(e.body, analysis::VOID);
+                jump(test);
+
+                const auto loop = move(unit().loops.back());
+                unit().loops.pop_back();
+                const auto end = new_block("endwhile");
+                fn()[br].blocks[1] = end;
+                for (const auto j : loop.breaks) fn()[j].blocks[0] = end;
+                unit().block = end;
+                return -1;
+            }
+
+            // The counter is a u64 phi, compared to the length of the array,
+            // or to the number of elements of the slice, and incremented at
+            // the end of every iteration.
+            auto for_(const typed_tree_t& at, const for_t<type_t>& e) -> int {
+                if (e.var_rhs.get().attribute.get().is<types::generator_t>())
+                    return for_generator(at, e);
+
+                const auto t = value_type(e.var_rhs.get().attribute);
+                const auto ty = t.get().get_if<types::array_t>();
+                const auto s = t.get().get_if<types::slice_t>();
+                if (!ty && !s)
+                    throw error("Can only iterate over arrays and slices yet", at.location);
+                const auto& element = ty ? ty->value_type : s->value_type;
+
+                const auto sequence = value(e.var_rhs, t);
+                const auto n = ty ? emit(opcode_t::length, analysis::U64, {sequence})
+                                  : constant(analysis::U64, analysis::slice_count(*s));
+                const auto start = constant(analysis::U64, 0);
+                const auto x = slot(e.var_lhs.name, element);
+                const auto from = unit().block;
+
+                const auto test = new_block("for");
+                jump(test);
+                unit().block = test;
+                const auto i =
+                    emit(instruction_t{opcode_t::phi, analysis::U64, {start}, {from}});
+                const auto condition = emit(opcode_t::lt, analysis::BOOL, {i, n});
+                const auto body = new_block("do");
+                const auto br =
+                    emit(instruction_t{opcode_t::branch, analysis::VOID, {condition}, {body, -1}});
+
+                unit().block = body;
+                // slices index the storage they view: begin + i * stride.
+                auto j = i;
+                if (s && s->stride != 1)
+                    j = emit(opcode_t::mul, analysis::U64,
+                             {i, constant(analysis::U64, uint64_t(s->stride))});
+                if (s && s->begin != 0)
+                    j = emit(opcode_t::add, analysis::U64,
+                             {j, constant(analysis::U64, uint64_t(s->begin))});
+                const auto x_i = emit(opcode_t::index, element, {sequence, j});
+                emit(opcode_t::store, analysis::VOID, {x, x_i});
+                scopes_.emplace_back();
+                bind(e.var_lhs.name, binding_t{binding_t::local, x, element, unit().index});
+                unit().loops.push_back(loop_t{-1, {}, {}, unit().regions.size()});
+                value(e.body, analysis::VOID);
+                scopes_.pop_back();
+
+                auto loop = move(unit().loops.back());
+                unit().loops.pop_back();
+                loop.continues.push_back(jump(-1));
+                const auto next = new_block("next");
+                for (const auto j : loop.continues) fn()[j].blocks[0] = next;
+                unit().block = next;
+                const auto one = constant(analysis::U64, 1);
+                const auto step = emit(opcode_t::add, analysis::U64, {i, one});
+                jump(test);
+                fn()[i].operands.push_back(step);
+                fn()[i].blocks.push_back(next);
+
+                const auto end = new_block("endfor");
+                fn()[br].blocks[1] = end;
+                for (const auto j : loop.breaks) fn()[j].blocks[0] = end;
+                unit().block = end;
+                return -1;
+            }
+
+            // Loops over a generator lower its body, with the loop's in
+            // place of each yield.
+            auto for_generator(const typed_tree_t& at, const for_t<type_t>& e) -> int {
+                const auto call = e.var_rhs.get().get_if<invoc_t<type_t>>();
+                const auto id = call ? call->target.get().get_if<lexer::identifier_t>() : nullptr;
+                const auto b = id ? optional(lookup(at, id->name)) : nullopt;
+                if (!b || b->kind != binding_t::generator)
+                    throw error("Can only iterate over calls of generators yet", at.location);
+
+                const auto& g = generators_[b->index];
+                if (!g.scopes)
+                    throw error("Can only iterate over generators after their definition yet",
+                                at.location);
+                for (auto x = expansion_; x; x = x->outer)
+                    if (x->generator == b->index)
+                        throw error("Can't compile recursive generators yet", at.location);
+
+                const auto& signature = g.type.get().as<types::function_t>();
+                const auto& parameters = signature.formal_parameters;
+                if (call->arguments.size() != parameters.size())
+                    throw error("Wrong number of arguments", at.location);
+                const auto element =
+                    value_type(signature.result_type.get().as<types::generator_t>().value_type);
+                if (!storable(element))
+                    throw error("Can't store values of this type yet", at.location);
+
+                auto arguments = vector<int>(parameters.size(), -1);
+                auto functions = vector<optional<binding_t>>(parameters.size());
+                for (auto i = 0u; i < parameters.size(); i++) {
+                    if (takes_function(parameters[i]))
+                        functions[i] = function_argument(call->arguments[i]);
+                    else
+                        arguments[i] = value(call->arguments[i], value_type(parameters[i].type));
+                }
+
+                auto expansion = expansion_t{
+                    b->index,
+                    binding_t{binding_t::local,
+                              slot(e.var_lhs.name, element),
+                              element,
+                              unit().index},
+                    &e.body,
+                    scopes_,
+                    {},
+                    expansion_,
+                    floor_,
+                    unit().regions.size()};
+                expansion.scopes.emplace_back();
+                expansion.scopes.back().insert_or_assign(e.var_lhs.name, expansion.variable);
+
+                // the generator's parameters are variables of the caller,
+                // seeing the names it was defined with, or the functions
+                // passed.
+                auto scopes = *g.scopes;
+                scopes.emplace_back();
+                for (auto i = 0u; i < parameters.size(); i++) {
+                    if (functions[i]) {
+                        scopes.back().insert_or_assign(parameters[i].name, *functions[i]);
+                        continue;
+                    }
+                    const auto t = value_type(parameters[i].type);
+                    const auto s = slot(parameters[i].name, t);
+                    emit(opcode_t::store, analysis::VOID, {s, arguments[i]});
+                    scopes.back().insert_or_assign(
+                        parameters[i].name, binding_t{binding_t::local, s, t, unit().index});
+                }
+
+                swap(scopes_, scopes);
+                expansion_ = &expansion;
+                floor_ = unit().loops.size();
+                value(g.ast->body, analysis::VOID);
+                expansion.ends.push_back(jump(-1));
+                expansion_ = expansion.outer;
+                floor_ = expansion.floor;
+                swap(scopes_, scopes);
+
+                const auto end = new_block("endfor");
+                for (const auto j : expansion.ends) fn()[j].blocks[0] = end;
+                unit().block = end;
+                return -1;
+            }
+
+            auto yield(const typed_tree_t& at, const yield_t<type_t>& e) -> int {
+                if (!expansion_ || !e.value.get())
+                    throw error("Can only yield values from generators", at.location);
+                auto& expansion = *expansion_;
+                const auto& x = expansion.variable;
+                emit(opcode_t::store, analysis::VOID, {x.index, value(e.value, x.type)});
+
+                // the loop's body, as if the generator weren't there.
+                swap(scopes_, expansion.scopes);
+                expansion_ = expansion.outer;
+                const auto floor = exchange(floor_, expansion.floor);
+                unit().loops.push_back(loop_t{-1, {}, {}, unit().regions.size()});
+                value(*expansion.body, analysis::VOID);
+                auto loop = move(unit().loops.back());
+                unit().loops.pop_back();
+                loop.continues.push_back(jump(-1));
+                floor_ = floor;
+                expansion_ = &expansion;
+                swap(scopes_, expansion.scopes);
+
+                // the generator goes on when the body continues.
+                const auto next = new_block("resume");
+                for (const auto j : loop.continues) fn()[j].blocks[0] = next;
+                expansion.ends.insert(expansion.ends.end(), loop.breaks.begin(), loop.breaks.end());
+                unit().block = next;
+                return -1;
+            }
+
+            // Everything allocated in a with block is freed once it ends, as
+            // its value, which can't be allocated, is known.
+            auto with_(const with_t<type_t>& e, const type_t& want) -> int {
+                unit().regions.push_back(emit(opcode_t::mark, analysis::U64, {}));
+                const auto v = value(e.body, want);
+                const auto mark = unit().regions.back();
+                unit().regions.pop_back();
+                emit(opcode_t::release, analysis::VOID, {mark});
+                return v;
+            }
+
+            // Frees what the regions left early, all but the first n open,
+            // allocated.
+            auto release(size_t n) -> void {
+                const auto& regions = unit().regions;
+                if (regions.size() > n) emit(opcode_t::release, analysis::VOID, {regions[n]});
+            }
+
+            auto return_(const return_t<type_t>& e) -> int {
+                // generators end the loop over them when they return.
+                if (expansion_) {
+                    if (e.value.get())
+                        throw error("Generators can't return values", e.value.get().location);
+                    release(expansion_->regions);
+                    expansion_->ends.push_back(jump(-1));
+                    unreachable_code();
+                    return -1;
+                }
+
+                const auto& t = unit().result_type;
+                auto v = e.value.get() ? value(e.value, t) : -1;
+                if (v == -1 && !t.get().is<types::void_t>()) v = zero(t);
+                release(0);
+                emit(opcode_t::ret, analysis::VOID, v == -1 ? vector<int>() : vector{v});
+                unreachable_code();
+                return -1;
+            }
+
+            auto loop_jump(const typed_tree_t& at, vector<int> loop_t::*jumps) -> int {
+                if (unit().loops.size() <= floor_)
+                    throw error(jumps == &loop_t::breaks ? "\"break\" outside of a loop"
+                                                         : "\"continue\" outside of a loop",
+                                at.location);
+                auto& loop = unit().loops.back();
+                release(loop.regions);
+                if (jumps == &loop_t::continues && loop.next != -1)
+                    jump(loop.next);
+                else
+                    (loop.*jumps).push_back(jump(-1));
+                unreachable_code();
+                return -1;
+            }
+        };
+    }  // namespace
+
+    auto value_type(const type_t& t) -> type_t {
+        const auto u = analysis::deref(t);
+        if (u.get().is<types::intlit_t>()) return analysis::I64;
+        if (u.get().is<types::floatlit_t>()) return analysis::F64;
+        if (const auto n = u.get().get_if<types::nominal_type_t>()) {
+            const auto named = value_type(n->type);
+            return scalar(named) ? named : u;
+        }
+        if (const auto a = u.get().get_if<types::array_t>()) {
+            const auto element = value_type(a->value_type);
+            if (element != a->value_type) return type_t(types::array_t{element, a->size});
+        }
+        if (const auto s = u.get().get_if<types::slice_t>()) {
+            const auto element = value_type(s->value_type);
+            if (element != s->value_type)
+                return type_t(types::slice_t{element, s->begin, s->end, s->stride});
+        }
+        return u;
+    }
+
+    auto lower(const attr_node_t<type_t>& ast) -> module_t {
+        auto module = module_t();
+        lowering_t(module).program(ast);
+        return module;
+    }
+}}  // namespace bt::ir
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <tuple>
+
+#include <bullet/ir/pass.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+
+    namespace {
+        // Slots whose address is only ever read from or written to: nothing
+        // stores it, passes it or computes with it, so no one else can see
+        // the variable.
+        auto promotable(const function_t& fn, const vector<vector<int>>& uses, int slot) -> bool {
+            return all_of(uses[slot].begin(), uses[slot].end(), [&](int u) {
+                const auto& i = fn[u];
+                return (i.op == opcode_t::load || i.op == opcode_t::store) &&
+                       i.operands[0] == slot &&
+                       (i.op == opcode_t::load || i.operands[1] != slot);
+            });
+        }
+
+        // The blocks where the dominance of each block ends, as Cooper, Harvey
+        // and Kennedy compute them.
+        auto frontiers(const function_t& fn, const vector<int>& idom) -> vector<vector<int>> {
+            const auto preds = predecessors(fn);
+            auto result = vector<vector<int>>(fn.blocks.size());
+            for (auto b = 0u; b < fn.blocks.size(); b++) {
+                if (preds[b].size() < 2 || idom[b] == -1) continue;
+                for (auto runner : preds[b]) {
+                    while (runner != idom[b]) {
+                        auto& frontier = result[runner];
+                        if (frontier.empty() || frontier.back() != int(b))
+                            frontier.push_back(int(b));
+                        runner = idom[runner];
+                    }
+                }
+            }
+            return result;
+        }
+
+        class promotion_t {
+            function_t& fn_;
+            vector<int> idom_;
+            vector<vector<int>> children_;
+            // the variables promoted, by slot id, and the index of each.
+            vector<int> slots_;
+            vector<int> variable_;
+            // the phis placed at the start of each block, and the variable
+            // each merges.
+            vector<vector<pair<int, int>>> phis_;
+            // the value each variable holds where the walk is, and its value
+            // before anything is stored, made when a load needs it and listed
+            // in the entry block once the walk is done.
+            vector<int> current_;
+            vector<int> zero_;
+            vector<int> replacement_;
+
+            auto resolve(int v) -> int {
+                while (v < int(replacement_.size()) && replacement_[v] != -1) v = replacement_[v];
+                return v;
+            }
+
+            auto zero(int x) -> int {
+                if (zero_[x] != -1) return zero_[x];
+                const auto& slot = fn_[slots_[x]];
+                auto c = instruction_t{opcode_t::constant, analysis::deref(slot.type)};
+                c.location = slot.location;
+                zero_[x] = fn_.add(move(c));
+                return zero_[x];
+            }
+
+            auto value(int x) -> int { return current_[x] != -1 ? current_[x] : zero(x); }
+
+            // Puts phis where stores to a variable meet, iterating over the
+            // frontiers of the blocks which store to it.
+            auto place_phis() -> void {
+                const auto frontier = frontiers(fn_, idom_);
+                const auto where = block_of(fn_);
+                const auto uses = users(fn_);
+                for (auto x = 0u; x < slots_.size(); x++) {
+                    auto placed = vector<bool>(fn_.blocks.size());
+                    auto seen = vector<bool>(fn_.blocks.size());
+                    auto work = vector<int>();
+                    for (const auto u : uses[slots_[x]])
+                        if (fn_[u].op == opcode_t::store && !seen[where[u]]) {
+                            seen[where[u]] = true;
+                            work.push_back(where[u]);
+                        }
+
+                    while (!work.empty()) {
+                        const auto b = work.back();
+                        work.pop_back();
+                        for (const auto d : frontier[b]) {
+                            if (placed[d]) continue;
+                            placed[d] = true;
+                            auto phi = instruction_t{opcode_t::phi,
+                                                     analysis::deref(fn_[slots_[x]].type)};
+                            phi.location = fn_[slots_[x]].location;
+                            phis_[d].emplace_back(fn_.add(move(phi)), int(x));
+                            if (!seen[d]) {
+                                seen[d] = true;
+                                work.push_back(d);
+                            }
+                        }
+                    }
+                }
+
+                for (auto b = 0u; b < fn_.blocks.size(); b++) {
+                    auto& instructions = fn_.blocks[b].instructions;
+                    auto ids = vector<int>();
+                    for (const auto& [id, x] : phis_[b]) ids.push_back(id);
+                    instructions.insert(instructions.begin(), ids.begin(), ids.end());
+                }
+            }
+
+            // Replaces loads by the value the variable holds, and forgets the
+            // stores, giving phis of the successors their operands.
+            auto rename(int block) -> void {
+                for (const auto& [id, x] : phis_[block]) current_[x] = id;
+
+                auto& instructions = fn_.blocks[block].instructions;
+                auto kept = vector<int>();
+                for (const auto id : instructions) {
+                    const auto& i = fn_[id];
+                    const auto memory = i.op == opcode_t::load || i.op == opcode_t::store;
+                    const auto x = memory ? variable_[i.operands[0]] : -1;
+                    if (i.op == opcode_t::load && x != -1) {
+                        replacement_[id] = value(x);
+                        continue;
+                    }
+                    if (i.op == opcode_t::store && x != -1) {
+                        current_[x] = resolve(i.operands[1]);
+                        continue;
+                    }
+                    if (i.op == opcode_t::slot && variable_[id] != -1) continue;
+                    kept.push_back(id);
+                }
+                instructions = move(kept);
+
+                auto successors = fn_.successors(block);
+                sort(successors.begin(), successors.end());
+                successors.erase(unique(successors.begin(), successors.end()), successors.end());
+                for (const auto s : successors)
+                    for (const auto& [id, x] : phis_[s]) {
+                        fn_[id].operands.push_back(value(x));
+                        fn_[id].blocks.push_back(block);
+                    }
+            }
+
+        public:
+            explicit promotion_t(function_t& fn)
+                : fn_(fn), variable_(fn.values.size(), -1), replacement_(fn.values.size(), -1) {
+                const auto uses = users(fn);
+                for (const auto id : fn.blocks[0].instructions)
+                    if (fn[id].op == opcode_t::slot && promotable(fn, uses, id)) {
+                        variable_[id] = int(slots_.size());
+                        slots_.push_back(id);
+                    }
+            }
+
+            auto run() -> bool {
+                if (slots_.empty()) return false;
+
+                idom_ = dominators(fn_);
+                children_.resize(fn_.blocks.size());
+                for (auto b = 1u; b < fn_.blocks.size(); b++)
+                    if (idom_[b] != -1) children_[idom_[b]].push_back(int(b));
+                phis_.resize(fn_.blocks.size());
+                current_.assign(slots_.size(), -1);
+                zero_.assign(slots_.size(), -1);
+                place_phis();
+
+                // a preorder walk of the dominator tree, restoring the values
+                // variables held on the way back up.
+                auto stack = vector<tuple<int, size_t, vector<int>>>();
+                stack.emplace_back(0, 0, current_);
+                rename(0);
+                while (!stack.empty()) {
+                    auto& [b, next, saved] = stack.back();
+                    if (next < children_[b].size()) {
+                        const auto c = children_[b][next++];
+                        stack.emplace_back(c, 0, current_);
+                        rename(c);
+                    } else {
+                        current_ = move(saved);
+                        stack.pop_back();
+                    }
+                }
+
+                auto& entry = fn_.blocks[0].instructions;
+                auto at = entry.begin();
+                while (fn_[*at].op == opcode_t::parameter) at++;
+                for (const auto z : zero_)
+                    if (z != -1) at = entry.insert(at, z) + 1;
+
+                substitute(fn_, move(replacement_));
+                return true;
+            }
+        };
+    }  // namespace
+
+    auto promote_variables(module_t& module) -> bool {
+        auto changed = false;
+        for (auto& fn : module.functions) {
+            // blocks nothing reaches have no place in the dominator tree.
+            changed |= remove_unreachable(fn);
+            changed |= promotion_t(fn).run();
+        }
+        return changed;
+    }
+}}  // namespace bt::ir
@@ -0,0 +1,68 @@
+#include <chrono>
+#include <iomanip>
+
+#include <bullet/ir/pass.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+
+    auto pass_manager_t::add(const string& name, pass_t pass) -> pass_manager_t& {
+        auto k = 0u;
+        while (k < statistics_.size() && statistics_[k].name != name) k++;
+        if (k == statistics_.size()) statistics_.push_back(statistics_t{name});
+        passes_.emplace_back(k, move(pass));
+        return *this;
+    }
+
+    auto pass_manager_t::run(module_t& module) -> bool {
+        auto changed = false;
+        for (auto& [k, pass] : passes_) {
+            auto& stats = statistics_[k];
+            const auto start = chrono::steady_clock::now();
+            const auto c = pass(module);
+            stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            stats.runs++;
+            stats.changes += c;
+            changed |= c;
+
+            if (verify_each) {
+                try {
+                    verify(module);
+                } catch (const error& e) {
+                    throw error("After " + stats.name + ": " + e.what());
+                }
+            }
+        }
+        return changed;
+    }
+
+    auto pipeline(int level) -> pass_manager_t {
+        auto passes = pass_manager_t();
+        if (level <= 0) return passes;
+
+        passes.add("mem2reg", promote_variables);
+        // functions are measured for inlining once their variables are
+        // values, without the loads and stores they start with.
+        if (level >= 2) passes.add("inline", [](module_t& m) { return inline_calls(m); });
+        passes.add("simplify-cfg", simplify_cfg)
+            .add("sccp", propagate_constants)
+            .add("simplify-cfg", simplify_cfg)
+            .add("gvn", number_values)
+            .add("dce", eliminate_dead_code);
+        if (level >= 2) passes.add("simplify-cfg", simplify_cfg);
+        return passes;
+    }
+
+    auto operator<<(ostream& os, const pass_manager_t& passes) -> ostream& {
+        auto total = 0.0;
+        for (const auto& s : passes.statistics()) {
+            os << "  " << left << setw(14) << s.name << right << setw(10) << fixed
+               << setprecision(3) << s.seconds * 1e3 << " ms  " << s.changes << "/" << s.runs
+               << " runs changed the module" << defaultfloat << endl;
+            total += s.seconds;
+        }
+        os << "  " << left << setw(14) << "total" << right << setw(10) << fixed << setprecision(3)
+           << total * 1e3 << " ms" << defaultfloat << endl;
+        return os;
+    }
+}}  // namespace bt::ir
@@ -0,0 +1,364 @@
+#include <bit>
+#include <cmath>
+#include <optional>
+
+#include <bullet/ir/pass.hpp>
+#include <bullet/vm/bytecode.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+
+    namespace types = analysis::types;
+
+    using analysis::type_t;
+
+    namespace {
+        auto is_bool(const type_t& t) -> bool { return t.get().is<types::bool_t>(); }
+
+        // A 64-bit result as the VM keeps values of type t.
+        auto narrow(uint64_t bits, const type_t& t) -> uint64_t {
+            if (is_bool(t)) return bits & 0xff;
+            if (analysis::is_floating_point(t)) {
+                const auto d = bit_cast<double>(bits);
+                return analysis::width(t) == 32 ? bit_cast<uint64_t>(double(float(d))) : bits;
+            }
+            const auto w = analysis::width(t);
+            if (w >= 64) return bits;
+            if (analysis::is_signed(t)) return uint64_t(int64_t(bits << (64 - w)) >> (64 - w));
+            return bits & ~uint64_t(0) >> (64 - w);
+        }
+
+        auto from_double(double d, const type_t& t) -> uint64_t {
+            return narrow(bit_cast<uint64_t>(d), t);
+        }
+
+        auto convert(uint64_t x, const type_t& from, const type_t& to) -> optional<uint64_t> {
+            const auto f_float = analysis::is_floating_point(from);
+            const auto t_float = analysis::is_floating_point(to);
+            if (f_float && t_float) return narrow(x, to);
+            if (t_float)
+                return from_double(analysis::is_signed(from) ? double(int64_t(x)) : double(x), to);
+            if (f_float) {
+                // out of range, the VM's conversions are undefined.
+                const auto d = bit_cast<double>(x);
+                if (analysis::is_signed(to)) {
+                    if (!(d > -0x1p63 - 1 && d < 0x1p63)) return nullopt;
+                    return narrow(uint64_t(int64_t(d)), to);
+                }
+                if (!(d > -1 && d < 0x1p64)) return nullopt;
+                return narrow(uint64_t(d), to);
+            }
+            return narrow(x, to);
+        }
+
+        auto compare(opcode_t op, uint64_t a, uint64_t b, const type_t& t) -> bool {
+            const auto order = [&](auto x, auto y) {
+                switch (op) {
+                case opcode_t::eq: return x == y;
+                case opcode_t::ne: return x != y;
+                case opcode_t::lt: return x < y;
+                case opcode_t::le: return x <= y;
+                case opcode_t::gt: return x > y;
+                default: return x >= y;
+                }
+            };
+            if (analysis::is_floating_point(t)) return order(bit_cast<double>(a), bit_cast<double>(b));
+            if (analysis::is_signed(t)) return order(int64_t(a), int64_t(b));
+            return order(a, b);
+        }
+
+        // Computes an instruction on constant operands exactly as the VM
+        // would, if it doesn't fault.
+        auto fold(const function_t& fn, const instruction_t& i, const vector<uint64_t>& x)
+            -> optional<uint64_t> {
+            const auto& t = i.type;
+            const auto scalar =
+                analysis::is_integral(t) || analysis::is_floating_point(t) || is_bool(t);
+            const auto f = analysis::is_floating_point(t);
+            const auto s = analysis::is_signed(t) && !f;
+            const auto d = [&](int k) { return bit_cast<double>(x[k]); };
+
+            switch (i.op) {
+            case opcode_t::add:
+            case opcode_t::sub:
+            case opcode_t::mul:
+            case opcode_t::div:
+            case opcode_t::rem:
+            case opcode_t::pow:
+                if (!scalar) return nullopt;
+                if (f) {
+                    switch (i.op) {
+                    case opcode_t::add: return from_double(d(0) + d(1), t);
+                    case opcode_t::sub: return from_double(d(0) - d(1), t);
+                    case opcode_t::mul: return from_double(d(0) * d(1), t);
+                    case opcode_t::div: return from_double(d(0) / d(1), t);
+                    case opcode_t::rem: return from_double(fmod(d(0), d(1)), t);
+                    default: return from_double(pow(d(0), d(1)), t);
+                    }
+                }
+                switch (i.op) {
+                case opcode_t::add: return narrow(x[0] + x[1], t);
+                case opcode_t::sub: return narrow(x[0] - x[1], t);
+                case opcode_t::mul: return narrow(x[0] * x[1], t);
+                case opcode_t::pow: return narrow(uint64_t(vm::ipow(int64_t(x[0]), int64_t(x[1]))), t);
+                default: break;
+                }
+                if (x[1] == 0) return nullopt;
+                if (i.op == opcode_t::div) {
+                    if (!s) return narrow(x[0] / x[1], t);
+                    if (int64_t(x[1]) == -1) return narrow(0 - x[0], t);
+                    return narrow(uint64_t(int64_t(x[0]) / int64_t(x[1])), t);
+                }
+                if (!s) return narrow(x[0] % x[1], t);
+                if (int64_t(x[1]) == -1) return 0;
+                return narrow(uint64_t(int64_t(x[0]) % int64_t(x[1])), t);
+            case opcode_t::neg:
+                if (!scalar) return nullopt;
+                return f ? from_double(-d(0), t) : narrow(0 - x[0], t);
+            case opcode_t::band: return narrow(x[0] & x[1], t);
+            case opcode_t::bor: return narrow(x[0] | x[1], t);
+            case opcode_t::bxor: return narrow(x[0] ^ x[1], t);
+            case opcode_t::bnot: return narrow(~x[0], t);
+            case opcode_t::eq:
+            case opcode_t::ne:
+            case opcode_t::lt:
+            case opcode_t::le:
+            case opcode_t::gt:
+            case opcode_t::ge:
+                if (!scalar) return nullopt;
+                return compare(i.op, x[0], x[1], fn[i.operands[0]].type);
+            case opcode_t::lnot: return !x[0];
+            case opcode_t::convert: {
+                const auto& from = fn[i.operands[0]].type;
+                const auto from_scalar = analysis::is_integral(from) ||
+                                         analysis::is_floating_point(from) || is_bool(from);
+                if (!scalar || !from_scalar) return nullopt;
+                return convert(x[0], from, t);
+            }
+            default: return nullopt;
+            }
+        }
+
+        // What is known of a value: nothing yet, that it is a constant, or
+        // that it isn't.
+        struct lattice_t {
+            enum state_t { unknown, constant, varying };
+
+            state_t state = unknown;
+            uint64_t bits = 0;
+        };
+
+        class propagation_t {
+            function_t& fn_;
+            vector<lattice_t> values_;
+            vector<vector<int>> users_;
+            vector<int> block_of_;
+            vector<bool> executable_;
+            // executable edges, as (from, to).
+            vector<vector<bool>> edges_;
+            vector<pair<int, int>> flow_;
+            vector<int> ssa_;
+
+            auto set(int id, lattice_t v) -> void {
+                auto& old = values_[id];
+                if (old.state == v.state && (v.state != lattice_t::constant || old.bits == v.bits))
+                    return;
+                // a value may only go down the lattice: a phi seeing two
+                // different constants varies.
+                if (old.state == lattice_t::constant && v.state == lattice_t::constant)
+                    v.state = lattice_t::varying;
+                if (old.state == lattice_t::varying) return;
+                old = v;
+                ssa_.push_back(id);
+            }
+
+            auto mark(int from, int to) -> void {
+                if (edges_[from][to]) return;
+                edges_[from][to] = true;
+                flow_.emplace_back(from, to);
+            }
+
+            auto visit(int id) -> void {
+                const auto& i = fn_[id];
+                const auto b = block_of_[id];
+
+                switch (i.op) {
+                case opcode_t::constant:
+                    set(id, {lattice_t::constant, i.immediate});
+                    return;
+                case opcode_t::phi: {
+                    auto v = lattice_t();
+                    for (auto k = 0u; k < i.operands.size(); k++) {
+                        if (!edges_[i.blocks[k]][b]) continue;
+                        const auto& x = values_[i.operands[k]];
+                        if (x.state == lattice_t::unknown) continue;
+                        if (x.state == lattice_t::varying ||
+                            (v.state == lattice_t::constant && v.bits != x.bits)) {
+                            v.state = lattice_t::varying;
+                            break;
+                        }
+                        v = x;
+                    }
+                    if (v.state != lattice_t::unknown) set(id, v);
+                    return;
+                }
+                case opcode_t::jump: mark(b, i.blocks[0]); return;
+                case opcode_t::branch: {
+                    const auto& c = values_[i.operands[0]];
+                    if (c.state == lattice_t::unknown) return;
+                    if (c.state == lattice_t::varying || c.bits) mark(b, i.blocks[0]);
+                    if (c.state == lattice_t::varying || !c.bits) mark(b, i.blocks[1]);
+                    return;
+                }
+                case opcode_t::ret:
+                case opcode_t::store: return;
+                case opcode_t::length: {
+                    const auto a =
+                        fn_[i.operands[0]].type.get().get_if<types::array_t>();
+                    if (a && a->size.size() == 1)
+                        set(id, {lattice_t::constant, a->size[0]});
+                    else
+                        set(id, {lattice_t::varying});
+                    return;
+                }
+                default: break;
+                }
+
+                auto x = vector<uint64_t>();
+                for (const auto v : i.operands) {
+                    const auto& o = values_[v];
+                    if (o.state == lattice_t::unknown) return;
+                    if (o.state == lattice_t::varying) {
+                        set(id, {lattice_t::varying});
+                        return;
+                    }
+                    x.push_back(o.bits);
+                }
+                const auto r = i.operands.empty() ? nullopt : fold(fn_, i, x);
+                set(id, r ? lattice_t{lattice_t::constant, *r} : lattice_t{lattice_t::varying});
+            }
+
+        public:
+            explicit propagation_t(function_t& fn)
+                : fn_(fn),
+                  values_(fn.values.size()),
+                  users_(users(fn)),
+                  block_of_(block_of(fn)),
+                  executable_(fn.blocks.size()),
+                  edges_(fn.blocks.size(), vector<bool>(fn.blocks.size())) {}
+
+            auto run() -> bool {
+                executable_[0] = true;
+                for (const auto id : fn_.blocks[0].instructions) visit(id);
+
+                while (!flow_.empty() || !ssa_.empty()) {
+                    while (!flow_.empty()) {
+                        const auto [from, to] = flow_.back();
+                        flow_.pop_back();
+                        const auto& instructions = fn_.blocks[to].instructions;
+                        if (executable_[to]) {
+                            for (const auto id : instructions)
+                                if (fn_[id].op == opcode_t::phi) visit(id);
+                            continue;
+                        }
+                        executable_[to] = true;
+                        for (const auto id : instructions) visit(id);
+                    }
+                    while (!ssa_.empty()) {
+                        const auto id = ssa_.back();
+                        ssa_.pop_back();
+                        for (const auto u : users_[id])
+                            if (executable_[block_of_[u]]) visit(u);
+                    }
+                }
+                return rewrite();
+            }
+
+        private:
+            auto rewrite() -> bool {
+                auto changed = false;
+                auto replacement = vector<int>(fn_.values.size(), -1);
+
+                for (auto b = 0u; b < fn_.blocks.size(); b++) {
+                    if (!executable_[b]) continue;
+                    auto& instructions = fn_.blocks[b].instructions;
+                    auto constants = vector<int>();
+
+                    for (auto k = 0u; k < instructions.size(); k++) {
+                        const auto id = instructions[k];
+                        auto& i = fn_[id];
+                        const auto& v = values_[id];
+
+                        if (i.op == opcode_t::branch) {
+                            const auto taken = edges_[b][i.blocks[0]];
+                            const auto other = edges_[b][i.blocks[1]];
+                            if (taken == other) continue;
+                            const auto target = taken ? i.blocks[0] : i.blocks[1];
+                            const auto skipped = taken ? i.blocks[1] : i.blocks[0];
+                            i = instruction_t{
+                                opcode_t::jump, analysis::VOID, {}, {target}, 0, "", i.location};
+                            if (skipped != target) drop_incoming(skipped, int(b));
+                            changed = true;
+                            continue;
+                        }
+
+                        if (v.state != lattice_t::constant || i.op == opcode_t::constant) continue;
+                        if (i.type.get().is<types::void_t>()) continue;
+                        if (i.op != opcode_t::phi && i.op != opcode_t::call && i.op != opcode_t::load) {
+                            i.op = opcode_t::constant;
+                            i.operands.clear();
+                            i.blocks.clear();
+                            i.immediate = v.bits;
+                            changed = true;
+                            continue;
+                        }
+                        if (i.op != opcode_t::phi) continue;
+
+                        // phis come first: the constant replacing one goes
+                        // after them.
+                        auto c = instruction_t{opcode_t::constant, i.type};
+                        c.immediate = v.bits;
+                        c.location = i.location;
+                        const auto cid = fn_.add(move(c));
+                        replacement[id] = cid;
+                        constants.push_back(cid);
+                        changed = true;
+                    }
+
+                    if (constants.empty()) continue;
+                    auto& list = fn_.blocks[b].instructions;
+                    list.erase(remove_if(list.begin(),
+                                         list.end(),
+                                         [&](int id) { return replacement[id] != -1; }),
+                               list.end());
+                    auto at = list.begin();
+                    while (fn_[*at].op == opcode_t::phi) at++;
+                    list.insert(at, constants.begin(), constants.end());
+                }
+
+                substitute(fn_, replacement);
+                changed |= remove_unreachable(fn_);
+                return changed;
+            }
+
+            auto drop_incoming(int block, int from) -> void {
+                for (const auto id : fn_.blocks[block].instructions) {
+                    auto& i = fn_[id];
+                    if (i.op != opcode_t::phi) break;
+                    for (auto k = 0u; k < i.blocks.size(); k++) {
+                        if (i.blocks[k] != from) continue;
+                        i.blocks.erase(i.blocks.begin() + k);
+                        i.operands.erase(i.operands.begin() + k);
+                        break;
+                    }
+                }
+            }
+        };
+    }  // namespace
+
+    auto propagate_constants(module_t& module) -> bool {
+        auto changed = false;
+        for (auto& fn : module.functions) changed |= propagation_t(fn).run();
+        return changed;
+    }
+}}  // namespace bt::ir
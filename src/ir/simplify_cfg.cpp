@@ -0,0 +1,183 @@
+#include <algorithm>
+
+#include <bullet/ir/pass.hpp>
+
+namespace bt { namespace ir {
+    using namespace std;
+
+    namespace {
+        auto phis(const function_t& fn, int block) -> vector<int> {
+            auto result = vector<int>();
+            for (const auto id : fn.blocks[block].instructions) {
+                if (fn[id].op != opcode_t::phi) break;
+                result.push_back(id);
+            }
+            return result;
+        }
+
+        auto drop_incoming(function_t& fn, int block, int from) -> void {
+            for (const auto id : phis(fn, block)) {
+                auto& i = fn[id];
+                for (auto k = 0u; k < i.blocks.size(); k++) {
+                    if (i.blocks[k] != from) continue;
+                    i.blocks.erase(i.blocks.begin() + k);
+                    i.operands.erase(i.operands.begin() + k);
+                    break;
+                }
+            }
+        }
+
+        // Branches on constants, or to one block either way, jump.
+        auto fold_branches(function_t& fn) -> bool {
+            auto changed = false;
+            for (auto b = 0u; b < fn.blocks.size(); b++) {
+                const auto id = fn.blocks[b].instructions.back();
+                auto& i = fn[id];
+                if (i.op != opcode_t::branch) continue;
+
+                const auto& condition = fn[i.operands[0]];
+                auto target = -1;
+                if (i.blocks[0] == i.blocks[1])
+                    target = i.blocks[0];
+                else if (condition.op == opcode_t::constant)
+                    target = i.blocks[condition.immediate ? 0 : 1];
+                if (target == -1) continue;
+
+                const auto skipped = i.blocks[0] == target ? i.blocks[1] : i.blocks[0];
+                i = instruction_t{opcode_t::jump, analysis::VOID, {}, {target}, 0, "", i.location};
+                if (skipped != target) drop_incoming(fn, skipped, int(b));
+                changed = true;
+            }
+            return changed;
+        }
+
+        // Phis of a single value are that value.
+        auto remove_trivial_phis(function_t& fn) -> bool {
+            auto replacement = vector<int>(fn.values.size(), -1);
+            auto changed = false;
+            for (auto b = 0u; b < fn.blocks.size(); b++) {
+                for (const auto id : phis(fn, int(b))) {
+                    const auto& operands = fn[id].operands;
+                    auto value = -1;
+                    auto single = true;
+                    for (const auto v : operands) {
+                        if (v == id || v == value) continue;
+                        if (value != -1) single = false;
+                        value = v;
+                    }
+                    if (!single || value == -1) continue;
+                    replacement[id] = value;
+                    changed = true;
+                }
+            }
+            if (!changed) return false;
+
+            for (auto& block : fn.blocks) {
+                auto& instructions = block.instructions;
+                instructions.erase(remove_if(instructions.begin(),
+                                             instructions.end(),
+                                             [&](int id) { return replacement[id] != -1; }),
+                                   instructions.end());
+            }
+            substitute(fn, move(replacement));
+            return true;
+        }
+
+        // Appends blocks to their only predecessor, when it only jumps to
+        // them.
+        auto merge_blocks(function_t& fn) -> bool {
+            auto preds = predecessors(fn);
+            auto changed = false;
+            for (auto b = 0u; b < fn.blocks.size(); b++) {
+                for (;;) {
+                    auto& instructions = fn.blocks[b].instructions;
+                    if (instructions.empty()) break;
+                    const auto& last = fn[instructions.back()];
+                    if (last.op != opcode_t::jump) break;
+                    const auto s = last.blocks[0];
+                    if (s == int(b) || preds[s].size() != 1 || !phis(fn, s).empty()) break;
+
+                    instructions.pop_back();
+                    auto moved = move(fn.blocks[s].instructions);
+                    fn.blocks[s].instructions.clear();
+                    instructions.insert(instructions.end(), moved.begin(), moved.end());
+
+                    for (const auto t : fn.successors(int(b))) {
+                        for (const auto id : phis(fn, t)) {
+                            auto& i = fn[id];
+                            replace(i.blocks.begin(), i.blocks.end(), s, int(b));
+                        }
+                        auto& p = preds[t];
+                        replace(p.begin(), p.end(), s, int(b));
+                        sort(p.begin(), p.end());
+                    }
+                    preds[s].clear();
+                    changed = true;
+                }
+            }
+            return changed;
+        }
+
+        // Sends predecessors of blocks which only jump straight to the
+        // block they jump to.
+        auto bypass_forwarders(function_t& fn) -> bool {
+            auto changed = false;
+            for (auto f = 1u; f < fn.blocks.size(); f++) {
+                const auto& instructions = fn.blocks[f].instructions;
+                if (instructions.size() != 1 || fn[instructions[0]].op != opcode_t::jump) continue;
+                const auto t = fn[instructions[0]].blocks[0];
+                if (t == int(f)) continue;
+
+                const auto preds = predecessors(fn);
+                const auto& from = preds[f];
+                if (from.empty()) continue;
+                const auto merging = phis(fn, t);
+                // a phi couldn't tell two edges from one block apart.
+                if (!merging.empty() &&
+                    any_of(from.begin(), from.end(), [&](int p) {
+                        return find(preds[t].begin(), preds[t].end(), p) != preds[t].end();
+                    }))
+                    continue;
+
+                for (const auto id : merging) {
+                    auto& i = fn[id];
+                    const auto k = find(i.blocks.begin(), i.blocks.end(), int(f)) - i.blocks.begin();
+                    const auto v = i.operands[k];
+                    i.blocks.erase(i.blocks.begin() + k);
+                    i.operands.erase(i.operands.begin() + k);
+                    for (const auto p : from) {
+                        i.blocks.push_back(p);
+                        i.operands.push_back(v);
+                    }
+                }
+                for (const auto p : from) {
+                    auto& jumps = fn[fn.blocks[p].instructions.back()].blocks;
+                    replace(jumps.begin(), jumps.end(), int(f), t);
+                }
+                changed = true;
+            }
+            return changed;
+        }
+
+        auto simplify(function_t& fn) -> bool {
+            auto changed = false;
+            for (auto again = true; again;) {
+                again = fold_branches(fn);
+                again |= remove_unreachable(fn);
+                again |= remove_trivial_phis(fn);
+                again |= merge_blocks(fn);
+                again |= remove_unreachable(fn);
+                again |= bypass_forwarders(fn);
+                again |= remove_unreachable(fn);
+                changed |= again;
+            }
+            return changed;
+        }
+    }  // namespace
+
+    auto simplify_cfg(module_t& module) -> bool {
+        auto changed = false;
+        for (auto& fn : module.functions) changed |= simplify(fn);
+        return changed;
+    }
+}}  // namespace bt::ir
@@ -0,0 +1,260 @@
+#include <bullet/jit/assembler.hpp>
+
+namespace bt { namespace jit {
+    using namespace std;
+
+    namespace {
+        auto fits8(int64_t v) -> bool { return v >= INT8_MIN && v <= INT8_MAX; }
+        auto fits32(int64_t v) -> bool { return v >= INT32_MIN && v <= INT32_MAX; }
+
+        auto n(reg_t r) -> int { return int(r); }
+        auto n(xmm_t r) -> int { return int(r); }
+    }  // namespace
+
+    auto assembler_t::label() -> label_t {
+        labels_.push_back(-1);
+        return label_t(labels_.size() - 1);
+    }
+
+    auto assembler_t::bind(label_t l) -> void { labels_.at(l) = ptrdiff_t(code_.size()); }
+
+    auto assembler_t::offset(label_t l) const -> size_t {
+        if (labels_.at(l) < 0) throw error("Unbound label");
+        return size_t(labels_[l]);
+    }
+
+    auto assembler_t::finish() -> vector<uint8_t> {
+        for (const auto& f : fixups_) {
+            const auto rel = int64_t(offset(f.target)) - int64_t(f.at + 4);
+            if (!fits32(rel)) throw error("Branch out of range");
+            for (auto i = 0; i < 4; i++) code_[f.at + i] = uint8_t(uint32_t(rel) >> (8 * i));
+        }
+        fixups_.clear();
+        return code_;
+    }
+
+    auto assembler_t::dword(uint32_t d) -> void {
+        for (auto i = 0; i < 4; i++) byte(uint8_t(d >> (8 * i)));
+    }
+
+    auto assembler_t::rex(bool wide, int reg, int base, bool force) -> void {
+        const auto bits = (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+        if (bits || force) byte(uint8_t(0x40 | bits));
+    }
+
+    auto assembler_t::encode(initializer_list<uint8_t> prefixes,
+                             bool wide,
+                             initializer_list<uint8_t> opcode,
+                             int reg,
+                             mem_t rm) -> void {
+        for (const auto p : prefixes) byte(p);
+        const auto base = n(rm.base);
+        rex(wide, reg, base);
+        for (const auto o : opcode) byte(o);
+
+        // rbp and r13 have no encoding without a displacement, rsp and r12
+        // none without a SIB byte.
+        const auto mod = rm.disp == 0 && (base & 7) != 5 ? 0 : fits8(rm.disp) ? 1 : 2;
+        byte(uint8_t(mod << 6 | (reg & 7) << 3 | (base & 7)));
+        if ((base & 7) == 4) byte(0x24);
+        if (mod == 1)
+            byte(uint8_t(rm.disp));
+        else if (mod == 2)
+            dword(uint32_t(rm.disp));
+    }
+
+    auto assembler_t::encode(initializer_list<uint8_t> prefixes,
+                             bool wide,
+                             initializer_list<uint8_t> opcode,
+                             int reg,
+                             int rm,
+                             bool byte_registers) -> void {
+        for (const auto p : prefixes) byte(p);
+        // without a REX prefix, the byte registers 4 to 7 are ah, ch, dh, bh.
+        rex(wide, reg, rm, byte_registers && (rm >= 4 || reg >= 4));
+        for (const auto o : opcode) byte(o);
+        byte(uint8_t(0xc0 | (reg & 7) << 3 | (rm & 7)));
+    }
+
+    auto assembler_t::branch(label_t target) -> void {
+        fixups_.push_back(fixup_t{code_.size(), target});
+        dword(0);
+    }
+
+    auto assembler_t::mov(reg_t dst, mem_t src) -> void { encode({}, true, {0x8b}, n(dst), src); }
+    auto assembler_t::mov(mem_t dst, reg_t src) -> void { encode({}, true, {0x89}, n(src), dst); }
+    auto assembler_t::mov(reg_t dst, reg_t src) -> void {
+        encode({}, true, {0x89}, n(src), n(dst));
+    }
+
+    auto assembler_t::mov(reg_t dst, uint64_t imm) -> void {
+        if (imm <= UINT32_MAX) {
+            // writing the 32 bit register clears the upper half.
+            rex(false, 0, n(dst));
+            byte(uint8_t(0xb8 | (n(dst) & 7)));
+            dword(uint32_t(imm));
+        } else {
+            rex(true, 0, n(dst));
+            byte(uint8_t(0xb8 | (n(dst) & 7)));
+            dword(uint32_t(imm));
+            dword(uint32_t(imm >> 32));
+        }
+    }
+
+    auto assembler_t::mov(mem_t dst, int32_t imm) -> void {
+        encode({}, true, {0xc7}, 0, dst);
+        dword(uint32_t(imm));
+    }
+
+    auto assembler_t::lea(reg_t dst, mem_t src) -> void { encode({}, true, {0x8d}, n(dst), src); }
+
+    auto assembler_t::add(reg_t dst, mem_t src) -> void { encode({}, true, {0x03}, n(dst), src); }
+    auto assembler_t::sub(reg_t dst, mem_t src) -> void { encode({}, true, {0x2b}, n(dst), src); }
+    auto assembler_t::and_(reg_t dst, mem_t src) -> void { encode({}, true, {0x23}, n(dst), src); }
+    auto assembler_t::or_(reg_t dst, mem_t src) -> void { encode({}, true, {0x0b}, n(dst), src); }
+    auto assembler_t::xor_(reg_t dst, mem_t src) -> void { encode({}, true, {0x33}, n(dst), src); }
+    auto assembler_t::imul(reg_t dst, mem_t src) -> void {
+        encode({}, true, {0x0f, 0xaf}, n(dst), src);
+    }
+    auto assembler_t::cmp(reg_t lhs, mem_t rhs) -> void { encode({}, true, {0x3b}, n(lhs), rhs); }
+
+    auto assembler_t::cmp(mem_t lhs, int8_t imm) -> void {
+        encode({}, true, {0x83}, 7, lhs);
+        byte(uint8_t(imm));
+    }
+
+    auto assembler_t::cmp(reg_t lhs, int8_t imm) -> void {
+        encode({}, true, {0x83}, 7, n(lhs));
+        byte(uint8_t(imm));
+    }
+
+    auto assembler_t::and_(reg_t dst, reg_t src) -> void {
+        encode({}, true, {0x21}, n(src), n(dst));
+    }
+    auto assembler_t::or_(reg_t dst, reg_t src) -> void {
+        encode({}, true, {0x09}, n(src), n(dst));
+    }
+    auto assembler_t::xor_(reg_t dst, reg_t src) -> void {
+        encode({}, true, {0x31}, n(src), n(dst));
+    }
+    auto assembler_t::test(reg_t lhs, reg_t rhs) -> void {
+        encode({}, true, {0x85}, n(rhs), n(lhs));
+    }
+
+    auto assembler_t::add(reg_t dst, int32_t imm) -> void {
+        encode({}, true, {0x81}, 0, n(dst));
+        dword(uint32_t(imm));
+    }
+
+    auto assembler_t::sub(reg_t dst, int32_t imm) -> void {
+        encode({}, true, {0x81}, 5, n(dst));
+        dword(uint32_t(imm));
+    }
+
+    auto assembler_t::neg(reg_t r) -> void { encode({}, true, {0xf7}, 3, n(r)); }
+    auto assembler_t::not_(reg_t r) -> void { encode({}, true, {0xf7}, 2, n(r)); }
+
+    auto assembler_t::btc(reg_t r, uint8_t bit) -> void {
+        encode({}, true, {0x0f, 0xba}, 7, n(r));
+        byte(bit);
+    }
+
+    auto assembler_t::cqo() -> void {
+        byte(0x48);
+        byte(0x99);
+    }
+
+    auto assembler_t::idiv(reg_t r) -> void { encode({}, true, {0xf7}, 7, n(r)); }
+    auto assembler_t::div(reg_t r) -> void { encode({}, true, {0xf7}, 6, n(r)); }
+    auto assembler_t::inc(mem_t m) -> void { encode({}, true, {0xff}, 0, m); }
+    auto assembler_t::dec(mem_t m) -> void { encode({}, true, {0xff}, 1, m); }
+
+    auto assembler_t::movsx8(reg_t dst, mem_t src) -> void {
+        encode({}, true, {0x0f, 0xbe}, n(dst), src);
+    }
+    auto assembler_t::movsx16(reg_t dst, mem_t src) -> void {
+        encode({}, true, {0x0f, 0xbf}, n(dst), src);
+    }
+    auto assembler_t::movsx32(reg_t dst, mem_t src) -> void {
+        encode({}, true, {0x63}, n(dst), src);
+    }
+    auto assembler_t::movzx8(reg_t dst, mem_t src) -> void {
+        encode({}, false, {0x0f, 0xb6}, n(dst), src);
+    }
+    auto assembler_t::movzx16(reg_t dst, mem_t src) -> void {
+        encode({}, false, {0x0f, 0xb7}, n(dst), src);
+    }
+    auto assembler_t::movzx32(reg_t dst, mem_t src) -> void {
+        encode({}, false, {0x8b}, n(dst), src);
+    }
+    auto assembler_t::movzx8(reg_t r) -> void {
+        encode({}, false, {0x0f, 0xb6}, n(r), n(r), true);
+    }
+
+    auto assembler_t::setcc(cond_t c, reg_t dst) -> void {
+        encode({}, false, {0x0f, uint8_t(0x90 | uint8_t(c))}, 0, n(dst), true);
+    }
+
+    auto assembler_t::push(reg_t r) -> void {
+        rex(false, 0, n(r));
+        byte(uint8_t(0x50 | (n(r) & 7)));
+    }
+
+    auto assembler_t::pop(reg_t r) -> void {
+        rex(false, 0, n(r));
+        byte(uint8_t(0x58 | (n(r) & 7)));
+    }
+
+    auto assembler_t::jmp(label_t target) -> void {
+        byte(0xe9);
+        branch(target);
+    }
+
+    auto assembler_t::jcc(cond_t c, label_t target) -> void {
+        byte(0x0f);
+        byte(uint8_t(0x80 | uint8_t(c)));
+        branch(target);
+    }
+
+    auto assembler_t::call(label_t target) -> void {
+        byte(0xe8);
+        branch(target);
+    }
+
+    auto assembler_t::call(reg_t target) -> void { encode({}, false, {0xff}, 2, n(target)); }
+    auto assembler_t::ret() -> void { byte(0xc3); }
+
+    auto assembler_t::movsd(xmm_t dst, mem_t src) -> void {
+        encode({0xf2}, false, {0x0f, 0x10}, n(dst), src);
+    }
+    auto assembler_t::movsd(mem_t dst, xmm_t src) -> void {
+        encode({0xf2}, false, {0x0f, 0x11}, n(src), dst);
+    }
+    auto assembler_t::addsd(xmm_t dst, mem_t src) -> void {
+        encode({0xf2}, false, {0x0f, 0x58}, n(dst), src);
+    }
+    auto assembler_t::subsd(xmm_t dst, mem_t src) -> void {
+        encode({0xf2}, false, {0x0f, 0x5c}, n(dst), src);
+    }
+    auto assembler_t::mulsd(xmm_t dst, mem_t src) -> void {
+        encode({0xf2}, false, {0x0f, 0x59}, n(dst), src);
+    }
+    auto assembler_t::divsd(xmm_t dst, mem_t src) -> void {
+        encode({0xf2}, false, {0x0f, 0x5e}, n(dst), src);
+    }
+    auto assembler_t::ucomisd(xmm_t lhs, mem_t rhs) -> void {
+        encode({0x66}, false, {0x0f, 0x2e}, n(lhs), rhs);
+    }
+    auto assembler_t::cvtsi2sd(xmm_t dst, mem_t src) -> void {
+        encode({0xf2}, true, {0x0f, 0x2a}, n(dst), src);
+    }
+    auto assembler_t::cvttsd2si(reg_t dst, mem_t src) -> void {
+        encode({0xf2}, true, {0x0f, 0x2c}, n(dst), src);
+    }
+    auto assembler_t::cvtsd2ss(xmm_t dst, xmm_t src) -> void {
+        encode({0xf2}, false, {0x0f, 0x5a}, n(dst), n(src));
+    }
+    auto assembler_t::cvtss2sd(xmm_t dst, xmm_t src) -> void {
+        encode({0xf3}, false, {0x0f, 0x5a}, n(dst), n(src));
+    }
+}}  // namespace bt::jit
@@ -0,0 +1,648 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+#include <bullet/jit/jit.hpp>
+#include <bullet/vm/kernels.hpp>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define BT_JIT_SUPPORTED 1
+#else
+#define BT_JIT_SUPPORTED 0
+#endif
+
+namespace bt { namespace jit {
+    using namespace std;
+    using namespace vm;
+
+    namespace {
+        // the messages the VM uses for the same faults.
+        constexpr auto division_by_zero = "Integer division by zero";
+        constexpr auto stack_overflow = "Stack overflow";
+        constexpr auto out_of_range = "Array index out of range";
+        constexpr auto different_lengths = "Arrays of different lengths";
+        constexpr auto empty_reduction = "Reduction of an empty array";
+        constexpr auto out_of_view = "Slice out of range";
+
+        // The runtime native code calls back into.
+        namespace runtime {
+            auto fmod(double x, double y) -> double { return std::fmod(x, y); }
+            auto pow(double x, double y) -> double { return std::pow(x, y); }
+            auto u2f(uint64_t u) -> double { return double(u); }
+            auto f2u(double f) -> uint64_t { return uint64_t(f); }
+
+            auto newarr(native_context_t* context, const value_t* from, int64_t n)
+                -> const array_t* {
+                return context->arena->make<array_t>(from, from + n, context->arena);
+            }
+
+            auto len(const array_t* a) -> uint64_t { return a->size(); }
+
+            auto index(native_context_t* context, const array_t* a, uint64_t i) -> uint64_t {
+                if (i >= a->size()) {
+                    context->fault = out_of_range;
+                    return 0;
+                }
+                return (*a)[i].u;
+            }
+
+            auto kernel(native_context_t* context, const array_t* a, const array_t* b, int code)
+                -> const array_t* {
+                if (a->size() != b->size()) {
+                    context->fault = different_lengths;
+                    return nullptr;
+                }
+                auto* result = context->arena->make<array_t>(a->size(), context->arena);
+                const auto op = kernel_op_t(code >> 4);
+                if (!elementwise(op, code_lane(code), a->data(), b->data(), result->data(),
+                                 a->size())) {
+                    context->fault = division_by_zero;
+                    return nullptr;
+                }
+                return result;
+            }
+
+            auto reduce(native_context_t* context, const array_t* a, int code) -> uint64_t {
+                if (a->empty()) {
+                    context->fault = empty_reduction;
+                    return 0;
+                }
+                const auto r = reduction_t(code >> 4);
+                return vm::reduce(r, code_lane(code), a->data(), a->size()).u;
+            }
+
+            // views are the registers kernel_strided and reduce_strided take.
+            auto kernel_strided(native_context_t* context, const value_t* views, int code)
+                -> const array_t* {
+                const auto x = views, y = views + 3;
+                const auto n = views[6].u;
+                if (!in_view(x, n) || !in_view(y, n)) {
+                    context->fault = out_of_view;
+                    return nullptr;
+                }
+                auto* result = context->arena->make<array_t>(n, context->arena);
+                const auto op = kernel_op_t(code >> 4);
+                if (!elementwise(op, code_lane(code), x[0].a->data() + x[1].u, x[2].i,
+                                 y[0].a->data() + y[1].u, y[2].i, result->data(), n)) {
+                    context->fault = division_by_zero;
+                    return nullptr;
+                }
+                return result;
+            }
+
+            auto reduce_strided(native_context_t* context, const value_t* view, int code)
+                -> uint64_t {
+                const auto n = view[3].u;
+                if (n == 0 || !in_view(view, n)) {
+                    context->fault = n == 0 ? empty_reduction : out_of_view;
+                    return 0;
+                }
+                const auto r = reduction_t(code >> 4);
+                return vm::reduce(r, code_lane(code), view[0].a->data() + view[1].u, view[2].i, n)
+                    .u;
+            }
+
+            // pieces are the registers format takes: the kinds of the values,
+            // then the values.
+            auto format(native_context_t* context, const value_t* pieces, int64_t n)
+                -> const string_t* {
+                return vm::format(pieces + 1, pieces[0].a->data(), n, *context->arena);
+            }
+
+            auto mark(native_context_t* context) -> uint64_t { return context->arena->mark(); }
+            auto release(native_context_t* context, uint64_t mark) -> void {
+                context->arena->release(mark);
+            }
+        }  // namespace runtime
+
+        template <typename F>
+        auto address(F* f) -> uint64_t {
+            return uint64_t(reinterpret_cast<uintptr_t>(f));
+        }
+
+        // values of one word: numbers, bools and strings, the address of
+        // their text.
+        auto is_primitive(const analysis::type_t& t) -> bool {
+            return analysis::is_integral(t) || analysis::is_floating_point(t) ||
+                   t.get().is<analysis::types::bool_t>() ||
+                   t.get().is<analysis::types::strlit_t>() ||
+                   t.get().is<analysis::types::string_t>();
+        }
+
+        auto has_primitive_signature(const function_t& fn) -> bool {
+            const auto f = fn.type.get().get_if<analysis::types::function_t>();
+            if (!f || !is_primitive(f->result_type)) return false;
+            for (const auto& parameter : f->formal_parameters)
+                if (!is_primitive(parameter.type)) return false;
+            return true;
+        }
+
+        // superinstructions run the instructions they replace, which stay in
+        // place after them: compiling their first one is enough.
+        auto unfused(opcode_t op) -> opcode_t {
+            switch (op) {
+            case opcode_t::lt_i_jmp_ifnot: return opcode_t::lt_i;
+            case opcode_t::le_i_jmp_ifnot: return opcode_t::le_i;
+            case opcode_t::lt_u_jmp_ifnot: return opcode_t::lt_u;
+            case opcode_t::le_u_jmp_ifnot: return opcode_t::le_u;
+            case opcode_t::eq_i_jmp_ifnot: return opcode_t::eq_i;
+            case opcode_t::ne_i_jmp_ifnot: return opcode_t::ne_i;
+            case opcode_t::loadi_add_i:
+            case opcode_t::loadi_sub_i: return opcode_t::loadi;
+            case opcode_t::getg_add_i_setg: return opcode_t::getg;
+            case opcode_t::add_i_jmp: return opcode_t::add_i;
+            default: return op;
+            }
+        }
+
+        // functions which may be compiled: those with a primitive signature,
+        // calling no others.
+        auto compilable(const program_t& program) -> vector<bool> {
+            auto result = vector<bool>(program.functions.size());
+            for (auto f = 1u; f < result.size(); f++)
+                result[f] = has_primitive_signature(program.functions[f]);
+
+            for (auto changed = true; changed;) {
+                changed = false;
+                for (auto f = 1u; f < result.size(); f++) {
+                    if (!result[f]) continue;
+                    for (const auto i : program.functions[f].code) {
+                        if (i.op() == opcode_t::call && !result[i.bx()]) {
+                            result[f] = false;
+                            changed = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        // Native frames keep the VM's: rbx points to the registers of the
+        // current function, r12 to the native context. Both are callee-saved,
+        // so they survive calls into the runtime.
+        class compiler_t {
+        public:
+            compiler_t(const program_t& program, const vector<bool>& compiled)
+                : program_(program), compiled_(compiled) {
+                for (auto f = 0u; f < program.functions.size(); f++) entries_.push_back(a_.label());
+            }
+
+            auto entry(size_t f) const -> label_t { return entries_[f]; }
+            auto assembler() -> assembler_t& { return a_; }
+
+            auto function(size_t f) -> void {
+                const auto& fn = program_.functions[f];
+                exit_ = a_.label();
+                overflow_ = a_.label();
+                division_ = a_.label();
+                at_.clear();
+                for (auto pc = 0u; pc <= fn.code.size(); pc++) at_.push_back(a_.label());
+
+                a_.bind(entries_[f]);
+                a_.push(reg_t::rbx);
+                a_.push(reg_t::r12);
+                // keeps the stack 16 byte aligned for calls.
+                a_.sub(reg_t::rsp, 8);
+                a_.mov(reg_t::rbx, reg_t::rdi);
+                a_.mov(reg_t::r12, reg_t::rsi);
+                a_.dec(context(offsetof(native_context_t, depth)));
+                a_.jcc(cond_t::s, overflow_);
+
+                for (auto pc = size_t(0); pc < fn.code.size(); pc++) {
+                    a_.bind(at_[pc]);
+                    instruction(fn, pc);
+                }
+                a_.bind(at_[fn.code.size()]);
+
+                a_.bind(exit_);
+                a_.inc(context(offsetof(native_context_t, depth)));
+                a_.add(reg_t::rsp, 8);
+                a_.pop(reg_t::r12);
+                a_.pop(reg_t::rbx);
+                a_.ret();
+
+                fail(overflow_, stack_overflow);
+                fail(division_, division_by_zero);
+            }
+
+        private:
+            static auto r(int n) -> mem_t { return mem_t{reg_t::rbx, n * 8}; }
+            static auto context(size_t offset) -> mem_t {
+                return mem_t{reg_t::r12, int32_t(offset)};
+            }
+
+            auto fail(label_t at, const char* message) -> void {
+                a_.bind(at);
+                a_.mov(reg_t::rax, address(message));
+                a_.mov(context(offsetof(native_context_t, fault)), reg_t::rax);
+                a_.jmp(exit_);
+            }
+
+            auto target(const function_t& fn, size_t pc, int offset) -> label_t {
+                const auto t = int64_t(pc) + 1 + offset;
+                if (t < 0 || t > int64_t(fn.code.size())) throw error("Jump out of the function");
+                return at_[t];
+            }
+
+            auto leave_on_fault() -> void {
+                a_.cmp(context(offsetof(native_context_t, fault)), 0);
+                a_.jcc(cond_t::ne, exit_);
+            }
+
+            auto binary(instruction_t i, void (assembler_t::*op)(reg_t, mem_t)) -> void {
+                a_.mov(reg_t::rax, r(i.b()));
+                (a_.*op)(reg_t::rax, r(i.c()));
+                a_.mov(r(i.a()), reg_t::rax);
+            }
+
+            auto binary(instruction_t i, void (assembler_t::*op)(xmm_t, mem_t)) -> void {
+                a_.movsd(xmm_t::xmm0, r(i.b()));
+                (a_.*op)(xmm_t::xmm0, r(i.c()));
+                a_.movsd(r(i.a()), xmm_t::xmm0);
+            }
+
+            auto compare(instruction_t i, cond_t c) -> void {
+                a_.mov(reg_t::rax, r(i.b()));
+                a_.cmp(reg_t::rax, r(i.c()));
+                a_.setcc(c, reg_t::rax);
+                a_.movzx8(reg_t::rax);
+                a_.mov(r(i.a()), reg_t::rax);
+            }
+
+            // ucomisd sets CF and ZF as an unsigned comparison would, and
+            // both along with PF when either operand is a NaN, which then
+            // compares false: B < C is C above B.
+            auto compare_f(instruction_t i, bool swap, cond_t c) -> void {
+                a_.movsd(xmm_t::xmm0, r(swap ? i.c() : i.b()));
+                a_.ucomisd(xmm_t::xmm0, r(swap ? i.b() : i.c()));
+                a_.setcc(c, reg_t::rax);
+                a_.movzx8(reg_t::rax);
+                a_.mov(r(i.a()), reg_t::rax);
+            }
+
+            auto equal_f(instruction_t i, bool equal) -> void {
+                a_.movsd(xmm_t::xmm0, r(i.b()));
+                a_.ucomisd(xmm_t::xmm0, r(i.c()));
+                a_.setcc(equal ? cond_t::e : cond_t::ne, reg_t::rax);
+                a_.setcc(equal ? cond_t::np : cond_t::p, reg_t::rcx);
+                a_.movzx8(reg_t::rax);
+                a_.movzx8(reg_t::rcx);
+                if (equal)
+                    a_.and_(reg_t::rax, reg_t::rcx);
+                else
+                    a_.or_(reg_t::rax, reg_t::rcx);
+                a_.mov(r(i.a()), reg_t::rax);
+            }
+
+            auto division(instruction_t i, bool is_signed, bool remainder) -> void {
+                const auto done = a_.label();
+                a_.mov(reg_t::rax, r(i.b()));
+                a_.mov(reg_t::rcx, r(i.c()));
+                a_.test(reg_t::rcx, reg_t::rcx);
+                a_.jcc(cond_t::e, division_);
+                if (is_signed) {
+                    // INT64_MIN / -1 traps; like the VM, wrap around instead.
+                    const auto divide = a_.label();
+                    a_.cmp(reg_t::rcx, -1);
+                    a_.jcc(cond_t::ne, divide);
+                    if (remainder)
+                        a_.xor_(reg_t::rax, reg_t::rax);
+                    else
+                        a_.neg(reg_t::rax);
+                    a_.jmp(done);
+                    a_.bind(divide);
+                    a_.cqo();
+                    a_.idiv(reg_t::rcx);
+                } else {
+                    a_.xor_(reg_t::rdx, reg_t::rdx);
+                    a_.div(reg_t::rcx);
+                }
+                if (remainder) a_.mov(reg_t::rax, reg_t::rdx);
+                a_.bind(done);
+                a_.mov(r(i.a()), reg_t::rax);
+            }
+
+            auto call_runtime(uint64_t function) -> void {
+                a_.mov(reg_t::rax, function);
+                a_.call(reg_t::rax);
+            }
+
+            auto instruction(const function_t& fn, size_t pc) -> void {
+                const auto i = fn.code[pc];
+                switch (unfused(i.op())) {
+                case opcode_t::move:
+                    a_.mov(reg_t::rax, r(i.b()));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::loadk:
+                    a_.mov(reg_t::rax, fn.constants.at(i.bx()).u);
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::loadi: a_.mov(r(i.a()), int32_t(i.sbx())); break;
+                case opcode_t::getg:
+                    a_.mov(reg_t::rax, context(offsetof(native_context_t, globals)));
+                    a_.mov(reg_t::rax, mem_t{reg_t::rax, i.bx() * 8});
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::setg:
+                    a_.mov(reg_t::rax, context(offsetof(native_context_t, globals)));
+                    a_.mov(reg_t::rcx, r(i.a()));
+                    a_.mov(mem_t{reg_t::rax, i.bx() * 8}, reg_t::rcx);
+                    break;
+
+                case opcode_t::add_i: binary(i, &assembler_t::add); break;
+                case opcode_t::sub_i: binary(i, &assembler_t::sub); break;
+                case opcode_t::mul_i: binary(i, &assembler_t::imul); break;
+                case opcode_t::div_i: division(i, true, false); break;
+                case opcode_t::div_u: division(i, false, false); break;
+                case opcode_t::rem_i: division(i, true, true); break;
+                case opcode_t::rem_u: division(i, false, true); break;
+                case opcode_t::pow_i:
+                    a_.mov(reg_t::rdi, r(i.b()));
+                    a_.mov(reg_t::rsi, r(i.c()));
+                    call_runtime(address(vm::ipow));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::neg_i:
+                    a_.mov(reg_t::rax, r(i.b()));
+                    a_.neg(reg_t::rax);
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::band: binary(i, &assembler_t::and_); break;
+                case opcode_t::bor: binary(i, &assembler_t::or_); break;
+                case opcode_t::bxor: binary(i, &assembler_t::xor_); break;
+                case opcode_t::bnot:
+                    a_.mov(reg_t::rax, r(i.b()));
+                    a_.not_(reg_t::rax);
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+
+                case opcode_t::add_f: binary(i, &assembler_t::addsd); break;
+                case opcode_t::sub_f: binary(i, &assembler_t::subsd); break;
+                case opcode_t::mul_f: binary(i, &assembler_t::mulsd); break;
+                case opcode_t::div_f: binary(i, &assembler_t::divsd); break;
+                case opcode_t::rem_f:
+                case opcode_t::pow_f:
+                    a_.movsd(xmm_t::xmm0, r(i.b()));
+                    a_.movsd(xmm_t::xmm1, r(i.c()));
+                    call_runtime(i.op() == opcode_t::rem_f ? address(runtime::fmod)
+                                                           : address(runtime::pow));
+                    a_.movsd(r(i.a()), xmm_t::xmm0);
+                    break;
+                case opcode_t::neg_f:
+                    a_.mov(reg_t::rax, r(i.b()));
+                    a_.btc(reg_t::rax, 63);
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+
+                case opcode_t::eq_i: compare(i, cond_t::e); break;
+                case opcode_t::ne_i: compare(i, cond_t::ne); break;
+                case opcode_t::lt_i: compare(i, cond_t::l); break;
+                case opcode_t::le_i: compare(i, cond_t::le); break;
+                case opcode_t::lt_u: compare(i, cond_t::b); break;
+                case opcode_t::le_u: compare(i, cond_t::be); break;
+                case opcode_t::eq_f: equal_f(i, true); break;
+                case opcode_t::ne_f: equal_f(i, false); break;
+                case opcode_t::lt_f: compare_f(i, true, cond_t::a); break;
+                case opcode_t::le_f: compare_f(i, true, cond_t::ae); break;
+                case opcode_t::not_b:
+                    a_.mov(reg_t::rax, r(i.b()));
+                    a_.test(reg_t::rax, reg_t::rax);
+                    a_.setcc(cond_t::e, reg_t::rax);
+                    a_.movzx8(reg_t::rax);
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+
+                case opcode_t::i2f:
+                    a_.cvtsi2sd(xmm_t::xmm0, r(i.b()));
+                    a_.movsd(r(i.a()), xmm_t::xmm0);
+                    break;
+                case opcode_t::u2f:
+                    a_.mov(reg_t::rdi, r(i.b()));
+                    call_runtime(address(runtime::u2f));
+                    a_.movsd(r(i.a()), xmm_t::xmm0);
+                    break;
+                case opcode_t::f2i:
+                    a_.cvttsd2si(reg_t::rax, r(i.b()));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::f2u:
+                    a_.movsd(xmm_t::xmm0, r(i.b()));
+                    call_runtime(address(runtime::f2u));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                // registers are little endian words: their low bytes come first.
+                case opcode_t::sext8:
+                    a_.movsx8(reg_t::rax, r(i.b()));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::sext16:
+                    a_.movsx16(reg_t::rax, r(i.b()));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::sext32:
+                    a_.movsx32(reg_t::rax, r(i.b()));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::zext8:
+                    a_.movzx8(reg_t::rax, r(i.b()));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::zext16:
+                    a_.movzx16(reg_t::rax, r(i.b()));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::zext32:
+                    a_.movzx32(reg_t::rax, r(i.b()));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::round_f32:
+                    a_.movsd(xmm_t::xmm0, r(i.b()));
+                    a_.cvtsd2ss(xmm_t::xmm0, xmm_t::xmm0);
+                    a_.cvtss2sd(xmm_t::xmm0, xmm_t::xmm0);
+                    a_.movsd(r(i.a()), xmm_t::xmm0);
+                    break;
+
+                case opcode_t::newarr:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    a_.lea(reg_t::rsi, r(i.b()));
+                    a_.mov(reg_t::rdx, uint64_t(i.c()));
+                    call_runtime(address(runtime::newarr));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::len:
+                    a_.mov(reg_t::rdi, r(i.b()));
+                    call_runtime(address(runtime::len));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::index:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    a_.mov(reg_t::rsi, r(i.b()));
+                    a_.mov(reg_t::rdx, r(i.c()));
+                    call_runtime(address(runtime::index));
+                    leave_on_fault();
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::kernel:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    a_.mov(reg_t::rsi, r(i.b()));
+                    a_.mov(reg_t::rdx, r(i.b() + 1));
+                    a_.mov(reg_t::rcx, uint64_t(i.c()));
+                    call_runtime(address(runtime::kernel));
+                    leave_on_fault();
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::reduce:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    a_.mov(reg_t::rsi, r(i.b()));
+                    a_.mov(reg_t::rdx, uint64_t(i.c()));
+                    call_runtime(address(runtime::reduce));
+                    leave_on_fault();
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::kernel_strided:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    a_.lea(reg_t::rsi, r(i.b()));
+                    a_.mov(reg_t::rdx, uint64_t(i.c()));
+                    call_runtime(address(runtime::kernel_strided));
+                    leave_on_fault();
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::reduce_strided:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    a_.lea(reg_t::rsi, r(i.b()));
+                    a_.mov(reg_t::rdx, uint64_t(i.c()));
+                    call_runtime(address(runtime::reduce_strided));
+                    leave_on_fault();
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::format:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    a_.lea(reg_t::rsi, r(i.b()));
+                    a_.mov(reg_t::rdx, uint64_t(i.c()));
+                    call_runtime(address(runtime::format));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::mark:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    call_runtime(address(runtime::mark));
+                    a_.mov(r(i.a()), reg_t::rax);
+                    break;
+                case opcode_t::release:
+                    a_.mov(reg_t::rdi, reg_t::r12);
+                    a_.mov(reg_t::rsi, r(i.a()));
+                    call_runtime(address(runtime::release));
+                    break;
+
+                case opcode_t::jmp: a_.jmp(target(fn, pc, i.sj())); break;
+                case opcode_t::jmp_if:
+                    a_.cmp(r(i.a()), 0);
+                    a_.jcc(cond_t::ne, target(fn, pc, i.sbx()));
+                    break;
+                case opcode_t::jmp_ifnot:
+                    a_.cmp(r(i.a()), 0);
+                    a_.jcc(cond_t::e, target(fn, pc, i.sbx()));
+                    break;
+
+                case opcode_t::call: {
+                    const auto callee = size_t(i.bx());
+                    if (callee >= program_.functions.size() || !compiled_[callee])
+                        throw error("Call to a function without native code");
+
+                    const auto n = program_.functions[callee].n_registers;
+                    a_.lea(reg_t::rdi, r(i.a() + n));
+                    a_.cmp(reg_t::rdi, context(offsetof(native_context_t, stack_end)));
+                    a_.jcc(cond_t::a, overflow_);
+                    a_.lea(reg_t::rdi, r(i.a()));
+                    a_.mov(reg_t::rsi, reg_t::r12);
+                    a_.call(entries_[callee]);
+                    leave_on_fault();
+                    break;
+                }
+                case opcode_t::ret:
+                    a_.mov(reg_t::rax, r(i.a()));
+                    a_.mov(r(0), reg_t::rax);
+                    a_.jmp(exit_);
+                    break;
+
+                default: throw error("Invalid instruction");
+                }
+            }
+
+            const program_t& program_;
+            const vector<bool>& compiled_;
+            assembler_t a_;
+            vector<label_t> entries_;
+
+            // labels of the function being compiled: its instructions, and
+            // the paths leaving it.
+            vector<label_t> at_;
+            label_t exit_ = 0;
+            label_t overflow_ = 0;
+            label_t division_ = 0;
+        };
+
+#if BT_JIT_SUPPORTED
+        // Pages holding code: written, then made executable and read only.
+        class executable_memory_t {
+        public:
+            explicit executable_memory_t(const vector<uint8_t>& code) : size_(code.size()) {
+                void* p = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p == MAP_FAILED) throw error("Can't map memory for native code");
+
+                memcpy(p, code.data(), size_);
+                if (mprotect(p, size_, PROT_READ | PROT_EXEC) != 0) {
+                    munmap(p, size_);
+                    throw error("Can't make native code executable");
+                }
+                memory_ = static_cast<uint8_t*>(p);
+            }
+
+            executable_memory_t(const executable_memory_t&) = delete;
+            auto operator=(const executable_memory_t&) -> executable_memory_t& = delete;
+
+            ~executable_memory_t() { munmap(memory_, size_); }
+
+            auto at(size_t offset) const -> const uint8_t* { return memory_ + offset; }
+
+        private:
+            uint8_t* memory_ = nullptr;
+            size_t size_;
+        };
+#endif
+    }  // namespace
+
+    auto supported() -> bool { return BT_JIT_SUPPORTED; }
+
+    auto compile(program_t& program) -> int {
+        program.native.clear();
+        program.native_code.reset();
+        if (!supported()) return 0;
+
+        const auto compiled = compilable(program);
+        const auto n = int(count(compiled.begin(), compiled.end(), true));
+        if (n == 0) return 0;
+
+        auto compiler = compiler_t(program, compiled);
+        for (auto f = 0u; f < program.functions.size(); f++)
+            if (compiled[f]) compiler.function(f);
+        const auto code = compiler.assembler().finish();
+
+#if BT_JIT_SUPPORTED
+        const auto memory = make_shared<executable_memory_t>(code);
+        program.native.assign(program.functions.size(), nullptr);
+        for (auto f = 0u; f < program.functions.size(); f++) {
+            if (!compiled[f]) continue;
+            const auto entry = memory->at(compiler.assembler().offset(compiler.entry(f)));
+            program.native[f] = reinterpret_cast<native_t>(entry);
+        }
+        program.native_code = memory;
+#endif
+        return n;
+    }
+}}  // namespace bt::jit
@@ -12,6 +12,8 @@
 #include <range/v3/core.hpp>
 #include <range/v3/view/zip.hpp>
 
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/analysis/diagnostics.hpp>
 #include <bullet/analysis/error.hpp>
 #include <bullet/analysis/prelude_environment.hpp>
 #include <bullet/analysis/symtab.hpp>
@@ -19,11 +21,15 @@
 #include <bullet/analysis/type_checking.hpp>
 #include <bullet/analysis/walk.hpp>
 #include <bullet/banner.hpp>
+#include <bullet/jit/jit.hpp>
 #include <bullet/jupyter/interpreter.hpp>
 #include <bullet/lexer/lexer.hpp>
 #include <bullet/lexer/token.hpp>
 #include <bullet/parser/ast.hpp>
 #include <bullet/parser/parser.hpp>
+#include <bullet/parser/pretty_print.hpp>
+#include <bullet/vm/lower.hpp>
+#include <bullet/vm/vm.hpp>
 
 namespace nl = nlohmann;
 using namespace std;
@@ -70,19 +76,19 @@ nl::json interpreter::execute_request_impl(int execution_counter,      // Typica
     // as third argument.
     // Replace "Hello World !!" by what you want to be displayed under the execution cell
 
-    analysis::error::errors.clear();
+    // each request is compiled in its own context, so cells never see each
+    // other's types or diagnostics.
+    auto compilation = compilation_t("<cell " + to_string(execution_counter) + ">");
+    const auto compilation_scope = compilation_t::scope_t(compilation);
+    const auto& diagnostics = compilation.diagnostics;
 
     try {
         const lexer::output_t lex_output = source | tokenize;
         const syntax::tree_t ast = parser::details::parse(lex_output);
 
-        attr_node_t<analysis::type_t> typed_ast =
-            walk_post_order<analysis::type_t>(ast, [](auto, auto) { return analysis::type_t(); });
+        attr_node_t<analysis::type_t> typed_ast = compilation.check(ast);
 
-        auto builtins = lang::prelude::environment();
-        type_check(typed_ast, builtins);
-
-        if (analysis::error::errors.empty()) {
+        if (diagnostics.empty()) {
             auto s = stringstream();
 
             s << fg::cyan << "Tokens:" << style::reset << endl;
@@ -95,6 +101,19 @@ nl::json interpreter::execute_request_impl(int execution_counter,      // Typica
             s << fg::cyan << "Typed AST:" << style::reset << endl;
             parser::pretty_print(typed_ast.get(), s, 0);
 
+            s << fg::cyan << "Result: " << style::reset;
+            try {
+                auto program = vm::lower(typed_ast);
+                jit::compile(program);
+                auto machine = vm::vm_t();
+                vm::print_value(s, machine.run(program), program.result_type);
+            } catch (const vm::error& e) {
+                s << fg::red << e.what() << style::reset;
+            } catch (const jit::error& e) {
+                s << fg::red << e.what() << style::reset;
+            }
+            s << endl;
+
             nl::json pub_data;
             pub_data["text/plain"] = s.str();
 
@@ -102,7 +121,7 @@ nl::json interpreter::execute_request_impl(int execution_counter,      // Typica
         } else {
             auto s = stringstream();
             s << fg::red << "ERRORS:";
-            for (auto&& e : analysis::error::errors) s << e->what() << endl;
+            s << diagnostics;
             s << style::reset << endl;
 
             publish_execution_error("Error.", "Program error", {s.str()});
@@ -111,7 +130,7 @@ nl::json interpreter::execute_request_impl(int execution_counter,      // Typica
         auto s = stringstream();
         s << fg::red << "Fatal error: " << e.what() << endl;
         s << fg::red << "Normal errors error:";
-        for (auto&& e : analysis::error::errors) s << e->what() << endl;
+        s << diagnostics;
         s << style::reset << endl;
 
         publish_execution_error("Error.", "Compiler Runtime Excpetion", {s.str()});
@@ -119,7 +138,7 @@ nl::json interpreter::execute_request_impl(int execution_counter,      // Typica
         auto s = stringstream();
         s << fg::red << "UNKNOWN FATAL ERROR." << endl;
         s << fg::red << "Normal errors:";
-        for (auto&& e : analysis::error::errors) s << e->what() << endl;
+        s << diagnostics;
         s << style::reset << endl;
 
         publish_execution_error("Error.", "Compiler Exception", {s.str()});
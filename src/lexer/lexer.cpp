@@ -1,5 +1,7 @@
 #include <bullet/lexer/lexer.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cctype>
 #include <cmath>
@@ -9,6 +11,7 @@
 
 #include <boost/hana.hpp>
 
+#include <bullet/lexer/decimal.hpp>
 #include <bullet/lexer/error.hpp>
 
 namespace bt { namespace lexer {
@@ -135,47 +138,60 @@ namespace bt { namespace lexer {
                        eat_string_literal(pos) || eat_identifier(pos);
             }
 
+            // The value of c as a digit in base 16 or below, or -1.
+            static auto digit_value(char c) -> int {
+                static const auto values = [] {
+                    auto v = array<int8_t, 256>();
+                    v.fill(-1);
+                    for (auto c = '0'; c <= '9'; c++) v[uint8_t(c)] = c - '0';
+                    for (auto c = 'a'; c <= 'f'; c++) v[uint8_t(c)] = c - 'a' + 10;
+                    for (auto c = 'A'; c <= 'F'; c++) v[uint8_t(c)] = c - 'A' + 10;
+                    return v;
+                }();
+                return values[uint8_t(c)];
+            }
+
+            // Eats digits in base 16, 8 or 2, with '_' separators after the
+            // first one. Sets overflow if the value doesn't fit in the result.
             template <int base, typename Integral>
-            auto eat_digits(uint32_t& pos, Integral& result) -> bool {
+            auto eat_digits(uint32_t& pos, Integral& result, bool& overflow) -> bool {
                 result = 0;
                 int n = 0;
                 for (; pos < input_length; n++, pos++) {
                     const auto c = input[pos];
-                    // cout << "EAT_DIGITS CONSIDERING : \"" << c << "\"" << endl;
-
-                    int v = -1;
-
-                    if constexpr (base == 16) {
-                        if (isdigit(c)) {
-                            v = c - '0';
-                        } else if (c == 'a' || c == 'b' || c == 'c' || c == 'd' || c == 'e' ||
-                                   c == 'f') {
-                            v = c - 'a' + 10;
-                        } else if (c == 'a' || c == 'A' || c == 'b' || c == 'B' || c == 'c' ||
-                                   c == 'C' || c == 'd' || c == 'D' || c == 'e' || c == 'E' ||
-                                   c == 'f' || c == 'F') {
-                            v = c - 'A' + 10;
-                        }
-                    } else if constexpr (base == 10) {
-                        if (isdigit(c)) v = c - '0';
-                    } else if constexpr (base == 8) {
-                        if ('0' < c && c < '8') v = c - '0';
-                    } else if constexpr (base == 2) {
-                        if (c == '0' || c == '1') v = c - '0';
-                    }
+                    const auto v = digit_value(c);
 
-                    if (v >= 0) {
-                        result = result * base + v;
+                    if (0 <= v && v < base) {
+                        overflow |= __builtin_mul_overflow(result, base, &result) ||
+                                    __builtin_add_overflow(result, v, &result);
                     } else if (n > 0 && c == '_') {
                         continue;
                     } else {
-                        // cout << "BREAKING FROM EAT_DIGITS ON : \"" << c << "\"" << endl;
                         break;
                     }
                 }
                 return n > 0;
             }
 
+            // Eats decimal digits, with '_' separators after the first one,
+            // eight at a time where it can. Their value is left to the caller.
+            auto eat_decimal_digits(uint32_t& pos, string_view& digits) -> bool {
+                const auto start = pos;
+                auto p = pos;
+                while (p < input_length) {
+                    if (p + 8 <= input_length && decimal::is_eight_digits(&input[p])) {
+                        p += 8;
+                    } else if (isdigit(input[p]) || (p > start && input[p] == '_')) {
+                        p++;
+                    } else {
+                        break;
+                    }
+                }
+                digits = input.substr(start, p - start);
+                pos = p;
+                return p > start;
+            }
+
             auto eat_numeric_literal(uint32_t& pos) -> bool {
                 using namespace literal::numeric;
                 const auto start_col = pos - start_of_line.back();
@@ -188,30 +204,42 @@ namespace bt { namespace lexer {
                 // cout << "EAT NUMERIC TOKEN " << s << endl;
 
                 unsigned long long intval;
+                bool overflow = false;
+
+                // the digits of decimal literals, converted once the kind of
+                // literal is known.
+                auto integer_digits = "0"sv;
+                auto fraction_digits = ""sv;
+                auto exponent_digits = ""sv;
 
                 int base;
                 bool match = false;
 
                 if (s.size() > 2 && s.substr(0, 2) == "0x"sv) {
                     p += 2;
-                    match = eat_digits<16, unsigned long long>(p, intval);
+                    match = eat_digits<16, unsigned long long>(p, intval, overflow);
                     base = 16;
                 } else if (s.size() > 2 && s.substr(0, 2) == "0b"sv) {
                     p += 1;
-                    match = eat_digits<2, unsigned long long>(p, intval);
+                    match = eat_digits<2, unsigned long long>(p, intval, overflow);
                     base = 2;
                 } else if (s.size() > 1 && s.front() == '0') {
                     p += 1;
                     base = 8;
-                    match = eat_digits<8, unsigned long long>(p, intval);
+                    match = eat_digits<8, unsigned long long>(p, intval, overflow);
                     if (!match) {
                         match = true;
                         intval = 0;
                         base = 10;
                     }
                 } else {
-                    match = eat_digits<10, unsigned long long>(p, intval);
+                    match = eat_decimal_digits(p, integer_digits);
                     base = 10;
+                    if (match) {
+                        const auto value = decimal::to_integer(integer_digits);
+                        overflow = !value;
+                        intval = value.value_or(0);
+                    }
                 }
 
                 if (!match) {
@@ -227,7 +255,7 @@ namespace bt { namespace lexer {
 
                 long double fpval = intval;
                 int width = 0;
-                int exponent = 0;
+                long long exponent = 0;
                 uint32_t q;
                 int n_digits = 0;
                 char signedness = 0;
@@ -250,8 +278,13 @@ namespace bt { namespace lexer {
                         ++p;
                     }
 
-                    if (eat_digits<10, int>(p, exponent)) {
-                        fpval *= pow(static_cast<long double>(10), exp_sign * exponent);
+                    if (eat_decimal_digits(p, exponent_digits)) {
+                        // anything this large overflows or underflows anyway.
+                        const auto limit = 1'000'000ull;
+                        exponent = exp_sign * static_cast<long long>(min(
+                            decimal::to_integer(exponent_digits).value_or(limit), limit));
+                        if (base != 10)
+                            fpval *= pow(static_cast<long double>(10), exponent);
                     } else {
                         throw_error("Invalid floating point literal", pos);
                     }
@@ -267,16 +300,16 @@ namespace bt { namespace lexer {
                     q = p;
 
                     switch (base) {
-                    case 10: match = eat_digits<10, unsigned long long>(p, b); break;
-                    case 16: match = eat_digits<16, unsigned long long>(p, b); break;
-                    case 8: match = eat_digits<8, unsigned long long>(p, b); break;
-                    case 2: match = eat_digits<8, unsigned long long>(p, b); break;
+                    case 10: match = eat_decimal_digits(p, fraction_digits); break;
+                    case 16: match = eat_digits<16, unsigned long long>(p, b, overflow); break;
+                    case 8: match = eat_digits<8, unsigned long long>(p, b, overflow); break;
+                    case 2: match = eat_digits<8, unsigned long long>(p, b, overflow); break;
                     default: assert(false);
                     }
 
                     n_digits = p - q;
 
-                    fpval += static_cast<long double>(b) * pow(base, -n_digits);
+                    if (base != 10) fpval += static_cast<long double>(b) * pow(base, -n_digits);
 
                     if (!match) goto emit_fp_token;
 
@@ -301,14 +334,21 @@ namespace bt { namespace lexer {
                     }
 
                 emit_fp_token:
+                    if (base == 10) {
+                        // unsuffixed literals are rounded as f64.
+                        const auto literal =
+                            decimal::literal_t{integer_digits, fraction_digits, exponent};
+                        fpval = width == 32 ? decimal::to_f32(literal) : decimal::to_f64(literal);
+                    }
+
                     pos = p;
                     const auto last_col = pos - start_of_line.back();
                     tokens.emplace_back(floating_point_t(fpval, width), line, start_col, last_col);
                 } else {
                     // integral
 
-                    if (p >= input_length || c == ' ' || c == ')' || c == ',' || c == ';' ||
-                        c == ' ' || c == '\n' || c == '\r' || c == ':') {
+                    if (p >= input_length || c == ' ' || c == ')' || c == ']' || c == ',' ||
+                        c == ';' || c == '\n' || c == '\r' || c == ':') {
                         // if (p < input_length)
                         // cout << "SEPARATOR FOUND: \"" << c << "\"" << endl;
                         goto emit_integral_token;
@@ -355,6 +395,7 @@ namespace bt { namespace lexer {
 
                 emit_integral_token:
 
+                    if (overflow) throw_error("Integral literal out of range", pos);
                     if (signedness == 0) signedness = '?';
 
                     pos = p;
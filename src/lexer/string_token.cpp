@@ -1,10 +1,55 @@
 #include <algorithm>
+#include <cctype>
 
 #include <bullet/lexer/string_token.hpp>
 
 namespace bt { namespace lexer {
     using namespace std;
 
+    namespace {
+        // The identifier between braces at the start of s, if any.
+        auto hole(string_view s) -> string_view {
+            if (s.size() < 3 || s[0] != '{') return {};
+            const auto first = static_cast<unsigned char>(s[1]);
+            if (!isalpha(first) && first != '_') return {};
+            auto n = size_t(2);
+            for (; n < s.size() && (isalnum(static_cast<unsigned char>(s[n])) || s[n] == '_');
+                 n++)
+                ;
+            if (n == s.size() || s[n] != '}') return {};
+            return s.substr(1, n - 1);
+        }
+    }  // namespace
+
+    auto pieces(const string_token_t& s) -> vector<string_piece_t> {
+        auto result = vector<string_piece_t>();
+        const auto text = [&](string_view t) {
+            if (result.empty() || result.back().interpolated) result.push_back({});
+            result.back().text += t;
+        };
+
+        const auto v = string_view(s.value);
+        for (auto k = size_t(0); k < v.size();) {
+            const auto rest = v.substr(k);
+            if (rest.starts_with("{{") || rest.starts_with("}}")) {
+                text(rest.substr(0, 1));
+                k += 2;
+            } else if (const auto name = hole(rest); !name.empty()) {
+                result.push_back({string(name), true});
+                k += name.size() + 2;
+            } else {
+                text(rest.substr(0, 1));
+                k++;
+            }
+        }
+        return result;
+    }
+
+    auto interpolates(const string_token_t& s) -> bool {
+        const auto p = pieces(s);
+        return any_of(p.begin(), p.end(), [](const auto& x) { return x.interpolated; });
+    }
+
     auto token_value(const string_token_t& i) -> string_view { return i.value; }
     auto token_symbol(const string_token_t& i) -> string_view { return "STRING_LITERAL"sv; }
 
@@ -1,8 +1,12 @@
 #include <iostream>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 #include <catch2/catch.hpp>
 #include <rang.hpp>
@@ -10,6 +14,8 @@
 #include <range/v3/view/zip.hpp>
 
 #include <boost/stacktrace.hpp>
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/analysis/diagnostics.hpp>
 #include <bullet/analysis/error.hpp>
 #include <bullet/analysis/prelude_environment.hpp>
 #include <bullet/analysis/symtab.hpp>
@@ -17,10 +23,20 @@
 #include <bullet/analysis/type_checking.hpp>
 #include <bullet/analysis/walk.hpp>
 #include <bullet/banner.hpp>
+#include <bullet/backend/c.hpp>
+#ifdef BT_HAVE_LLVM
+#include <bullet/backend/llvm.hpp>
+#include <bullet/ir/lower.hpp>
+#include <bullet/ir/pass.hpp>
+#endif
+#include <bullet/jit/jit.hpp>
 #include <bullet/lexer/lexer.hpp>
 #include <bullet/lexer/token.hpp>
 #include <bullet/parser/ast.hpp>
 #include <bullet/parser/parser.hpp>
+#include <bullet/parser/pretty_print.hpp>
+#include <bullet/vm/lower.hpp>
+#include <bullet/vm/vm.hpp>
 
 namespace views = ranges::views;
 
@@ -46,18 +62,215 @@ auto print_kind(raise<T>& err, auto invoc, auto type) -> raise<T>& {
     return err;
 };
 
+auto read_source(const string& path) -> string {
+    auto input = ifstream(path);
+    auto buffer = stringstream();
+    buffer << input.rdbuf();
+    return buffer.str();
+}
+
+struct source_file_t {
+    string path;
+    string text;
+    size_t lines;
+};
+
+struct batch_stats_t {
+    size_t units = 0;
+    size_t lines = 0;
+    size_t bytes = 0;
+    size_t errors = 0;
+    size_t failures = 0;
+    double seconds = 0;
+};
+
+// Compiles every file `repeat` times on `jobs` threads, each unit in its own
+// compilation context. Reports of the first round are kept in `reports`.
+auto compile_batch(const vector<source_file_t>& files,
+                   unsigned jobs,
+                   unsigned repeat,
+                   vector<string>* reports = nullptr) -> batch_stats_t {
+    const auto n = files.size() * repeat;
+    auto next = atomic<size_t>(0);
+    auto errors = atomic<size_t>(0);
+    auto failures = atomic<size_t>(0);
+
+    if (reports) reports->assign(files.size(), string());
+
+    auto worker = [&] {
+        for (auto i = next++; i < n; i = next++) {
+            const auto& file = files[i % files.size()];
+            auto compilation = compilation_t(file.path);
+            auto report = stringstream();
+
+            try {
+                const syntax::tree_t ast = file.text | tokenize | parse;
+                compilation.check(ast);
+                report << compilation.diagnostics;
+            } catch (const exception& e) {
+                failures++;
+                report << "Fatal error: " << e.what() << endl;
+            }
+
+            errors += compilation.diagnostics.size() + compilation.diagnostics.dropped();
+            if (reports && i < files.size()) (*reports)[i] = report.str();
+        }
+    };
+
+    // the analysis passes trace to cout and cerr; in batch mode that is noise,
+    // and it would serialise the workers on the streams.
+    cout.setstate(ios::badbit);
+    cerr.setstate(ios::badbit);
+
+    const auto start = chrono::steady_clock::now();
+    auto threads = vector<thread>();
+    for (auto t = 1u; t < jobs; t++) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+    const auto stop = chrono::steady_clock::now();
+
+    cout.clear();
+    cerr.clear();
+
+    auto stats = batch_stats_t();
+    stats.units = n;
+    for (const auto& file : files) {
+        stats.lines += file.lines * repeat;
+        stats.bytes += file.text.size() * repeat;
+    }
+    stats.errors = errors;
+    stats.failures = failures;
+    stats.seconds = chrono::duration<double>(stop - start).count();
+    return stats;
+}
+
+auto operator<<(ostream& os, const batch_stats_t& stats) -> ostream& {
+    os << "compiled " << stats.units << " units (" << stats.lines << " lines, " << stats.bytes
+       << " bytes) in " << stats.seconds * 1e3 << " ms: " << stats.units / stats.seconds
+       << " units/s, " << stats.lines / stats.seconds << " lines/s; " << stats.errors
+       << " errors, " << stats.failures << " failures";
+    return os;
+}
+
+auto usage() -> void {
+    cout << "usage: btc [-O LEVEL] [--run [--jit]] FILE" << endl;
+#ifdef BT_HAVE_LLVM
+    cout << "       btc [-O LEVEL] [--llvm] [--emit-obj OBJECT] FILE" << endl;
+#endif
+    cout << "       btc [-O LEVEL] [--emit-c SOURCE] [--cc EXECUTABLE] FILE" << endl;
+    cout << "       btc [-j JOBS] [--repeat N] [--bench] FILE..." << endl << endl;
+    cout << "With a single file, traces every compiler stage, lowering the program to the IR "
+            "and optimizing it at -O2 unless -O says otherwise for the backends; --run then runs "
+            "the program in the VM and prints its result, and --jit first compiles its numeric "
+            "functions to native code. --llvm compiles the program with LLVM, at the same level, "
+            "prints the IR and runs it, and --emit-obj writes it to an object file. --emit-c "
+            "translates the program to C and writes it to a file, and --cc compiles it to an "
+            "executable with the system's C compiler. Otherwise "
+            "the files are compiled in parallel, each in its own "
+            "compilation, and the throughput is reported; --bench measures it for 1, 2, 4, ... "
+            "up to JOBS threads."
+         << endl;
+}
+
+auto compile_files(const vector<string>& paths, unsigned jobs, unsigned repeat, bool bench)
+    -> int {
+    auto files = vector<source_file_t>();
+    for (const auto& path : paths) {
+        auto text = read_source(path);
+        const auto lines = size_t(count(text.begin(), text.end(), '\n'));
+        files.push_back(source_file_t{path, move(text), lines});
+    }
+
+    if (bench) {
+        // warm up the allocator and the page cache before measuring.
+        compile_batch(files, 1, 1);
+
+        double baseline = 0;
+        for (auto j = 1u;; j = min(j * 2, jobs)) {
+            const auto stats = compile_batch(files, j, repeat);
+            if (j == 1) baseline = stats.seconds;
+            cout << j << " threads: " << stats << " (speedup " << baseline / stats.seconds
+                 << "x)" << endl;
+            if (j == jobs) break;
+        }
+        return 0;
+    }
+
+    auto reports = vector<string>();
+    const auto stats = compile_batch(files, jobs, repeat, &reports);
+
+    auto failed = false;
+    for (auto i = 0u; i < files.size(); i++) {
+        if (reports[i].empty()) continue;
+        failed = true;
+        cout << fg::red << files[i].path << ":" << style::reset << endl << reports[i];
+    }
+
+    cout << jobs << " threads: " << stats << endl;
+    return failed ? 1 : 0;
+}
+
 int main(int argc, const char* argv[]) {
     // try {
     cout << coloured_banner() << endl;
 
     if (argc <= 1) return 0;
 
-    auto source = [&] {
-        auto input = ifstream(argv[1]);
-        auto buffer = stringstream();
-        buffer << input.rdbuf();
-        return buffer.str();
-    }();
+    auto paths = vector<string>();
+    auto jobs = max(1u, thread::hardware_concurrency());
+    auto repeat = 1u;
+    auto bench = false;
+    auto batch = false;
+    auto run = false;
+    auto jit = false;
+    auto llvm = false;
+    auto optimization = 2;
+    auto object = string();
+    auto c_source = string();
+    auto executable = string();
+
+    for (auto i = 1; i < argc; i++) {
+        const auto arg = string_view(argv[i]);
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+            jobs = max(1, atoi(argv[++i]));
+            batch = true;
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = max(1, atoi(argv[++i]));
+            batch = true;
+        } else if (arg == "--bench") {
+            bench = batch = true;
+        } else if (arg == "--run") {
+            run = true;
+        } else if (arg == "--jit") {
+            run = jit = true;
+        } else if (arg == "--llvm") {
+            llvm = true;
+        } else if (arg == "-O" && i + 1 < argc) {
+            optimization = atoi(argv[++i]);
+        } else if (arg.starts_with("-O") && arg.size() == 3) {
+            optimization = arg[2] - '0';
+        } else if (arg == "--emit-obj" && i + 1 < argc) {
+            object = argv[++i];
+        } else if (arg == "--emit-c" && i + 1 < argc) {
+            c_source = argv[++i];
+        } else if (arg == "--cc" && i + 1 < argc) {
+            executable = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
+
+    if (paths.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (batch || paths.size() > 1) return compile_files(paths, jobs, repeat, bench);
+
+    auto source = read_source(paths.front());
 
     const lexer::output_t lex_output = source | tokenize;
 
@@ -66,16 +279,15 @@ int main(int argc, const char* argv[]) {
 
     const syntax::tree_t ast = parser::details::parse(lex_output);
 
+    auto compilation = compilation_t(paths.front());
+    const auto& diagnostics = compilation.diagnostics;
+
     auto s = std::stringstream();
     cout << fg::cyan << "AST:" << style::reset << endl;
     parser::pretty_print<empty_attribute_t>(ast, s, 0);
     cout << s.str() << endl;
 
-    attr_node_t<analysis::type_t> typed_ast =
-        walk_post_order<analysis::type_t>(ast, [](auto, auto) { return analysis::type_t(); });
-
-    auto builtins = lang::prelude::environment();
-    type_check(typed_ast, builtins);
+    attr_node_t<analysis::type_t> typed_ast = compilation.check(ast);
 
     {
         auto s = std::stringstream();
@@ -84,10 +296,117 @@ int main(int argc, const char* argv[]) {
         cout << s.str() << endl << endl;
 
         cout << fg::red << "ERRORS:";
-        for (auto&& e : analysis::error::errors) cout << e->what() << endl;
+        cout << diagnostics;
         cout << style::reset << endl;
     }
 
+    const auto backends =
+        run || llvm || !object.empty() || !c_source.empty() || !executable.empty();
+    auto module = ir::module_t();
+    if (backends && diagnostics.empty()) {
+        try {
+            module = ir::lower(typed_ast);
+            auto passes = ir::pipeline(optimization);
+            passes.run(module);
+            cout << fg::cyan << "IR (-O" << optimization << "):" << style::reset << endl
+                 << module << endl
+                 << passes << endl;
+        } catch (const ir::error& e) {
+            cout << fg::red << e.what() << style::reset << endl;
+            return 1;
+        }
+    }
+
+    if (run && diagnostics.empty()) {
+        try {
+            auto program = vm::lower(module);
+            cout << fg::cyan << "Bytecode:" << style::reset << endl << program << endl;
+
+            if (jit) {
+                const auto compiled = jit::compile(program);
+                cout << fg::cyan << "Native code: " << style::reset << compiled << " of "
+                     << program.functions.size() - 1 << " functions" << endl;
+            }
+
+            auto machine = vm::vm_t();
+            const auto start = chrono::steady_clock::now();
+            const auto result = machine.run(program);
+            const auto seconds =
+                chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            cout << fg::cyan << "Result: " << style::reset;
+            vm::print_value(cout, result, program.result_type);
+            cout << endl
+                 << machine.executed() << " instructions in " << seconds * 1e3 << " ms ("
+                 << machine.executed() / seconds << " instructions/s)" << endl;
+        } catch (const vm::error& e) {
+            cout << fg::red << e.what() << style::reset << endl;
+            return 1;
+        } catch (const jit::error& e) {
+            cout << fg::red << e.what() << style::reset << endl;
+            return 1;
+        }
+    }
+
+    if ((llvm || !object.empty()) && diagnostics.empty()) {
+#ifdef BT_HAVE_LLVM
+        try {
+            auto compiled = backend::llvm_module_t(module, paths.front());
+            compiled.optimize(optimization);
+            cout << fg::cyan << "LLVM IR (-O" << optimization << "):" << style::reset << endl
+                 << compiled.ir() << endl;
+
+            if (!object.empty()) {
+                compiled.emit_object(object);
+                cout << fg::cyan << "Object file: " << style::reset << object << endl;
+            }
+
+            if (llvm) {
+                const auto start = chrono::steady_clock::now();
+                const auto result = compiled.run();
+                const auto seconds =
+                    chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                cout << fg::cyan << "Result: " << style::reset;
+                vm::print_value(cout, result, compiled.result_type());
+                cout << endl << "compiled and ran in " << seconds * 1e3 << " ms" << endl;
+            }
+        } catch (const backend::error& e) {
+            cout << fg::red << e.what() << style::reset << endl;
+            return 1;
+        }
+#else
+        cout << fg::red << "btc was built without LLVM" << style::reset << endl;
+        return 1;
+#endif
+    }
+
+    if ((!c_source.empty() || !executable.empty()) && diagnostics.empty()) {
+        try {
+            const auto c = backend::emit_c(module, paths.front());
+            cout << fg::cyan << "C:" << style::reset << endl << c << endl;
+
+            if (!c_source.empty()) {
+                auto file = ofstream(c_source);
+                file << c;
+                if (!file) throw backend::error("Can't write " + c_source);
+                cout << fg::cyan << "C source: " << style::reset << c_source << endl;
+            }
+
+            if (!executable.empty()) {
+                const auto start = chrono::steady_clock::now();
+                backend::compile_c(c, executable);
+                const auto seconds =
+                    chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                cout << fg::cyan << "Executable: " << style::reset << executable << " (compiled in "
+                     << seconds * 1e3 << " ms)" << endl;
+            }
+        } catch (const backend::error& e) {
+            cout << fg::red << e.what() << style::reset << endl;
+            return 1;
+        }
+    }
+
     /*
     using noattr = const empty_attribute_t&;
 
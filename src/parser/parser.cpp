@@ -33,6 +33,14 @@ namespace bt { namespace parser {
                 return *it;
             }
 
+            // After "fn", whether a function type follows rather than a
+            // function.
+            auto function_type_follows() -> bool {
+                if (peek().token != OPAREN || it + 1 == end(input.tokens)) return false;
+                const auto& first = (it + 1)->token;
+                return !holds_alternative<identifier_t>(first) && first != CPAREN;
+            }
+
             void throw_error(const std::string& s) { throw ::bt::parser::error(s, peek()); }
 
             void throw_error(std::stringstream& s) { throw ::bt::parser::error(s, peek()); }
@@ -216,6 +224,21 @@ namespace bt { namespace parser {
                 } while (eat_if<token::comma_t>());
             }
 
+            // The parameters of a template, after its "[": types, or constants
+            // of the type given for them.
+            auto template_parameters() -> named_group_t<empty_attribute_t> {
+                auto result = named_group_t<empty_attribute_t>();
+                do {
+                    const auto name = expect<identifier_t>();
+                    auto type = p_node_t();
+                    if (eat_if<token::colon_t>())
+                        type = p_node_t(type_expr_t<empty_attribute_t>{p_node_t(expression())});
+                    result.emplace_back(name, type);
+                } while (eat_if<token::comma_t>());
+                expect<token::cbracket_t>();
+                return result;
+            }
+
             auto delimited_code() -> tree_t {
                 const auto l = loc_first();
                 const auto old_code = code;
@@ -254,9 +277,12 @@ namespace bt { namespace parser {
                 if (auto result = eat_if(
                         [this](token::type_t) -> tree_t {
                             auto name = optional<with_loc<identifier_t>>();
+                            auto parameters = named_group_t<empty_attribute_t>();
                             if (const auto ident = eat_if<identifier_t>()) {
                                 name = ident->get_with_loc<identifier_t>();
-                                if (eat_if<token::assign_t>())
+                                if (eat_if<token::obracket_t>())
+                                    parameters = template_parameters();
+                                else if (eat_if<token::assign_t>())
                                     return def_type_t<empty_attribute_t>{
                                         *name, p_node_t(type_expr_t<empty_attribute_t>{
                                                    p_node_t(atom_expr())})};
@@ -276,10 +302,13 @@ namespace bt { namespace parser {
                                 }
                             }
 
-                            if (name)
-                                return def_type_t<empty_attribute_t>{
-                                    *name,
-                                    p_node_t(type_expr_t<empty_attribute_t>{p_node_t(type)})};
+                            auto definition =
+                                p_node_t(type_expr_t<empty_attribute_t>{p_node_t(type)});
+                            if (!parameters.empty())
+                                definition = p_node_t(
+                                    template_t<empty_attribute_t>{move(parameters), definition});
+
+                            if (name) return def_type_t<empty_attribute_t>{*name, definition};
                             return type;
                         },
                         [this](token::alias_t) -> tree_t {
@@ -344,6 +373,9 @@ namespace bt { namespace parser {
                         [this](token::def_t) -> tree_t {
                             const auto fn_name = expect<lexer::identifier_t>();
 
+                            auto parameters = named_group_t<empty_attribute_t>();
+                            if (eat_if<token::obracket_t>()) parameters = template_parameters();
+
                             auto arg_names = std::vector<with_loc<lexer::identifier_t>>();
                             auto arg_types = std::vector<p_node_t>();
 
@@ -365,11 +397,14 @@ namespace bt { namespace parser {
 
                             const auto body = expression();
 
-                            return var_def_t<empty_attribute_t>{
-                                fn_name, 0,
-                                p_node_t(),  // TODO!
-                                p_node_t(fn_expr_t<empty_attribute_t>{arg_names, arg_types,
-                                                                      result_type, body})};
+                            auto fn = p_node_t(fn_expr_t<empty_attribute_t>{arg_names, arg_types,
+                                                                             result_type, body});
+                            if (!parameters.empty())
+                                fn = p_node_t(template_t<empty_attribute_t>{move(parameters), fn});
+
+                            return var_def_t<empty_attribute_t>{fn_name, 0,
+                                                                p_node_t(),  // TODO!
+                                                                fn};
                         },
                         [this](token::if_t) -> tree_t {
                             auto ast = if_t<empty_attribute_t>{};
@@ -514,7 +549,19 @@ namespace bt { namespace parser {
 
                             return ast;
                         },
-                        [this](token::fn_t) -> tree_t {
+                        [this, l](token::fn_t) -> tree_t {
+                            // fn(R, A...) is the type of functions: its
+                            // parentheses start with a type where those of a
+                            // function start with a parameter's name.
+                            if (function_type_follows()) {
+                                expect<token::oparen_t>();
+                                auto target = p_node_t(tree_t(lexer::identifier_t("fn")));
+                                target.get().location = location(l);
+                                auto args = data();
+                                expect<token::cparen_t>();
+                                return invoc_t<empty_attribute_t>{target, move(args)};
+                            }
+
                             auto ast = fn_expr_t<empty_attribute_t>();
 
                             if (eat_if<token::oparen_t>()) {
@@ -764,11 +811,23 @@ namespace bt { namespace parser {
             auto simple_atom_expr() -> tree_t {
                 auto result = atom();
 
-                while (const auto invoc = eat_if([&](token::oparen_t) -> tree_t {
-                           const auto args = data();
-                           expect<token::cparen_t>();
-                           return invoc_t<empty_attribute_t>{result, move(args)};
-                       }))
+                while (const auto invoc = eat_if(
+                           [&](token::oparen_t) -> tree_t {
+                               const auto args = data();
+                               expect<token::cparen_t>();
+                               return invoc_t<empty_attribute_t>{result, move(args)};
+                           },
+                           // the arguments of a template, unlike its
+                           // parameters, have no names.
+                           [&](token::obracket_t) -> tree_t {
+                               const auto l = loc_last();
+                               auto args = named_group_t<empty_attribute_t>();
+                               for (auto& arg : data())
+                                   args.emplace_back(with_loc<identifier_t>(identifier_t(), l),
+                                                     arg);
+                               expect<token::cbracket_t>();
+                               return template_t<empty_attribute_t>{move(args), result};
+                           }))
                     result = invoc;
 
                 return result;
@@ -816,6 +875,9 @@ namespace bt { namespace parser {
                     },
                     [this](token::data_t) -> tree_t { return delimited_data(); },
                     [this](token::do_t) -> tree_t { return delimited_code(); },
+                    [this](token::with_t) -> tree_t {
+                        return with_t<empty_attribute_t>{p_node_t(delimited_code())};
+                    },
                     [](identifier_t id) { return tree_t(id); },
                     [](string_literal_t s) { return tree_t(literal_t(s)); },
                     [](integral_literal_t i) { return tree_t(literal_t(i)); },
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <array>
+#include <iomanip>
+
+#include <bullet/vm/bytecode.hpp>
+
+namespace bt { namespace vm {
+    using namespace std;
+
+    namespace {
+        enum class format_t { a, ab, abc, abx, asbx, sj };
+
+        struct opcode_info_t {
+            string_view name;
+            format_t format;
+            int length = 1;
+        };
+
+        constexpr auto opcodes = array<opcode_info_t, size_t(opcode_t::count)>{{
+            {"move", format_t::ab},       {"loadk", format_t::abx},
+            {"loadi", format_t::asbx},    {"getg", format_t::abx},
+            {"setg", format_t::abx},      {"add_i", format_t::abc},
+            {"sub_i", format_t::abc},     {"mul_i", format_t::abc},
+            {"div_i", format_t::abc},     {"div_u", format_t::abc},
+            {"rem_i", format_t::abc},     {"rem_u", format_t::abc},
+            {"pow_i", format_t::abc},     {"neg_i", format_t::ab},
+            {"band", format_t::abc},      {"bor", format_t::abc},
+            {"bxor", format_t::abc},      {"bnot", format_t::ab},
+            {"add_f", format_t::abc},     {"sub_f", format_t::abc},
+            {"mul_f", format_t::abc},     {"div_f", format_t::abc},
+            {"rem_f", format_t::abc},     {"pow_f", format_t::abc},
+            {"neg_f", format_t::ab},      {"eq_i", format_t::abc},
+            {"ne_i", format_t::abc},      {"lt_i", format_t::abc},
+            {"le_i", format_t::abc},      {"lt_u", format_t::abc},
+            {"le_u", format_t::abc},      {"eq_f", format_t::abc},
+            {"ne_f", format_t::abc},      {"lt_f", format_t::abc},
+            {"le_f", format_t::abc},      {"not_b", format_t::ab},
+            {"i2f", format_t::ab},        {"u2f", format_t::ab},
+            {"f2i", format_t::ab},        {"f2u", format_t::ab},
+            {"sext8", format_t::ab},      {"sext16", format_t::ab},
+            {"sext32", format_t::ab},     {"zext8", format_t::ab},
+            {"zext16", format_t::ab},     {"zext32", format_t::ab},
+            {"round_f32", format_t::ab},  {"newarr", format_t::abc},
+            {"len", format_t::ab},        {"index", format_t::abc},
+            {"kernel", format_t::abc},    {"reduce", format_t::abc},
+            {"kernel_strided", format_t::abc}, {"reduce_strided", format_t::abc},
+            {"format", format_t::abc},    {"mark", format_t::a},
+            {"release", format_t::a},
+            {"jmp", format_t::sj},        {"jmp_if", format_t::asbx},
+            {"jmp_ifnot", format_t::asbx}, {"call", format_t::abx},
+            {"ret", format_t::a},
+
+            {"lt_i_jmp_ifnot", format_t::abc, 2},
+            {"le_i_jmp_ifnot", format_t::abc, 2},
+            {"lt_u_jmp_ifnot", format_t::abc, 2},
+            {"le_u_jmp_ifnot", format_t::abc, 2},
+            {"eq_i_jmp_ifnot", format_t::abc, 2},
+            {"ne_i_jmp_ifnot", format_t::abc, 2},
+            {"loadi_add_i", format_t::asbx, 2},
+            {"loadi_sub_i", format_t::asbx, 2},
+            {"getg_add_i_setg", format_t::abx, 3},
+            {"add_i_jmp", format_t::abc, 2},
+        }};
+    }  // namespace
+
+    auto opcode_name(opcode_t op) -> string_view {
+        return op < opcode_t::count ? opcodes[size_t(op)].name : "<invalid>";
+    }
+
+    auto opcode_length(opcode_t op) -> int {
+        return op < opcode_t::count ? opcodes[size_t(op)].length : 1;
+    }
+
+    auto operator<<(ostream& os, opcode_t op) -> ostream& {
+        os << opcode_name(op);
+        return os;
+    }
+
+    auto instruction_t::patch(int offset) -> void {
+        if (op() == opcode_t::jmp)
+            *this = sj(op(), offset);
+        else
+            *this = abx(op(), a(), offset);
+    }
+
+    auto ipow(int64_t base, int64_t exponent) -> int64_t {
+        if (exponent < 0) return base == 1 ? 1 : base == -1 ? (exponent & 1 ? -1 : 1) : 0;
+
+        auto result = uint64_t(1);
+        auto b = uint64_t(base);
+        for (auto e = uint64_t(exponent); e; e >>= 1) {
+            if (e & 1) result *= b;
+            b *= b;
+        }
+        return int64_t(result);
+    }
+
+    auto operator<<(ostream& os, instruction_t i) -> ostream& {
+        if (i.op() >= opcode_t::count) {
+            os << "<invalid " << hex << i.bits() << dec << ">";
+            return os;
+        }
+
+        os << left << setw(16) << i.op() << right;
+        switch (opcodes[size_t(i.op())].format) {
+        case format_t::a: os << i.a(); break;
+        case format_t::ab: os << i.a() << ' ' << i.b(); break;
+        case format_t::abc: os << i.a() << ' ' << i.b() << ' ' << i.c(); break;
+        case format_t::abx: os << i.a() << ' ' << i.bx(); break;
+        case format_t::asbx: os << i.a() << ' ' << i.sbx(); break;
+        case format_t::sj: os << i.sj(); break;
+        }
+        return os;
+    }
+
+    auto operator<<(ostream& os, const program_t& program) -> ostream& {
+        for (const auto& fn : program.functions) {
+            os << "function " << fn.name << " (" << fn.n_parameters << " parameters, "
+               << fn.n_registers << " registers):" << endl;
+            for (auto pc = 0u; pc < fn.code.size(); pc++)
+                os << setw(8) << pc << "  " << fn.code[pc] << endl;
+            for (auto k = 0u; k < fn.constants.size(); k++) {
+                const auto v = fn.constants[k];
+                os << setw(8) << 'k' << k << "  ";
+                const auto array = find_if(program.arrays.begin(),
+                                           program.arrays.end(),
+                                           [&](const auto& a) { return a.get() == v.a; });
+                if (array != program.arrays.end())
+                    os << "array of " << (*array)->size();
+                else
+                    os << "0x" << hex << v.u << dec;
+                os << endl;
+            }
+        }
+        if (!program.globals.empty()) {
+            os << "globals:";
+            for (const auto& g : program.globals) os << ' ' << g;
+            os << endl;
+        }
+        return os;
+    }
+
+    auto print_value(ostream& os, value_t value, const analysis::type_t& type) -> void {
+        using namespace analysis;
+
+        if (is_integral(type)) {
+            if (is_signed(type))
+                os << value.i;
+            else
+                os << value.u;
+        } else if (type.get().is<types::f32_t>()) {
+            os << float(value.f);
+        } else if (is_floating_point(type)) {
+            os << value.f;
+        } else if (type.get().is<types::bool_t>()) {
+            os << (value.u ? "true" : "false");
+        } else if (const auto array = type.get().get_if<types::array_t>()) {
+            os << '(';
+            for (auto i = 0u; i < value.a->size(); i++) {
+                if (i) os << ", ";
+                print_value(os, (*value.a)[i], array->value_type);
+            }
+            os << ')';
+        } else if (type.get().is<types::strlit_t>() || type.get().is<types::string_t>()) {
+            // escaped as the lexer reads them, braces doubled.
+            os << '"';
+            for (const auto c : value.s->view()) {
+                switch (c) {
+                case '"': os << "\\\""; break;
+                case '\\': os << "\\\\"; break;
+                case '\n': os << "\\n"; break;
+                case '\t': os << "\\t"; break;
+                case '{':
+                case '}': os << c << c; break;
+                default: os << c; break;
+                }
+            }
+            os << '"';
+        } else {
+            os << type;
+        }
+    }
+}}  // namespace bt::vm
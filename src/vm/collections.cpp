@@ -0,0 +1,131 @@
+#include <cstdlib>
+
+#include <bullet/vm/collections.hpp>
+
+namespace bt { namespace vm {
+    using namespace std;
+
+    thread_local arena_t* arena_heap_t::arena = nullptr;
+
+    arena_heap_t::scope_t::scope_t(arena_t& arena) : outer_(arena_heap_t::arena) {
+        arena_heap_t::arena = &arena;
+    }
+
+    arena_heap_t::scope_t::~scope_t() { arena_heap_t::arena = outer_; }
+
+    auto arena_heap_t::allocate_unowned(size_t n) -> void* {
+        auto* p = malloc(n);
+        if (!p) throw bad_alloc();
+        return p;
+    }
+
+    namespace {
+        constexpr auto out_of_range = "Vector index out of range";
+        constexpr auto missing_key = "Key not in map";
+
+        template <typename T, typename Items>
+        auto make(arena_t& arena, Items items) -> const T* {
+            return arena.make<T>(T{move(items)});
+        }
+
+        auto append(runtime_collections_t::vector_t v, const array_t& xs)
+            -> runtime_collections_t::vector_t {
+            auto t = move(v).transient();
+            for (const auto x : xs) t.push_back(x);
+            return move(t).persistent();
+        }
+
+        auto vector_op(collection_op_t op, const value_t* args, value_t& result, arena_t& arena)
+            -> const char* {
+            using vector_t = runtime_collections_t::vector_t;
+            if (op == collection_op_t::make || op == collection_op_t::from) {
+                const auto v = op == collection_op_t::make ? vector_t() : append({}, *args[0].a);
+                result.vec = make<persistent_vector_t>(arena, v);
+                return nullptr;
+            }
+
+            const auto& v = args[0].vec->items;
+            switch (op) {
+            case collection_op_t::push:
+                result.vec = make<persistent_vector_t>(arena, v.push_back(args[1]));
+                return nullptr;
+            case collection_op_t::get:
+                if (args[1].u >= v.size()) return out_of_range;
+                result = v[args[1].u];
+                return nullptr;
+            case collection_op_t::put:
+                if (args[1].u >= v.size()) return out_of_range;
+                result.vec = make<persistent_vector_t>(arena, v.set(args[1].u, args[2]));
+                return nullptr;
+            case collection_op_t::size: result.u = v.size(); return nullptr;
+            case collection_op_t::extend:
+                result.vec = make<persistent_vector_t>(arena, append(v, *args[1].a));
+                return nullptr;
+            default: return "Invalid operation on a vector";
+            }
+        }
+
+        auto map_op(collection_op_t op, const value_t* args, value_t& result, arena_t& arena)
+            -> const char* {
+            using map_t = runtime_collections_t::map_t;
+            switch (op) {
+            case collection_op_t::make:
+                result.map = make<persistent_map_t>(arena, map_t());
+                return nullptr;
+            case collection_op_t::get: {
+                const auto* x = args[0].map->items.find(args[1].u);
+                if (!x) return missing_key;
+                result = *x;
+                return nullptr;
+            }
+            case collection_op_t::put:
+                result.map =
+                    make<persistent_map_t>(arena, args[0].map->items.set(args[1].u, args[2]));
+                return nullptr;
+            case collection_op_t::has:
+                result.u = args[0].map->items.count(args[1].u);
+                return nullptr;
+            case collection_op_t::size: result.u = args[0].map->items.size(); return nullptr;
+            default: return "Invalid operation on a map";
+            }
+        }
+
+        auto set_op(collection_op_t op, const value_t* args, value_t& result, arena_t& arena)
+            -> const char* {
+            using set_t = runtime_collections_t::set_t;
+            switch (op) {
+            case collection_op_t::make:
+                result.set = make<persistent_set_t>(arena, set_t());
+                return nullptr;
+            case collection_op_t::from: {
+                // this immer has no transients of sets: elements are added
+                // one at a time.
+                auto s = set_t();
+                for (const auto x : *args[0].a) s = move(s).insert(x.u);
+                result.set = make<persistent_set_t>(arena, move(s));
+                return nullptr;
+            }
+            case collection_op_t::insert:
+                result.set = make<persistent_set_t>(arena, args[0].set->items.insert(args[1].u));
+                return nullptr;
+            case collection_op_t::has:
+                result.u = args[0].set->items.count(args[1].u);
+                return nullptr;
+            case collection_op_t::size: result.u = args[0].set->items.size(); return nullptr;
+            default: return "Invalid operation on a set";
+            }
+        }
+    }  // namespace
+
+    auto collection(int code, const value_t* args, value_t& result, arena_t& arena)
+        -> const char* {
+        const auto heap = arena_heap_t::scope_t(arena);
+        const auto op = collection_op_t(code & 0xf);
+        switch (collection_kind_t(code >> 4)) {
+        case collection_kind_t::vector: return vector_op(op, args, result, arena);
+        case collection_kind_t::map: return map_op(op, args, result, arena);
+        case collection_kind_t::set: return set_op(op, args, result, arena);
+        }
+        return "Invalid collection";
+    }
+}}  // namespace bt::vm
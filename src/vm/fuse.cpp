@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <array>
+#include <iomanip>
+
+#include <bullet/vm/fuse.hpp>
+
+namespace bt { namespace vm {
+    using namespace std;
+
+    namespace {
+        struct pattern_t {
+            opcode_t fused;
+            array<opcode_t, 3> sequence;
+        };
+
+        constexpr auto patterns = array{
+            pattern_t{opcode_t::lt_i_jmp_ifnot, {opcode_t::lt_i, opcode_t::jmp_ifnot}},
+            pattern_t{opcode_t::le_i_jmp_ifnot, {opcode_t::le_i, opcode_t::jmp_ifnot}},
+            pattern_t{opcode_t::lt_u_jmp_ifnot, {opcode_t::lt_u, opcode_t::jmp_ifnot}},
+            pattern_t{opcode_t::le_u_jmp_ifnot, {opcode_t::le_u, opcode_t::jmp_ifnot}},
+            pattern_t{opcode_t::eq_i_jmp_ifnot, {opcode_t::eq_i, opcode_t::jmp_ifnot}},
+            pattern_t{opcode_t::ne_i_jmp_ifnot, {opcode_t::ne_i, opcode_t::jmp_ifnot}},
+            pattern_t{opcode_t::loadi_add_i, {opcode_t::loadi, opcode_t::add_i}},
+            pattern_t{opcode_t::loadi_sub_i, {opcode_t::loadi, opcode_t::sub_i}},
+            pattern_t{opcode_t::getg_add_i_setg,
+                      {opcode_t::getg, opcode_t::add_i, opcode_t::setg}},
+            pattern_t{opcode_t::add_i_jmp, {opcode_t::add_i, opcode_t::jmp}},
+        };
+
+        // how often the sequence ran, as far as pairs tell: a triple ran at
+        // most as often as the rarer of its pairs.
+        auto frequency(const pattern_t& pattern, const profile_t& profile) -> uint64_t {
+            const auto length = opcode_length(pattern.fused);
+            auto result = profile.count(pattern.sequence[0], pattern.sequence[1]);
+            for (auto i = 2; i < length; i++)
+                result = min(result, profile.count(pattern.sequence[i - 1], pattern.sequence[i]));
+            return result;
+        }
+
+        auto matches(const pattern_t& pattern, const vector<instruction_t>& code, size_t pc)
+            -> bool {
+            const auto length = size_t(opcode_length(pattern.fused));
+            if (pc + length > code.size()) return false;
+            for (auto i = 0u; i < length; i++)
+                if (code[pc + i].op() != pattern.sequence[i]) return false;
+            return true;
+        }
+    }  // namespace
+
+    profile_t::profile_t() : pairs_(n * n) {}
+
+    auto profile_t::total() const -> uint64_t {
+        auto result = uint64_t(0);
+        for (const auto count : pairs_) result += count;
+        return result;
+    }
+
+    auto profile_t::hottest(size_t count) const -> vector<pair_t> {
+        auto result = vector<pair_t>();
+        for (auto i = 0u; i < pairs_.size(); i++)
+            if (pairs_[i]) result.push_back(pair_t{opcode_t(i / n), opcode_t(i % n), pairs_[i]});
+
+        const auto by_count = [](const auto& p, const auto& q) { return p.count > q.count; };
+        const auto end = result.begin() + min(count, result.size());
+        partial_sort(result.begin(), end, result.end(), by_count);
+        result.erase(end, result.end());
+        return result;
+    }
+
+    auto operator<<(ostream& os, const profile_t& profile) -> ostream& {
+        const auto total = double(max(profile.total(), uint64_t(1)));
+        for (const auto& pair : profile.hottest(10))
+            os << setw(14) << pair.first << " -> " << left << setw(14) << pair.second << right
+               << setw(12) << pair.count << fixed << setprecision(1) << setw(7)
+               << pair.count / total * 100 << '%' << defaultfloat << endl;
+        return os;
+    }
+
+    auto fuse(program_t& program, const profile_t& profile, double threshold) -> int {
+        const auto minimum = threshold * double(profile.total());
+
+        auto hot = vector<pair<uint64_t, pattern_t>>();
+        for (const auto& pattern : patterns) {
+            const auto count = frequency(pattern, profile);
+            if (count > 0 && double(count) >= minimum) hot.emplace_back(count, pattern);
+        }
+        stable_sort(hot.begin(), hot.end(), [](const auto& p, const auto& q) {
+            return p.first > q.first;
+        });
+
+        auto fused = 0;
+        for (auto& fn : program.functions) {
+            for (auto pc = size_t(0); pc < fn.code.size();) {
+                const auto found = find_if(hot.begin(), hot.end(), [&](const auto& p) {
+                    return matches(p.second, fn.code, pc);
+                });
+                if (found == hot.end()) {
+                    pc += opcode_length(fn.code[pc].op());
+                    continue;
+                }
+
+                fn.code[pc] = fn.code[pc].with_op(found->second.fused);
+                pc += opcode_length(found->second.fused);
+                fused++;
+            }
+        }
+        return fused;
+    }
+}}  // namespace bt::vm
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+
+#include <immer/heap/free_list_heap.hpp>
+#include <immer/heap/free_list_node.hpp>
+#include <immer/heap/malloc_heap.hpp>
+#include <immer/heap/thread_local_free_list_heap.hpp>
+
+#include <bullet/vm/heap.hpp>
+
+namespace bt { namespace vm {
+    using namespace std;
+
+    namespace {
+        // free blocks each thread keeps of every size, and free chunks all
+        // threads share.
+        constexpr size_t free_blocks = 256;
+        constexpr size_t free_chunks = 64;
+
+        template <size_t Size>
+        using block_heap_t = immer::with_free_list_node<
+            immer::thread_local_free_list_heap<Size, free_blocks, immer::malloc_heap>>;
+
+        using chunk_heap_t = immer::with_free_list_node<
+            immer::free_list_heap<arena_t::chunk_size, free_chunks, immer::malloc_heap>>;
+
+        template <size_t Size>
+        auto allocate_sized() -> void* {
+            return block_heap_t<Size>::allocate(Size);
+        }
+
+        template <size_t Size>
+        auto free_sized(void* p) -> void {
+            block_heap_t<Size>::deallocate(Size, p);
+        }
+
+        constexpr void* (*allocators[])() = {
+            allocate_sized<16>,  allocate_sized<32>,  allocate_sized<64>,   allocate_sized<128>,
+            allocate_sized<256>, allocate_sized<512>, allocate_sized<1024>, allocate_sized<2048>,
+        };
+
+        constexpr void (*deallocators[])(void*) = {
+            free_sized<16>,  free_sized<32>,  free_sized<64>,   free_sized<128>,
+            free_sized<256>, free_sized<512>, free_sized<1024>, free_sized<2048>,
+        };
+
+        static_assert(size_t(16) << (size(allocators) - 1) == max_block_size);
+
+        // blocks of up to 16 bytes are of class 0, up to 32 of class 1...
+        auto size_class(size_t n) -> int { return n <= 16 ? 0 : int(bit_width(n - 1)) - 4; }
+
+        constexpr auto offset_bits = 40;
+        constexpr auto offset_mask = (arena_t::mark_t(1) << offset_bits) - 1;
+    }  // namespace
+
+    auto allocate_block(size_t n) -> void* {
+        if (n > max_block_size) return immer::malloc_heap::allocate(n);
+        return allocators[size_class(n)]();
+    }
+
+    auto free_block(void* p, size_t n) noexcept -> void {
+        if (n > max_block_size)
+            immer::malloc_heap::deallocate(n, p);
+        else
+            deallocators[size_class(n)](p);
+    }
+
+    arena_t::~arena_t() { clear(); }
+
+    auto arena_t::mark() const -> mark_t {
+        if (chunks_.empty()) return 0;
+        return mark_t(chunks_.size()) << offset_bits | mark_t(next_ - chunks_.back().data);
+    }
+
+    auto arena_t::release(mark_t mark) -> void {
+        const auto n = size_t(mark >> offset_bits);
+        for (; chunks_.size() > n; chunks_.pop_back()) {
+            const auto& c = chunks_.back();
+            if (c.size == chunk_size)
+                chunk_heap_t::deallocate(chunk_size, c.data);
+            else
+                immer::malloc_heap::deallocate(c.size, c.data);
+        }
+        if (chunks_.empty()) {
+            next_ = end_ = nullptr;
+            return;
+        }
+        next_ = chunks_.back().data + (mark & offset_mask);
+        end_ = chunks_.back().data + chunks_.back().size;
+    }
+
+    auto arena_t::grow(size_t n, size_t alignment) -> void* {
+        // allocations which don't fit in a chunk once aligned get one of
+        // their own.
+        const auto size = n + alignment > chunk_size ? n + alignment : chunk_size;
+        if (chunks_.size() == chunks_.capacity())
+            chunks_.reserve(max(size_t(8), 2 * chunks_.size()));
+        auto* data = static_cast<char*>(size == chunk_size ? chunk_heap_t::allocate(chunk_size)
+                                                           : immer::malloc_heap::allocate(size));
+        chunks_.push_back(chunk_t{data, size});
+        next_ = data;
+        end_ = data + size;
+        return bump(n, alignment);
+    }
+}}  // namespace bt::vm
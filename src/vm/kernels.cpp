@@ -0,0 +1,525 @@
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include <bullet/vm/kernels.hpp>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BT_KERNELS_X86 1
+// declares the builtins gathering words, whichever instruction sets are on.
+#include <immintrin.h>
+#else
+#define BT_KERNELS_X86 0
+#endif
+
+// Vectors are only passed between functions inlined into the kernels of one
+// instruction set, whose calling convention never applies to them.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace bt { namespace vm {
+    using namespace std;
+
+    namespace {
+        constexpr auto is_float(lane_t l) -> bool { return l == lane_t::f32 || l == lane_t::f64; }
+        constexpr auto is_signed(lane_t l) -> bool { return l <= lane_t::i64; }
+
+        constexpr auto bits(lane_t l) -> int {
+            switch (l) {
+            case lane_t::i8:
+            case lane_t::u8: return 8;
+            case lane_t::i16:
+            case lane_t::u16: return 16;
+            case lane_t::i32:
+            case lane_t::u32:
+            case lane_t::f32: return 32;
+            default: return 64;
+            }
+        }
+
+        // Vectors of W words, read as signed or unsigned integers, or as
+        // doubles; and of W floats. Vectors of one word are how kernels
+        // operate on single elements.
+        template <int W>
+        struct words_t {
+            typedef int64_t s __attribute__((vector_size(W * 8)));
+            typedef uint64_t u __attribute__((vector_size(W * 8)));
+            typedef double d __attribute__((vector_size(W * 8)));
+            typedef float f __attribute__((vector_size(W * 4)));
+            // what the builtins gathering words take.
+            typedef long long q __attribute__((vector_size(W * 8)));
+        };
+
+        // what words of a lane are read as: sums of integers wrap, so they
+        // add unsigned words.
+        template <int W, lane_t L, bool wrapping = false>
+        using vector_t =
+            conditional_t<is_float(L),
+                          typename words_t<W>::d,
+                          conditional_t<is_signed(L) && !wrapping,
+                                        typename words_t<W>::s,
+                                        typename words_t<W>::u>>;
+
+        template <typename V>
+        [[gnu::always_inline]] inline auto load(const value_t* p) -> V {
+            auto v = V();
+            memcpy(&v, p, sizeof v);
+            return v;
+        }
+
+        template <typename V>
+        [[gnu::always_inline]] inline auto store(value_t* p, const V& v) -> void {
+            memcpy(p, &v, sizeof v);
+        }
+
+        // The W words from p on, stride words apart: gathered in one
+        // instruction into vectors of 4 and 8 words, one at a time into
+        // others.
+        template <int W, typename V>
+        [[gnu::always_inline]] inline auto gather(const value_t* p, ptrdiff_t stride) -> V {
+#if BT_KERNELS_X86
+            if constexpr (W == 4 || W == 8) {
+                using q = typename words_t<W>::q;
+                auto index = q();
+                for (auto j = 0; j < W; j++) index[j] = j * stride;
+                const auto base = reinterpret_cast<const long long*>(p);
+                if constexpr (W == 4)
+                    return V(__builtin_ia32_gatherdiv4di(q(), base, index, q() - 1, 8));
+                else
+                    return V(__builtin_ia32_gatherdiv8di(q(), base, index, 0xff, 8));
+            }
+#endif
+            auto v = V();
+            for (auto j = 0; j < W; j++)
+                memcpy(reinterpret_cast<char*>(&v) + j * 8, p + j * stride, 8);
+            return v;
+        }
+
+        template <int W, typename V, bool Strided>
+        [[gnu::always_inline]] inline auto read(const value_t* p, ptrdiff_t stride) -> V {
+            if constexpr (Strided)
+                return gather<W, V>(p, stride);
+            else
+                return load<V>(p);
+        }
+
+        // Integer results of a lane's type, extended back to 64 bits the way
+        // the VM keeps them.
+        template <int W, lane_t L>
+        [[gnu::always_inline]] inline auto narrow(const typename words_t<W>::u& x) ->
+            typename words_t<W>::u {
+            using s = typename words_t<W>::s;
+            using u = typename words_t<W>::u;
+            constexpr auto w = bits(L);
+            if constexpr (w == 64)
+                return x;
+            else if constexpr (is_signed(L))
+                return u(s(x << (64 - w)) >> (64 - w));
+            else
+                return x & ((uint64_t(1) << w) - 1);
+        }
+
+        // float results, rounded to float precision for f32.
+        template <int W, lane_t L>
+        [[gnu::always_inline]] inline auto round(const typename words_t<W>::d& x) ->
+            typename words_t<W>::d {
+            if constexpr (L == lane_t::f32)
+                return __builtin_convertvector(
+                    __builtin_convertvector(x, typename words_t<W>::f), typename words_t<W>::d);
+            else
+                return x;
+        }
+
+        // the elements of x where mask is set, those of y elsewhere.
+        template <int W, typename V, typename M>
+        [[gnu::always_inline]] inline auto select(const M& mask, const V& x, const V& y) -> V {
+            using u = typename words_t<W>::u;
+            return V((u(x) & u(mask)) | (u(y) & ~u(mask)));
+        }
+
+        template <int W, lane_t L, kernel_op_t Op, bool Strided>
+        [[gnu::always_inline]] inline auto apply(
+            const value_t* a, ptrdiff_t sa, const value_t* b, ptrdiff_t sb, value_t* out)
+            -> void {
+            using u = typename words_t<W>::u;
+            using V = vector_t<W, L>;
+            const auto x = read<W, V, Strided>(a, sa);
+            const auto y = read<W, V, Strided>(b, sb);
+
+            if constexpr (Op == kernel_op_t::eq)
+                store(out, u(x == y) & 1);
+            else if constexpr (Op == kernel_op_t::ne)
+                store(out, u(x != y) & 1);
+            else if constexpr (Op == kernel_op_t::lt)
+                store(out, u(x < y) & 1);
+            else if constexpr (Op == kernel_op_t::le)
+                store(out, u(x <= y) & 1);
+            else if constexpr (is_float(L)) {
+                const auto r = Op == kernel_op_t::add   ? x + y
+                               : Op == kernel_op_t::sub ? x - y
+                               : Op == kernel_op_t::mul ? x * y
+                                                        : x / y;
+                store(out, round<W, L>(r));
+            } else if constexpr (Op == kernel_op_t::mul && bits(L) <= 32) {
+                // the low halves decide the bits kept, and multiply in one
+                // instruction where 64 bit products take several.
+                constexpr auto low = uint64_t(0xffffffff);
+                store(out, narrow<W, L>((u(x) & low) * (u(y) & low)));
+            } else {
+                const auto r = Op == kernel_op_t::add   ? u(x) + u(y)
+                               : Op == kernel_op_t::sub ? u(x) - u(y)
+                                                        : u(x) * u(y);
+                store(out, narrow<W, L>(r));
+            }
+        }
+
+        // Integer division, one element at a time, as the VM divides.
+        template <lane_t L>
+        auto divide(const value_t* a,
+                    ptrdiff_t sa,
+                    const value_t* b,
+                    ptrdiff_t sb,
+                    value_t* out,
+                    size_t n) -> bool {
+            for (auto k = size_t(0); k < n; k++) {
+                const auto x = a[ptrdiff_t(k) * sa], y = b[ptrdiff_t(k) * sb];
+                if (y.u == 0) return false;
+                auto q = value_t();
+                if constexpr (is_signed(L))
+                    q.i = y.i == -1 ? int64_t(0 - x.u) : x.i / y.i;
+                else
+                    q.u = x.u / y.u;
+                store(out + k, narrow<1, L>(load<typename words_t<1>::u>(&q)));
+            }
+            return true;
+        }
+
+        template <int W, lane_t L, kernel_op_t Op, bool Strided>
+        [[gnu::always_inline]] inline auto map(const value_t* a,
+                                               ptrdiff_t sa,
+                                               const value_t* b,
+                                               ptrdiff_t sb,
+                                               value_t* out,
+                                               size_t n) -> bool {
+            if constexpr (Op == kernel_op_t::div && !is_float(L)) {
+                return divide<L>(a, sa, b, sb, out, n);
+            } else {
+                auto k = size_t(0);
+                for (; k + W <= n; k += W)
+                    apply<W, L, Op, Strided>(a + ptrdiff_t(k) * sa, sa, b + ptrdiff_t(k) * sb, sb,
+                                             out + k);
+                for (; k < n; k++)
+                    apply<1, L, Op, false>(a + ptrdiff_t(k) * sa, sa, b + ptrdiff_t(k) * sb, sb,
+                                           out + k);
+                return true;
+            }
+        }
+
+        // Elements next to each other are loaded as they are, others
+        // gathered.
+        template <int W, lane_t L, kernel_op_t Op>
+        [[gnu::always_inline]] inline auto map(const value_t* a,
+                                               ptrdiff_t sa,
+                                               const value_t* b,
+                                               ptrdiff_t sb,
+                                               value_t* out,
+                                               size_t n) -> bool {
+            if (sa == 1 && sb == 1) return map<W, L, Op, false>(a, sa, b, sb, out, n);
+            return map<W, L, Op, true>(a, sa, b, sb, out, n);
+        }
+
+        // folds x into the partial results p.
+        template <int W, lane_t L, reduction_t R, typename V>
+        [[gnu::always_inline]] inline auto combine(V& p, const V& x) -> void {
+            if constexpr (R == reduction_t::sum && is_float(L))
+                p = round<W, L>(p + x);
+            else if constexpr (R == reduction_t::sum)
+                p = p + x;
+            else if constexpr (R == reduction_t::min)
+                p = select<W>(x < p, x, p);
+            else
+                p = select<W>(x > p, x, p);
+        }
+
+        template <int W, lane_t L, reduction_t R, bool Strided>
+        [[gnu::always_inline]] inline auto fold(const value_t* a, ptrdiff_t stride, size_t n)
+            -> value_t {
+            using V = vector_t<W, L, R == reduction_t::sum>;
+            using V1 = vector_t<1, L, R == reduction_t::sum>;
+            constexpr auto partials = 8 / W;
+
+            // sums start from zero, min and max from the first element.
+            value_t q[8];
+            for (auto& x : q) x = R == reduction_t::sum ? value_t{0} : a[0];
+
+            auto p = array<V, partials>();
+            memcpy(p.data(), q, sizeof q);
+            auto k = size_t(0);
+            for (; k + 8 <= n; k += 8)
+                for (auto j = 0; j < partials; j++)
+                    combine<W, L, R>(p[j],
+                                     read<W, V, Strided>(a + ptrdiff_t(k + j * W) * stride,
+                                                         stride));
+            memcpy(q, p.data(), sizeof q);
+
+            const auto into = [&](value_t& to, const value_t& x) {
+                auto r = load<V1>(&to);
+                combine<1, L, R>(r, load<V1>(&x));
+                store(&to, r);
+            };
+            for (; k < n; k++) into(q[k % 8], a[ptrdiff_t(k) * stride]);
+            for (auto width = 1; width < 8; width *= 2)
+                for (auto j = 0; j < 8; j += 2 * width) into(q[j], q[j + width]);
+
+            if constexpr (R == reduction_t::sum && !is_float(L))
+                store(q, narrow<1, L>(load<typename words_t<1>::u>(q)));
+            return q[0];
+        }
+
+        template <int W, lane_t L, reduction_t R>
+        [[gnu::always_inline]] inline auto fold(const value_t* a, ptrdiff_t stride, size_t n)
+            -> value_t {
+            if (stride == 1) return fold<W, L, R, false>(a, stride, n);
+            return fold<W, L, R, true>(a, stride, n);
+        }
+
+        template <int W, lane_t L>
+        [[gnu::always_inline]] inline auto map_lane(kernel_op_t op,
+                                                    const value_t* a,
+                                                    ptrdiff_t sa,
+                                                    const value_t* b,
+                                                    ptrdiff_t sb,
+                                                    value_t* out,
+                                                    size_t n) -> bool {
+            switch (op) {
+            case kernel_op_t::add: return map<W, L, kernel_op_t::add>(a, sa, b, sb, out, n);
+            case kernel_op_t::sub: return map<W, L, kernel_op_t::sub>(a, sa, b, sb, out, n);
+            case kernel_op_t::mul: return map<W, L, kernel_op_t::mul>(a, sa, b, sb, out, n);
+            case kernel_op_t::div: return map<W, L, kernel_op_t::div>(a, sa, b, sb, out, n);
+            case kernel_op_t::eq: return map<W, L, kernel_op_t::eq>(a, sa, b, sb, out, n);
+            case kernel_op_t::ne: return map<W, L, kernel_op_t::ne>(a, sa, b, sb, out, n);
+            case kernel_op_t::lt: return map<W, L, kernel_op_t::lt>(a, sa, b, sb, out, n);
+            default: return map<W, L, kernel_op_t::le>(a, sa, b, sb, out, n);
+            }
+        }
+
+        template <int W>
+        [[gnu::always_inline]] inline auto map_any(kernel_op_t op,
+                                                   lane_t lane,
+                                                   const value_t* a,
+                                                   ptrdiff_t sa,
+                                                   const value_t* b,
+                                                   ptrdiff_t sb,
+                                                   value_t* out,
+                                                   size_t n) -> bool {
+            switch (lane) {
+            case lane_t::i8: return map_lane<W, lane_t::i8>(op, a, sa, b, sb, out, n);
+            case lane_t::i16: return map_lane<W, lane_t::i16>(op, a, sa, b, sb, out, n);
+            case lane_t::i32: return map_lane<W, lane_t::i32>(op, a, sa, b, sb, out, n);
+            case lane_t::i64: return map_lane<W, lane_t::i64>(op, a, sa, b, sb, out, n);
+            case lane_t::u8: return map_lane<W, lane_t::u8>(op, a, sa, b, sb, out, n);
+            case lane_t::u16: return map_lane<W, lane_t::u16>(op, a, sa, b, sb, out, n);
+            case lane_t::u32: return map_lane<W, lane_t::u32>(op, a, sa, b, sb, out, n);
+            case lane_t::u64: return map_lane<W, lane_t::u64>(op, a, sa, b, sb, out, n);
+            case lane_t::f32: return map_lane<W, lane_t::f32>(op, a, sa, b, sb, out, n);
+            default: return map_lane<W, lane_t::f64>(op, a, sa, b, sb, out, n);
+            }
+        }
+
+        template <int W, lane_t L>
+        [[gnu::always_inline]] inline auto fold_lane(reduction_t r,
+                                                     const value_t* a,
+                                                     ptrdiff_t stride,
+                                                     size_t n) -> value_t {
+            switch (r) {
+            case reduction_t::sum: return fold<W, L, reduction_t::sum>(a, stride, n);
+            case reduction_t::min: return fold<W, L, reduction_t::min>(a, stride, n);
+            default: return fold<W, L, reduction_t::max>(a, stride, n);
+            }
+        }
+
+        template <int W>
+        [[gnu::always_inline]] inline auto fold_any(reduction_t r,
+                                                    lane_t lane,
+                                                    const value_t* a,
+                                                    ptrdiff_t stride,
+                                                    size_t n) -> value_t {
+            switch (lane) {
+            case lane_t::i8: return fold_lane<W, lane_t::i8>(r, a, stride, n);
+            case lane_t::i16: return fold_lane<W, lane_t::i16>(r, a, stride, n);
+            case lane_t::i32: return fold_lane<W, lane_t::i32>(r, a, stride, n);
+            case lane_t::i64: return fold_lane<W, lane_t::i64>(r, a, stride, n);
+            case lane_t::u8: return fold_lane<W, lane_t::u8>(r, a, stride, n);
+            case lane_t::u16: return fold_lane<W, lane_t::u16>(r, a, stride, n);
+            case lane_t::u32: return fold_lane<W, lane_t::u32>(r, a, stride, n);
+            case lane_t::u64: return fold_lane<W, lane_t::u64>(r, a, stride, n);
+            case lane_t::f32: return fold_lane<W, lane_t::f32>(r, a, stride, n);
+            default: return fold_lane<W, lane_t::f64>(r, a, stride, n);
+            }
+        }
+
+        // The kernels for each instruction set, which everything above is
+        // inlined into.
+        auto map_scalar(kernel_op_t op,
+                        lane_t lane,
+                        const value_t* a,
+                        ptrdiff_t sa,
+                        const value_t* b,
+                        ptrdiff_t sb,
+                        value_t* out,
+                        size_t n) -> bool {
+            return map_any<1>(op, lane, a, sa, b, sb, out, n);
+        }
+
+        auto fold_scalar(reduction_t r, lane_t lane, const value_t* a, ptrdiff_t stride, size_t n)
+            -> value_t {
+            return fold_any<1>(r, lane, a, stride, n);
+        }
+
+#if BT_KERNELS_X86
+        [[gnu::target("sse4.2")]] auto map_sse4_2(kernel_op_t op,
+                                                  lane_t lane,
+                                                  const value_t* a,
+                                                  ptrdiff_t sa,
+                                                  const value_t* b,
+                                                  ptrdiff_t sb,
+                                                  value_t* out,
+                                                  size_t n) -> bool {
+            return map_any<2>(op, lane, a, sa, b, sb, out, n);
+        }
+
+        [[gnu::target("sse4.2")]] auto fold_sse4_2(reduction_t r,
+                                                   lane_t lane,
+                                                   const value_t* a,
+                                                   ptrdiff_t stride,
+                                                   size_t n) -> value_t {
+            return fold_any<2>(r, lane, a, stride, n);
+        }
+
+        [[gnu::target("avx2")]] auto map_avx2(kernel_op_t op,
+                                              lane_t lane,
+                                              const value_t* a,
+                                              ptrdiff_t sa,
+                                              const value_t* b,
+                                              ptrdiff_t sb,
+                                              value_t* out,
+                                              size_t n) -> bool {
+            return map_any<4>(op, lane, a, sa, b, sb, out, n);
+        }
+
+        [[gnu::target("avx2")]] auto fold_avx2(reduction_t r,
+                                               lane_t lane,
+                                               const value_t* a,
+                                               ptrdiff_t stride,
+                                               size_t n) -> value_t {
+            return fold_any<4>(r, lane, a, stride, n);
+        }
+
+        [[gnu::target("avx512f,avx512dq")]] auto map_avx512(kernel_op_t op,
+                                                            lane_t lane,
+                                                            const value_t* a,
+                                                            ptrdiff_t sa,
+                                                            const value_t* b,
+                                                            ptrdiff_t sb,
+                                                            value_t* out,
+                                                            size_t n) -> bool {
+            return map_any<8>(op, lane, a, sa, b, sb, out, n);
+        }
+
+        [[gnu::target("avx512f,avx512dq")]] auto fold_avx512(reduction_t r,
+                                                             lane_t lane,
+                                                             const value_t* a,
+                                                             ptrdiff_t stride,
+                                                             size_t n) -> value_t {
+            return fold_any<8>(r, lane, a, stride, n);
+        }
+#endif
+    }  // namespace
+
+    auto lane(const analysis::type_t& t) -> optional<lane_t> {
+        if (analysis::is_floating_point(t))
+            return analysis::width(t) == 32 ? lane_t::f32 : lane_t::f64;
+        if (!analysis::is_integral(t)) return nullopt;
+        const auto w = analysis::width(t);
+        const auto k = w == 8 ? 0 : w == 16 ? 1 : w == 32 ? 2 : 3;
+        return lane_t(analysis::is_signed(t) ? k : k + 4);
+    }
+
+    auto detect_isa() -> isa_t {
+        static const auto isa = [] {
+#if BT_KERNELS_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+                return isa_t::avx512;
+            if (__builtin_cpu_supports("avx2")) return isa_t::avx2;
+            if (__builtin_cpu_supports("sse4.2")) return isa_t::sse4_2;
+#endif
+            return isa_t::scalar;
+        }();
+        return isa;
+    }
+
+    auto isa_name(isa_t isa) -> string_view {
+        switch (isa) {
+        case isa_t::sse4_2: return "sse4.2";
+        case isa_t::avx2: return "avx2";
+        case isa_t::avx512: return "avx512";
+        default: return "scalar";
+        }
+    }
+
+    auto in_view(const value_t* view, size_t n) -> bool {
+        const auto size = view[0].a->size();
+        const auto first = view[1].u, stride = view[2].u;
+        if (n == 0) return first <= size;
+        return view[2].i > 0 && first < size && n - 1 <= (size - 1 - first) / stride;
+    }
+
+    auto elementwise(kernel_op_t op,
+                     lane_t lane,
+                     const value_t* a,
+                     const value_t* b,
+                     value_t* out,
+                     size_t n,
+                     isa_t isa) -> bool {
+        return elementwise(op, lane, a, 1, b, 1, out, n, isa);
+    }
+
+    auto elementwise(kernel_op_t op,
+                     lane_t lane,
+                     const value_t* a,
+                     ptrdiff_t a_stride,
+                     const value_t* b,
+                     ptrdiff_t b_stride,
+                     value_t* out,
+                     size_t n,
+                     isa_t isa) -> bool {
+        const auto sa = a_stride, sb = b_stride;
+        switch (isa) {
+#if BT_KERNELS_X86
+        case isa_t::avx512: return map_avx512(op, lane, a, sa, b, sb, out, n);
+        case isa_t::avx2: return map_avx2(op, lane, a, sa, b, sb, out, n);
+        case isa_t::sse4_2: return map_sse4_2(op, lane, a, sa, b, sb, out, n);
+#endif
+        default: return map_scalar(op, lane, a, sa, b, sb, out, n);
+        }
+    }
+
+    auto reduce(reduction_t r, lane_t lane, const value_t* a, size_t n, isa_t isa) -> value_t {
+        return reduce(r, lane, a, 1, n, isa);
+    }
+
+    auto reduce(reduction_t r, lane_t lane, const value_t* a, ptrdiff_t stride, size_t n, isa_t isa)
+        -> value_t {
+        switch (isa) {
+#if BT_KERNELS_X86
+        case isa_t::avx512: return fold_avx512(r, lane, a, stride, n);
+        case isa_t::avx2: return fold_avx2(r, lane, a, stride, n);
+        case isa_t::sse4_2: return fold_sse4_2(r, lane, a, stride, n);
+#endif
+        default: return fold_scalar(r, lane, a, stride, n);
+        }
+    }
+}}  // namespace bt::vm
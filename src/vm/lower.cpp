@@ -0,0 +1,989 @@
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+#include <vector>
+
+#include <bullet/analysis/layout.hpp>
+#include <bullet/ir/lower.hpp>
+#include <bullet/vm/kernels.hpp>
+#include <bullet/vm/lower.hpp>
+
+namespace bt { namespace vm {
+    using namespace std;
+
+    namespace types = analysis::types;
+
+    using analysis::type_t;
+
+    namespace {
+        // How the VM holds and operates on values of a type.
+        struct repr_t {
+            enum kind_t { none, signed_int, unsigned_int, floating, boolean, array, text };
+
+            kind_t kind = none;
+            int width = 64;
+
+            auto operator==(const repr_t&) const -> bool = default;
+
+            auto integral() const -> bool {
+                return kind == signed_int || kind == unsigned_int || kind == boolean;
+            }
+        };
+
+        auto repr(const type_t& t) -> repr_t {
+            if (analysis::is_integral(t))
+                return {analysis::is_signed(t) ? repr_t::signed_int : repr_t::unsigned_int,
+                        analysis::width(t)};
+            if (analysis::is_floating_point(t)) return {repr_t::floating, analysis::width(t)};
+            if (t.get().is<types::bool_t>()) return {repr_t::boolean, 8};
+            // slices are the storage they view.
+            if (t.get().is<types::array_t>() || t.get().is<types::slice_t>())
+                return {repr_t::array, 64};
+            // literals are the strings they convert to.
+            if (t.get().is<types::strlit_t>() || t.get().is<types::string_t>())
+                return {repr_t::text, 64};
+            return {};
+        }
+
+        // Whether values of one type take instructions to become values of
+        // another: narrower integers are already extended the way a wider type
+        // keeps them, unless a signed one becomes unsigned.
+        auto converts(const type_t& from, const type_t& to) -> bool {
+            const auto f = repr(from);
+            const auto t = repr(to);
+            if (t.kind == repr_t::none || f == t) return false;
+            if (f.integral() && t.integral())
+                return t.width < 64 && !(f.width < t.width && (f.kind != repr_t::signed_int ||
+                                                               t.kind == repr_t::signed_int));
+            if (f.kind == repr_t::floating && t.kind == repr_t::floating) return t.width == 32;
+            return f.kind != repr_t::array && f.kind != repr_t::text;
+        }
+
+        // How format writes values of a type.
+        auto piece(const type_t& t) -> piece_t {
+            switch (repr(t).kind) {
+            case repr_t::signed_int: return piece_t::signed_int;
+            case repr_t::unsigned_int: return piece_t::unsigned_int;
+            case repr_t::floating: return analysis::width(t) == 32 ? piece_t::f32 : piece_t::f64;
+            case repr_t::boolean: return piece_t::boolean;
+            default: return piece_t::text;
+            }
+        }
+
+        auto element_type(const type_t& pointer) -> type_t {
+            return pointer.get().as<types::ptr_t>().value_type;
+        }
+
+        // A register to copy to another, or a constant to load into it.
+        struct move_t {
+            int dst;
+            int src;
+            bool constant = false;
+        };
+
+        // Compiles one function of the module. Values get registers of their
+        // own, allocated over the intervals they are live in; variables, the
+        // slots of the IR, one each for the whole call, parameters first, in
+        // the registers they arrive in. Constants take no register until an
+        // instruction needs them, when they are loaded into scratch registers
+        // above every other.
+        class codegen_t {
+            const ir::module_t& module_;
+            const ir::function_t& fn_;
+            program_t& program_;
+            function_t& out_;
+
+            vector<int> order_;
+            vector<int> block_of_;
+            vector<int> position_;
+            // the value standing for each one: itself, the operand of a
+            // conversion which changes nothing, or the slot a load reads if
+            // it can use the slot's register directly.
+            vector<int> root_;
+            vector<int> register_;
+            // registers held for the whole call: parameters and variables.
+            int reserved_ = 0;
+            // the first register above every value's.
+            int top_ = 0;
+            int scratch_ = 0;
+
+            unordered_map<uint64_t, int> constants_;
+            vector<int> block_pc_;
+            // jumps to patch, and the blocks they go to.
+            vector<pair<int, int>> fixups_;
+            // where each call's callee frame starts.
+            vector<int> call_bases_;
+
+            struct stub_t {
+                int jump;
+                vector<move_t> moves;
+                int target;
+            };
+            vector<stub_t> stubs_;
+
+            auto fail(const string& what, int id) -> void {
+                throw error(what, fn_[id].location);
+            }
+
+            auto emit(instruction_t i) -> int {
+                out_.code.push_back(i);
+                return int(out_.code.size()) - 1;
+            }
+
+            auto emit(vm::opcode_t op, int a, int b = 0, int c = 0) -> int {
+                use(max({a, b, c}));
+                return emit(instruction_t::abc(op, a, b, c));
+            }
+
+            auto use(int r) -> void {
+                if (r > instruction_t::max_register)
+                    throw error("Too many values live at once in \"" + fn_.name + "\"");
+                out_.n_registers = max(out_.n_registers, r + 1);
+            }
+
+            auto constant(value_t v) -> int {
+                const auto [it, fresh] = constants_.try_emplace(v.u, out_.constants.size());
+                if (fresh) {
+                    if (it->second > instruction_t::max_bx)
+                        throw error("Too many constants in \"" + fn_.name + "\"");
+                    out_.constants.push_back(v);
+                }
+                return it->second;
+            }
+
+            auto load(int dst, int id) -> void {
+                const auto& c = fn_[id];
+                use(dst);
+                if (repr(c.type).kind == repr_t::array) {
+                    // the zero value of an array type: as many zeros; of a
+                    // slice type, the zeros it views.
+                    const auto s = c.type.get().get_if<types::slice_t>();
+                    const auto n = s ? size_t(s->end)
+                                     : analysis::length(c.type.get().as<types::array_t>());
+                    program_.arrays.push_back(make_unique<array_t>(n, value_t{.u = 0}));
+                    const auto v = value_t{.a = program_.arrays.back().get()};
+                    emit(instruction_t::abx(vm::opcode_t::loadk, dst, constant(v)));
+                    return;
+                }
+                if (repr(c.type).kind == repr_t::text) {
+                    const auto s = program_.literals.intern(module_.strings.at(c.immediate));
+                    emit(instruction_t::abx(vm::opcode_t::loadk, dst, constant(value_t{.s = s})));
+                    return;
+                }
+                immediate(dst, value_t{.u = c.immediate});
+            }
+
+            auto immediate(int dst, value_t v) -> void {
+                use(dst);
+                if (v.i >= instruction_t::min_sbx && v.i <= instruction_t::max_sbx)
+                    emit(instruction_t::abx(vm::opcode_t::loadi, dst, int(v.i)));
+                else
+                    emit(instruction_t::abx(vm::opcode_t::loadk, dst, constant(v)));
+            }
+
+            auto is_constant(int v) const -> bool { return fn_[v].op == ir::opcode_t::constant; }
+
+            // The register holding a value, loading constants into a scratch
+            // register.
+            auto operand(int v) -> int {
+                const auto r = root_[v];
+                if (!is_constant(r)) return register_[r];
+                const auto s = top_ + scratch_++;
+                load(s, r);
+                return s;
+            }
+
+            auto jump_to(vm::opcode_t op, int block, int a = 0) -> void {
+                const auto pc = op == vm::opcode_t::jmp ? emit(instruction_t::sj(op, 0))
+                                                        : emit(instruction_t::abx(op, a, 0));
+                fixups_.emplace_back(pc, block);
+            }
+
+            auto patch(int pc, int target) -> void {
+                auto& i = out_.code[pc];
+                const auto offset = target - (pc + 1);
+                const auto far =
+                    i.op() == vm::opcode_t::jmp
+                        ? offset < instruction_t::min_sj || offset > instruction_t::max_sj
+                        : offset < instruction_t::min_sbx || offset > instruction_t::max_sbx;
+                if (far) throw error("Jump out of range in \"" + fn_.name + "\"");
+                i.patch(offset);
+            }
+
+            // Truncates src to the width of its type, into dst.
+            auto narrow(int dst, int src, repr_t to) -> void {
+                if (to.kind == repr_t::floating && to.width == 32) {
+                    emit(vm::opcode_t::round_f32, dst, src);
+                    return;
+                }
+                if (to.integral() && to.width < 64) {
+                    const auto sign = to.kind == repr_t::signed_int;
+                    const auto op = to.width == 8
+                                        ? (sign ? vm::opcode_t::sext8 : vm::opcode_t::zext8)
+                                    : to.width == 16
+                                        ? (sign ? vm::opcode_t::sext16 : vm::opcode_t::zext16)
+                                        : (sign ? vm::opcode_t::sext32 : vm::opcode_t::zext32);
+                    emit(op, dst, src);
+                    return;
+                }
+                if (dst != src) emit(vm::opcode_t::move, dst, src);
+            }
+
+            // Copies registers in parallel, through a scratch register for
+            // cycles, then loads constants.
+            auto parallel(vector<move_t> moves) -> void {
+                auto loads = vector<move_t>();
+                auto copies = vector<move_t>();
+                for (const auto& m : moves)
+                    if (m.constant)
+                        loads.push_back(m);
+                    else if (m.dst != m.src)
+                        copies.push_back(m);
+
+                const auto temporary = top_ + scratch_;
+                while (!copies.empty()) {
+                    const auto ready = find_if(copies.begin(), copies.end(), [&](const move_t& m) {
+                        return none_of(copies.begin(), copies.end(), [&](const move_t& n) {
+                            return n.src == m.dst;
+                        });
+                    });
+                    if (ready != copies.end()) {
+                        emit(vm::opcode_t::move, ready->dst, ready->src);
+                        copies.erase(ready);
+                        continue;
+                    }
+                    // every destination is still to be read: set one aside.
+                    const auto d = copies.front().dst;
+                    emit(vm::opcode_t::move, temporary, d);
+                    for (auto& m : copies)
+                        if (m.src == d) m.src = temporary;
+                }
+                for (const auto& m : loads) load(m.dst, m.src);
+            }
+
+            // The moves giving the phis of a block their value coming from
+            // another.
+            auto phi_moves(int from, int to) -> vector<move_t> {
+                auto moves = vector<move_t>();
+                for (const auto id : fn_.blocks[to].instructions) {
+                    const auto& i = fn_[id];
+                    if (i.op != ir::opcode_t::phi) break;
+                    for (auto k = 0u; k < i.blocks.size(); k++) {
+                        if (i.blocks[k] != from) continue;
+                        const auto r = root_[i.operands[k]];
+                        moves.push_back(is_constant(r) ? move_t{register_[id], r, true}
+                                                       : move_t{register_[id], register_[r]});
+                    }
+                }
+                return moves;
+            }
+
+            auto analyse() -> void;
+            auto aliases() -> void;
+            auto allocate() -> void;
+            auto instruction(int id, int next) -> void;
+            auto branch(int block, const ir::instruction_t& i, int next) -> void;
+            auto call(int id) -> void;
+            auto kernel(int id) -> void;
+
+        public:
+            codegen_t(const ir::module_t& module,
+                      const ir::function_t& fn,
+                      program_t& program,
+                      function_t& out)
+                : module_(module), fn_(fn), program_(program), out_(out) {}
+
+            auto run() -> void {
+                analyse();
+                allocate();
+
+                block_pc_.assign(fn_.blocks.size(), -1);
+                for (auto k = 0u; k < order_.size(); k++) {
+                    const auto b = order_[k];
+                    const auto next = k + 1 < order_.size() ? order_[k + 1] : -1;
+                    block_pc_[b] = int(out_.code.size());
+                    for (const auto id : fn_.blocks[b].instructions) {
+                        scratch_ = 0;
+                        const auto& i = fn_[id];
+                        if (i.op == ir::opcode_t::branch)
+                            branch(b, i, next);
+                        else
+                            instruction(id, next);
+                    }
+                }
+
+                // moves on the edges branches can't fall through to.
+                for (auto& stub : stubs_) {
+                    patch(stub.jump, int(out_.code.size()));
+                    scratch_ = 0;
+                    parallel(stub.moves);
+                    jump_to(vm::opcode_t::jmp, stub.target);
+                }
+                for (const auto& [pc, block] : fixups_) patch(pc, block_pc_[block]);
+            }
+        };
+
+
+        auto codegen_t::analyse() -> void {
+            // blocks are laid out in order, which mostly lets code fall
+            // through to the block it continues with.
+            auto reachable = vector<bool>(fn_.blocks.size());
+            for (const auto b : ir::reverse_post_order(fn_)) reachable[b] = true;
+            for (auto b = 0u; b < fn_.blocks.size(); b++)
+                if (reachable[b]) order_.push_back(int(b));
+
+            block_of_.assign(fn_.values.size(), -1);
+            position_.assign(fn_.values.size(), -1);
+            for (const auto b : order_) {
+                const auto& instructions = fn_.blocks[b].instructions;
+                for (auto k = 0u; k < instructions.size(); k++) {
+                    block_of_[instructions[k]] = b;
+                    position_[instructions[k]] = int(k);
+                }
+            }
+
+            for (const auto b : order_)
+                for (const auto id : fn_.blocks[b].instructions) {
+                    const auto& i = fn_[id];
+                    const auto kind = repr(i.type).kind;
+                    if (i.op == ir::opcode_t::slot || i.op == ir::opcode_t::global) {
+                        if (repr(element_type(i.type)).kind == repr_t::none)
+                            fail("The VM can't store values of this type yet", id);
+                    } else if (i.op == ir::opcode_t::parameter && kind == repr_t::none) {
+                        fail("The VM can't pass values of this type yet", id);
+                    } else if (!i.type.get().is<types::void_t>() && kind == repr_t::none) {
+                        fail("The VM can't compute values of this type yet", id);
+                    }
+                }
+            aliases();
+        }
+
+        auto codegen_t::aliases() -> void {
+            const auto uses = ir::users(fn_);
+
+            // conversions which change nothing stand for their operand.
+            auto link = vector<int>(fn_.values.size(), -1);
+            for (const auto b : order_)
+                for (const auto id : fn_.blocks[b].instructions) {
+                    const auto& i = fn_[id];
+                    if (i.op == ir::opcode_t::convert && !converts(fn_[i.operands[0]].type, i.type))
+                        link[id] = i.operands[0];
+                    // and so do views, which hold the same storage.
+                    if (i.op == ir::opcode_t::view) link[id] = i.operands[0];
+                }
+
+            // the instructions using a value, seeing through those.
+            const auto uses_of = [&](int v) {
+                auto result = vector<int>();
+                auto work = vector<int>{v};
+                while (!work.empty()) {
+                    const auto x = work.back();
+                    work.pop_back();
+                    for (const auto u : uses[x])
+                        if (link[u] == x)
+                            work.push_back(u);
+                        else
+                            result.push_back(u);
+                }
+                return result;
+            };
+
+            // a load uses the register of its slot if nothing stores to the
+            // slot before the last use of the value, in the same block.
+            for (const auto b : order_) {
+                const auto& instructions = fn_.blocks[b].instructions;
+                for (auto k = 0u; k < instructions.size(); k++) {
+                    const auto id = instructions[k];
+                    const auto& i = fn_[id];
+                    if (i.op != ir::opcode_t::load || fn_[i.operands[0]].op != ir::opcode_t::slot)
+                        continue;
+
+                    const auto slot = i.operands[0];
+                    auto last = int(k);
+                    auto local = true;
+                    for (const auto u : uses_of(id)) {
+                        local &= block_of_[u] == b && fn_[u].op != ir::opcode_t::phi;
+                        last = max(last, position_[u]);
+                    }
+                    for (auto q = int(k) + 1; local && q < last; q++) {
+                        const auto& j = fn_[instructions[q]];
+                        local = !(j.op == ir::opcode_t::store && j.operands[0] == slot);
+                    }
+                    if (local) link[id] = slot;
+                }
+            }
+
+            root_.resize(fn_.values.size());
+            for (auto v = 0u; v < root_.size(); v++) {
+                auto r = int(v);
+                while (link[r] != -1) r = link[r];
+                root_[v] = r;
+            }
+        }
+
+        auto codegen_t::allocate() -> void {
+            const auto n = fn_.values.size();
+            const auto uses = ir::users(fn_);
+            register_.assign(n, -1);
+
+            // parameters arrive in the first registers; a variable only ever
+            // set to a parameter keeps it there.
+            for (const auto id : fn_.blocks[order_[0]].instructions) {
+                const auto& i = fn_[id];
+                if (i.op != ir::opcode_t::parameter) continue;
+                register_[id] = int(i.immediate);
+                if (uses[id].size() != 1) continue;
+                const auto& u = fn_[uses[id][0]];
+                if (u.op == ir::opcode_t::store && u.operands[1] == id &&
+                    fn_[u.operands[0]].op == ir::opcode_t::slot && register_[u.operands[0]] == -1)
+                    register_[u.operands[0]] = int(i.immediate);
+            }
+            reserved_ = out_.n_parameters;
+            for (const auto b : order_)
+                for (const auto id : fn_.blocks[b].instructions)
+                    if (fn_[id].op == ir::opcode_t::slot && register_[id] == -1)
+                        register_[id] = reserved_++;
+            if (reserved_ > instruction_t::max_register + 1)
+                throw error("Too many variables in \"" + fn_.name + "\"");
+
+            // the values registers are allocated to.
+            const auto allocated = [&](int id) {
+                const auto& i = fn_[id];
+                return root_[id] == id && i.op != ir::opcode_t::constant &&
+                       i.op != ir::opcode_t::global && i.op != ir::opcode_t::slot &&
+                       i.op != ir::opcode_t::parameter &&
+                       !i.type.get().is<types::void_t>();
+            };
+
+            // a value computed only to be stored right away is computed in
+            // the variable's register.
+            auto coalesced = vector<bool>(n);
+            for (const auto b : order_) {
+                const auto& instructions = fn_.blocks[b].instructions;
+                for (auto k = 1u; k < instructions.size(); k++) {
+                    const auto& store = fn_[instructions[k]];
+                    if (store.op != ir::opcode_t::store ||
+                        fn_[store.operands[0]].op != ir::opcode_t::slot)
+                        continue;
+                    const auto v = store.operands[1];
+                    const auto op = fn_[v].op;
+                    if (v != instructions[k - 1] || !allocated(v) || uses[v].size() != 1 ||
+                        op == ir::opcode_t::phi || op == ir::opcode_t::load)
+                        continue;
+                    register_[v] = register_[store.operands[0]];
+                    coalesced[v] = true;
+                }
+            }
+            const auto pooled = [&](int v) {
+                const auto r = root_[v];
+                return allocated(r) && !coalesced[r] ? r : -1;
+            };
+
+            // the values live on entry to each block, phis being defined at
+            // the end of the predecessors, which use their operands there.
+            auto live_in = vector<vector<bool>>(fn_.blocks.size(), vector<bool>(n));
+            auto live_out = live_in;
+            for (auto changed = true; changed;) {
+                changed = false;
+                for (auto k = order_.size(); k-- > 0;) {
+                    const auto b = order_[k];
+                    auto live = vector<bool>(n);
+                    for (const auto s : fn_.successors(b)) {
+                        for (auto v = 0u; v < n; v++)
+                            if (live_in[s][v]) live[v] = true;
+                        for (const auto id : fn_.blocks[s].instructions) {
+                            const auto& i = fn_[id];
+                            if (i.op != ir::opcode_t::phi) break;
+                            for (auto j = 0u; j < i.blocks.size(); j++) {
+                                const auto v = pooled(i.operands[j]);
+                                if (i.blocks[j] == b && v != -1) live[v] = true;
+                            }
+                        }
+                    }
+                    live_out[b] = live;
+
+                    const auto& instructions = fn_.blocks[b].instructions;
+                    for (auto j = instructions.size(); j-- > 0;) {
+                        const auto& i = fn_[instructions[j]];
+                        live[instructions[j]] = false;
+                        if (i.op == ir::opcode_t::phi) continue;
+                        for (const auto v : i.operands)
+                            if (const auto r = pooled(v); r != -1) live[r] = true;
+                    }
+                    if (live != live_in[b]) {
+                        live_in[b] = move(live);
+                        changed = true;
+                    }
+                }
+            }
+
+            // the hull of the positions each value is live at: uses at 2k,
+            // the definition at 2k + 1.
+            auto first = vector<int>(fn_.blocks.size(), -1);
+            auto last = vector<int>(fn_.blocks.size(), -1);
+            auto counter = 0;
+            for (const auto b : order_) {
+                first[b] = counter;
+                counter += int(fn_.blocks[b].instructions.size());
+                last[b] = counter - 1;
+            }
+
+            auto start = vector<int>(n, INT_MAX);
+            auto end = vector<int>(n, -1);
+            const auto extend = [&](int v, int at) {
+                start[v] = min(start[v], at);
+                end[v] = max(end[v], at);
+            };
+            for (const auto b : order_) {
+                for (auto v = 0u; v < n; v++) {
+                    if (live_in[b][v]) extend(int(v), 2 * first[b]);
+                    if (live_out[b][v]) extend(int(v), 2 * last[b] + 1);
+                }
+                const auto& instructions = fn_.blocks[b].instructions;
+                for (auto k = 0u; k < instructions.size(); k++) {
+                    const auto id = instructions[k];
+                    const auto& i = fn_[id];
+                    const auto at = first[b] + int(k);
+                    if (pooled(id) == id) extend(id, 2 * at + 1);
+                    if (i.op == ir::opcode_t::phi) {
+                        for (const auto p : i.blocks)
+                            if (first[p] != -1) extend(id, 2 * last[p] + 1);
+                        continue;
+                    }
+                    for (const auto v : i.operands)
+                        if (const auto r = pooled(v); r != -1) extend(r, 2 * at);
+                }
+            }
+
+            // the lowest register free over the whole interval.
+            auto values = vector<int>();
+            for (auto v = 0u; v < n; v++)
+                if (end[v] != -1) values.push_back(int(v));
+            sort(values.begin(), values.end(), [&](int a, int b) { return start[a] < start[b]; });
+
+            auto busy_until = vector<int>();
+            top_ = reserved_;
+            for (const auto v : values) {
+                auto r = 0u;
+                while (r < busy_until.size() && busy_until[r] >= start[v]) r++;
+                if (r == busy_until.size()) busy_until.push_back(-1);
+                busy_until[r] = end[v];
+                register_[v] = reserved_ + int(r);
+                top_ = max(top_, register_[v] + 1);
+            }
+            if (top_ > instruction_t::max_register + 1)
+                throw error("Too many values live at once in \"" + fn_.name + "\"");
+            use(max(top_ - 1, 0));
+
+            // a callee's frame starts above every register still needed
+            // after the call.
+            call_bases_.assign(n, -1);
+            for (const auto b : order_)
+                for (const auto id : fn_.blocks[b].instructions) {
+                    if (fn_[id].op != ir::opcode_t::call) continue;
+                    const auto at = 2 * (first[b] + position_[id]) + 1;
+                    auto base = reserved_;
+                    for (const auto v : values)
+                        if (start[v] < at && end[v] > at) base = max(base, register_[v] + 1);
+                    call_bases_[id] = base;
+                }
+        }
+
+        auto codegen_t::instruction(int id, int next) -> void {
+            const auto& i = fn_[id];
+            const auto dst = register_[id];
+            const auto r = repr(i.type);
+            const auto f = r.kind == repr_t::floating;
+            const auto s = r.kind == repr_t::signed_int;
+
+            switch (i.op) {
+            case ir::opcode_t::constant:
+            case ir::opcode_t::parameter:
+            case ir::opcode_t::slot:
+            case ir::opcode_t::global:
+            case ir::opcode_t::phi: return;
+
+            case ir::opcode_t::add:
+            case ir::opcode_t::sub:
+            case ir::opcode_t::mul:
+            case ir::opcode_t::div:
+            case ir::opcode_t::rem:
+            case ir::opcode_t::pow:
+            case ir::opcode_t::band:
+            case ir::opcode_t::bor:
+            case ir::opcode_t::bxor: {
+                if (r.kind == repr_t::array) {
+                    kernel(id);
+                    return;
+                }
+                auto code = vm::opcode_t::count;
+                switch (i.op) {
+                case ir::opcode_t::add: code = f ? vm::opcode_t::add_f : vm::opcode_t::add_i; break;
+                case ir::opcode_t::sub: code = f ? vm::opcode_t::sub_f : vm::opcode_t::sub_i; break;
+                case ir::opcode_t::mul: code = f ? vm::opcode_t::mul_f : vm::opcode_t::mul_i; break;
+                case ir::opcode_t::div:
+                    code = f ? vm::opcode_t::div_f : s ? vm::opcode_t::div_i : vm::opcode_t::div_u;
+                    break;
+                case ir::opcode_t::rem:
+                    code = f ? vm::opcode_t::rem_f : s ? vm::opcode_t::rem_i : vm::opcode_t::rem_u;
+                    break;
+                case ir::opcode_t::pow: code = f ? vm::opcode_t::pow_f : vm::opcode_t::pow_i; break;
+                case ir::opcode_t::band: code = vm::opcode_t::band; break;
+                case ir::opcode_t::bor: code = vm::opcode_t::bor; break;
+                default: code = vm::opcode_t::bxor; break;
+                }
+                const auto a = operand(i.operands[0]);
+                const auto b = operand(i.operands[1]);
+                emit(code, dst, a, b);
+                // bitwise operations keep extended operands extended.
+                if (i.op != ir::opcode_t::band && i.op != ir::opcode_t::bor &&
+                    i.op != ir::opcode_t::bxor)
+                    narrow(dst, dst, r);
+                return;
+            }
+            case ir::opcode_t::neg:
+                emit(f ? vm::opcode_t::neg_f : vm::opcode_t::neg_i, dst, operand(i.operands[0]));
+                narrow(dst, dst, r);
+                return;
+            case ir::opcode_t::bnot:
+                emit(vm::opcode_t::bnot, dst, operand(i.operands[0]));
+                narrow(dst, dst, r);
+                return;
+
+            case ir::opcode_t::eq:
+            case ir::opcode_t::ne:
+            case ir::opcode_t::lt:
+            case ir::opcode_t::le:
+            case ir::opcode_t::gt:
+            case ir::opcode_t::ge: {
+                if (r.kind == repr_t::array) {
+                    kernel(id);
+                    return;
+                }
+                const auto t = repr(fn_[i.operands[0]].type);
+                const auto tf = t.kind == repr_t::floating;
+                const auto ts = t.kind == repr_t::signed_int;
+                auto a = operand(i.operands[0]);
+                auto b = operand(i.operands[1]);
+                if (i.op == ir::opcode_t::gt || i.op == ir::opcode_t::ge) swap(a, b);
+                const auto code =
+                    i.op == ir::opcode_t::eq   ? (tf ? vm::opcode_t::eq_f : vm::opcode_t::eq_i)
+                    : i.op == ir::opcode_t::ne ? (tf ? vm::opcode_t::ne_f : vm::opcode_t::ne_i)
+                    : i.op == ir::opcode_t::lt || i.op == ir::opcode_t::gt
+                        ? (tf ? vm::opcode_t::lt_f : ts ? vm::opcode_t::lt_i : vm::opcode_t::lt_u)
+                        : (tf ? vm::opcode_t::le_f : ts ? vm::opcode_t::le_i : vm::opcode_t::le_u);
+                emit(code, dst, a, b);
+                return;
+            }
+            case ir::opcode_t::lnot: emit(vm::opcode_t::not_b, dst, operand(i.operands[0])); return;
+
+            case ir::opcode_t::convert: {
+                if (root_[id] != id) return;
+                const auto from = repr(fn_[i.operands[0]].type);
+                const auto x = operand(i.operands[0]);
+                if (from.integral() && f) {
+                    emit(from.kind == repr_t::signed_int ? vm::opcode_t::i2f : vm::opcode_t::u2f,
+                         dst,
+                         x);
+                    narrow(dst, dst, r);
+                } else if (from.kind == repr_t::floating && r.integral()) {
+                    emit(s ? vm::opcode_t::f2i : vm::opcode_t::f2u, dst, x);
+                    narrow(dst, dst, r);
+                } else {
+                    narrow(dst, x, r);
+                }
+                return;
+            }
+
+            case ir::opcode_t::load: {
+                if (root_[id] != id) return;
+                const auto& address = fn_[i.operands[0]];
+                if (address.op == ir::opcode_t::global)
+                    emit(instruction_t::abx(vm::opcode_t::getg, dst, int(address.immediate)));
+                else
+                    emit(vm::opcode_t::move, dst, register_[i.operands[0]]);
+                use(dst);
+                return;
+            }
+            case ir::opcode_t::store: {
+                const auto& address = fn_[i.operands[0]];
+                const auto v = root_[i.operands[1]];
+                if (address.op == ir::opcode_t::global) {
+                    const auto x = operand(v);
+                    emit(instruction_t::abx(vm::opcode_t::setg, x, int(address.immediate)));
+                } else if (is_constant(v)) {
+                    load(register_[i.operands[0]], v);
+                } else if (register_[v] != register_[i.operands[0]]) {
+                    emit(vm::opcode_t::move, register_[i.operands[0]], register_[v]);
+                }
+                return;
+            }
+
+            case ir::opcode_t::array: {
+                const auto element = i.type.get().as<types::array_t>().value_type;
+                const auto constant_elements =
+                    repr(element).kind != repr_t::array &&
+                    all_of(i.operands.begin(), i.operands.end(), [&](int v) {
+                        return is_constant(root_[v]);
+                    });
+
+                // arrays of constants are built once.
+                if (constant_elements) {
+                    auto elements = array_t();
+                    for (const auto v : i.operands)
+                        elements.push_back(value_t{.u = fn_[root_[v]].immediate});
+                    program_.arrays.push_back(make_unique<array_t>(move(elements)));
+                    const auto a = value_t{.a = program_.arrays.back().get()};
+                    emit(instruction_t::abx(vm::opcode_t::loadk, dst, constant(a)));
+                    use(dst);
+                    return;
+                }
+
+                const auto base = top_;
+                const auto count = int(i.operands.size());
+                if (base + count > instruction_t::max_register)
+                    fail("The VM can't build arrays of this many computed elements yet", id);
+                auto moves = vector<move_t>();
+                for (auto k = 0; k < count; k++) {
+                    const auto v = root_[i.operands[k]];
+                    moves.push_back(is_constant(v) ? move_t{base + k, v, true}
+                                                   : move_t{base + k, register_[v]});
+                }
+                scratch_ = count;
+                parallel(move(moves));
+                emit(vm::opcode_t::newarr, dst, base, count);
+                return;
+            }
+            case ir::opcode_t::length: emit(vm::opcode_t::len, dst, operand(i.operands[0])); return;
+            case ir::opcode_t::index: {
+                const auto a = operand(i.operands[0]);
+                const auto x = operand(i.operands[1]);
+                emit(vm::opcode_t::index, dst, a, x);
+                return;
+            }
+            case ir::opcode_t::view: return;
+            case ir::opcode_t::reduce: {
+                const auto& t = fn_[i.operands[0]].type;
+                const auto lane = vm::lane(i.type);
+                if (!lane) fail("The VM has no kernel for arrays of this type", id);
+                const auto code = vm::kernel_code(vm::reduction_t(i.immediate), *lane);
+                const auto s = t.get().get_if<types::slice_t>();
+                if (!s) {
+                    emit(instruction_t::abc(
+                        vm::opcode_t::reduce, dst, operand(i.operands[0]), code));
+                    use(dst);
+                    return;
+                }
+
+                // slices are reduced as views, which kernel describes.
+                const auto base = top_;
+                if (base + 4 > instruction_t::max_register)
+                    throw error("Too many values live at once in \"" + fn_.name + "\"");
+                const auto v = root_[i.operands[0]];
+                scratch_ = 4;
+                parallel({is_constant(v) ? move_t{base, v, true} : move_t{base, register_[v]}});
+                immediate(base + 1, value_t{.i = s->begin});
+                immediate(base + 2, value_t{.i = s->stride});
+                immediate(base + 3, value_t{.u = analysis::slice_count(*s)});
+                use(dst);
+                emit(instruction_t::abc(vm::opcode_t::reduce_strided, dst, base, code));
+                return;
+            }
+
+            case ir::opcode_t::format: {
+                // the kinds of the pieces go before them, in an array built
+                // once.
+                const auto base = top_;
+                const auto count = int(i.operands.size());
+                if (base + count + 1 > instruction_t::max_register)
+                    fail("The VM can't interpolate this many values in a string yet", id);
+                auto pieces = array_t();
+                auto moves = vector<move_t>();
+                for (auto k = 0; k < count; k++) {
+                    const auto v = root_[i.operands[k]];
+                    pieces.push_back(value_t{.u = uint64_t(piece(fn_[i.operands[k]].type))});
+                    moves.push_back(is_constant(v) ? move_t{base + 1 + k, v, true}
+                                                   : move_t{base + 1 + k, register_[v]});
+                }
+                program_.arrays.push_back(make_unique<array_t>(move(pieces)));
+                const auto kinds = value_t{.a = program_.arrays.back().get()};
+                scratch_ = count + 1;
+                parallel(move(moves));
+                emit(instruction_t::abx(vm::opcode_t::loadk, base, constant(kinds)));
+                use(dst);
+                emit(vm::opcode_t::format, dst, base, count);
+                return;
+            }
+
+            case ir::opcode_t::mark: emit(vm::opcode_t::mark, dst); return;
+            case ir::opcode_t::release: emit(vm::opcode_t::release, operand(i.operands[0])); return;
+
+            case ir::opcode_t::call: call(id); return;
+
+            case ir::opcode_t::jump: {
+                const auto block = block_of_[id];
+                parallel(phi_moves(block, i.blocks[0]));
+                if (i.blocks[0] != next) jump_to(vm::opcode_t::jmp, i.blocks[0]);
+                return;
+            }
+            case ir::opcode_t::ret:
+                emit(vm::opcode_t::ret, i.operands.empty() ? 0 : operand(i.operands[0]));
+                return;
+
+            default: fail("The VM can't run this instruction yet", id);
+            }
+        }
+
+        // Element-wise operations on arrays take their operands in two
+        // consecutive registers, as newarr does its elements; with a slice,
+        // each operand as a view, the storage followed by the index of the
+        // first element and how far apart elements are, and the number of
+        // elements after both.
+        auto codegen_t::kernel(int id) -> void {
+            const auto& i = fn_[id];
+            const auto lane = vm::lane(*analysis::numeric_elements(fn_[i.operands[0]].type));
+            if (!lane) fail("The VM has no kernel for arrays of this type", id);
+
+            auto x = i.operands[0], y = i.operands[1];
+            if (i.op == ir::opcode_t::gt || i.op == ir::opcode_t::ge) swap(x, y);
+            auto op = vm::kernel_op_t::count;
+            switch (i.op) {
+            case ir::opcode_t::add: op = vm::kernel_op_t::add; break;
+            case ir::opcode_t::sub: op = vm::kernel_op_t::sub; break;
+            case ir::opcode_t::mul: op = vm::kernel_op_t::mul; break;
+            case ir::opcode_t::div: op = vm::kernel_op_t::div; break;
+            case ir::opcode_t::eq: op = vm::kernel_op_t::eq; break;
+            case ir::opcode_t::ne: op = vm::kernel_op_t::ne; break;
+            case ir::opcode_t::lt:
+            case ir::opcode_t::gt: op = vm::kernel_op_t::lt; break;
+            case ir::opcode_t::le:
+            case ir::opcode_t::ge: op = vm::kernel_op_t::le; break;
+            default: fail("The VM can't run this instruction on arrays yet", id);
+            }
+
+            const auto slice = [&](int v) { return fn_[v].type.get().get_if<types::slice_t>(); };
+            const auto strided = slice(x) || slice(y);
+            const auto step = strided ? 3 : 1;
+            const auto width = strided ? 7 : 2;
+            const auto base = top_;
+            if (base + width > instruction_t::max_register)
+                throw error("Too many values live at once in \"" + fn_.name + "\"");
+            auto moves = vector<move_t>();
+            for (const auto [k, v] : {pair(0, root_[x]), pair(1, root_[y])})
+                moves.push_back(is_constant(v) ? move_t{base + k * step, v, true}
+                                               : move_t{base + k * step, register_[v]});
+            scratch_ = width;
+            parallel(move(moves));
+            if (strided) {
+                for (const auto [k, v] : {pair(0, x), pair(1, y)}) {
+                    const auto s = slice(v);
+                    immediate(base + k * step + 1, value_t{.i = s ? s->begin : 0});
+                    immediate(base + k * step + 2, value_t{.i = s ? s->stride : 1});
+                }
+                immediate(base + 6, value_t{.u = *analysis::element_count(i.type)});
+            }
+            use(base + width - 1);
+            use(register_[id]);
+            const auto code = vm::kernel_code(op, *lane);
+            const auto kernel = strided ? vm::opcode_t::kernel_strided : vm::opcode_t::kernel;
+            emit(instruction_t::abc(kernel, register_[id], base, code));
+        }
+
+        auto codegen_t::branch(int block, const ir::instruction_t& i, int next) -> void {
+            const auto t = i.blocks[0];
+            const auto f = i.blocks[1];
+            const auto c = root_[i.operands[0]];
+
+            // branches on constants and to one block either way only jump.
+            if (is_constant(c) || t == f) {
+                const auto target = t == f || fn_[c].immediate ? t : f;
+                parallel(phi_moves(block, target));
+                if (target != next) jump_to(vm::opcode_t::jmp, target);
+                return;
+            }
+
+            const auto test = register_[c];
+            const auto on_true = phi_moves(block, t);
+            const auto on_false = phi_moves(block, f);
+            // the moves of one edge go out of line, so the other falls
+            // through.
+            const auto stub = [&](vm::opcode_t op, vector<move_t> moves, int target) {
+                const auto pc = emit(instruction_t::abx(op, test, 0));
+                stubs_.push_back(stub_t{pc, move(moves), target});
+            };
+
+            if (on_false.empty()) {
+                if (on_true.empty() && f == next) {
+                    jump_to(vm::opcode_t::jmp_if, t, test);
+                    return;
+                }
+                jump_to(vm::opcode_t::jmp_ifnot, f, test);
+                parallel(on_true);
+                if (t != next) jump_to(vm::opcode_t::jmp, t);
+            } else if (on_true.empty() && t != next) {
+                jump_to(vm::opcode_t::jmp_if, t, test);
+                parallel(on_false);
+                if (f != next) jump_to(vm::opcode_t::jmp, f);
+            } else {
+                stub(vm::opcode_t::jmp_ifnot, on_false, f);
+                parallel(on_true);
+                if (t != next) jump_to(vm::opcode_t::jmp, t);
+            }
+        }
+
+        // Arguments go to consecutive registers from the base of the callee's
+        // frame, where the result comes back.
+        auto codegen_t::call(int id) -> void {
+            const auto& i = fn_[id];
+            const auto base = call_bases_[id];
+            const auto count = int(i.operands.size());
+            if (i.immediate >= module_.functions.size())
+                fail("Call to an unknown function", id);
+
+            auto moves = vector<move_t>();
+            for (auto k = 0; k < count; k++) {
+                const auto v = root_[i.operands[k]];
+                moves.push_back(is_constant(v) ? move_t{base + k, v, true}
+                                               : move_t{base + k, register_[v]});
+            }
+            scratch_ = max(scratch_, base + count - top_);
+            use(base + max(count - 1, 0));
+            parallel(move(moves));
+            emit(instruction_t::abx(vm::opcode_t::call, base, int(i.immediate)));
+
+            const auto dst = register_[id];
+            if (dst != -1 && dst != base) emit(vm::opcode_t::move, dst, base);
+        }
+    }  // namespace
+
+    auto lower(const ir::module_t& module) -> program_t {
+        auto program = program_t();
+        program.result_type = module.result_type;
+
+        if (module.globals.size() > size_t(instruction_t::max_bx) + 1)
+            throw error("Too many globals");
+        for (const auto& g : module.globals) program.globals.push_back(g.name);
+
+        if (module.functions.size() > size_t(instruction_t::max_bx) + 1)
+            throw error("Too many functions");
+        for (const auto& fn : module.functions) {
+            auto& out = program.functions.emplace_back();
+            out.name = fn.name;
+            out.type = fn.type;
+            if (const auto f = fn.type.get().get_if<types::function_t>())
+                out.n_parameters = int(f->formal_parameters.size());
+        }
+        for (auto f = 0u; f < module.functions.size(); f++)
+            codegen_t(module, module.functions[f], program, program.functions[f]).run();
+        program.literals.seal();
+        return program;
+    }
+
+    auto lower(const parser::syntax::attr_node_t<type_t>& ast) -> program_t {
+        try {
+            return lower(ir::lower(ast));
+        } catch (const ir::error& e) {
+            throw error(e.what());
+        }
+    }
+}}  // namespace bt::vm
@@ -0,0 +1,245 @@
+#include <bit>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+
+#include <bullet/vm/bytecode.hpp>
+#include <bullet/vm/string.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define BT_READ_ONLY_LITERALS 1
+#else
+#define BT_READ_ONLY_LITERALS 0
+#endif
+
+namespace bt { namespace vm {
+    using namespace std;
+
+    static_assert(endian::native == endian::little,
+                  "strings tell small from large ones by the last byte of their capacity");
+
+    string_t::string_t() noexcept { reset(); }
+
+    string_t::string_t(string_view text) {
+        if (text.size() <= small_capacity) {
+            memcpy(bytes_, text.data(), text.size());
+            bytes_[text.size()] = 0;
+            bytes_[sizeof bytes_ - 1] = static_cast<unsigned char>(small_capacity - text.size());
+            return;
+        }
+        auto* data = static_cast<char*>(allocate_block(text.size()));
+        memcpy(data, text.data(), text.size());
+        set(data, text.size(), text.size());
+    }
+
+    string_t::string_t(string_t&& other) noexcept {
+        memcpy(bytes_, other.bytes_, sizeof bytes_);
+        other.reset();
+    }
+
+    auto string_t::operator=(string_t&& other) noexcept -> string_t& {
+        if (this != &other) {
+            this->~string_t();
+            memcpy(bytes_, other.bytes_, sizeof bytes_);
+            other.reset();
+        }
+        return *this;
+    }
+
+    string_t::~string_t() {
+        if (!is_small() && !is_borrowed()) free_block(get().data, get().capacity);
+    }
+
+    auto string_t::borrow(string_view text) noexcept -> string_t {
+        auto s = string_t();
+        s.set(const_cast<char*>(text.data()), text.size(), 0);
+        return s;
+    }
+
+    auto string_t::uninitialized(size_t n) -> string_t {
+        auto s = string_t();
+        if (n <= small_capacity) {
+            s.bytes_[n] = 0;
+            s.bytes_[sizeof s.bytes_ - 1] = static_cast<unsigned char>(small_capacity - n);
+        } else {
+            s.set(static_cast<char*>(allocate_block(n)), n, n);
+        }
+        return s;
+    }
+
+    auto string_t::clone() const -> string_t {
+        if (is_borrowed()) return borrow(view());
+        return string_t(view());
+    }
+
+    auto string_t::data() const noexcept -> const char* {
+        return is_small() ? reinterpret_cast<const char*>(bytes_) : get().data;
+    }
+
+    auto string_t::size() const noexcept -> size_t {
+        return is_small() ? small_capacity - tag() : get().size;
+    }
+
+    auto string_t::buffer() noexcept -> char* {
+        return is_small() ? reinterpret_cast<char*>(bytes_) : get().data;
+    }
+
+    auto string_t::is_borrowed() const noexcept -> bool { return !is_small() && !get().capacity; }
+
+    auto string_t::get() const noexcept -> large_t {
+        auto l = large_t();
+        memcpy(&l, bytes_, sizeof l);
+        l.capacity &= ~(size_t(0xff) << 56);
+        return l;
+    }
+
+    auto string_t::set(char* data, size_t size, size_t capacity) noexcept -> void {
+        const auto l = large_t{data, size, capacity | size_t(large) << 56};
+        memcpy(bytes_, &l, sizeof l);
+    }
+
+    auto string_t::reset() noexcept -> void {
+        bytes_[0] = 0;
+        bytes_[sizeof bytes_ - 1] = static_cast<unsigned char>(small_capacity);
+    }
+
+    auto operator==(const string_t& lhs, const string_t& rhs) -> bool {
+        return lhs.view() == rhs.view();
+    }
+
+    auto operator<<(ostream& os, const string_t& s) -> ostream& { return os << s.view(); }
+
+    // Pages holding the text of literals: written, then made read only.
+    struct literal_pool_t::pages_t {
+        explicit pages_t(const string& text) : size(text.size()) {
+#if BT_READ_ONLY_LITERALS
+            void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                           -1, 0);
+            if (p == MAP_FAILED) throw bad_alloc();
+            memcpy(p, text.data(), size);
+            mprotect(p, size, PROT_READ);
+            data = static_cast<const char*>(p);
+#else
+            auto* p = new char[size];
+            memcpy(p, text.data(), size);
+            data = p;
+#endif
+        }
+
+        pages_t(const pages_t&) = delete;
+        auto operator=(const pages_t&) -> pages_t& = delete;
+
+        ~pages_t() {
+#if BT_READ_ONLY_LITERALS
+            munmap(const_cast<char*>(data), size);
+#else
+            delete[] data;
+#endif
+        }
+
+        const char* data = nullptr;
+        size_t size;
+    };
+
+    literal_pool_t::literal_pool_t() = default;
+    literal_pool_t::literal_pool_t(literal_pool_t&&) noexcept = default;
+    auto literal_pool_t::operator=(literal_pool_t&&) noexcept -> literal_pool_t& = default;
+    literal_pool_t::~literal_pool_t() = default;
+
+    auto literal_pool_t::intern(string_view text) -> const string_t* {
+        const auto [it, fresh] = index_.try_emplace(string(text), nullptr);
+        if (fresh) {
+            literals_.push_back(make_unique<string_t>(text));
+            it->second = literals_.back().get();
+            bytes_ += text.size();
+        }
+        return it->second;
+    }
+
+    auto literal_pool_t::seal() -> void {
+        auto text = string();
+        for (auto k = sealed_; k < literals_.size(); k++) text += literals_[k]->view();
+        if (text.empty()) {
+            sealed_ = literals_.size();
+            return;
+        }
+
+        pages_.push_back(make_unique<pages_t>(text));
+        auto at = pages_.back()->data;
+        for (; sealed_ < literals_.size(); sealed_++) {
+            auto& literal = *literals_[sealed_];
+            const auto n = literal.size();
+            literal = string_t::borrow(string_view(at, n));
+            at += n;
+        }
+    }
+
+    namespace {
+        // writes a number or bool to the end of s, as print_value does.
+        auto append(string& s, value_t v, piece_t piece) -> void {
+            char digits[32];
+            auto n = 0;
+            switch (piece) {
+            case piece_t::signed_int:
+                n = int(to_chars(digits, end(digits), v.i).ptr - digits);
+                break;
+            case piece_t::unsigned_int:
+                n = int(to_chars(digits, end(digits), v.u).ptr - digits);
+                break;
+            case piece_t::f32:
+                n = snprintf(digits, sizeof digits, "%g", double(float(v.f)));
+                break;
+            case piece_t::f64: n = snprintf(digits, sizeof digits, "%g", v.f); break;
+            case piece_t::boolean: s += v.u ? "true" : "false"; return;
+            case piece_t::text: return;
+            }
+            s.append(digits, size_t(n));
+        }
+    }  // namespace
+
+    auto format(const value_t* values, const value_t* pieces, size_t n, arena_t& arena)
+        -> const string_t* {
+        // numbers are written out first, one after the other, to know the
+        // size of the whole.
+        thread_local auto numbers = string();
+        thread_local auto ends = vector<size_t>();
+        numbers.clear();
+        ends.clear();
+        auto size = size_t(0);
+        for (auto k = size_t(0); k < n; k++) {
+            const auto piece = piece_t(pieces[k].u);
+            if (piece == piece_t::text) {
+                size += values[k].s->size();
+                continue;
+            }
+            append(numbers, values[k], piece);
+            ends.push_back(numbers.size());
+        }
+        size += numbers.size();
+
+        // small strings are written in place, larger ones borrow their text
+        // from the arena.
+        auto* result = size <= string_t::small_capacity
+                           ? arena.make<string_t>(string_t::uninitialized(size))
+                           : nullptr;
+        auto* text = result ? result->buffer() : static_cast<char*>(arena.bump(size, 1));
+        auto* out = text;
+        auto number = size_t(0);
+        for (auto k = size_t(0); k < n; k++) {
+            auto piece = string_view();
+            if (piece_t(pieces[k].u) == piece_t::text) {
+                piece = values[k].s->view();
+            } else {
+                const auto from = number ? ends[number - 1] : 0;
+                piece = string_view(numbers).substr(from, ends[number] - from);
+                number++;
+            }
+            memcpy(out, piece.data(), piece.size());
+            out += piece.size();
+        }
+        if (!result) result = arena.make<string_t>(string_t::borrow(string_view(text, size)));
+        return result;
+    }
+}}  // namespace bt::vm
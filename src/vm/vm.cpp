@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <type_traits>
+
+#include <bullet/vm/kernels.hpp>
+#include <bullet/vm/vm.hpp>
+
+#if defined(BT_VM_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define BT_VM_THREADED 1
+#else
+#define BT_VM_THREADED 0
+#endif
+
+namespace bt { namespace vm {
+    using namespace std;
+
+    namespace {
+        constexpr auto threaded = bool(BT_VM_THREADED);
+        constexpr auto max_native_depth = size_t(1) << 16;
+
+        template <typename Code>
+        struct frame_t {
+            const function_t* function;
+            const Code* pc;
+            value_t* base;
+        };
+
+        template <typename Code>
+        auto word(const Code& code) -> instruction_t {
+            if constexpr (is_same_v<Code, instruction_t>)
+                return code;
+            else
+                return code.i;
+        }
+    }  // namespace
+
+    vm_t::vm_t(size_t stack_size) : stack_(stack_size) {}
+
+    auto vm_t::run(const program_t& program) -> value_t {
+        return execute<false>(program, nullptr);
+    }
+
+    auto vm_t::run(const program_t& program, profile_t& profile) -> value_t {
+        return execute<true>(program, &profile);
+    }
+
+    auto vm_t::dispatch() -> string_view { return threaded ? "threaded" : "switch"; }
+
+    // Handlers are written once for both dispatch modes: OP labels a handler,
+    // NEXT ends it. With threaded dispatch, NEXT fetches the following
+    // instruction and jumps to its handler directly, so that every handler has
+    // a jump of its own for the branch predictor to learn; with a switch, it
+    // goes back to the one shared jump.
+#define RA base[i.a()]
+#define RB base[i.b()]
+#define RC base[i.c()]
+#if BT_VM_THREADED
+#define OP(name) op_##name
+#define NEXT()                                                                                     \
+    do {                                                                                           \
+        i = pc->i;                                                                                 \
+        count(i.op());                                                                             \
+        goto *(pc++)->handler;                                                                     \
+    } while (false)
+#else
+#define OP(name) case opcode_t::name
+#define NEXT() continue
+#endif
+
+    template <bool profiling>
+    auto vm_t::execute(const program_t& program, profile_t* profile) -> value_t {
+        using code_t = conditional_t<threaded, threaded_t, instruction_t>;
+
+        arena_.clear();
+        globals_.assign(program.globals.size(), value_t{0});
+
+#if BT_VM_THREADED
+        auto handlers = array<const void*, size_t(opcode_t::count) + 1>();
+        handlers.fill(&&op_invalid);
+#define HANDLER(name) handlers[size_t(opcode_t::name)] = &&op_##name
+        HANDLER(move), HANDLER(loadk), HANDLER(loadi), HANDLER(getg), HANDLER(setg);
+        HANDLER(add_i), HANDLER(sub_i), HANDLER(mul_i), HANDLER(div_i), HANDLER(div_u);
+        HANDLER(rem_i), HANDLER(rem_u), HANDLER(pow_i), HANDLER(neg_i);
+        HANDLER(band), HANDLER(bor), HANDLER(bxor), HANDLER(bnot);
+        HANDLER(add_f), HANDLER(sub_f), HANDLER(mul_f), HANDLER(div_f), HANDLER(rem_f);
+        HANDLER(pow_f), HANDLER(neg_f);
+        HANDLER(eq_i), HANDLER(ne_i), HANDLER(lt_i), HANDLER(le_i), HANDLER(lt_u), HANDLER(le_u);
+        HANDLER(eq_f), HANDLER(ne_f), HANDLER(lt_f), HANDLER(le_f), HANDLER(not_b);
+        HANDLER(i2f), HANDLER(u2f), HANDLER(f2i), HANDLER(f2u);
+        HANDLER(sext8), HANDLER(sext16), HANDLER(sext32);
+        HANDLER(zext8), HANDLER(zext16), HANDLER(zext32), HANDLER(round_f32);
+        HANDLER(newarr), HANDLER(len), HANDLER(index), HANDLER(kernel), HANDLER(reduce);
+        HANDLER(kernel_strided), HANDLER(reduce_strided), HANDLER(format);
+        HANDLER(mark), HANDLER(release);
+        HANDLER(jmp), HANDLER(jmp_if), HANDLER(jmp_ifnot), HANDLER(call), HANDLER(ret);
+        HANDLER(lt_i_jmp_ifnot), HANDLER(le_i_jmp_ifnot), HANDLER(lt_u_jmp_ifnot);
+        HANDLER(le_u_jmp_ifnot), HANDLER(eq_i_jmp_ifnot), HANDLER(ne_i_jmp_ifnot);
+        HANDLER(loadi_add_i), HANDLER(loadi_sub_i), HANDLER(getg_add_i_setg), HANDLER(add_i_jmp);
+#undef HANDLER
+
+        threaded_.resize(program.functions.size());
+        for (auto f = 0u; f < program.functions.size(); f++) {
+            const auto& code = program.functions[f].code;
+            auto& translated = threaded_[f];
+            translated.resize(code.size());
+            for (auto pc = 0u; pc < code.size(); pc++)
+                translated[pc] = threaded_t{handlers[min(size_t(code[pc].op()),
+                                                         size_t(opcode_t::count))],
+                                            code[pc]};
+        }
+        const auto code_of = [&](size_t f) -> const code_t* { return threaded_[f].data(); };
+#else
+        const auto code_of = [&](size_t f) -> const code_t* {
+            return program.functions[f].code.data();
+        };
+#endif
+
+        const auto stack_end = stack_.data() + stack_.size();
+        const auto max_depth = stack_.size() / 4;
+        auto frames = vector<frame_t<code_t>>();
+
+        const auto* fn = &program.functions.front();
+        const auto* pc = code_of(0);
+        auto* base = stack_.data();
+        auto* k = fn->constants.data();
+        auto* g = globals_.data();
+        auto executed = uint64_t(0);
+        auto i = instruction_t();
+        auto last = opcode_t::count;
+
+        // native frames live on the machine's stack as well, so they nest
+        // less deeply.
+        const auto* native = program.native.empty() ? nullptr : program.native.data();
+        auto context = native_context_t{g, stack_end, int64_t(min(max_depth, max_native_depth)),
+                                        nullptr, &arena_};
+
+        if (base + fn->n_registers > stack_end) throw error("Stack overflow");
+
+        const auto fail = [&](const char* what) {
+            executed_ = executed;
+            throw error(what);
+        };
+        const auto count = [&](opcode_t op) {
+            executed++;
+            if constexpr (profiling) {
+                if (last != opcode_t::count) profile->record(last, op);
+                last = op;
+            }
+        };
+
+#if BT_VM_THREADED
+        i = pc->i;
+        count(i.op());
+        goto *(pc++)->handler;
+#else
+        while (true) {
+            i = *pc++;
+            count(i.op());
+
+            switch (i.op()) {
+#endif
+        OP(move): RA = RB; NEXT();
+        OP(loadk): RA = k[i.bx()]; NEXT();
+        OP(loadi): RA.i = i.sbx(); NEXT();
+        OP(getg): RA = g[i.bx()]; NEXT();
+        OP(setg): g[i.bx()] = RA; NEXT();
+
+        OP(add_i): RA.u = RB.u + RC.u; NEXT();
+        OP(sub_i): RA.u = RB.u - RC.u; NEXT();
+        OP(mul_i): RA.u = RB.u * RC.u; NEXT();
+        OP(div_i): {
+            if (RC.i == 0) fail("Integer division by zero");
+            // the one quotient which overflows wraps around, like the others.
+            RA.i = RC.i == -1 ? int64_t(0 - RB.u) : RB.i / RC.i;
+            NEXT();
+        }
+        OP(div_u): {
+            if (RC.u == 0) fail("Integer division by zero");
+            RA.u = RB.u / RC.u;
+            NEXT();
+        }
+        OP(rem_i): {
+            if (RC.i == 0) fail("Integer division by zero");
+            RA.i = RC.i == -1 ? 0 : RB.i % RC.i;
+            NEXT();
+        }
+        OP(rem_u): {
+            if (RC.u == 0) fail("Integer division by zero");
+            RA.u = RB.u % RC.u;
+            NEXT();
+        }
+        OP(pow_i): RA.i = ipow(RB.i, RC.i); NEXT();
+        OP(neg_i): RA.u = 0 - RB.u; NEXT();
+        OP(band): RA.u = RB.u & RC.u; NEXT();
+        OP(bor): RA.u = RB.u | RC.u; NEXT();
+        OP(bxor): RA.u = RB.u ^ RC.u; NEXT();
+        OP(bnot): RA.u = ~RB.u; NEXT();
+
+        OP(add_f): RA.f = RB.f + RC.f; NEXT();
+        OP(sub_f): RA.f = RB.f - RC.f; NEXT();
+        OP(mul_f): RA.f = RB.f * RC.f; NEXT();
+        OP(div_f): RA.f = RB.f / RC.f; NEXT();
+        OP(rem_f): RA.f = fmod(RB.f, RC.f); NEXT();
+        OP(pow_f): RA.f = pow(RB.f, RC.f); NEXT();
+        OP(neg_f): RA.f = -RB.f; NEXT();
+
+        OP(eq_i): RA.u = RB.u == RC.u; NEXT();
+        OP(ne_i): RA.u = RB.u != RC.u; NEXT();
+        OP(lt_i): RA.u = RB.i < RC.i; NEXT();
+        OP(le_i): RA.u = RB.i <= RC.i; NEXT();
+        OP(lt_u): RA.u = RB.u < RC.u; NEXT();
+        OP(le_u): RA.u = RB.u <= RC.u; NEXT();
+        OP(eq_f): RA.u = RB.f == RC.f; NEXT();
+        OP(ne_f): RA.u = RB.f != RC.f; NEXT();
+        OP(lt_f): RA.u = RB.f < RC.f; NEXT();
+        OP(le_f): RA.u = RB.f <= RC.f; NEXT();
+        OP(not_b): RA.u = !RB.u; NEXT();
+
+        OP(i2f): RA.f = double(RB.i); NEXT();
+        OP(u2f): RA.f = double(RB.u); NEXT();
+        OP(f2i): RA.i = int64_t(RB.f); NEXT();
+        OP(f2u): RA.u = uint64_t(RB.f); NEXT();
+        OP(sext8): RA.i = int8_t(RB.u); NEXT();
+        OP(sext16): RA.i = int16_t(RB.u); NEXT();
+        OP(sext32): RA.i = int32_t(RB.u); NEXT();
+        OP(zext8): RA.u = uint8_t(RB.u); NEXT();
+        OP(zext16): RA.u = uint16_t(RB.u); NEXT();
+        OP(zext32): RA.u = uint32_t(RB.u); NEXT();
+        OP(round_f32): RA.f = float(RB.f); NEXT();
+
+        OP(newarr): {
+            RA.a = arena_.make<array_t>(&RB, &RB + i.c(), &arena_);
+            NEXT();
+        }
+        OP(len): RA.u = RB.a->size(); NEXT();
+        OP(index): {
+            if (RC.u >= RB.a->size()) fail("Array index out of range");
+            RA = (*RB.a)[RC.u];
+            NEXT();
+        }
+
+        OP(kernel): {
+            const auto& x = *RB.a;
+            const auto& y = *base[i.b() + 1].a;
+            if (x.size() != y.size()) fail("Arrays of different lengths");
+            auto* result = arena_.make<array_t>(x.size(), &arena_);
+            const auto op = kernel_op_t(i.c() >> 4);
+            if (!elementwise(op, code_lane(i.c()), x.data(), y.data(), result->data(), x.size()))
+                fail("Integer division by zero");
+            RA.a = result;
+            NEXT();
+        }
+        OP(reduce): {
+            const auto& x = *RB.a;
+            if (x.empty()) fail("Reduction of an empty array");
+            RA = vm::reduce(reduction_t(i.c() >> 4), code_lane(i.c()), x.data(), x.size());
+            NEXT();
+        }
+
+        OP(kernel_strided): {
+            const auto x = &RB, y = x + 3;
+            const auto n = x[6].u;
+            if (!in_view(x, n) || !in_view(y, n)) fail("Slice out of range");
+            auto* result = arena_.make<array_t>(n, &arena_);
+            const auto op = kernel_op_t(i.c() >> 4);
+            if (!elementwise(op, code_lane(i.c()), x[0].a->data() + x[1].u, x[2].i,
+                             y[0].a->data() + y[1].u, y[2].i, result->data(), n))
+                fail("Integer division by zero");
+            RA.a = result;
+            NEXT();
+        }
+        OP(reduce_strided): {
+            const auto x = &RB;
+            const auto n = x[3].u;
+            if (n == 0) fail("Reduction of an empty array");
+            if (!in_view(x, n)) fail("Slice out of range");
+            RA = vm::reduce(reduction_t(i.c() >> 4), code_lane(i.c()), x[0].a->data() + x[1].u,
+                            x[2].i, n);
+            NEXT();
+        }
+
+        OP(format): RA.s = vm::format(&RB + 1, RB.a->data(), i.c(), arena_); NEXT();
+        OP(mark): RA.u = arena_.mark(); NEXT();
+        OP(release): arena_.release(RA.u); NEXT();
+
+        OP(jmp): pc += i.sj(); NEXT();
+        OP(jmp_if): {
+            if (RA.u) pc += i.sbx();
+            NEXT();
+        }
+        OP(jmp_ifnot): {
+            if (!RA.u) pc += i.sbx();
+            NEXT();
+        }
+
+        OP(call): {
+            const auto* callee = &program.functions[i.bx()];
+            auto* callee_base = &RA;
+            // frames of functions without parameters may share their first
+            // register with the caller's last, so the depth is bounded too.
+            if (callee_base + callee->n_registers > stack_end || frames.size() == max_depth)
+                fail("Stack overflow");
+
+            if (native && native[i.bx()]) {
+                native[i.bx()](callee_base, &context);
+                if (context.fault) fail(context.fault);
+                NEXT();
+            }
+
+            frames.push_back(frame_t<code_t>{fn, pc, base});
+            fn = callee;
+            pc = code_of(i.bx());
+            base = callee_base;
+            k = fn->constants.data();
+            NEXT();
+        }
+        OP(ret): {
+            const auto result = RA;
+            if (frames.empty()) {
+                executed_ = executed;
+                return result;
+            }
+
+            // the callee's frame starts at the caller's destination register.
+            base[0] = result;
+            const auto& caller = frames.back();
+            fn = caller.function;
+            pc = caller.pc;
+            base = caller.base;
+            k = fn->constants.data();
+            frames.pop_back();
+            NEXT();
+        }
+
+        // superinstructions read the instructions they replace from the
+        // words following them.
+#define COMPARE_AND_BRANCH(name, result)                                                           \
+    OP(name##_jmp_ifnot): {                                                                        \
+        RA.u = result;                                                                             \
+        const auto j = word(*pc++);                                                                \
+        if (!base[j.a()].u) pc += j.sbx();                                                         \
+        executed++;                                                                                \
+        NEXT();                                                                                    \
+    }
+        COMPARE_AND_BRANCH(lt_i, RB.i < RC.i)
+        COMPARE_AND_BRANCH(le_i, RB.i <= RC.i)
+        COMPARE_AND_BRANCH(lt_u, RB.u < RC.u)
+        COMPARE_AND_BRANCH(le_u, RB.u <= RC.u)
+        COMPARE_AND_BRANCH(eq_i, RB.u == RC.u)
+        COMPARE_AND_BRANCH(ne_i, RB.u != RC.u)
+#undef COMPARE_AND_BRANCH
+
+        OP(loadi_add_i): {
+            RA.i = i.sbx();
+            const auto j = word(*pc++);
+            base[j.a()].u = base[j.b()].u + base[j.c()].u;
+            executed++;
+            NEXT();
+        }
+        OP(loadi_sub_i): {
+            RA.i = i.sbx();
+            const auto j = word(*pc++);
+            base[j.a()].u = base[j.b()].u - base[j.c()].u;
+            executed++;
+            NEXT();
+        }
+        OP(getg_add_i_setg): {
+            RA = g[i.bx()];
+            const auto j = word(pc[0]);
+            base[j.a()].u = base[j.b()].u + base[j.c()].u;
+            const auto s = word(pc[1]);
+            g[s.bx()] = base[s.a()];
+            pc += 2;
+            executed += 2;
+            NEXT();
+        }
+        OP(add_i_jmp): {
+            RA.u = RB.u + RC.u;
+            const auto j = word(*pc++);
+            pc += j.sj();
+            executed++;
+            NEXT();
+        }
+
+#if BT_VM_THREADED
+    op_invalid:
+#else
+            default: break;
+            }
+#endif
+        fail("Invalid instruction");
+#if !BT_VM_THREADED
+        }
+#endif
+        return value_t{0};
+    }
+
+#undef RA
+#undef RB
+#undef RC
+#undef OP
+#undef NEXT
+}}  // namespace bt::vm
@@ -0,0 +1,770 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#include <catch2/catch.hpp>
+#include <rang.hpp>
+
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/analysis/diagnostics.hpp>
+#include <bullet/analysis/error.hpp>
+#include <bullet/analysis/layout.hpp>
+#include <bullet/analysis/prelude_environment.hpp>
+#include <bullet/analysis/scheduler.hpp>
+#include <bullet/analysis/type_checking.hpp>
+#include <bullet/analysis/walk.hpp>
+#include <bullet/lexer/lexer.hpp>
+#include <bullet/parser/ast.hpp>
+#include <bullet/parser/parser.hpp>
+#include <bullet/parser/pretty_print.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace lexer;
+using namespace parser;
+using namespace syntax;
+using namespace analysis;
+
+namespace {
+auto typed_ast(string_view input) -> attr_node_t<type_t> {
+    const syntax::tree_t ast = input | tokenize | parse;
+    return walk_post_order<type_t>(ast, [](auto, auto) { return type_t(); });
+}
+
+auto check(string_view input) -> attr_node_t<type_t> {
+    auto ast = typed_ast(input);
+    type_check(ast, lang::prelude::environment());
+    return ast;
+}
+
+// counts the leaves of every subtree.
+const auto count_leaves = boost::hana::overload(
+    [](const bin_op_t<int>& op, const node_t&) {
+        return op.lhs.get().attribute + op.rhs.get().attribute;
+    },
+    [](const block_t<int>& b, const node_t&) {
+        auto n = 0;
+        for (const auto& s : b) n += s.get().attribute;
+        return n;
+    },
+    [](const auto&, const node_t&) { return 1; });
+
+// the last statement of a program, which is the whole program if it has one.
+auto last_statement(const attr_node_t<type_t>& program) -> attr_node_t<type_t> {
+    if (const auto block = program.get().get_if<block_t<type_t>>()) return block->back();
+    return program;
+}
+
+auto node_at(uint32_t line) -> attr_node_t<empty_attribute_t> {
+    auto node = attr_node_t<empty_attribute_t>();
+    node->location = parser::location_t(line, 1, line, 1);
+    return node;
+}
+}  // namespace
+
+TEST_CASE("Diagnostics are recorded into the installed engine", "[analysis/diagnostics]") {
+    auto diagnostics = diagnostics_t();
+    const auto scope = diagnostics_t::scope_t(diagnostics);
+
+    check("y + 1");
+
+    REQUIRE(diagnostics.size() >= 1);
+    REQUIRE(diagnostics.begin()->code == diag_code_t::undefined_identifier);
+}
+
+TEST_CASE("Diagnostics are formatted lazily from typed arguments", "[analysis/diagnostics]") {
+    auto diagnostics = diagnostics_t();
+    const auto scope = diagnostics_t::scope_t(diagnostics);
+
+    {
+        auto err =
+            analysis::raise<analysis::error>(node_at(3), diag_code_t::assign_type_mismatch);
+        err << "Can't assign value of type \"" << analysis::F64 << "\" to \"" << analysis::I32
+            << "\" (" << 42 << ")";
+    }
+
+    REQUIRE(diagnostics.size() == 1);
+    const auto& d = *diagnostics.begin();
+    REQUIRE(d.code == diag_code_t::assign_type_mismatch);
+    REQUIRE(holds_alternative<type_t>(d.args[1]));
+    REQUIRE(holds_alternative<long long>(d.args[5]));
+    REQUIRE(d.message() == R"(Can't assign value of type "f64" to "i32" (42), at (3:1-3:1).)");
+}
+
+TEST_CASE("Diagnostics beyond the error cap are dropped", "[analysis/diagnostics]") {
+    auto diagnostics = diagnostics_t(2);
+    const auto scope = diagnostics_t::scope_t(diagnostics);
+
+    for (auto i = 0; i < 5; i++) {
+        auto err = analysis::raise<analysis::error>(node_at(i));
+        err << "error " << i;
+    }
+
+    REQUIRE(diagnostics.size() == 2);
+    REQUIRE(diagnostics.dropped() == 3);
+
+    auto s = stringstream();
+    s << diagnostics;
+    REQUIRE(s.str().find("3 further errors suppressed") != string::npos);
+}
+
+TEST_CASE("Forked diagnostics share the error cap and merge back", "[analysis/diagnostics]") {
+    auto diagnostics = diagnostics_t(3);
+    auto left = diagnostics.fork();
+    auto right = diagnostics.fork();
+
+    for (auto* d : {&left, &right, &left, &right}) {
+        const auto scope = diagnostics_t::scope_t(*d);
+        auto err = analysis::raise<analysis::error>(node_at(1));
+        err << "error";
+    }
+
+    diagnostics.merge(move(left));
+    diagnostics.merge(move(right));
+
+    REQUIRE(diagnostics.size() == 3);
+    REQUIRE(diagnostics.dropped() == 1);
+}
+
+TEST_CASE("Concurrent compilations keep their own types and diagnostics",
+          "[analysis/compilation]") {
+    struct result_t {
+        int a_id = 0, b_id = 0;
+        size_t errors = 0;
+    };
+
+    auto results = vector<result_t>(4);
+    auto threads = vector<thread>();
+    for (auto& result : results) {
+        threads.emplace_back([&result] {
+            auto compilation = compilation_t();
+            const syntax::tree_t ast = "type a = i32\ntype b = f64\ny + 1" | tokenize | parse;
+            compilation.check(ast);
+
+            const auto id = [&](string_view name) {
+                const auto type = compilation.types.lookup_nominal(name);
+                return type->get().get<types::nominal_type_t>().id;
+            };
+            result.a_id = id("a");
+            result.b_id = id("b");
+            result.errors = compilation.diagnostics.size();
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    for (const auto& result : results) {
+        REQUIRE(result.a_id == 1);
+        REQUIRE(result.b_id == 2);
+        REQUIRE(result.errors >= 1);
+        REQUIRE(result.errors == results.front().errors);
+    }
+}
+
+TEST_CASE("Instantiating a generic type leaves the prelude untouched", "[analysis/compilation]") {
+    auto compilation = compilation_t();
+    const syntax::tree_t ast = "var p: ptr(i32)" | tokenize | parse;
+    compilation.check(ast);
+
+    REQUIRE(analysis::PTR.get().get<types::ptr_t>().value_type.get().empty());
+    const auto& ptr = compilation.prelude.types.lookup("ptr")->get().get<types::ptr_t>();
+    REQUIRE(ptr.value_type.get().empty());
+}
+
+TEST_CASE("Constant expressions fold to literals", "[analysis/constant]") {
+    // a program's last statement, folded, and the codes of its diagnostics.
+    const auto fold = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        const auto typed = compilation.check(ast);
+
+        auto codes = vector<diag_code_t>();
+        for (const auto& d : compilation.diagnostics) codes.push_back(d.code);
+        auto s = stringstream();
+        s << last_statement(typed);
+        return pair(s.str(), codes);
+    };
+    using codes_t = vector<diag_code_t>;
+
+    REQUIRE(fold("1 + 2 * 3").first == "integral_t[7?0]");
+    REQUIRE(fold("(2 ** 10 - 1 == 1023) and not false").first == "token[TRUE]");
+    REQUIRE(fold("1 - 3").first == "unary_op[token[MINUS], integral_t[2?0]]");
+    REQUIRE(fold("7.5 / 2.5").first == fold("3.0").first);
+    REQUIRE(fold("(200u8 + 100u8) / 2u8").second == codes_t{diag_code_t::constant_overflow});
+
+    // let variables with constant initializers are replaced by their values.
+    const auto [call, call_codes] = fold("let n: i64 = 6 * 7\n"
+                                         "def f(x: i64): i64 = x + n\n"
+                                         "f(n - 2)");
+    REQUIRE(call_codes.empty());
+    REQUIRE(call.find("integral_t[40i64]") != string::npos);
+    // but not where a parameter shadows them.
+    REQUIRE(fold("let n: i64 = 1\n"
+                 "def f(n: i64): i64 = n + 1")
+                .first.find("ident[n]") != string::npos);
+
+    // nothing is folded which faults when the program runs.
+    REQUIRE(fold("1 / 0").first.find("binary_op") == 0);
+
+    REQUIRE(fold("100i8 + 100i8").second == codes_t{diag_code_t::constant_overflow});
+    REQUIRE(fold("var x: i32 = 2147483647 + 1").second == codes_t{diag_code_t::constant_overflow});
+    REQUIRE(fold("let x = 3000000000").second == codes_t{diag_code_t::constant_overflow});
+    REQUIRE(fold("-128i8 / -1i8").second == codes_t{diag_code_t::constant_overflow});
+    REQUIRE(fold("var x: i64 = -9223372036854775808").second.empty());
+    REQUIRE(fold("var x: u64 = 18446744073709551615u64").second.empty());
+    REQUIRE(fold("var x: i64 = 9223372036854775807 + 1").second ==
+            codes_t{diag_code_t::constant_overflow});
+}
+
+TEST_CASE("Array dimensions are computed at compile time", "[analysis/constant]") {
+    const auto type_of = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        const auto typed = compilation.check(ast);
+
+        auto s = stringstream();
+        s << last_statement(typed).get().attribute;
+        return pair(s.str(), compilation.diagnostics.size());
+    };
+
+    REQUIRE(type_of("var a: array(i64, 2 * 3)") == pair(string("ptr(array(i64, 6))"), size_t(0)));
+    REQUIRE(type_of("var a: array(u8, data(2, 4 - 1))") ==
+            pair(string("ptr(array(u8, 2, 3))"), size_t(0)));
+    REQUIRE(type_of("var a: array(i64, 1 - 1)").second == 1);
+}
+
+TEST_CASE("Arrays of numbers compute element by element", "[analysis/arrays]") {
+    const auto type_of = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        const auto typed = compilation.check(ast);
+
+        auto s = stringstream();
+        s << last_statement(typed).get().attribute;
+        return pair(s.str(), compilation.diagnostics.size());
+    };
+
+    REQUIRE(type_of("data(1, 2) + data(3, 4)") == pair(string("array(i32, 2)"), size_t(0)));
+    REQUIRE(type_of("data(1.5, 2.5) < data(3.5, 0.5)") ==
+            pair(string("array(bool, 2)"), size_t(0)));
+    REQUIRE(type_of("let a = data(1, 2, 3)\nmax(a)") == pair(string("i32"), size_t(0)));
+
+    // elements must have the same type, and arrays the same size.
+    REQUIRE(type_of("data(1, 2) + data(3, 4, 5)").second == 1);
+    REQUIRE(type_of("var x: i64 = 1\ndata(x, x) * data(1.5, 2.5)").second == 1);
+    REQUIRE(type_of("sum(1)").second == 1);
+}
+
+TEST_CASE("Slices view elements of sequences in place", "[analysis/slices]") {
+    const auto check_program = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        const auto typed = compilation.check(ast);
+
+        auto codes = vector<diag_code_t>();
+        for (const auto& d : compilation.diagnostics) codes.push_back(d.code);
+        auto s = stringstream();
+        s << last_statement(typed).get().attribute;
+        return pair(s.str(), codes);
+    };
+    using codes_t = vector<diag_code_t>;
+    const auto a = "let a = data(1, 2, 3, 4, 5, 6)\n"s;
+
+    // bounds end just after the last element viewed.
+    REQUIRE(check_program(a + "slice(a, 1, 6, 2)") == pair("slice(i32, 1, 6, 2)"s, codes_t{}));
+    REQUIRE(check_program(a + "slice(a, 0, 4, 3)").first == "slice(i32, 0, 4, 3)");
+    REQUIRE(check_program(a + "slice(a, 2, 2)").first == "slice(i32, 2, 2, 1)");
+
+    // slices of slices view the array underneath.
+    REQUIRE(check_program(a + "let s = slice(a, 1, 6, 2)\nslice(s, 1, 3)").first ==
+            "slice(i32, 3, 6, 2)");
+    REQUIRE(check_program(a + "let s = slice(a, 0, 6, 2)\nslice(s, 0, 3, 2)").first ==
+            "slice(i32, 0, 5, 4)");
+
+    // they are reduced, looped over and computed with as arrays are.
+    REQUIRE(check_program(a + "let s = slice(a, 1, 6, 2)\nsum(s)").first == "i32");
+    REQUIRE(check_program(a + "slice(a, 0, 3) + slice(a, 3, 6)").first == "array(i32, 3)");
+    REQUIRE(check_program(a +
+                          "var t: i32 = 0\n"
+                          "for (x : slice(a, 0, 6, 2)):\n"
+                          "    t = t + x\n"
+                          "t")
+                .second.empty());
+
+    // arrays convert to slices of all their elements.
+    REQUIRE(check_program("def total(xs: slice(i32, 0, 3)): i32 = sum(xs)\n"
+                          "let b = data(1, 2, 3)\n"
+                          "total(b)") == pair("i32"s, codes_t{}));
+
+    REQUIRE(check_program(a + "slice(a, 2, 7)").second == codes_t{diag_code_t::invalid_slice});
+    REQUIRE(check_program(a + "slice(a, 0, 6, 0)").second ==
+            codes_t{diag_code_t::invalid_slice});
+    REQUIRE(check_program(a + "var n: i64 = 3\nslice(a, 0, n)").second ==
+            codes_t{diag_code_t::not_a_constant});
+    REQUIRE(check_program(a + "slice(a, 1)").second == codes_t{diag_code_t::argument_mismatch});
+    REQUIRE(check_program("var x: i64 = 1\nslice(x, 0, 1)").second ==
+            codes_t{diag_code_t::invalid_slice});
+}
+
+TEST_CASE("String literals naming variables between braces are strings", "[analysis/strings]") {
+    const auto check_program = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        const auto typed = compilation.check(ast);
+
+        auto codes = vector<diag_code_t>();
+        for (const auto& d : compilation.diagnostics) codes.push_back(d.code);
+        auto s = stringstream();
+        s << last_statement(typed).get().attribute;
+        return pair(s.str(), codes);
+    };
+    using codes_t = vector<diag_code_t>;
+
+    REQUIRE(check_program("\"hello\"") == pair("strlit(5)"s, codes_t{}));
+    REQUIRE(check_program("\"{{hello}}\"").first == "strlit(9)");
+    REQUIRE(check_program("let n = 1\n\"n = {n}\"") == pair("string"s, codes_t{}));
+    REQUIRE(check_program("let s = \"x\"\nlet b = true\n\"{s}{b}\"") ==
+            pair("string"s, codes_t{}));
+
+    REQUIRE(check_program("\"{nothing}\"").second ==
+            codes_t{diag_code_t::undefined_identifier});
+    REQUIRE(check_program("let a = data(1, 2)\n\"{a}\"").second ==
+            codes_t{diag_code_t::invalid_interpolation});
+}
+
+TEST_CASE("What with blocks allocate doesn't outlive them", "[analysis/regions]") {
+    const auto check_program = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        compilation.check(ast);
+
+        auto codes = vector<diag_code_t>();
+        for (const auto& d : compilation.diagnostics) codes.push_back(d.code);
+        return codes;
+    };
+    using codes_t = vector<diag_code_t>;
+
+    REQUIRE(check_program("let n = with:\n"
+                          "    let a = data(1, 2)\n"
+                          "    sum(a)\n"
+                          "n")
+                .empty());
+    REQUIRE(check_program("let n = 1\n"
+                          "with:\n"
+                          "    var s: string = \"\"\n"
+                          "    s = \"n = {n}\"\n"
+                          "    n")
+                .empty());
+    // functions defined in a with block allocate outside of it.
+    REQUIRE(check_program("with:\n"
+                          "    def f(n: i64): string = do:\n"
+                          "        return \"n = {n}\"\n"
+                          "    f(1)\n"
+                          "    1")
+                .empty());
+
+    REQUIRE(check_program("with:\n    data(1, 2)") == codes_t{diag_code_t::invalid_region});
+    REQUIRE(check_program("var s: string = \"\"\n"
+                          "let n = 1\n"
+                          "with:\n"
+                          "    s = \"n = {n}\"") == codes_t{diag_code_t::invalid_region});
+    REQUIRE(check_program("def f(n: i64): string = do:\n"
+                          "    with:\n"
+                          "        return \"n = {n}\"\n"
+                          "    \"\"\n"
+                          "f(1)") == codes_t{diag_code_t::invalid_region});
+    REQUIRE(check_program("def g(n: i64): i64 = do:\n"
+                          "    with:\n"
+                          "        yield n\n"
+                          "for (x : g(1)):\n"
+                          "    x") == codes_t{diag_code_t::invalid_region});
+}
+
+TEST_CASE("Functions which yield are generators", "[analysis/generators]") {
+    const auto check_program = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        const auto typed = compilation.check(ast);
+
+        auto codes = vector<diag_code_t>();
+        for (const auto& d : compilation.diagnostics) codes.push_back(d.code);
+        auto s = stringstream();
+        s << last_statement(typed).get().attribute;
+        return pair(s.str(), codes);
+    };
+    using codes_t = vector<diag_code_t>;
+
+    const auto [type, codes] = check_program("def upto(n: i64): i64 = do:\n"
+                                             "    var i: i64 = 0\n"
+                                             "    while (i < n):\n"
+                                             "        yield i\n"
+                                             "        i = i + 1\n"
+                                             "upto(3)");
+    REQUIRE(codes.empty());
+    REQUIRE(type == "generator(i64)");
+
+    // loops over them see the values they yield.
+    REQUIRE(check_program("def twice(n: f64): f64 = do:\n"
+                          "    yield n\n"
+                          "    yield n\n"
+                          "var s: f64 = 0.0\n"
+                          "for (x : twice(1.5)):\n"
+                          "    s = s + x\n"
+                          "s")
+                .second.empty());
+
+    REQUIRE(check_program("def f(n: i64): bool = do:\n"
+                          "    yield n\n"
+                          "f(1)")
+                .second == codes_t{diag_code_t::invalid_yield});
+    REQUIRE(check_program("def f(n: i64) = do:\n"
+                          "    yield n\n"
+                          "f(1)")
+                .second == codes_t{diag_code_t::invalid_yield});
+}
+
+TEST_CASE("Functions are passed to functions taking them", "[analysis/closures]") {
+    const auto check_program = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        const auto typed = compilation.check(ast);
+
+        auto codes = vector<diag_code_t>();
+        for (const auto& d : compilation.diagnostics) codes.push_back(d.code);
+        auto s = stringstream();
+        s << last_statement(typed).get().attribute;
+        return pair(s.str(), codes);
+    };
+    using codes_t = vector<diag_code_t>;
+
+    const auto apply = "def apply(f: fn(i64, i64), x: i64): i64 = f(x)\n"s;
+    const auto [type, codes] = check_program(apply + "apply(fn(y: i64): i64 = y * 2, 3)");
+    REQUIRE(codes.empty());
+    REQUIRE(type == "i64");
+
+    // functions convert to function types whatever their parameters are
+    // called, but not to those of other signatures.
+    REQUIRE(check_program(apply +
+                          "def triple(z: i64): i64 = 3 * z\n"
+                          "apply(triple, 3)")
+                .second.empty());
+    REQUIRE(check_program(apply +
+                          "def half(z: f64): f64 = z / 2.0\n"
+                          "apply(half, 3)")
+                .second == codes_t{diag_code_t::argument_mismatch});
+
+    // "with" names copies of values, or variables, for the function's body.
+    REQUIRE(check_program("def f(n: i64): i64 = do:\n"
+                          "    var x: i64 = n\n"
+                          "    var g = fn(m: i64): i64 = m + k + x with (k = n * 2, var x)\n"
+                          "    g(1)\n"
+                          "f(1)")
+                .second.empty());
+    REQUIRE(check_program("def f(n: i64): i64 = do:\n"
+                          "    var g = fn(m: i64): i64 = m with (nothing)\n"
+                          "    g(1)\n"
+                          "f(1)")
+                .second == codes_t{diag_code_t::undefined_identifier});
+}
+
+TEST_CASE("Templates are instantiated once for each set of arguments",
+          "[analysis/templates]") {
+    auto check_program = [](string_view input) {
+        auto compilation = compilation_t();
+        const syntax::tree_t ast = input | tokenize | parse;
+        const auto typed = compilation.check(ast);
+
+        auto codes = vector<diag_code_t>();
+        for (const auto& d : compilation.diagnostics) codes.push_back(d.code);
+        auto s = stringstream();
+        s << last_statement(typed).get().attribute;
+        return tuple(s.str(), codes, compilation.templates.size());
+    };
+    using codes_t = vector<diag_code_t>;
+
+    const auto larger = "def larger[T](a: T, b: T): T = if (a > b) a else b\n"s;
+    const auto scaled = "def scaled[T, N: i64](x: T): T = x * N\n"s;
+
+    // arguments are given, or deduced from those of calls; calls with the
+    // same arguments share an instance.
+    const auto [type, codes, instances] = check_program(larger + scaled +
+                                                        "var x: i64 = 1\n"
+                                                        "var y: f64 = 2.0\n"
+                                                        "larger(x, 2)\n"
+                                                        "larger[i64](3, x)\n"
+                                                        "larger(y, y)\n"
+                                                        "scaled[i64, 1 + 2](x)\n"
+                                                        "scaled[i64, 3](x) + larger(x, x)");
+    REQUIRE(codes.empty());
+    REQUIRE(type == "i64");
+    REQUIRE(instances == 3);
+
+    // instances of types are nominal types, the same for the same arguments.
+    REQUIRE(std::get<0>(check_program("type pair[T](first: T, second: T)\n"
+                                      "var p: pair[i64]\n"
+                                      "var q: pair[i64]\n"
+                                      "p = q\n"
+                                      "p")) == "ptr(pair[i64])");
+
+    // recursive calls with the same arguments call the instance itself,
+    // those with new ones are stopped.
+    REQUIRE(std::get<1>(check_program("def count[T](n: T): T = if (n > 0) count(n - 1) else n\n"
+                                      "count(3)"))
+                .empty());
+    const auto nested = std::get<1>(check_program(
+        "def nest[T](n: i64): i64 = if (n > 0) nest[ptr(T)](n - 1) else n\n"
+        "nest[i64](3)"));
+    REQUIRE(count(nested.begin(), nested.end(), diag_code_t::template_recursion) == 1);
+
+    REQUIRE(std::get<1>(check_program(larger + "larger[i64, i64](1, 2)")) ==
+            codes_t{diag_code_t::generic_arity});
+    REQUIRE(std::get<1>(check_program(scaled +
+                                      "var n: i64 = 2\n"
+                                      "scaled[i64, n](1)")) ==
+            codes_t{diag_code_t::not_a_constant});
+    REQUIRE(std::get<1>(check_program("def zero[T](n: i64): i64 = 0\n"
+                                      "zero(1)")) == codes_t{diag_code_t::template_deduction});
+    REQUIRE(std::get<1>(check_program("var x: i64 = 1\n"
+                                      "x[i64]")) == codes_t{diag_code_t::not_a_template});
+}
+
+TEST_CASE("Types are laid out as the C ABI lays them out", "[analysis/layout]") {
+    using offsets_t = vector<size_t>;
+    const auto type = [](auto t) { return analysis::type_t(type_value(move(t))); };
+    const auto fields = [](vector<analysis::type_t> ts) {
+        auto s = analysis::types::struct_t();
+        for (auto i = 0u; i < ts.size(); i++)
+            s.push_back(analysis::types::name_and_type_t{string(1, char('a' + i)), ts[i]});
+        return s;
+    };
+    const auto ptr = type(analysis::types::ptr_t{analysis::I64});
+
+    // fields are aligned in the order declared, unless they may be reordered.
+    const auto s = type(fields({analysis::U8, analysis::I64, analysis::U8}));
+    const auto declared = layout(s);
+    REQUIRE(declared.size == 24);
+    REQUIRE(declared.align == 8);
+    REQUIRE(declared.offsets == offsets_t{0, 8, 16});
+    const auto packed = layout(s, field_order_t::packed);
+    REQUIRE(packed.size == 16);
+    REQUIRE(packed.offsets == offsets_t{8, 0, 9});
+    REQUIRE(layout(type(analysis::types::tuple_t{analysis::I32, analysis::U8})).size == 8);
+
+    // arrays are contiguous, row-major.
+    const auto a = type(analysis::types::array_t{analysis::I32, {2, 3}});
+    REQUIRE(layout(a).size == 24);
+    REQUIRE(layout(a).align == 4);
+    REQUIRE(layout(a).strides == offsets_t{12, 4});
+    REQUIRE(length(a.get().as<analysis::types::array_t>()) == 6);
+
+    // variants tag their alternatives in values the largest never takes,
+    // when it has such values.
+    const auto optional_ptr = layout(type(analysis::types::variant_t{analysis::VOID, ptr}));
+    REQUIRE(optional_ptr.size == 8);
+    REQUIRE(optional_ptr.tag->offset == 0);
+    REQUIRE(optional_ptr.tag->start == 0);
+    REQUIRE(optional_ptr.tag->untagged == 1u);
+    const auto flag = analysis::types::variant_t{analysis::BOOL, analysis::VOID, analysis::VOID};
+    REQUIRE(layout(type(flag)).size == 1);
+
+    const auto number = type(analysis::types::variant_t{analysis::I64, analysis::F64});
+    const auto tagged = layout(number);
+    REQUIRE(tagged.size == 16);
+    REQUIRE(tagged.tag->offset == 8);
+    REQUIRE(tagged.tag->size == 1);
+    REQUIRE(!tagged.tag->untagged);
+    REQUIRE(tagged.offsets == offsets_t{0, 0});
+
+    // so do variants of variants, in the values the tag never takes.
+    const auto nested = layout(type(analysis::types::variant_t{number, analysis::VOID}));
+    REQUIRE(nested.size == 16);
+    REQUIRE(nested.tag->offset == 8);
+    REQUIRE(nested.tag->start == 2);
+
+    // the layouts of a compilation are computed once for each type, and
+    // those of the types they are made of along with them.
+    auto compilation = compilation_t();
+    const auto t = type(fields({a, s}));
+    const auto& l = compilation.layouts.of(t);
+    REQUIRE(&compilation.layouts.of(type(fields({a, s}))) == &l);
+    REQUIRE(l.offsets == offsets_t{0, 24});
+    REQUIRE(l.size == 48);
+    REQUIRE(compilation.layouts.size() == 6);
+}
+
+TEST_CASE("Arrays of structs are split into one array for each field", "[analysis/layout]") {
+    using offsets_t = vector<size_t>;
+    const auto type = [](auto t) { return analysis::type_t(type_value(move(t))); };
+    auto s = analysis::types::struct_t();
+    s.push_back({"a", analysis::U8});
+    s.push_back({"b", analysis::I64});
+    s.push_back({"c", analysis::U8});
+    const auto a = analysis::types::array_t{type(s), {4}};
+
+    // each field's array is aligned as the field is.
+    const auto split = layout(type(a), field_order_t::declared, records_t::split);
+    REQUIRE(split.offsets == offsets_t{0, 8, 40});
+    REQUIRE(split.widths == offsets_t{1, 8, 1});
+    REQUIRE(split.strides == offsets_t{1});
+    REQUIRE(split.size == 48);
+    REQUIRE(layout(type(a), field_order_t::packed, records_t::split).size == 40);
+    REQUIRE(layout(type(analysis::types::array_t{type(s), {2, 3}}), field_order_t::declared,
+                   records_t::split)
+                .strides == offsets_t{3, 1});
+
+    // arrays are split when their loops load at most half of what they load
+    // from whole elements, padding included.
+    REQUIRE(preferred_records(a, {{{0}, 100}, {{0, 2}, 100}}) == records_t::split);
+    REQUIRE(preferred_records(a, {{{0, 1, 2}, 100}}) == records_t::split);
+    REQUIRE(preferred_records(a, {}) == records_t::interleaved);
+    auto v = analysis::types::struct_t();
+    v.push_back({"x", analysis::F64});
+    v.push_back({"y", analysis::F64});
+    v.push_back({"z", analysis::F64});
+    const auto vs = analysis::types::array_t{type(v), {4}};
+    REQUIRE(preferred_records(vs, {{{0, 1}, 100}}) == records_t::interleaved);
+    REQUIRE(preferred_records(vs, {{{2}, 100}, {{0, 1, 2}, 10}}) == records_t::split);
+
+    // loops over arrays use the fields of elements they access, or all of
+    // them.
+    auto compilation = compilation_t();
+    const syntax::tree_t ast = "type point(x: i64, y: i64, z: i64)\n"
+                               "var ps: array(point, 4)\n"
+                               "var total: i64 = 0\n"
+                               "for (p : ps):\n"
+                               "    total = total + p.x\n"
+                               "for (p : ps):\n"
+                               "    total = total + p.z * p.x + p.z\n"
+                               "total"sv |
+                               tokenize | parse;
+    const auto typed = compilation.check(ast);
+    auto report = stringstream();
+    report << compilation.diagnostics;
+    INFO(report.str());
+    REQUIRE(compilation.diagnostics.empty());
+
+    const auto uses = field_uses(typed);
+    REQUIRE(uses.size() == 1);
+    const auto& ps = uses.at("ps");
+    REQUIRE(ps.size() == 2);
+    REQUIRE(ps[0].fields == offsets_t{0});
+    REQUIRE(ps[1].fields == offsets_t{0, 2});
+    REQUIRE(ps[1].elements == 4);
+    const auto point = compilation.types.lookup_nominal("point");
+    REQUIRE(preferred_records(analysis::types::array_t{*point, {4}}, ps) == records_t::split);
+
+    const syntax::tree_t bad = "type point(x: i64, y: i64)\n"
+                               "var p: point\n"
+                               "p.w"sv |
+                               tokenize | parse;
+    auto other = compilation_t();
+    other.check(bad);
+    REQUIRE(other.diagnostics.size() == 1);
+    REQUIRE(other.diagnostics.begin()->code == diag_code_t::undefined_field);
+}
+
+TEST_CASE("The prelude is built once and shared", "[analysis/prelude]") {
+    const auto& prelude = lang::prelude::environment();
+    REQUIRE(&prelude == &lang::prelude::environment());
+    REQUIRE(&compilation_t().prelude == &prelude);
+    REQUIRE(&prelude.types.lookup("int")->get() == &analysis::I32.get());
+}
+
+TEST_CASE("Prelude snapshots round-trip", "[analysis/prelude]") {
+    auto s = stringstream();
+    lang::prelude::save(s, lang::prelude::environment());
+    REQUIRE(s.str().find("types byte i8\n") != string::npos);
+
+    auto in = stringstream(s.str());
+    const auto loaded = lang::prelude::load(in);
+    REQUIRE(&loaded.types.lookup("byte")->get() == &analysis::I8.get());
+    REQUIRE(&loaded.fns.lookup("print")->get() == &analysis::FUNCTION.get());
+
+    auto again = stringstream();
+    lang::prelude::save(again, loaded);
+    REQUIRE(again.str() == s.str());
+}
+
+TEST_CASE("walk_post_order copes with a million-deep expression chain", "[analysis/walk]") {
+    const auto depth = 1'000'000;
+    const auto one = node_t(integral_literal_t(1, '?', 0));
+
+    auto chain = one;
+    for (auto i = 0; i < depth; i++)
+        chain = node_t(bin_op_t<empty_attribute_t>{lexer::PLUS, chain, one});
+
+    auto leaves = attr_node_t<int>(walk_post_order<int>(chain.get(), count_leaves));
+
+    REQUIRE(leaves.get().attribute == depth + 1);
+
+    auto scheduler = scheduler_t(3);
+    auto parallel_leaves = attr_node_t<int>(
+        parallel_walk_post_order<int>(scheduler, 64, chain.get(), pure(count_leaves)));
+
+    REQUIRE(parallel_leaves.get().attribute == depth + 1);
+
+    dismantle(parallel_leaves);
+    dismantle(leaves);
+    dismantle(chain);
+}
+
+TEST_CASE("parallel_walk_post_order agrees with walk_post_order", "[analysis/walk]") {
+    const auto one = node_t(integral_literal_t(1, '?', 0));
+
+    // a module of many statements of assorted sizes, some nested in blocks.
+    auto module = block_t<empty_attribute_t>();
+    for (auto i = 0; i < 500; i++) {
+        auto statement = one;
+        for (auto j = 0; j < i % 37; j++)
+            statement = node_t(bin_op_t<empty_attribute_t>{lexer::PLUS, statement, one});
+        if (i % 50 == 0) statement = node_t(block_t<empty_attribute_t>{statement, one, statement});
+        module.push_back(statement);
+    }
+    const auto tree = tree_t(module);
+
+    auto scheduler = scheduler_t(3);
+    const auto sequential = attr_node_t<int>(walk_post_order<int>(tree, count_leaves));
+
+    for (auto grain : {1, 16, 1000, 1'000'000}) {
+        const auto parallel = attr_node_t<int>(
+            parallel_walk_post_order<int>(scheduler, grain, tree, pure(count_leaves)));
+
+        auto expected = stringstream(), actual = stringstream();
+        pretty_print(sequential.get(), expected, 0);
+        pretty_print(parallel.get(), actual, 0);
+        REQUIRE(actual.str() == expected.str());
+    }
+}
+
+TEST_CASE("parallel_walk_post_order only forks side effect free passes", "[analysis/walk]") {
+    auto visits = 0;
+    const auto counting = [&](const auto&, const node_t&) { return ++visits; };
+
+    REQUIRE(!is_side_effect_free_v<decltype(counting)>);
+    REQUIRE(is_side_effect_free_v<decltype(pure(counting))>);
+
+    auto module = block_t<empty_attribute_t>();
+    for (auto i = 0; i < 100; i++) module.push_back(node_t(integral_literal_t(i, '?', 0)));
+
+    // not declared pure: walked in order on the calling thread.
+    auto scheduler = scheduler_t(3);
+    const auto numbered =
+        attr_node_t<int>(parallel_walk_post_order<int>(scheduler, 1, tree_t(module), counting));
+
+    REQUIRE(visits == 101);
+    REQUIRE(numbered.get().attribute == 101);
+    REQUIRE(numbered.get().as<block_t<int>>()[41].get().attribute == 42);
+}
+
+TEST_CASE("parallel_walk_post_order reports errors from any task", "[analysis/walk]") {
+    const auto one = node_t(integral_literal_t(1, '?', 0));
+
+    auto module = block_t<empty_attribute_t>(200, one);
+    module[137] = node_t(else_t<empty_attribute_t>{one});
+
+    auto scheduler = scheduler_t(3);
+    REQUIRE_THROWS_AS(
+        parallel_walk_post_order<int>(scheduler, 8, tree_t(module), pure(count_leaves)),
+        analysis::error);
+}
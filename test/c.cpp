@@ -0,0 +1,185 @@
+#define CATCH_CONFIG_MAIN
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include <catch2/catch.hpp>
+
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/backend/c.hpp>
+#include <bullet/lexer/lexer.hpp>
+#include <bullet/parser/ast.hpp>
+#include <bullet/parser/parser.hpp>
+#include <bullet/vm/lower.hpp>
+#include <bullet/vm/vm.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace lexer;
+using namespace parser;
+using namespace backend;
+
+namespace {
+auto check(string_view input) -> syntax::attr_node_t<analysis::type_t> {
+    auto compilation = analysis::compilation_t();
+    const syntax::tree_t ast = input | tokenize | parse;
+    auto typed_ast = compilation.check(ast);
+
+    auto report = stringstream();
+    report << compilation.diagnostics;
+    INFO(report.str());
+    REQUIRE(compilation.diagnostics.empty());
+    return typed_ast;
+}
+
+auto have_cc() -> bool {
+    static const auto found = system("${CC:-cc} --version > /dev/null 2>&1") == 0;
+    return found;
+}
+
+struct outcome_t {
+    string output;
+    int status;
+};
+
+// compiles a translation and runs the executable.
+auto execute(const string& source) -> outcome_t {
+    const auto path = string("./test_c_program");
+    compile_c(source, path);
+
+    auto outcome = outcome_t();
+    const auto pipe = popen((path + " 2> /dev/null").c_str(), "r");
+    REQUIRE(pipe);
+    char buffer[256];
+    for (size_t n; (n = fread(buffer, 1, sizeof buffer, pipe)) > 0;) outcome.output.append(buffer, n);
+    outcome.status = pclose(pipe);
+    remove(path.c_str());
+
+    if (!outcome.output.empty() && outcome.output.back() == '\n') outcome.output.pop_back();
+    return outcome;
+}
+
+// runs a program in the VM and, when there is a C compiler, translated to C,
+// which must agree with the VM.
+auto run(string_view input) -> string {
+    const auto typed_ast = check(input);
+    const auto program = vm::lower(typed_ast);
+    auto s = stringstream();
+    vm::print_value(s, vm::vm_t().run(program), program.result_type);
+
+    const auto source = emit_c(typed_ast);
+    INFO(source);
+    if (have_cc()) {
+        const auto outcome = execute(source);
+        REQUIRE(outcome.status == 0);
+        REQUIRE(outcome.output == s.str());
+    }
+    return s.str();
+}
+}  // namespace
+
+TEST_CASE("C code computes what the VM does", "[backend/c]") {
+    REQUIRE(run("def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + fib(n - 2)\n"
+                "fib(20)") == "6765");
+    REQUIRE(run("def f(x: i32): i32 = x + 1\nf(2147483647)") == "-2147483648");
+    REQUIRE(run("def f(b: u8): u8 = b + 10\nf(250u8)") == "4");
+    REQUIRE(run("def f(n: i64, d: i64): i64 = n / d + n % d\nf(-7, 2)") == "-4");
+    REQUIRE(run("def f(n: i8, d: i8): i8 = n / d\nf(-128i8, -1i8)") == "-128");
+    REQUIRE(run("def f(n: i64): i64 = n * 3037000500\nf(3037000500)") == "-9223372036709301616");
+    REQUIRE(run("def f(u: u64): u64 = u / 2\nf(18446744073709551615u64)") ==
+            "9223372036854775807");
+    REQUIRE(run("def f(n: i64): i64 = (n ** 4) ^ (n & 10)\nf(3)") == "83");
+    REQUIRE(run("def f(x: f32): f32 = x + 0.2f32\nf(0.1f32)") == [] {
+        auto s = stringstream();
+        s << 0.1f + 0.2f;
+        return s.str();
+    }());
+    REQUIRE(run("def f(d: f64): f64 = -(d * 4) / 3 + d ** 2.0 + d % 1.0\nf(1.5)") == "0.75");
+    REQUIRE(run("def f(x: f64): bool = x >= 2.5 and x != 3.0 and not (x < 0.0)\nf(2.5)") ==
+            "true");
+    REQUIRE(run("def f(n: u64): bool = n - 1 > 0 or n / 0u64 > 0u64\nf(0u64)") == "true");
+}
+
+TEST_CASE("C code runs loops, globals and arrays", "[backend/c]") {
+    REQUIRE(run("def loops(n: i64): i64 = do:\n"
+                "    var s: i64 = 0\n"
+                "    var i: i64 = 0\n"
+                "    while (true):\n"
+                "        i = i + 1\n"
+                "        if (i > n) break\n"
+                "        if (i % 2 == 0) continue\n"
+                "        s = s + i\n"
+                "    return s\n"
+                "loops(10)") == "25");
+    REQUIRE(run("var calls: i64 = 0\n"
+                "def count(n: i64): i64 = do:\n"
+                "    calls = calls + 1\n"
+                "    n\n"
+                "count(1) + count(2)\n"
+                "calls") == "2");
+    REQUIRE(run("def sum(n: i64): i64 = do:\n"
+                "    var s: i64 = 0\n"
+                "    for (x : data(n, n + 1, n + 2)):\n"
+                "        s = s + x\n"
+                "    for (y : data(10, 20, 30)):\n"
+                "        s = s + y\n"
+                "    return s\n"
+                "sum(1)") == "66");
+    REQUIRE(run("def dot(x: f64): f64 = do:\n"
+                "    let a = data(x, x + 1.0, x + 2.0) * data(0.5, 0.25, 2.0)\n"
+                "    return sum(a) + max(a)\n"
+                "dot(1.0)") == "13");
+    REQUIRE(run("def strided(x: f64): f64 = do:\n"
+                "    let a = data(x, x + 1.0, x + 2.0, x + 3.0, x + 4.0, x + 5.0)\n"
+                "    let evens = slice(a, 0, 6, 2)\n"
+                "    var t: f64 = 0.0\n"
+                "    for (y : slice(a, 1, 6, 2)):\n"
+                "        t = t + y\n"
+                "    return sum(evens * slice(evens, 0, 3)) + t\n"
+                "strided(1.0)") == "47");
+}
+
+TEST_CASE("Types translate to C types", "[backend/c]") {
+    const auto source = emit_c(check("type point(x: i64, y: f32)\n"
+                                     "var p: point\n"
+                                     "def f(n: u16): u16 = n\n"
+                                     "def g(n: i64): i64 = do:\n"
+                                     "    var s: i64 = 0\n"
+                                     "    for (x : data(n, n)):\n"
+                                     "        s = s + x\n"
+                                     "    s\n"
+                                     "g(1)"),
+                               "points");
+    INFO(source);
+    REQUIRE(source.find("/* points, translated to C11 by btc. */") == 0);
+    REQUIRE(source.find("typedef struct bt_t_point bt_t_point;") != string::npos);
+    REQUIRE(source.find("struct bt_t_point { int64_t x; float y; };") != string::npos);
+    REQUIRE(source.find("static bt_t_point g_p;") != string::npos);
+    REQUIRE(source.find("typedef struct { int64_t v[2]; } bt_array_") != string::npos);
+    REQUIRE(source.find("static uint16_t f_f(uint16_t v_n)") != string::npos);
+    REQUIRE(source.find("static int64_t bt_main(void)") != string::npos);
+}
+
+TEST_CASE("Faults in C code exit with status 1", "[backend/c]") {
+    REQUIRE_THROWS_AS(emit_c(check("def f(n: i64): i64 = do:\n"
+                                   "    var x: i64 = n\n"
+                                   "    def g(m: i64): i64 = do:\n"
+                                   "        x = m\n"
+                                   "        m\n"
+                                   "    g(1)\n"
+                                   "f(1)")),
+                      backend::error);
+    if (!have_cc()) return;
+
+    for (const auto program : {"def f(n: i64): i64 = 1 / n\nf(0)",
+                               "def f(n: i64): i64 = f(n + 1) + 1\nf(0)"}) {
+        INFO(program);
+        const auto outcome = execute(emit_c(check(program)));
+        REQUIRE(outcome.status != 0);
+        REQUIRE(outcome.output.empty());
+    }
+
+    REQUIRE_THROWS_AS(compile_c("int main(void) { return undeclared; }", "./test_c_broken"),
+                      backend::error);
+}
@@ -0,0 +1,580 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithm>
+#include <sstream>
+
+#include <catch2/catch.hpp>
+
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/ir/ir.hpp>
+#include <bullet/ir/lower.hpp>
+#include <bullet/ir/pass.hpp>
+#include <bullet/lexer/lexer.hpp>
+#include <bullet/parser/ast.hpp>
+#include <bullet/parser/parser.hpp>
+#include <bullet/vm/lower.hpp>
+#include <bullet/vm/vm.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace lexer;
+using namespace parser;
+using namespace ir;
+
+namespace {
+auto lower_checked(string_view input) -> module_t {
+    auto compilation = analysis::compilation_t();
+    const syntax::tree_t ast = input | tokenize | parse;
+    const auto typed_ast = compilation.check(ast);
+
+    auto report = stringstream();
+    report << compilation.diagnostics;
+    INFO(report.str());
+    REQUIRE(compilation.diagnostics.empty());
+
+    auto module = lower(typed_ast);
+    verify(module);
+    return module;
+}
+
+// optimizes a module at a level, checking it after every pass.
+auto optimized(module_t module, int level) -> module_t {
+    auto passes = pipeline(level);
+    passes.verify_each = true;
+    passes.run(module);
+    return module;
+}
+
+// runs a module in the VM and prints its result.
+auto run(const module_t& module) -> string {
+    const auto program = vm::lower(module);
+    auto machine = vm::vm_t();
+    const auto result = machine.run(program);
+
+    auto s = stringstream();
+    vm::print_value(s, result, program.result_type);
+    return s.str();
+}
+
+auto count(const function_t& fn, opcode_t op) -> int {
+    auto n = 0;
+    for (const auto& block : fn.blocks)
+        for (const auto id : block.instructions) n += fn[id].op == op;
+    return n;
+}
+
+auto listing(const module_t& module) -> string {
+    auto s = stringstream();
+    s << module;
+    return s.str();
+}
+}  // namespace
+
+TEST_CASE("Programs lower to verifiable SSA", "[ir/lower]") {
+    const auto module = lower_checked("def add(a: i64, b: i64): i64 = a + b\n"
+                                      "def f(n: i64): i64 = if (n > 0 and n < 10) n else 0\n"
+                                      "var total: i64 = 0\n"
+                                      "for (x : data(1, 2, 3)):\n"
+                                      "    total = total + add(x, f(x))\n"
+                                      "total");
+    INFO(listing(module));
+    REQUIRE(module.functions.size() == 3);
+    REQUIRE(module.functions[1].name == "add");
+    REQUIRE(module.functions[2].name == "f");
+    REQUIRE(module.globals.size() == 1);
+    REQUIRE(module.result_type == analysis::I64);
+
+    // values meet in phis where "and" and "if" join, and the loop counter.
+    REQUIRE(count(module.functions[2], opcode_t::phi) == 2);
+    REQUIRE(count(module.functions[0], opcode_t::phi) == 1);
+    REQUIRE(count(module.functions[0], opcode_t::call) == 2);
+    REQUIRE(run(module) == "12");
+}
+
+TEST_CASE("Variables are promoted to values", "[ir/mem2reg]") {
+    const auto module = lower_checked("def f(n: i64): i64 = do:\n"
+                                      "    var i: i64 = 0\n"
+                                      "    var s: i64 = 0\n"
+                                      "    while (i < n):\n"
+                                      "        if (i % 2 == 0):\n"
+                                      "            s = s + i\n"
+                                      "        i = i + 1\n"
+                                      "    s\n"
+                                      "f(10)");
+    auto promoted = module;
+    REQUIRE(promote_variables(promoted));
+    verify(promoted);
+    INFO(listing(promoted));
+
+    const auto& f = promoted.functions[1];
+    REQUIRE(count(f, opcode_t::slot) == 0);
+    REQUIRE(count(f, opcode_t::load) == 0);
+    REQUIRE(count(f, opcode_t::store) == 0);
+    // i and s meet at the loop's head, and s where the "if" joins.
+    REQUIRE(count(f, opcode_t::phi) >= 3);
+    REQUIRE(run(promoted) == run(module));
+    REQUIRE(run(promoted) == "20");
+    REQUIRE_FALSE(promote_variables(promoted));
+}
+
+TEST_CASE("Variables whose address escapes stay in memory", "[ir/mem2reg]") {
+    auto module = lower_checked("def f(n: i64): i64 = do:\n"
+                                "    var x: i64 = n\n"
+                                "    var y: i64 = n\n"
+                                "    x + y\n"
+                                "f(3)");
+    auto& f = module.functions[1];
+    auto slots = vector<int>();
+    for (const auto id : f.blocks[0].instructions)
+        if (f[id].op == opcode_t::slot) slots.push_back(id);
+    REQUIRE(slots.size() == 3);
+
+    // stores the address of y, as taking it would, into a variable of its
+    // own.
+    const auto p = f.add(instruction_t{opcode_t::slot, pointer_to(f[slots[2]].type)});
+    const auto escape = f.add(instruction_t{opcode_t::store, analysis::VOID, {p, slots[2]}});
+    auto& entry = f.blocks[0].instructions;
+    entry.insert(entry.begin() + 3, p);
+    entry.insert(entry.end() - 1, escape);
+    verify(module);
+
+    REQUIRE(promote_variables(module));
+    verify(module);
+    INFO(listing(module));
+    // only y is left in memory, the others' stores having nothing to read.
+    REQUIRE(count(module.functions[1], opcode_t::slot) == 1);
+    REQUIRE(count(module.functions[1], opcode_t::load) == 1);
+    REQUIRE(run(module) == "6");
+}
+
+TEST_CASE("Constants propagate through branches", "[ir/sccp]") {
+    auto module = lower_checked("def f(n: i64): i64 = do:\n"
+                                "    let k: i64 = 5 * 4\n"
+                                "    if (k > 10) n + k else n * k\n"
+                                "f(1)");
+    propagate_constants(module);
+    simplify_cfg(module);
+    eliminate_dead_code(module);
+    verify(module);
+    INFO(listing(module));
+
+    const auto& f = module.functions[1];
+    REQUIRE(f.blocks.size() == 1);
+    REQUIRE(count(f, opcode_t::mul) == 0);
+    REQUIRE(count(f, opcode_t::add) == 1);
+    REQUIRE(run(module) == "21");
+}
+
+TEST_CASE("Constants fold as the VM computes them", "[ir/sccp]") {
+    // variables, which the checker doesn't fold, become constants once
+    // value numbering has forwarded what was stored to them.
+    for (const auto program : {"def f(a: i32): i32 = do:\n"
+                               "    var b: i32 = 2147483647i32\n"
+                               "    b + 1i32\n"
+                               "f(0i32)",
+                               "def f(a: u8): u8 = do:\n"
+                               "    var b: u8 = 250u8\n"
+                               "    b + 10u8\n"
+                               "f(0u8)",
+                               "def f(a: i8): i8 = do:\n"
+                               "    var b: i8 = -128i8\n"
+                               "    b / -1i8\n"
+                               "f(0i8)",
+                               "def f(a: i64): i64 = do:\n"
+                               "    var b: i64 = -7\n"
+                               "    b / 2 + b % 2 + b ** 2\n"
+                               "f(0)",
+                               "def f(a: f32): f32 = do:\n"
+                               "    var b: f32 = 0.1f32\n"
+                               "    b + 0.2f32\n"
+                               "f(0.0f32)",
+                               "def f(a: f64): f64 = do:\n"
+                               "    var b: f64 = -2.75\n"
+                               "    b * b - b / 0.5\n"
+                               "f(0.0)",
+                               "def f(a: i64): bool = do:\n"
+                               "    var b: f64 = 2.5\n"
+                               "    b >= 2.5 and b != 3.0\n"
+                               "f(0)"}) {
+        INFO(program);
+        const auto module = lower_checked(program);
+        auto folded = module;
+        for (auto changed = true; changed;) {
+            changed = number_values(folded);
+            changed |= propagate_constants(folded);
+            changed |= simplify_cfg(folded);
+        }
+        eliminate_dead_code(folded);
+        verify(folded);
+        INFO(listing(folded));
+        const auto& f = folded.functions[1];
+        REQUIRE(f.blocks.size() == 1);
+        REQUIRE(f[f.blocks[0].instructions.back()].op == opcode_t::ret);
+        REQUIRE(f[f[f.blocks[0].instructions.back()].operands[0]].op == opcode_t::constant);
+        REQUIRE(run(folded) == run(module));
+    }
+
+    // division by zero is left to fault when it runs.
+    auto module = lower_checked("def f(n: i64): i64 = do:\n"
+                                "    var b: i64 = 0\n"
+                                "    n / b\n"
+                                "f(1)");
+    number_values(module);
+    propagate_constants(module);
+    REQUIRE(count(module.functions[1], opcode_t::div) == 1);
+}
+
+TEST_CASE("Value numbering removes redundant computations", "[ir/gvn]") {
+    auto module = lower_checked("def f(a: i64, b: i64): i64 = (a + b) * (b + a)\nf(2, 3)");
+    number_values(module);
+    eliminate_dead_code(module);
+    verify(module);
+    INFO(listing(module));
+
+    const auto& f = module.functions[1];
+    REQUIRE(count(f, opcode_t::add) == 1);
+    // loads of the parameters' slots read what was stored there.
+    REQUIRE(count(f, opcode_t::load) == 0);
+    REQUIRE(run(module) == "25");
+}
+
+TEST_CASE("Dead code is eliminated", "[ir/dce]") {
+    auto module = lower_checked("def f(n: i64): i64 = do:\n"
+                                "    let unused: i64 = n * n\n"
+                                "    n + 1\n"
+                                "f(4)");
+    eliminate_dead_code(module);
+    verify(module);
+    INFO(listing(module));
+    REQUIRE(count(module.functions[1], opcode_t::mul) == 0);
+    REQUIRE(run(module) == "5");
+}
+
+TEST_CASE("Small functions are inlined", "[ir/inline]") {
+    auto module = lower_checked("def square(n: i64): i64 = n * n\n"
+                                "def fact(n: i64): i64 = if (n < 2) 1 else n * fact(n - 1)\n"
+                                "def f(n: i64): i64 = square(n) + fact(n)\n"
+                                "f(5)");
+    inline_calls(module);
+    verify(module);
+    INFO(listing(module));
+
+    const auto& f = module.functions[3];
+    // recursive functions are only inlined once, into their callers.
+    REQUIRE(count(f, opcode_t::call) == 1);
+    REQUIRE(count(module.functions[2], opcode_t::call) == 1);
+    REQUIRE(run(module) == "145");
+}
+
+TEST_CASE("Control flow is simplified", "[ir/simplify_cfg]") {
+    auto module = lower_checked("def f(n: i64): i64 = do:\n"
+                                "    var x: i64 = 0\n"
+                                "    if (n > 0):\n"
+                                "        x = 1\n"
+                                "    x\n"
+                                "f(3)");
+    const auto blocks = module.functions[1].blocks.size();
+    simplify_cfg(module);
+    verify(module);
+    INFO(listing(module));
+    REQUIRE(module.functions[1].blocks.size() < blocks);
+    REQUIRE(run(module) == "1");
+}
+
+TEST_CASE("Optimized programs compute what unoptimized ones do", "[ir/pass]") {
+    for (const auto program :
+         {"def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + fib(n - 2)\nfib(15)",
+          "def f(n: u64): u64 = do:\n"
+          "    var i: u64 = 0u64\n"
+          "    var s: u64 = 0u64\n"
+          "    while (i <= n):\n"
+          "        if (i != 3):\n"
+          "            s = s + i\n"
+          "        i = i + 1\n"
+          "    return s\n"
+          "f(10u64)",
+          "var calls: i64 = 0\n"
+          "def count(n: i64): i64 = do:\n"
+          "    calls = calls + 1\n"
+          "    n\n"
+          "def both(n: i64): bool = count(n) > 0 and count(n) > 1\n"
+          "both(2)\n"
+          "both(0)\n"
+          "calls",
+          "def sum(n: i64): i64 = do:\n"
+          "    var s: i64 = 0\n"
+          "    for (x : data(n, 2 * n, 3 * n)):\n"
+          "        if (x > 10):\n"
+          "            break\n"
+          "        s = s + x\n"
+          "    s\n"
+          "sum(3)",
+          "def f(x: f64): f64 = x * 2.0 + 1.0\nf(f(1.5))"}) {
+        INFO(program);
+        const auto module = lower_checked(program);
+        const auto expected = run(module);
+        for (const auto level : {1, 2, 3}) {
+            INFO("-O" << level);
+            const auto o = optimized(module, level);
+            INFO(listing(o));
+            REQUIRE(run(o) == expected);
+        }
+    }
+}
+
+TEST_CASE("The pass manager times every pass", "[ir/pass]") {
+    REQUIRE(pipeline(0).statistics().empty());
+
+    auto module = lower_checked("def f(n: i64): i64 = n + 1\nf(1)");
+    auto passes = pass_manager_t();
+    auto runs = 0;
+    passes.add("count", [&](module_t&) { return ++runs > 1; })
+        .add("dce", eliminate_dead_code)
+        .add("count", [&](module_t&) { return ++runs > 1; });
+    REQUIRE(passes.run(module));
+
+    const auto& statistics = passes.statistics();
+    REQUIRE(statistics.size() == 2);
+    REQUIRE(statistics[0].name == "count");
+    REQUIRE(statistics[0].runs == 2);
+    REQUIRE(statistics[0].changes == 1);
+    REQUIRE(statistics[1].runs == 1);
+
+    auto s = stringstream();
+    s << passes;
+    REQUIRE(s.str().find("dce") != string::npos);
+    REQUIRE(s.str().find("total") != string::npos);
+}
+
+TEST_CASE("Interpolated strings are formatted at once", "[ir/strings]") {
+    const auto module = lower_checked("let n = 7\n"
+                                      "let s = \"s\"\n"
+                                      "\"{s}{n} and {n}\"");
+    REQUIRE(count(module.functions[0], opcode_t::format) == 1);
+    REQUIRE(listing(module).find("\" and \"") != string::npos);
+    REQUIRE(run(module) == "\"s7 and 7\"");
+    REQUIRE(run(optimized(module, 2)) == "\"s7 and 7\"");
+}
+
+TEST_CASE("With blocks release what they allocate however they are left", "[ir/regions]") {
+    const auto module = lower_checked("def f(n: i64): i64 = do:\n"
+                                      "    var i: i64 = 0\n"
+                                      "    var t: i64 = 0\n"
+                                      "    while (i < n):\n"
+                                      "        i = i + 1\n"
+                                      "        with:\n"
+                                      "            let a = data(i, i) + data(1, 1)\n"
+                                      "            if (i == 3) continue\n"
+                                      "            if (i > 5) break\n"
+                                      "            if (sum(a) > 100) return t\n"
+                                      "            t = t + sum(a)\n"
+                                      "    t\n"
+                                      "f(10)");
+    INFO(listing(module));
+    auto marks = 0;
+    auto releases = 0;
+    for (const auto& fn : module.functions) {
+        marks += count(fn, opcode_t::mark);
+        releases += count(fn, opcode_t::release);
+    }
+    // at its end, and before continue, break and return.
+    REQUIRE(marks == 1);
+    REQUIRE(releases == 4);
+    REQUIRE(run(module) == "32");
+    REQUIRE(run(optimized(module, 2)) == "32");
+}
+
+TEST_CASE("Malformed IR fails verification", "[ir/verify]") {
+    auto module = lower_checked("def f(n: i64): i64 = n\nf(1)");
+    auto& f = module.functions[1];
+    f.blocks[0].instructions.pop_back();
+    REQUIRE_THROWS_AS(verify(module), ir::error);
+
+    auto passes = pass_manager_t();
+    passes.verify_each = true;
+    passes.add("break", [](module_t& m) {
+        m.functions[1].blocks.push_back(block_t{"empty"});
+        return true;
+    });
+    REQUIRE_THROWS_AS(passes.run(module), ir::error);
+}
+
+TEST_CASE("Loops over generators run their body in place of each yield", "[ir/generators]") {
+    const auto module = lower_checked("def upto(n: i64): i64 = do:\n"
+                                      "    var i: i64 = 0\n"
+                                      "    while (i < n):\n"
+                                      "        yield i\n"
+                                      "        i = i + 1\n"
+                                      "def evens(n: i64): i64 = do:\n"
+                                      "    for (x : upto(n)):\n"
+                                      "        if (x % 2 == 0):\n"
+                                      "            yield x\n"
+                                      "def sum(n: i64): i64 = do:\n"
+                                      "    var s: i64 = 0\n"
+                                      "    for (x : evens(n)):\n"
+                                      "        if (x > 10):\n"
+                                      "            break\n"
+                                      "        s = s + x\n"
+                                      "    s\n"
+                                      "sum(100)");
+    INFO(listing(module));
+    // generators are no functions of their own, and nothing calls them.
+    REQUIRE(module.functions.size() == 2);
+    REQUIRE(module.functions[1].name == "sum");
+    REQUIRE(count(module.functions[1], opcode_t::call) == 0);
+    REQUIRE(run(module) == "30");
+
+    // once promoted, their variables are values like the loop's own.
+    const auto o = optimized(module, 1);
+    INFO(listing(o));
+    REQUIRE(count(o.functions[1], opcode_t::slot) == 0);
+    REQUIRE(run(o) == "30");
+}
+
+TEST_CASE("Generators end the loop over them when they return", "[ir/generators]") {
+    const auto module = lower_checked("def some(n: i64): i64 = do:\n"
+                                      "    yield n\n"
+                                      "    if (n > 1):\n"
+                                      "        return\n"
+                                      "    yield n + 1\n"
+                                      "    yield n + 2\n"
+                                      "def count(n: i64): i64 = do:\n"
+                                      "    var k: i64 = 0\n"
+                                      "    for (x : some(n)):\n"
+                                      "        if (x == 2):\n"
+                                      "            continue\n"
+                                      "        k = k * 10 + x\n"
+                                      "    k\n"
+                                      "count(1) * 100 + count(5)");
+    INFO(listing(module));
+    REQUIRE(run(module) == "1305");
+}
+
+TEST_CASE("Generators which can't be expanded are reported", "[ir/generators]") {
+    REQUIRE_THROWS_AS(lower_checked("def down(n: i64): i64 = do:\n"
+                                    "    yield n\n"
+                                    "    if (n > 0):\n"
+                                    "        for (x : down(n - 1)):\n"
+                                    "            yield x\n"
+                                    "def f(n: i64): i64 = do:\n"
+                                    "    var s: i64 = 0\n"
+                                    "    for (x : down(n)):\n"
+                                    "        s = s + x\n"
+                                    "    s\n"
+                                    "f(3)"),
+                      ir::error);
+    REQUIRE_THROWS_AS(lower_checked("def one(n: i64): i64 = do:\n"
+                                    "    yield n\n"
+                                    "one(1)"),
+                      ir::error);
+}
+
+TEST_CASE("Closures are passed the variables they capture", "[ir/closures]") {
+    const auto module = lower_checked("def f(n: i64): i64 = do:\n"
+                                      "    var x: i64 = n\n"
+                                      "    def g(m: i64): i64 = x + m\n"
+                                      "    var h = fn(m: i64): i64 = x + m + k "
+                                      "with (x, k = n * 100)\n"
+                                      "    var r = fn(m: i64): i64 = x + m with (var x)\n"
+                                      "    x = x * 10\n"
+                                      "    g(1) * 1000000 + h(1) * 1000 + r(1)\n"
+                                      "f(2)");
+    INFO(listing(module));
+    // captured variables are read when called, and copies made by "with"
+    // when the closure is.
+    REQUIRE(run(module) == "21203021");
+    auto parameters = vector<size_t>();
+    for (auto f = 2u; f < module.functions.size(); f++) {
+        const auto& type = module.functions[f].type.get().as<analysis::types::function_t>();
+        parameters.push_back(type.formal_parameters.size());
+    }
+    REQUIRE(parameters == vector<size_t>{2, 3, 2});
+
+    // nothing is allocated for them, and once inlined nothing is left.
+    const auto o = optimized(module, 2);
+    INFO(listing(o));
+    REQUIRE(count(o.functions[1], opcode_t::call) == 0);
+    REQUIRE(count(o.functions[1], opcode_t::slot) == 0);
+    REQUIRE(run(o) == "21203021");
+}
+
+TEST_CASE("Functions taking functions are specialized for those passed", "[ir/closures]") {
+    const auto module = lower_checked("def apply(f: fn(i64, i64), x: i64): i64 = f(x)\n"
+                                      "def twice(f: fn(i64, i64), x: i64): i64 = apply(f, f(x))\n"
+                                      "def triple(y: i64): i64 = 3 * y\n"
+                                      "def sum(n: i64): i64 = do:\n"
+                                      "    var k: i64 = 2\n"
+                                      "    var total: i64 = 0\n"
+                                      "    var i: i64 = 0\n"
+                                      "    while (i < n):\n"
+                                      "        total = total + twice(fn(y: i64): i64 = y * k, i)\n"
+                                      "        total = total + apply(triple, i)\n"
+                                      "        total = total + twice(triple, i)\n"
+                                      "        i = i + 1\n"
+                                      "    total\n"
+                                      "sum(5)");
+    INFO(listing(module));
+    REQUIRE(run(module) == "160");
+
+    // one specialization for each function passed, shared by the calls
+    // passing it.
+    auto names = vector<string>();
+    for (const auto& fn : module.functions) names.push_back(fn.name);
+    REQUIRE(count_if(names.begin(), names.end(), [](const string& name) {
+                return name.starts_with("apply<");
+            }) == 2);
+    REQUIRE(count_if(names.begin(), names.end(), [](const string& name) {
+                return name.starts_with("twice<");
+            }) == 2);
+
+    // the loop calls nothing once they are inlined, and the variable the
+    // lambda captures is a constant.
+    const auto o = optimized(module, 2);
+    INFO(listing(o));
+    const auto& sum = o.functions[2];
+    REQUIRE(sum.name == "sum");
+    REQUIRE(count(sum, opcode_t::call) == 0);
+    REQUIRE(count(sum, opcode_t::slot) == 0);
+    REQUIRE(run(o) == "160");
+}
+
+TEST_CASE("Templates lower to one function for each instance", "[ir/templates]") {
+    const auto module = lower_checked("def larger[T](a: T, b: T): T = if (a > b) a else b\n"
+                                      "def scaled[N: i64](x: i64): i64 = x * N\n"
+                                      "def sum(n: i64): i64 = do:\n"
+                                      "    var total: i64 = 0\n"
+                                      "    var i: i64 = 0\n"
+                                      "    while (i < n):\n"
+                                      "        total = total + larger(i, 2) + larger[i64](1, i)\n"
+                                      "        total = total + scaled[2](i) + scaled[1 + 1](i)\n"
+                                      "        i = i + 1\n"
+                                      "    total\n"
+                                      "sum(5)");
+    INFO(listing(module));
+    REQUIRE(run(module) == "64");
+
+    auto names = vector<string>();
+    for (const auto& fn : module.functions) names.push_back(fn.name);
+    REQUIRE(count(names.begin(), names.end(), "larger[i64]") == 1);
+    REQUIRE(count(names.begin(), names.end(), "scaled[2]") == 1);
+    REQUIRE(count_if(names.begin(), names.end(), [](const string& name) {
+                return name.starts_with("larger") || name.starts_with("scaled");
+            }) == 2);
+}
+
+TEST_CASE("Closures which can't be converted are reported", "[ir/closures]") {
+    // functions escaping where they are defined would need their
+    // environment on the heap.
+    REQUIRE_THROWS_AS(lower_checked("def id(f: fn(i64, i64)): fn(i64, i64) = f\n"
+                                    "def g(m: i64): i64 = m\n"
+                                    "id(g)"),
+                      ir::error);
+    REQUIRE_THROWS_AS(lower_checked("def f(n: i64): i64 = do:\n"
+                                    "    var x: i64 = n\n"
+                                    "    def g(m: i64): i64 = do:\n"
+                                    "        x = m\n"
+                                    "        m\n"
+                                    "    g(1)\n"
+                                    "f(1)"),
+                      ir::error);
+}
@@ -0,0 +1,206 @@
+#define CATCH_CONFIG_MAIN
+
+#include <sstream>
+
+#include <catch2/catch.hpp>
+
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/jit/assembler.hpp>
+#include <bullet/jit/jit.hpp>
+#include <bullet/lexer/lexer.hpp>
+#include <bullet/parser/ast.hpp>
+#include <bullet/parser/parser.hpp>
+#include <bullet/vm/lower.hpp>
+#include <bullet/vm/vm.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace lexer;
+using namespace parser;
+using namespace jit;
+
+namespace {
+auto lower_checked(string_view input) -> vm::program_t {
+    auto compilation = analysis::compilation_t();
+    const syntax::tree_t ast = input | tokenize | parse;
+    const auto typed_ast = compilation.check(ast);
+
+    auto report = stringstream();
+    report << compilation.diagnostics;
+    INFO(report.str());
+    REQUIRE(compilation.diagnostics.empty());
+
+    return vm::lower(typed_ast);
+}
+
+auto print(vm::value_t value, const vm::program_t& program) -> string {
+    auto s = stringstream();
+    vm::print_value(s, value, program.result_type);
+    return s.str();
+}
+
+// runs a program interpreted, then with native code, which must compile
+// `compiled` functions and agree with the interpreter.
+auto run(string_view input, int compiled = 1) -> string {
+    auto program = lower_checked(input);
+    auto machine = vm::vm_t();
+    const auto interpreted = print(machine.run(program), program);
+
+    REQUIRE(jit::compile(program) == compiled);
+    REQUIRE(print(machine.run(program), program) == interpreted);
+    return interpreted;
+}
+
+auto bytes(assembler_t& a) -> vector<int> {
+    const auto code = a.finish();
+    return vector<int>(code.begin(), code.end());
+}
+}  // namespace
+
+TEST_CASE("The assembler encodes x86-64 instructions", "[jit/assembler]") {
+    auto a = assembler_t();
+    a.mov(reg_t::rax, mem_t{reg_t::rbx, 8});
+    a.mov(mem_t{reg_t::r12, 16}, reg_t::rax);
+    a.mov(mem_t{reg_t::rbx, 0}, int32_t(-1));
+    REQUIRE(bytes(a) == vector<int>{0x48, 0x8b, 0x43, 0x08,              // mov rax, [rbx + 8]
+                                    0x49, 0x89, 0x44, 0x24, 0x10,        // mov [r12 + 16], rax
+                                    0x48, 0xc7, 0x03, 0xff, 0xff, 0xff, 0xff});
+
+    auto b = assembler_t();
+    b.push(reg_t::r12);
+    b.movsd(xmm_t::xmm0, mem_t{reg_t::rbx, 0x100});
+    b.setcc(cond_t::l, reg_t::rax);
+    b.ret();
+    REQUIRE(bytes(b) == vector<int>{0x41, 0x54,                                  // push r12
+                                    0xf2, 0x0f, 0x10, 0x83, 0x00, 0x01, 0x00, 0x00,  // movsd
+                                    0x0f, 0x9c, 0xc0,                            // setl al
+                                    0xc3});
+}
+
+TEST_CASE("Branches resolve to their labels", "[jit/assembler]") {
+    auto a = assembler_t();
+    const auto back = a.label();
+    const auto forward = a.label();
+    a.bind(back);
+    a.jmp(forward);
+    a.jcc(cond_t::e, back);
+    a.bind(forward);
+    REQUIRE(bytes(a) == vector<int>{0xe9, 0x06, 0x00, 0x00, 0x00,  // jmp +6
+                                    0x0f, 0x84, 0xf5, 0xff, 0xff, 0xff});  // je -11
+
+    auto unbound = assembler_t();
+    unbound.jmp(unbound.label());
+    REQUIRE_THROWS_AS(unbound.finish(), jit::error);
+}
+
+TEST_CASE("Native code computes what the VM does", "[jit/compile]") {
+    if (!jit::supported()) return;
+
+    REQUIRE(run("def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + fib(n - 2)\n"
+                "fib(20)") == "6765");
+    REQUIRE(run("def f(x: i32): i32 = x + 1\nf(2147483647)") == "-2147483648");
+    REQUIRE(run("def f(b: u8): u8 = b + 10\nf(250u8)") == "4");
+    REQUIRE(run("def f(n: i64, d: i64): i64 = n / d + n % d\nf(-7, 2)") == "-4");
+    REQUIRE(run("def f(u: u64): u64 = u / 2\nf(18446744073709551615u64)") ==
+            "9223372036854775807");
+    REQUIRE(run("def f(n: i64): i64 = (n ** 4) ^ (n & 10)\nf(3)") == "83");
+    REQUIRE(run("def f(x: f32): f32 = x + 0.2f32\nf(0.1f32)") == [] {
+        auto s = stringstream();
+        s << 0.1f + 0.2f;
+        return s.str();
+    }());
+    REQUIRE(run("def f(d: f64): f64 = -(d * 4) / 3\nf(1.5)") == "-2");
+    REQUIRE(run("def f(x: f64): bool = x >= 2.5 and x != 3.0 and not (x < 0.0)\nf(2.5)") ==
+            "true");
+    REQUIRE(run("def f(n: u64): bool = n - 1 > 0\nf(0u64)") == "true");
+    REQUIRE(run("def label(n: i64, x: f64): string = \"{n} is {x}\"\nlabel(6 * 7, 0.5)") ==
+            "\"42 is 0.5\"");
+}
+
+TEST_CASE("Native code runs loops and uses globals", "[jit/compile]") {
+    if (!jit::supported()) return;
+
+    REQUIRE(run("def loops(n: i64): i64 = do:\n"
+                "    var s: i64 = 0\n"
+                "    var i: i64 = 0\n"
+                "    while (true):\n"
+                "        i = i + 1\n"
+                "        if (i > n) break\n"
+                "        if (i % 2 == 0) continue\n"
+                "        s = s + i\n"
+                "    return s\n"
+                "loops(10)") == "25");
+    REQUIRE(run("var calls: i64 = 0\n"
+                "def count(n: i64): i64 = do:\n"
+                "    calls = calls + 1\n"
+                "    n\n"
+                "count(1) + count(2)\n"
+                "calls") == "2");
+    REQUIRE(run("def sum(n: i64): i64 = do:\n"
+                "    var s: i64 = 0\n"
+                "    for (x : data(n, n + 1, n + 2)):\n"
+                "        s = s + x\n"
+                "    return s\n"
+                "sum(1)") == "6");
+    REQUIRE(run("def dot(x: f64): f64 = do:\n"
+                "    let a = data(x, x + 1.0, x + 2.0) * data(0.5, 0.25, 2.0)\n"
+                "    return sum(a) + max(a)\n"
+                "dot(1.0)") == "13");
+    REQUIRE(run("def strided(x: f64): f64 = do:\n"
+                "    let a = data(x, x + 1.0, x + 2.0, x + 3.0, x + 4.0, x + 5.0)\n"
+                "    let evens = slice(a, 0, 6, 2)\n"
+                "    var t: f64 = 0.0\n"
+                "    for (y : slice(a, 1, 6, 2)):\n"
+                "        t = t + y\n"
+                "    return sum(evens * slice(evens, 0, 3)) + t\n"
+                "strided(1.0)") == "47");
+    REQUIRE(run("def regions(n: i64): i64 = do:\n"
+                "    var t: i64 = 0\n"
+                "    for (x : data(1, 2, 3, 4, 5, 6)):\n"
+                "        with:\n"
+                "            let a = data(x, n) * data(x, 2)\n"
+                "            if (x > 4) break\n"
+                "            t = t + sum(a)\n"
+                "    return t\n"
+                "regions(3)") == "54");
+}
+
+TEST_CASE("Only functions with primitive signatures are compiled", "[jit/compile]") {
+    if (!jit::supported()) return;
+
+    auto program = lower_checked("def add(a: i64, b: i64): i64 = a + b\n"
+                                 "def twice(n: i64): i64 = add(n, n)\n"
+                                 "def square(n: i64): i64 = n * n\n"
+                                 "twice(square(3))");
+    REQUIRE(jit::compile(program) == 3);
+    REQUIRE(program.native[0] == nullptr);
+
+    // without a signature to go by, add stays interpreted, and so does twice,
+    // which calls it.
+    program.functions[1].type = analysis::VOID;
+    REQUIRE(jit::compile(program) == 1);
+    REQUIRE(program.native[1] == nullptr);
+    REQUIRE(program.native[2] == nullptr);
+    REQUIRE(program.native[3] != nullptr);
+    REQUIRE(vm::vm_t().run(program).i == 18);
+}
+
+TEST_CASE("Faults in native code raise vm::error", "[jit/errors]") {
+    if (!jit::supported()) return;
+
+    auto division = lower_checked("def f(n: i64): i64 = 1 / n\nf(0)");
+    REQUIRE(jit::compile(division) == 1);
+    REQUIRE_THROWS_AS(vm::vm_t().run(division), vm::error);
+
+    auto recursion = lower_checked("def f(n: i64): i64 = f(n + 1)\nf(0)");
+    REQUIRE(jit::compile(recursion) == 1);
+    REQUIRE_THROWS_AS(vm::vm_t().run(recursion), vm::error);
+
+    // the VM can still run programs after a fault.
+    auto machine = vm::vm_t();
+    REQUIRE_THROWS_AS(machine.run(division), vm::error);
+    auto fib = lower_checked("def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + fib(n - 2)\n"
+                             "fib(10)");
+    REQUIRE(jit::compile(fib) == 1);
+    REQUIRE(machine.run(fib).i == 55);
+}
@@ -1,5 +1,7 @@
 #define CATCH_CONFIG_MAIN
 
+#include <cstdlib>
+#include <random>
 #include <sstream>
 
 #include <range/v3/algorithm/copy.hpp>
@@ -9,6 +11,8 @@
 
 #include <catch2/catch.hpp>
 
+#include <bullet/lexer/decimal.hpp>
+#include <bullet/lexer/error.hpp>
 #include <bullet/lexer/lexer.hpp>
 #include <bullet/lexer/token.hpp>
 
@@ -22,6 +26,10 @@ auto tok_list(string_view input) -> source_token_list_t {
     auto output = input | tokenize;
     return output.tokens;
 }
+
+auto float_value(const string& input) -> long double {
+    return get<literal::numeric::floating_point_t>(tok_list(input).front().token).value;
+}
 }  // namespace
 
 TEST_CASE("Basic token functionality", "[token]") {
@@ -139,6 +147,69 @@ TEST_CASE("Tokenize: floats.", "[lexer/tokenize]") {
     REQUIRE(tok_list("42e1f32"sv) == token_list_t{token_t(floating_point_t(420, 32))});
 }
 
+TEST_CASE("Tokenize: integers are parsed eight digits at a time.", "[lexer/tokenize]") {
+    using namespace literal::numeric;
+    REQUIRE(decimal::is_eight_digits("12345678"));
+    REQUIRE(!decimal::is_eight_digits("1234567a"));
+    REQUIRE(!decimal::is_eight_digits("/2345678"));
+    REQUIRE(!decimal::is_eight_digits("1234567:"));
+    REQUIRE(decimal::parse_eight_digits("12345678") == 12345678);
+    REQUIRE(decimal::parse_eight_digits("00000009") == 9);
+
+    REQUIRE(tok_list("1_000_000_000_000"sv) ==
+            token_list_t{token_t(integral_t(1'000'000'000'000, '?', 0))});
+    REQUIRE(tok_list("18446744073709551615u64"sv) ==
+            token_list_t{token_t(integral_t(18446744073709551615ull, 'u', 64))});
+    REQUIRE(tok_list("0xffff_ffff_ffff_ffff"sv) ==
+            token_list_t{token_t(integral_t(18446744073709551615ull, '?', 0))});
+    REQUIRE(tok_list("010"sv) == token_list_t{token_t(integral_t(8, '?', 0))});
+
+    REQUIRE_THROWS_AS(tok_list("18446744073709551616"sv), lexer::error);
+    REQUIRE_THROWS_AS(tok_list("0x1_0000_0000_0000_0000"sv), lexer::error);
+
+    // a float may have any number of digits.
+    REQUIRE(float_value("18446744073709551616.0") == 18446744073709551616.0);
+}
+
+TEST_CASE("Tokenize: floats are correctly rounded.", "[lexer/tokenize]") {
+    const auto same_as_strtod = [](const string& literal) {
+        INFO(literal);
+        REQUIRE(float_value(literal) == strtod(literal.c_str(), nullptr));
+        REQUIRE(float_value(literal + "f64") == strtod(literal.c_str(), nullptr));
+        REQUIRE(float_value(literal + "f32") == strtof(literal.c_str(), nullptr));
+    };
+
+    for (const auto literal : {
+             "0.1", "0.3", "1.0", "3.14159", "1e23", "8.5e-5", "9007199254740993.0",
+             "9007199254740993e0", "2.2250738585072011e-308", "2.2250738585072014e-308",
+             "1.7976931348623157e308", "1.7976931348623159e308", "4.9406564584124654e-324",
+             "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400", "1e400",
+             "3.4028234664e38", "3.4028235677973366e38", "1.17549435e-38", "1.4e-45",
+             "7.006492321624085e-46", "16777217.0", "0.100000000000000005551115123125782702118",
+             "123456789012345678901234567890e-20", "0.000000000000000000000000000001",
+             "4503599627370497.5", "4503599627370496.5", "1e0", "0.0", "0e999",
+         })
+        same_as_strtod(literal);
+
+    auto random = mt19937_64(1789);
+    for (auto i = 0; i < 20'000; i++) {
+        auto literal = to_string(1 + random() % 9);
+        const auto n_digits = random() % 25;
+        const auto point = random() % (n_digits + 1);
+        for (auto j = 0u; j < n_digits; j++) {
+            if (j == point) literal += '.';
+            literal += char('0' + random() % 10);
+        }
+        if (literal.back() == '.') literal += '0';
+        if (random() % 2) literal += "e" + to_string(int(random() % 700) - 350);
+        if (literal.find_first_of(".e") == string::npos) literal += ".0";
+
+        same_as_strtod(literal);
+    }
+
+    REQUIRE(float_value("1_000.000_5") == 1000.0005);
+}
+
 TEST_CASE("Tokenize: strings.", "[lexer/tokenize]") {
     REQUIRE(tok_list(R"bt("")bt"sv) == token_list_t{token_t(string_token_t(""))});
     REQUIRE(tok_list(R"bt("this is a test")bt"sv) ==
@@ -156,6 +227,26 @@ TEST_CASE("Tokenize: strings.", "[lexer/tokenize]") {
             token_list_t{token_t(string_token_t("tab? \tfoo"))});
 }
 
+TEST_CASE("String literals interpolate the variables named between braces", "[lexer/strings]") {
+    using pieces_t = vector<string_piece_t>;
+    const auto of = [](string s) { return pieces(string_token_t(move(s))); };
+
+    REQUIRE(of("") == pieces_t{});
+    REQUIRE(of("plain") == pieces_t{{"plain", false}});
+    REQUIRE(of("{x}") == pieces_t{{"x", true}});
+    REQUIRE(of("x = {x}, y = {_y2}!") ==
+            pieces_t{{"x = ", false}, {"x", true}, {", y = ", false}, {"_y2", true}, {"!", false}});
+    REQUIRE(of("{a}{b}") == pieces_t{{"a", true}, {"b", true}});
+
+    // doubled braces are braces, and so are braces around anything else.
+    REQUIRE(of("{{x}}") == pieces_t{{"{x}", false}});
+    REQUIRE(of("{1} {x y} {} {") == pieces_t{{"{1} {x y} {} {", false}});
+    REQUIRE(of("set {{{x}}}") == pieces_t{{"set {", false}, {"x", true}, {"}", false}});
+
+    REQUIRE(interpolates(string_token_t("{x}")));
+    REQUIRE(!interpolates(string_token_t("{{x}}")));
+}
+
 TEST_CASE("Tokenize: random shit.", "[lexer/tokenize]") {
     const auto input = R"bt(
 foo:
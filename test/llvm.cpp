@@ -0,0 +1,161 @@
+#define CATCH_CONFIG_MAIN
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <catch2/catch.hpp>
+
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/backend/llvm.hpp>
+#include <bullet/lexer/lexer.hpp>
+#include <bullet/parser/ast.hpp>
+#include <bullet/parser/parser.hpp>
+#include <bullet/vm/lower.hpp>
+#include <bullet/vm/vm.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace lexer;
+using namespace parser;
+using namespace backend;
+
+namespace {
+auto check(string_view input) -> syntax::attr_node_t<analysis::type_t> {
+    auto compilation = analysis::compilation_t();
+    const syntax::tree_t ast = input | tokenize | parse;
+    auto typed_ast = compilation.check(ast);
+
+    auto report = stringstream();
+    report << compilation.diagnostics;
+    INFO(report.str());
+    REQUIRE(compilation.diagnostics.empty());
+    return typed_ast;
+}
+
+auto print(vm::value_t value, const analysis::type_t& type) -> string {
+    auto s = stringstream();
+    vm::print_value(s, value, type);
+    return s.str();
+}
+
+// runs a program in the VM, then compiled by LLVM at every optimization
+// level, which must agree with the VM.
+auto run(string_view input) -> string {
+    const auto typed_ast = check(input);
+    const auto program = vm::lower(typed_ast);
+    const auto interpreted = print(vm::vm_t().run(program), program.result_type);
+
+    for (auto level = 0; level <= 3; level++) {
+        INFO("-O" << level);
+        auto module = llvm_module_t(typed_ast);
+        module.optimize(level);
+        REQUIRE(print(module.run(), module.result_type()) == interpreted);
+    }
+    return interpreted;
+}
+}  // namespace
+
+TEST_CASE("LLVM code computes what the VM does", "[backend/llvm]") {
+    REQUIRE(run("def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + fib(n - 2)\n"
+                "fib(20)") == "6765");
+    REQUIRE(run("def f(x: i32): i32 = x + 1\nf(2147483647)") == "-2147483648");
+    REQUIRE(run("def f(b: u8): u8 = b + 10\nf(250u8)") == "4");
+    REQUIRE(run("def f(n: i64, d: i64): i64 = n / d + n % d\nf(-7, 2)") == "-4");
+    REQUIRE(run("def f(n: i8, d: i8): i8 = n / d\nf(-128i8, -1i8)") == "-128");
+    REQUIRE(run("def f(u: u64): u64 = u / 2\nf(18446744073709551615u64)") ==
+            "9223372036854775807");
+    REQUIRE(run("def f(n: i64): i64 = (n ** 4) ^ (n & 10)\nf(3)") == "83");
+    REQUIRE(run("def f(x: f32): f32 = x + 0.2f32\nf(0.1f32)") == [] {
+        auto s = stringstream();
+        s << 0.1f + 0.2f;
+        return s.str();
+    }());
+    REQUIRE(run("def f(d: f64): f64 = -(d * 4) / 3 + d ** 2.0 + d % 1.0\nf(1.5)") == "0.75");
+    REQUIRE(run("def f(x: f64): bool = x >= 2.5 and x != 3.0 and not (x < 0.0)\nf(2.5)") ==
+            "true");
+    REQUIRE(run("def f(n: u64): bool = n - 1 > 0 or n / 0u64 > 0u64\nf(0u64)") == "true");
+}
+
+TEST_CASE("LLVM code runs loops, globals and arrays", "[backend/llvm]") {
+    REQUIRE(run("def loops(n: i64): i64 = do:\n"
+                "    var s: i64 = 0\n"
+                "    var i: i64 = 0\n"
+                "    while (true):\n"
+                "        i = i + 1\n"
+                "        if (i > n) break\n"
+                "        if (i % 2 == 0) continue\n"
+                "        s = s + i\n"
+                "    return s\n"
+                "loops(10)") == "25");
+    REQUIRE(run("var calls: i64 = 0\n"
+                "def count(n: i64): i64 = do:\n"
+                "    calls = calls + 1\n"
+                "    n\n"
+                "count(1) + count(2)\n"
+                "calls") == "2");
+    REQUIRE(run("def sum(n: i64): i64 = do:\n"
+                "    var s: i64 = 0\n"
+                "    for (x : data(n, n + 1, n + 2)):\n"
+                "        s = s + x\n"
+                "    for (y : data(10, 20, 30)):\n"
+                "        s = s + y\n"
+                "    return s\n"
+                "sum(1)") == "66");
+    REQUIRE(run("def dot(x: f64): f64 = do:\n"
+                "    let a = data(x, x + 1.0, x + 2.0) * data(0.5, 0.25, 2.0)\n"
+                "    return sum(a) + max(a)\n"
+                "dot(1.0)") == "13");
+    REQUIRE(run("def strided(x: f64): f64 = do:\n"
+                "    let a = data(x, x + 1.0, x + 2.0, x + 3.0, x + 4.0, x + 5.0)\n"
+                "    let evens = slice(a, 0, 6, 2)\n"
+                "    var t: f64 = 0.0\n"
+                "    for (y : slice(a, 1, 6, 2)):\n"
+                "        t = t + y\n"
+                "    return sum(evens * slice(evens, 0, 3)) + t\n"
+                "strided(1.0)") == "47");
+}
+
+TEST_CASE("LLVM modules print as IR and emit objects", "[backend/llvm]") {
+    auto module = llvm_module_t(check("def square(n: i64): i64 = n * n\nsquare(7)"), "squares");
+    const auto unoptimized = module.ir();
+    REQUIRE(unoptimized.find("define i64 @bt_main()") != string::npos);
+    REQUIRE(unoptimized.find("define internal i64 @square(i64 %n)") != string::npos);
+    REQUIRE(unoptimized.find("alloca") != string::npos);
+
+    module.optimize(2);
+    REQUIRE(module.ir().find("ret i64 49") != string::npos);
+    REQUIRE(module.run().i == 49);
+    REQUIRE_THROWS_AS(module.optimize(4), backend::error);
+
+    const auto path = string("test_llvm_square.o");
+    module.emit_object(path);
+    auto object = ifstream(path, ios::binary);
+    auto magic = string(4, '\0');
+    object.read(magic.data(), 4);
+    REQUIRE(magic == "\x7f" "ELF");
+    remove(path.c_str());
+}
+
+TEST_CASE("Faults in LLVM code raise backend::error", "[backend/llvm]") {
+    auto division = llvm_module_t(check("def f(n: i64): i64 = 1 / n\nf(0)"));
+    REQUIRE_THROWS_AS(division.run(), backend::error);
+
+    auto recursion = llvm_module_t(check("def f(n: i64): i64 = f(n + 1) + 1\nf(0)"));
+    REQUIRE_THROWS_WITH(recursion.run(), "Stack overflow");
+
+    // modules still run after a fault.
+    REQUIRE_THROWS_WITH(division.run(), "Integer division by zero");
+    auto fib = llvm_module_t(check("def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + "
+                                   "fib(n - 2)\nfib(10)"));
+    REQUIRE(fib.run().i == 55);
+
+    REQUIRE_THROWS_AS(llvm_module_t(check("def f(n: i64): i64 = do:\n"
+                                          "    var x: i64 = n\n"
+                                          "    def g(m: i64): i64 = do:\n"
+                                          "        x = m\n"
+                                          "        m\n"
+                                          "    g(1)\n"
+                                          "f(1)")),
+                      backend::error);
+}
@@ -13,6 +13,7 @@
 #include <bullet/lexer/token.hpp>
 #include <bullet/parser/ast.hpp>
 #include <bullet/parser/parser.hpp>
+#include <bullet/parser/traversal.hpp>
 
 using namespace std;
 using namespace bt;
@@ -31,6 +32,12 @@ using node_t = noattr<attr_node_t>;
 auto ast(string_view input) -> syntax::tree_t {
     return input | tokenize | parse;
 }
+
+auto kind(const node_t& n) -> string {
+    if (n.get().is<bin_op_t<empty_attribute_t>>()) return "op";
+    if (n.get().is<lexer::identifier_t>()) return n.get().get<lexer::identifier_t>().name;
+    return "?";
+}
 }  // namespace
 
 TEST_CASE("Integral literal parsing.", "[parser]") {
@@ -127,4 +134,87 @@ TEST_CASE("Statements", "[parser]") {
 
     REQUIRE(ast(R"(some_fn(x))") ==
             tree_t(noattr<syntax::invoc_t>{node_t(id("some_fn")), noattr<syntax::data_t>{x}}));
+
+    auto body = noattr<syntax::block_t>();
+    body.push_back(
+        node_t(tree_t(noattr<syntax::assign_t>{x, node_t(noattr<bin_op_t>{PLUS, y, two})})));
+    REQUIRE(ast("with:\n    x = y + 2") == tree_t(noattr<syntax::with_t>{node_t(tree_t(body))}));
+}
+
+TEST_CASE("Function types", "[parser]") {
+    const auto i64 = node_t(primitive_type_t(i64_t{}));
+    const auto u64 = node_t(primitive_type_t(u64_t{}));
+
+    // fn(R, A...) is a type where parentheses after fn start with one.
+    REQUIRE(ast("fn(i64, u64)") ==
+            tree_t(noattr<syntax::invoc_t>{node_t(id("fn")), noattr<syntax::data_t>{i64, u64}}));
+    REQUIRE(ast("fn(x: i64) = x").is<noattr<syntax::fn_expr_t>>());
+}
+
+TEST_CASE("Templates", "[parser]") {
+    // parameters are named, with the type of those which are constants.
+    const auto def = ast("def f[T, N: u64](x: T): T = x");
+    REQUIRE(def.is<noattr<syntax::var_def_t>>());
+    const auto& rhs = def.get<noattr<syntax::var_def_t>>().rhs;
+    const auto& t = rhs.get().get<noattr<syntax::template_t>>();
+    REQUIRE(t.arguments.size() == 2);
+    REQUIRE(t.arguments[0].first.name == "T");
+    REQUIRE(t.arguments[1].first.name == "N");
+    REQUIRE(t.body.get().is<noattr<syntax::fn_expr_t>>());
+
+    // arguments are not.
+    const auto use = ast("f[i64, 3](x)");
+    REQUIRE(use.is<noattr<syntax::invoc_t>>());
+    const auto& target = use.get<noattr<syntax::invoc_t>>().target;
+    const auto& u = target.get().get<noattr<syntax::template_t>>();
+    REQUIRE(u.arguments.size() == 2);
+    REQUIRE(u.arguments[0].first.name.empty());
+    REQUIRE(u.body == node_t(id("f")));
+}
+
+TEST_CASE("Traversal visits nodes in evaluation order", "[parser/traversal]") {
+    const auto root = node_t(ast("x + y * z"));
+
+    auto pre = vector<string>(), post = vector<string>();
+    REQUIRE(traverse(
+        root, [&](const node_t& n) { pre.push_back(kind(n)); },
+        [&](const node_t& n) { post.push_back(kind(n)); }));
+
+    REQUIRE(pre == vector<string>{"op", "x", "op", "y", "z"});
+    REQUIRE(post == vector<string>{"x", "y", "z", "op", "op"});
+
+    auto seen = vector<string>();
+    REQUIRE(!traverse_pre_order(root, [&](const node_t& n) {
+        seen.push_back(kind(n));
+        return kind(n) == "y" ? traverse_action_t::stop : traverse_action_t::descend;
+    }));
+    REQUIRE(seen == vector<string>{"op", "x", "op", "y"});
+
+    seen.clear();
+    traverse_pre_order(root, [&](const node_t& n, const traverse_context_t<empty_attribute_t>& c) {
+        seen.push_back(kind(n) + ":" + to_string(c.depth));
+        return c.depth == 1 ? traverse_action_t::skip : traverse_action_t::descend;
+    });
+    REQUIRE(seen == vector<string>{"op:0", "x:1", "op:1"});
+}
+
+TEST_CASE("Traversal copes with a million-deep expression chain", "[parser/traversal]") {
+    const auto depth = 1'000'000;
+    const auto one = node_t(integral_literal_t(1, '?', 0));
+
+    auto chain = one;
+    for (auto i = 0; i < depth; i++) chain = node_t(noattr<bin_op_t>{PLUS, chain, one});
+
+    auto nodes = size_t(0), max_depth = size_t(0);
+    traverse_pre_order(chain,
+                       [&](const node_t&, const traverse_context_t<empty_attribute_t>& c) {
+                           nodes++;
+                           max_depth = max(max_depth, c.depth);
+                       });
+
+    REQUIRE(nodes == 2 * depth + 1);
+    REQUIRE(max_depth == depth);
+
+    dismantle(chain);
+    REQUIRE(!chain.get());
 }
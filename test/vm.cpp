@@ -0,0 +1,521 @@
+#define CATCH_CONFIG_MAIN
+
+#include <array>
+#include <sstream>
+
+#include <catch2/catch.hpp>
+
+#include <bullet/analysis/compilation.hpp>
+#include <bullet/lexer/lexer.hpp>
+#include <bullet/parser/ast.hpp>
+#include <bullet/parser/parser.hpp>
+#include <bullet/vm/bytecode.hpp>
+#include <bullet/vm/error.hpp>
+#include <bullet/vm/fuse.hpp>
+#include <bullet/vm/kernels.hpp>
+#include <bullet/vm/lower.hpp>
+#include <bullet/vm/vm.hpp>
+
+using namespace std;
+using namespace bt;
+using namespace lexer;
+using namespace parser;
+using namespace vm;
+
+namespace {
+auto lower_checked(string_view input) -> program_t {
+    auto compilation = analysis::compilation_t();
+    const syntax::tree_t ast = input | tokenize | parse;
+    const auto typed_ast = compilation.check(ast);
+
+    auto report = stringstream();
+    report << compilation.diagnostics;
+    INFO(report.str());
+    REQUIRE(compilation.diagnostics.empty());
+
+    return lower(typed_ast);
+}
+
+// runs a program, which must type check, and prints its result.
+auto run(string_view input) -> string {
+    const auto program = lower_checked(input);
+    auto machine = vm_t();
+    const auto result = machine.run(program);
+
+    auto s = stringstream();
+    print_value(s, result, program.result_type);
+    return s.str();
+}
+}  // namespace
+
+TEST_CASE("Instructions pack their operands into 32 bits", "[vm/bytecode]") {
+    const auto abc = instruction_t::abc(opcode_t::add_i, 1, 2, 255);
+    REQUIRE(abc.op() == opcode_t::add_i);
+    REQUIRE(abc.a() == 1);
+    REQUIRE(abc.b() == 2);
+    REQUIRE(abc.c() == 255);
+
+    const auto abx = instruction_t::abx(opcode_t::loadi, 7, -3);
+    REQUIRE(abx.op() == opcode_t::loadi);
+    REQUIRE(abx.a() == 7);
+    REQUIRE(abx.sbx() == -3);
+
+    auto j = instruction_t::sj(opcode_t::jmp, 0);
+    j.patch(instruction_t::min_sj);
+    REQUIRE(j.op() == opcode_t::jmp);
+    REQUIRE(j.sj() == instruction_t::min_sj);
+
+    auto branch = instruction_t::abx(opcode_t::jmp_ifnot, 4, 0);
+    branch.patch(-42);
+    REQUIRE(branch.a() == 4);
+    REQUIRE(branch.sbx() == -42);
+}
+
+TEST_CASE("Arithmetic follows the attributed types", "[vm/arithmetic]") {
+    REQUIRE(run("1 + 2 * 3") == "7");
+    REQUIRE(run("-5") == "-5");
+    REQUIRE(run("var x: i32 = 2147483647\nx = x + 1\nx") == "-2147483648");
+    REQUIRE(run("var b: u8 = 250u8\nb = b + 10\nb") == "4");
+    REQUIRE(run("var n: i64 = -7\nn / 2") == "-3");
+    REQUIRE(run("var n: i64 = -7\nn % 2") == "-1");
+    REQUIRE(run("var u: u64 = 18446744073709551615u64\nu / 2") == "9223372036854775807");
+    REQUIRE(run("var n: i64 = 3\nn ** 4") == "81");
+    REQUIRE(run("var n: i64 = 12\n(n & 10) | 1") == "9");
+
+    auto f = stringstream();
+    f << 0.1f + 0.2f;
+    REQUIRE(run("var x: f32 = 0.1f32\nx = x + 0.2f32\nx") == f.str());
+    REQUIRE(run("var d: f64 = 1.5\nd * 4") == "6");
+}
+
+TEST_CASE("Comparisons and logical operators", "[vm/arithmetic]") {
+    REQUIRE(run("var n: i64 = -1\nn < 0") == "true");
+    REQUIRE(run("var n: u64 = 0u64\nn - 1 > 0") == "true");
+    REQUIRE(run("var x: f64 = 2.5\nx >= 2.5 and x != 3.0") == "true");
+    REQUIRE(run("var n: i64 = 0\nn == 1 or not (n == 0)") == "false");
+}
+
+TEST_CASE("Control flow", "[vm/control]") {
+    REQUIRE(run("var n: i64 = 5\n"
+                "var r: i64 = 0\n"
+                "if (n < 0):\n"
+                "    r = 1\n"
+                "elif (n < 10):\n"
+                "    r = 2\n"
+                "else:\n"
+                "    r = 3\n"
+                "r") == "2");
+    REQUIRE(run("var i: i64 = 0\n"
+                "var s: i64 = 0\n"
+                "while (i < 100):\n"
+                "    s = s + i\n"
+                "    i = i + 1\n"
+                "s") == "4950");
+    REQUIRE(run("var i: i64 = 0\n"
+                "var s: i64 = 0\n"
+                "while (true):\n"
+                "    i = i + 1\n"
+                "    if (i > 10) break\n"
+                "    if (i % 2 == 0) continue\n"
+                "    s = s + i\n"
+                "s") == "25");
+    REQUIRE(run("var s: i64 = 0\n"
+                "for (x : data(1, 2, 3, 4)):\n"
+                "    s = s + x\n"
+                "s") == "10");
+}
+
+TEST_CASE("Functions", "[vm/functions]") {
+    REQUIRE(run("def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + fib(n - 2)\n"
+                "fib(20)") == "6765");
+    REQUIRE(run("def add(a: i64, b: i64): i64 = a + b\n"
+                "def twice(a: i64): i64 = add(a, a)\n"
+                "twice(add(1, 2))") == "6");
+    REQUIRE(run("var calls: i64 = 0\n"
+                "def count(n: i64): i64 = do:\n"
+                "    calls = calls + 1\n"
+                "    n\n"
+                "count(1) + count(2)\n"
+                "calls") == "2");
+    REQUIRE(run("def sum(n: i64): i64 = do:\n"
+                "    var s: i64 = 0\n"
+                "    var i: i64 = 0\n"
+                "    while (i <= n):\n"
+                "        s = s + i\n"
+                "        i = i + 1\n"
+                "    return s\n"
+                "sum(1000)") == "500500");
+}
+
+TEST_CASE("Arrays", "[vm/arrays]") {
+    REQUIRE(run("let a = data(1, 2, 3)\na") == "(1, 2, 3)");
+    REQUIRE(run("var n: i64 = 5\nlet a = data(n, n + 1)\na") == "(5, 6)");
+}
+
+TEST_CASE("Arrays of numbers compute element by element", "[vm/kernels]") {
+    REQUIRE(run("data(1, 2, 3) + data(4, 5, 6)") == "(5, 7, 9)");
+    REQUIRE(run("var n: i64 = 7\ndata(n, n * 2) / data(n - 5, n - 4)") == "(3, 4)");
+    REQUIRE(run("data(1.5, 2.5) * data(2.0, 0.5)") == "(3, 1.25)");
+    REQUIRE(run("data(1, 5, 3) < data(2, 2, 3)") == "(true, false, false)");
+    REQUIRE(run("data(1, 5, 3) >= data(2, 2, 3)") == "(false, true, true)");
+
+    REQUIRE(run("let a = data(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11)\nsum(a)") == "66");
+    REQUIRE(run("let a = data(4, -2, 7)\nmin(a)") == "-2");
+    REQUIRE(run("max(data(4, -2, 7) * data(2, 2, 2))") == "14");
+    // elements keep the width of their type.
+    REQUIRE(run("var x: i8 = 100i8\nlet a = data(x, x, x)\nsum(a)") == "44");
+    REQUIRE(run("var x: i8 = 100i8\ndata(x, x) + data(x, x)") == "(-56, -56)");
+
+    REQUIRE_THROWS_AS(run("var z: i64 = 0\ndata(z, z) / data(z, z)"), vm::error);
+}
+
+TEST_CASE("Slices view the elements of arrays in place", "[vm/slices]") {
+    const auto a = "let a = data(1, 2, 3, 4, 5, 6, 7, 8, 9, 10)\n"s;
+    REQUIRE(run(a + "let s = slice(a, 1, 10, 2)\nsum(s)") == "30");
+    REQUIRE(run(a + "let s = slice(a, 0, 10, 3)\nmin(s) + max(s)") == "11");
+    // slices of slices view the same array.
+    REQUIRE(run(a + "let s = slice(a, 1, 10, 2)\nlet t = slice(s, 1, 4, 2)\nsum(t)") == "12");
+
+    REQUIRE(run(a + "slice(a, 0, 3) + slice(a, 7, 10)") == "(9, 11, 13)");
+    REQUIRE(run(a + "slice(a, 0, 10, 2) * data(1, 1, 1, 1, 2)") == "(1, 3, 5, 7, 18)");
+    REQUIRE(run(a + "slice(a, 1, 10, 3) < slice(a, 3, 6)") == "(true, false, false)");
+    REQUIRE(run(a +
+                "var t: i32 = 0\n"
+                "for (x : slice(a, 2, 10, 4)):\n"
+                "    t = t * 10 + x\n"
+                "t") == "37");
+
+    // arrays are passed as slices of all their elements.
+    REQUIRE(run("def total(xs: slice(i32, 0, 3)): i32 = sum(xs)\n"
+                "let b = data(1, 2, 3)\n"
+                "total(b)") == "6");
+    REQUIRE_THROWS_AS(run(a + "let s = slice(a, 3, 3)\nsum(s)"), vm::error);
+}
+
+TEST_CASE("Strings keep short text in place and borrow long literals", "[vm/strings]") {
+    const auto small = string_t("hello");
+    REQUIRE(small.is_small());
+    REQUIRE(small.view() == "hello");
+    REQUIRE(reinterpret_cast<const void*>(small.data()) == &small);
+
+    const auto text = "a string which doesn't fit in 24 bytes"s;
+    auto large = string_t(text);
+    REQUIRE(!large.is_small());
+    REQUIRE(!large.is_borrowed());
+    REQUIRE(large.view() == text);
+    const auto* data = large.data();
+    const auto moved = std::move(large);
+    REQUIRE(moved.data() == data);
+    REQUIRE(large.view().empty());
+    REQUIRE(moved.clone() == moved);
+    REQUIRE(moved.clone().data() != data);
+
+    const auto borrowed = string_t::borrow(text);
+    REQUIRE(borrowed.is_borrowed());
+    REQUIRE(borrowed.data() == text.data());
+    REQUIRE(borrowed.clone().data() == text.data());
+
+    // literals are stored once, and borrow their text once sealed.
+    auto pool = literal_pool_t();
+    const auto* a = pool.intern(text);
+    REQUIRE(pool.intern("short") != a);
+    REQUIRE(pool.intern(text) == a);
+    REQUIRE(pool.size() == 2);
+    REQUIRE(pool.bytes() == text.size() + 5);
+    pool.seal();
+    REQUIRE(a->is_borrowed());
+    REQUIRE(a->view() == text);
+    REQUIRE(pool.intern(text) == a);
+
+    const auto values = array{value_t{.s = a}, value_t{.i = -12}, value_t{.u = 1}};
+    const auto pieces = array{value_t{.u = uint64_t(piece_t::text)},
+                              value_t{.u = uint64_t(piece_t::signed_int)},
+                              value_t{.u = uint64_t(piece_t::boolean)}};
+    auto arena = arena_t();
+    REQUIRE(format(values.data(), pieces.data(), 3, arena)->view() == text + "-12true");
+}
+
+TEST_CASE("String literals interpolate variables", "[vm/strings]") {
+    REQUIRE(run("\"hello\"") == "\"hello\"");
+    REQUIRE(run("let n = 42\n\"n = {n}\"") == "\"n = 42\"");
+    REQUIRE(run("let x: f64 = 0.5\nlet y: f32 = 2.25f32\nlet b = 1 < 2\n\"{x}, {y}, {b}\"") ==
+            "\"0.5, 2.25, true\"");
+    REQUIRE(run("let u = 200u8\nlet i = -3i8\n\"{u}{i}\"") == "\"200-3\"");
+    REQUIRE(run("let name = \"world\"\n"
+                "let greeting = \"hello, {name}\"\n"
+                "\"{greeting}! {{{name}}}\"") == "\"hello, world! {{world}}\"");
+    REQUIRE(run("var s: string = \"\"\n"
+                "var i: i64 = 0\n"
+                "while (i < 12):\n"
+                "    s = \"{s}{i}\"\n"
+                "    i = i + 1\n"
+                "s") == "\"01234567891011\"");
+    REQUIRE(run("def label(n: i64): string = \"n = {n}\"\n"
+                "label(4)") == "\"n = 4\"");
+
+    // equal literals are one constant, whose text isn't copied.
+    const auto program = lower_checked("let a = \"a literal of more than 23 bytes\"\n"
+                                       "let b = \"a literal of more than 23 bytes\"\n"
+                                       "\"{a}{b}\"");
+    REQUIRE(program.literals.size() == 1);
+    auto machine = vm_t();
+    const auto result = machine.run(program);
+    REQUIRE(result.s->view() == "a literal of more than 23 bytesa literal of more than 23 bytes");
+}
+
+TEST_CASE("Arenas allocate by bumping a pointer and free from a mark", "[vm/heap]") {
+    auto arena = arena_t();
+    REQUIRE(arena.mark() == 0);
+    auto* a = static_cast<char*>(arena.bump(10, 1));
+    auto* b = static_cast<char*>(arena.bump(8, 8));
+    REQUIRE(b == a + 16);
+    REQUIRE(arena.chunks() == 1);
+
+    // what is allocated after a mark is where what was released was.
+    const auto mark = arena.mark();
+    auto* c = arena.bump(100);
+    arena.bump(arena_t::chunk_size / 2);
+    arena.bump(arena_t::chunk_size / 2);
+    REQUIRE(arena.chunks() == 2);
+    arena.release(mark);
+    REQUIRE(arena.chunks() == 1);
+    REQUIRE(arena.bump(100) == c);
+
+    // allocations larger than a chunk get one of their own.
+    auto* big = static_cast<char*>(arena.bump(3 * arena_t::chunk_size));
+    big[3 * arena_t::chunk_size - 1] = 1;
+    REQUIRE(arena.chunks() == 2);
+    arena.clear();
+    REQUIRE(arena.chunks() == 0);
+
+    auto* values = arena.make<array_t>(3, &arena);
+    REQUIRE(values->size() == 3);
+    REQUIRE(arena.chunks() == 1);
+
+    // freed blocks are reused for blocks of the same size.
+    auto* block = allocate_block(100);
+    free_block(block, 100);
+    REQUIRE(allocate_block(120) == block);
+    free_block(block, 120);
+}
+
+TEST_CASE("With blocks free what they allocate when they end", "[vm/regions]") {
+    const auto loop = [](string_view body) {
+        return "var total: i64 = 0\n"
+               "var i: i64 = 0\n"
+               "while (i < 20000):\n" +
+               string(body) +
+               "    i = i + 1\n"
+               "total";
+    };
+    const auto allocating = "let a = data(i, i, i) + data(1, 2, 3)\n"
+                            "let s = \"iteration {i}, in a string too long to be small\"\n"
+                            "total = total + sum(a)\n"s;
+
+    // the arrays and strings of every iteration are kept until the next run
+    // without a region, and freed at the end of each with it.
+    auto machine = vm_t();
+    REQUIRE(machine.run(lower_checked(loop("    " + allocating))).i == 600090000);
+    REQUIRE(machine.arena().chunks() > 1);
+    auto indented = "    with:\n"s;
+    for (auto line = string(); const auto c : allocating) {
+        line += c;
+        if (c == '\n') indented += "        " + exchange(line, string());
+    }
+    REQUIRE(machine.run(lower_checked(loop(indented))).i == 600090000);
+    REQUIRE(machine.arena().chunks() == 0);
+
+    // regions are freed when break, continue and return leave them.
+    REQUIRE(run("def first(n: i64): i64 = do:\n"
+                "    var i: i64 = 0\n"
+                "    while (true):\n"
+                "        with:\n"
+                "            let a = data(i, i * i)\n"
+                "            if (sum(a) > n) return i\n"
+                "        i = i + 1\n"
+                "    0\n"
+                "first(50)") == "7");
+    REQUIRE(run("var t: i64 = 0\n"
+                "for (x : data(1, 2, 3, 4, 5, 6)):\n"
+                "    with:\n"
+                "        let a = data(x, x) * data(x, 2)\n"
+                "        if (x % 2 == 0) continue\n"
+                "        if (x > 4) break\n"
+                "        t = t + sum(a)\n"
+                "t") == "18");
+    // a with block is an expression, whose value outlives it.
+    REQUIRE(run("let n = with:\n"
+                "    let a = data(1, 2, 3) * data(4, 5, 6)\n"
+                "    sum(a)\n"
+                "n + 1") == "33");
+}
+
+TEST_CASE("Strided kernels gather the elements they operate on", "[vm/kernels]") {
+    constexpr auto n = size_t(29);
+    auto storage = array_t(n * 5);
+    for (auto k = size_t(0); k < storage.size(); k++) storage[k].i = int64_t(k * 7919 % 211) - 100;
+
+    for (const auto stride : {ptrdiff_t(1), ptrdiff_t(2), ptrdiff_t(5)}) {
+        // what they operate on, copied next to each other.
+        auto a = array_t(n), b = array_t(n);
+        for (auto k = size_t(0); k < n; k++) {
+            a[k] = storage[k * stride];
+            b[k] = storage[1 + k];
+        }
+        for (auto isa = isa_t::scalar; isa <= detect_isa(); isa = isa_t(int(isa) + 1)) {
+            INFO(isa_name(isa) << " " << stride);
+            for (auto op = 0; op < int(kernel_op_t::count); op++) {
+                if (kernel_op_t(op) == kernel_op_t::div) continue;
+                auto x = array_t(n), y = array_t(n);
+                REQUIRE(elementwise(kernel_op_t(op), lane_t::i64, storage.data(), stride,
+                                    storage.data() + 1, 1, x.data(), n, isa));
+                REQUIRE(elementwise(kernel_op_t(op), lane_t::i64, a.data(), b.data(), y.data(), n,
+                                    isa_t::scalar));
+                for (auto k = size_t(0); k < n; k++) REQUIRE(x[k].u == y[k].u);
+            }
+            for (auto r = 0; r < int(reduction_t::count); r++)
+                REQUIRE(reduce(reduction_t(r), lane_t::i64, storage.data(), stride, n, isa).u ==
+                        reduce(reduction_t(r), lane_t::i64, a.data(), n, isa_t::scalar).u);
+        }
+    }
+
+    // views must lie within their array.
+    const auto view = [&](uint64_t first, int64_t stride) {
+        return array{value_t{.a = &storage}, value_t{.u = first}, value_t{.i = stride}};
+    };
+    REQUIRE(in_view(view(0, 5).data(), n));
+    REQUIRE(!in_view(view(5, 5).data(), n));
+    REQUIRE(in_view(view(storage.size(), 1).data(), 0));
+}
+
+TEST_CASE("Kernels compute the same on every instruction set", "[vm/kernels]") {
+    // enough elements for whole vectors and some left over.
+    constexpr auto n = size_t(37);
+    const auto same = [&](lane_t lane, const array_t& a, const array_t& b) {
+        for (auto isa = isa_t::scalar; isa <= detect_isa(); isa = isa_t(int(isa) + 1)) {
+            INFO(isa_name(isa));
+            for (auto op = 0; op < int(kernel_op_t::count); op++) {
+                auto x = array_t(n), y = array_t(n);
+                REQUIRE(elementwise(kernel_op_t(op), lane, a.data(), b.data(), x.data(), n, isa));
+                REQUIRE(elementwise(
+                    kernel_op_t(op), lane, a.data(), b.data(), y.data(), n, isa_t::scalar));
+                for (auto k = size_t(0); k < n; k++) REQUIRE(x[k].u == y[k].u);
+            }
+            for (auto r = 0; r < int(reduction_t::count); r++)
+                REQUIRE(reduce(reduction_t(r), lane, a.data(), n, isa).u ==
+                        reduce(reduction_t(r), lane, a.data(), n, isa_t::scalar).u);
+        }
+    };
+
+    auto a = array_t(n), b = array_t(n);
+    for (auto k = size_t(0); k < n; k++) {
+        a[k].f = 1.0 / double(k + 1);
+        b[k].f = k % 3 ? 0.5 * double(k) : -0.25;
+    }
+    same(lane_t::f64, a, b);
+    for (auto k = size_t(0); k < n; k++) {
+        a[k].i = int8_t(k * 37 - 100);
+        b[k].i = int8_t(k % 5 + 1);
+    }
+    same(lane_t::i8, a, b);
+}
+
+TEST_CASE("Faults at run time raise vm::error", "[vm/errors]") {
+    REQUIRE_THROWS_AS(run("var n: i64 = 0\n1 / n"), vm::error);
+    REQUIRE_THROWS_AS(run("def f(n: i64): i64 = f(n + 1)\nf(0)"), vm::error);
+}
+
+TEST_CASE("Constructs the VM can't run are reported when lowering", "[vm/errors]") {
+    REQUIRE_THROWS_AS(lower_checked("def f(n: i64): i64 = do:\n"
+                                    "    var x: i64 = n\n"
+                                    "    def g(m: i64): i64 = do:\n"
+                                    "        x = m\n"
+                                    "        m\n"
+                                    "    g(1)\n"
+                                    "f(1)"),
+                      vm::error);
+}
+
+TEST_CASE("The VM counts the instructions it executes", "[vm/vm]") {
+    const auto program = lower_checked("var i: i64 = 0\nwhile (i < 10):\n    i = i + 1\ni");
+    auto machine = vm_t();
+    REQUIRE(machine.run(program).i == 10);
+
+    const auto once = machine.executed();
+    REQUIRE(once > 10);
+    machine.run(program);
+    REQUIRE(machine.executed() == once);
+}
+
+TEST_CASE("Profiles count the operations following each other", "[vm/fuse]") {
+    const auto program = lower_checked("var i: i64 = 0\nwhile (i < 10):\n    i = i + 1\ni");
+    auto machine = vm_t();
+    auto profile = profile_t();
+    REQUIRE(machine.run(program, profile).i == 10);
+
+    REQUIRE(profile.count(opcode_t::lt_i, opcode_t::jmp_ifnot) == 11);
+    REQUIRE(profile.total() == machine.executed() - 1);
+
+    const auto hottest = profile.hottest(3);
+    REQUIRE(hottest.size() == 3);
+    REQUIRE(hottest[0].count >= hottest[1].count);
+    REQUIRE(hottest[1].count >= hottest[2].count);
+}
+
+TEST_CASE("Superinstructions compute what they replace", "[vm/fuse]") {
+    const auto sources = {
+        "def fib(n: i64): i64 = if (n < 2) n else fib(n - 1) + fib(n - 2)\nfib(15)",
+        "var s: i64 = 0\n"
+        "for (x : data(1, 2, 3, 4)):\n"
+        "    s = s + x\n"
+        "s",
+        "def f(n: u64): u64 = do:\n"
+        "    var i: u64 = 0u64\n"
+        "    var s: u64 = 0u64\n"
+        "    while (i <= n):\n"
+        "        if (i != 3u64):\n"
+        "            s = s + i\n"
+        "        i = i + 1\n"
+        "    return s\n"
+        "f(10u64)",
+    };
+
+    for (const auto source : sources) {
+        INFO(source);
+        auto program = lower_checked(source);
+        auto machine = vm_t();
+        auto profile = profile_t();
+        const auto expected = machine.run(program, profile).u;
+        const auto executed = machine.executed();
+
+        REQUIRE(fuse(program, profile, 0) > 0);
+        REQUIRE(machine.run(program).u == expected);
+        REQUIRE(machine.executed() == executed);
+
+        // fusing again finds nothing left to fuse.
+        REQUIRE(fuse(program, profile, 0) == 0);
+    }
+}
+
+TEST_CASE("Jumps into a fused sequence run the rest of it", "[vm/fuse]") {
+    auto program = program_t();
+    program.result_type = analysis::I64;
+    auto& fn = program.functions.emplace_back();
+    fn.name = "<top level>";
+    fn.n_registers = 2;
+    fn.code = {
+        instruction_t::abx(opcode_t::loadi, 1, 2),
+        instruction_t::sj(opcode_t::jmp, 1),
+        instruction_t::abx(opcode_t::loadi, 1, 40),
+        instruction_t::abc(opcode_t::add_i, 0, 1, 1),
+        instruction_t::abc(opcode_t::ret, 0, 0, 0),
+    };
+
+    auto profile = profile_t();
+    profile.record(opcode_t::loadi, opcode_t::add_i);
+    REQUIRE(fuse(program, profile) == 1);
+    REQUIRE(program.functions[0].code[2].op() == opcode_t::loadi_add_i);
+
+    auto machine = vm_t();
+    REQUIRE(machine.run(program).i == 4);
+}
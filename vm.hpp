@@ -1,9 +0,0 @@
-
-
-struct vm_t {
-
-
-};
-
-
-